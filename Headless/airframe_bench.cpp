@@ -0,0 +1,233 @@
+/*
+   airframe_bench.cpp: per-step cost of mixing and thrust/torque summation for each airframe
+
+   Times Airframe<Frame>, whose motor loop is unrolled for the frame, against the same
+   arithmetic over a run-time motor count with each motor behind a heap pointer, checks that
+   the two agree, and checks that each demand turns the airframe the way its torque says.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "core/airframe.hpp"
+
+static const float THRUST_COEFFICIENT = 1.0f;
+static const float DRAG_COEFFICIENT   = 0.02f;
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// The same mixing and summation as Airframe<Frame>, over motors allocated one at a time
+class RuntimeAirframe {
+
+    private:
+
+        std::vector<std::unique_ptr<hf::airframe_motor_t>> _motors;
+
+    public:
+
+        template <class Frame>
+        static RuntimeAirframe of(void)
+        {
+            RuntimeAirframe airframe;
+            for (uint8_t k=0; k<Frame::MOTORS; ++k) {
+                airframe._motors.emplace_back(new hf::airframe_motor_t(Frame::motor(k)));
+            }
+            return airframe;
+        }
+
+        void mix(const float demands[hf::DEMAND_COUNT], float * motorValues) const
+        {
+            float highest = 0;
+            for (size_t k=0; k<_motors.size(); ++k) {
+                const hf::airframe_motor_t & m = *_motors[k];
+                motorValues[k] = demands[hf::DEMAND_THROTTLE] + demands[hf::DEMAND_ROLL] * m.roll +
+                    demands[hf::DEMAND_PITCH] * m.pitch + demands[hf::DEMAND_YAW] * m.yaw;
+                highest = motorValues[k] > highest ? motorValues[k] : highest;
+            }
+            float excess = highest > 1 ? highest - 1 : 0;
+            for (size_t k=0; k<_motors.size(); ++k) {
+                float v = motorValues[k] - excess;
+                motorValues[k] = v < 0 ? 0 : v > 1 ? 1 : v;
+            }
+        }
+
+        void wrench(const float * motorValues, float & thrust, float torque[3]) const
+        {
+            float t = 0, roll = 0, pitch = 0, yaw = 0;
+            for (size_t k=0; k<_motors.size(); ++k) {
+                const hf::airframe_motor_t & m = *_motors[k];
+                float squared = motorValues[k] * motorValues[k];
+                float lift = THRUST_COEFFICIENT * squared;
+                t     += lift;
+                roll  -= m.y * .01f * lift;
+                pitch -= m.x * .01f * lift;
+                yaw   += m.direction * DRAG_COEFFICIENT * squared;
+            }
+            thrust = t;
+            torque[0] = roll;
+            torque[1] = pitch;
+            torque[2] = yaw;
+        }
+};
+
+typedef struct {
+
+    float demands[hf::DEMAND_COUNT];
+
+} demand_t;
+
+template <class Frame>
+static bool bench(const std::vector<demand_t> & demands, uint32_t passes)
+{
+    typedef hf::Airframe<Frame> A;
+
+    RuntimeAirframe runtime = RuntimeAirframe::of<Frame>();
+
+    float motors[Frame::MOTORS], check[Frame::MOTORS];
+    float thrust, torque[3], checkThrust, checkTorque[3];
+
+    // Unrolled and run-time versions must agree
+    bool agree = true;
+    for (const demand_t & d : demands) {
+        A::mix(d.demands, motors);
+        A::wrench(motors, THRUST_COEFFICIENT, DRAG_COEFFICIENT, thrust, torque);
+        runtime.mix(d.demands, check);
+        runtime.wrench(check, checkThrust, checkTorque);
+        agree = agree && fabsf(thrust - checkThrust) < 1e-5f;
+        for (uint8_t j=0; j<3; ++j) {
+            agree = agree && fabsf(torque[j] - checkTorque[j]) < 1e-5f;
+        }
+    }
+
+    // Each demand about hover must give a torque of its own sign, outweighing any it couples into
+    // other axes through the quadratic thrust curve or an offset arm
+    bool signs = true;
+    float hoverThrust, hover[3];
+    const float level[hf::DEMAND_COUNT] = { .5f, 0, 0, 0 };
+    A::mix(level, motors);
+    A::wrench(motors, THRUST_COEFFICIENT, DRAG_COEFFICIENT, hoverThrust, hover);
+    for (uint8_t axis=0; axis<3; ++axis) {
+        float d[hf::DEMAND_COUNT] = { .5f, 0, 0, 0 };
+        d[hf::DEMAND_ROLL + axis] = .1f;
+        A::mix(d, motors);
+        A::wrench(motors, THRUST_COEFFICIENT, DRAG_COEFFICIENT, thrust, torque);
+        float own = torque[axis] - hover[axis];
+        signs = signs && own > 0;
+        for (uint8_t j=0; j<3; ++j) {
+            signs = signs && (j == axis || fabsf(torque[j] - hover[j]) < own / 4);
+        }
+    }
+
+    // Remixing quad-X motor values for the same airframe must give them back
+    bool remix = true;
+    if (Frame::MOTORS == 4) {
+        for (const demand_t & d : demands) {
+            float quad[4], shown[Frame::MOTORS];
+            hf::Airframe<hf::QuadX>::mix(d.demands, quad);
+            A::fromQuadX(quad, shown);
+            hf::Airframe<hf::QuadX>::fromQuadX(quad, check);
+            for (uint8_t k=0; k<4; ++k) {
+                remix = remix && fabsf(check[k] - quad[k]) < 1e-5f;
+            }
+        }
+    }
+
+    volatile float sink = 0;
+
+    double start = wallSeconds();
+    for (uint32_t p=0; p<passes; ++p) {
+        for (const demand_t & d : demands) {
+            A::mix(d.demands, motors);
+            A::wrench(motors, THRUST_COEFFICIENT, DRAG_COEFFICIENT, thrust, torque);
+            sink = sink + thrust + torque[0] + torque[1] + torque[2];
+        }
+    }
+    double unrolled = wallSeconds() - start;
+
+    start = wallSeconds();
+    for (uint32_t p=0; p<passes; ++p) {
+        for (const demand_t & d : demands) {
+            runtime.mix(d.demands, check);
+            runtime.wrench(check, checkThrust, checkTorque);
+            sink = sink + checkThrust + checkTorque[0] + checkTorque[1] + checkTorque[2];
+        }
+    }
+    double looped = wallSeconds() - start;
+
+    double steps = (double)passes * demands.size();
+
+    printf("%-7s %d motors: %6.2f ns per step unrolled, %6.2f ns run-time loop (%.2fx); %s, %s, %s\n",
+            Frame::name(), Frame::MOTORS, 1e9 * unrolled / steps, 1e9 * looped / steps, looped / unrolled,
+            agree ? "agree" : "DISAGREE", signs ? "torques ok" : "TORQUES WRONG",
+            remix ? "remix ok" : "REMIX WRONG");
+
+    return agree && signs && remix;
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t count = 4096;
+    uint32_t passes = 2000;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:p:")) != -1) {
+        switch (c) {
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'p':
+                passes = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n DEMANDS] [-p PASSES]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // Demands like the firmware's, occasionally saturating
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> throttle(0, 1), attitude(-.3f, .3f);
+    std::vector<demand_t> demands(count);
+    for (demand_t & d : demands) {
+        d.demands[hf::DEMAND_THROTTLE] = throttle(random);
+        d.demands[hf::DEMAND_ROLL] = attitude(random);
+        d.demands[hf::DEMAND_PITCH] = attitude(random);
+        d.demands[hf::DEMAND_YAW] = attitude(random);
+    }
+
+    bool ok = true;
+    ok = bench<hf::QuadX>(demands, passes) && ok;
+    ok = bench<hf::QuadPlus>(demands, passes) && ok;
+    ok = bench<hf::Hexa>(demands, passes) && ok;
+    ok = bench<hf::Octo>(demands, passes) && ok;
+
+    return ok ? 0 : 1;
+}
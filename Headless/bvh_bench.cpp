@@ -0,0 +1,420 @@
+/*
+   bvh_bench.cpp: sphere and box sweeps through a collision BVH
+
+   Builds a synthetic scene like BigFlatMap (ground and scattered boxes) or BottomOfAWell (a
+   deep round shaft), or a skewed one that drives the surface-area heuristic to a very deep
+   tree, or loads an exported map, writes and maps the BVH file, checks sweeps
+   against a brute-force pass over every triangle, and times them.  Also checks that malformed
+   files, whose nodes point outside the file or nest too deep to sweep, are refused.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include <thread>
+#include <vector>
+
+#include "core/bvh.hpp"
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static uint32_t seed = 12345;
+
+static float uniform(float lo, float hi)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * ((seed >> 8) / 16777216.f);
+}
+
+// A 400 m square of ground in 2 m cells, with boxes standing on it
+static void flatScene(hf::BvhBuilder & builder)
+{
+    for (int i=0; i<200; ++i) {
+        for (int j=0; j<200; ++j) {
+            float x0 = -200 + 2*i, y0 = -200 + 2*j;
+            float a[3] = {x0, y0, 0}, b[3] = {x0+2, y0, 0}, c[3] = {x0+2, y0+2, 0}, d[3] = {x0, y0+2, 0};
+            builder.addTriangle(a, b, c);
+            builder.addTriangle(a, c, d);
+        }
+    }
+
+    for (int k=0; k<2000; ++k) {
+        float x = uniform(-195, 195), y = uniform(-195, 195);
+        float w = uniform(0.5f, 4), h = uniform(0.5f, 20);
+        float min[3] = {x, y, 0}, max[3] = {x+w, y+w, h};
+        builder.addBox(min, max);
+    }
+
+    float start[3] = {0, 0, 1};
+    builder.setStart(start);
+}
+
+// A shaft 3 m in radius and 30 m deep, with a floor
+static void wellScene(hf::BvhBuilder & builder)
+{
+    const int SEGMENTS = 128, RINGS = 60;
+    const float RADIUS = 3, DEPTH = 30;
+
+    for (int s=0; s<SEGMENTS; ++s) {
+        float a0 = 2 * (float)M_PI * s / SEGMENTS, a1 = 2 * (float)M_PI * (s+1) / SEGMENTS;
+        for (int r=0; r<RINGS; ++r) {
+            float z0 = DEPTH * r / RINGS, z1 = DEPTH * (r+1) / RINGS;
+            float a[3] = {RADIUS*cosf(a0), RADIUS*sinf(a0), z0}, b[3] = {RADIUS*cosf(a1), RADIUS*sinf(a1), z0};
+            float c[3] = {RADIUS*cosf(a1), RADIUS*sinf(a1), z1}, d[3] = {RADIUS*cosf(a0), RADIUS*sinf(a0), z1};
+            builder.addTriangle(a, b, c);
+            builder.addTriangle(a, c, d);
+        }
+        float o[3] = {0, 0, 0}, b[3] = {RADIUS*cosf(a0), RADIUS*sinf(a0), 0}, c[3] = {RADIUS*cosf(a1), RADIUS*sinf(a1), 0};
+        builder.addTriangle(o, b, c);
+    }
+
+    float start[3] = {0, 0, 1};
+    builder.setStart(start);
+}
+
+// Triangles along a line, each farther out and larger than the last by a constant factor: every
+// SAH split peels off only the farthest, so an unchecked build goes a level deeper for each
+static void skewedScene(hf::BvhBuilder & builder)
+{
+    float x = 1;
+
+    for (int k=0; k<300; ++k) {
+        float s = x / 100;
+        float a[3] = {x, 0, 0}, b[3] = {x+s, 0, 0}, c[3] = {x, s, s};
+        builder.addTriangle(a, b, c);
+        x *= 1.3f;
+    }
+
+    float start[3] = {0, 0, 1};
+    builder.setStart(start);
+}
+
+typedef struct {
+
+    float start[3];
+    float end[3];
+
+} query_t;
+
+// Short moves from random points over the scene, in random directions
+static std::vector<query_t> makeQueries(const hf::CollisionBvh & bvh, uint32_t count, float length)
+{
+    const hf::bvh_header_t * h = bvh.header();
+
+    std::vector<query_t> queries(count);
+
+    for (auto & q : queries) {
+        float dir[3], n2;
+        do {
+            for (int k=0; k<3; ++k) {
+                dir[k] = uniform(-1, 1);
+            }
+            n2 = dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+        } while (n2 > 1 || n2 < 1e-4f);
+        float len = uniform(0, length) / sqrtf(n2);
+        for (int k=0; k<3; ++k) {
+            q.start[k] = uniform(h->boundsMin[k], h->boundsMax[k]);
+            q.end[k] = q.start[k] + dir[k] * len;
+        }
+    }
+
+    return queries;
+}
+
+// Every triangle, in order: the reference the BVH must agree with
+static bool bruteSweep(const hf::CollisionBvh & bvh, const query_t & q, bool box, float radius, const float half[3],
+        float & fraction)
+{
+    hf::Vec3 p(q.start), d = hf::Vec3(q.end) - p, h(half);
+    bool found = false;
+    fraction = 1;
+
+    for (uint32_t k=0; k<bvh.triangleCount(); ++k) {
+        float t;
+        hf::Vec3 n;
+        bool hit = box ? hf::SweepTests::box(p, d, h, bvh.triangles()[k], fraction, t, n) :
+            hf::SweepTests::sphere(p, d, radius, bvh.triangles()[k], fraction, t, n);
+        if (hit && (!found || t < fraction)) {
+            fraction = t;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+static uint32_t check(const hf::CollisionBvh & bvh, const std::vector<query_t> & queries, uint32_t count, bool box,
+        float radius, const float half[3], uint32_t & hits)
+{
+    uint32_t errors = 0;
+    hits = 0;
+
+    for (uint32_t k=0; k<count && k<queries.size(); ++k) {
+        hf::sweep_hit_t hit;
+        bool found = box ? bvh.sweepBox(queries[k].start, queries[k].end, half, hit) :
+            bvh.sweepSphere(queries[k].start, queries[k].end, radius, hit);
+        float fraction;
+        bool expected = bruteSweep(bvh, queries[k], box, radius, half, fraction);
+        if (found != expected || (found && fabsf(hit.fraction - fraction) > 1e-5f)) {
+            ++errors;
+        }
+        hits += found;
+    }
+
+    return errors;
+}
+
+// Writes nodes and triangles as they are, however wrong
+static bool writeRaw(const char * path, const std::vector<hf::bvh_node_t> & nodes, uint32_t triangleCount)
+{
+    hf::bvh_header_t header = {};
+    header.magic = hf::BVH_MAGIC;
+    header.version = hf::BVH_VERSION;
+    header.triangleCount = triangleCount;
+    header.nodeCount = (uint32_t)nodes.size();
+
+    std::vector<hf::bvh_triangle_t> triangles(triangleCount, hf::bvh_triangle_t());
+
+    FILE * fp = fopen(path, "wb");
+    if (!fp) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+        fwrite(nodes.data(), sizeof(hf::bvh_node_t), nodes.size(), fp) == nodes.size() &&
+        fwrite(triangles.data(), sizeof(hf::bvh_triangle_t), triangles.size(), fp) == triangles.size();
+
+    return fclose(fp) == 0 && ok;
+}
+
+static hf::bvh_node_t node(uint32_t first, uint32_t count)
+{
+    hf::bvh_node_t n = {{-1, -1, -1}, first, {1, 1, 1}, count};
+    return n;
+}
+
+// A tree that is a single path of the given depth, with a leaf hanging off each level
+static std::vector<hf::bvh_node_t> chain(uint32_t depth)
+{
+    std::vector<hf::bvh_node_t> nodes;
+
+    for (uint32_t k=0; k<depth; ++k) {
+        nodes.push_back(node(2*k + 1, 0));
+        if (k > 0) {
+            nodes.push_back(node(0, 1));
+        }
+    }
+    nodes.push_back(node(0, 1));
+    nodes.push_back(node(0, 1));
+
+    return nodes;
+}
+
+// Returns how many of the malformed files were wrongly accepted
+static uint32_t checkMalformed(const char * path)
+{
+    typedef struct {
+        const char * what;
+        std::vector<hf::bvh_node_t> nodes;
+        bool valid;
+    } case_t;
+
+    std::vector<case_t> cases = {
+        { "leaf past the triangles",    { node(0, 2) }, false },
+        { "leaf count wrapping around", { node(1, 0xffffffff) }, false },
+        { "child before its parent",    { node(0, 0), node(0, 1) }, false },
+        { "smallest tree",              { node(1, 0), node(0, 1), node(0, 1) }, true },
+        { "right child past the nodes", { node(2, 0), node(0, 1), node(0, 1) }, false },
+        { "children past the nodes",    { node(3, 0), node(0, 1), node(0, 1) }, false },
+        { "deepest walkable tree",      chain(hf::BVH_MAX_DEPTH), true },
+        { "tree too deep to walk",      chain(hf::BVH_MAX_DEPTH + 1), false },
+    };
+
+    uint32_t wrong = 0;
+
+    for (const case_t & c : cases) {
+        hf::CollisionBvh bvh;
+        hf::sweep_hit_t hit;
+        float start[3] = {0, 0, 0}, end[3] = {0, 0, 1};
+        bool opened = writeRaw(path, c.nodes, 1) && bvh.open(path);
+        if (opened) {
+            bvh.sweepSphere(start, end, 0.1f, hit);
+        }
+        if (opened != c.valid) {
+            printf("%s: %s\n", c.what, opened ? "ACCEPTED" : "REFUSED");
+            ++wrong;
+        }
+    }
+
+    unlink(path);
+
+    printf("Malformed files: %u of %u handled as expected\n", (uint32_t)cases.size() - wrong, (uint32_t)cases.size());
+
+    return wrong;
+}
+
+// Runs every query on each of the given number of threads; returns queries per second
+static double timeSweeps(const hf::CollisionBvh & bvh, const std::vector<query_t> & queries, int threads, bool box,
+        float radius, const float half[3], uint32_t & hits)
+{
+    std::vector<uint32_t> counts(threads);
+    std::vector<std::thread> pool;
+
+    double start = wallSeconds();
+
+    for (int j=0; j<threads; ++j) {
+        pool.push_back(std::thread([&, j]() {
+            uint32_t n = 0;
+            hf::sweep_hit_t hit;
+            for (const auto & q : queries) {
+                n += box ? bvh.sweepBox(q.start, q.end, half, hit) : bvh.sweepSphere(q.start, q.end, radius, hit);
+            }
+            counts[j] = n;
+        }));
+    }
+
+    for (auto & t : pool) {
+        t.join();
+    }
+
+    double elapsed = wallSeconds() - start;
+
+    hits = counts[0];
+
+    return threads * queries.size() / elapsed;
+}
+
+int main(int argc, char ** argv)
+{
+    const char * scene = "flat";
+    const char * input = nullptr;
+    const char * output = "/tmp/hackflight_bench.hfbvh";
+    uint32_t count = 1000000;
+    uint32_t checked = 2000;
+    float length = 0.5f;
+    float radius = 0.1f;
+    float half[3] = {0.1f, 0.1f, 0.03f};
+    int threads = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "s:f:o:n:c:l:r:t:")) != -1) {
+        switch (c) {
+            case 's':
+                scene = optarg;
+                break;
+            case 'f':
+                input = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'c':
+                checked = atoi(optarg);
+                break;
+            case 'l':
+                length = atof(optarg);
+                break;
+            case 'r':
+                radius = atof(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s flat|well|skewed | -f BVHFILE] [-o OUTFILE] [-n QUERIES] [-c CHECKED] [-l LENGTH_M] "
+                        "[-r RADIUS_M] [-t THREADS]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (!input) {
+
+        hf::BvhBuilder builder;
+
+        if (!strcmp(scene, "flat")) {
+            flatScene(builder);
+        }
+        else if (!strcmp(scene, "well")) {
+            wellScene(builder);
+        }
+        else if (!strcmp(scene, "skewed")) {
+            skewedScene(builder);
+        }
+        else {
+            fprintf(stderr, "Unknown scene %s\n", scene);
+            return 1;
+        }
+
+        double start = wallSeconds();
+        if (!builder.write(output)) {
+            fprintf(stderr, "Unable to write %s\n", output);
+            return 1;
+        }
+        printf("Built %s scene: %u triangles in %.1f ms\n", scene, builder.triangleCount(), 1e3 * (wallSeconds() - start));
+
+        input = output;
+    }
+
+    hf::CollisionBvh bvh;
+
+    double start = wallSeconds();
+    if (!bvh.open(input)) {
+        fprintf(stderr, "Unable to open %s\n", input);
+        return 1;
+    }
+
+    printf("Opened %s in %.1f us: %u triangles, %u nodes, depth %u, %.1f MB%s\n", input, 1e6 * (wallSeconds() - start),
+            bvh.triangleCount(), bvh.nodeCount(), bvh.depth(),
+            (sizeof(hf::bvh_header_t) + bvh.nodeCount() * sizeof(hf::bvh_node_t) + bvh.triangleCount() * sizeof(hf::bvh_triangle_t)) / 1e6,
+            bvh.isMapped() ? ", mapped" : "");
+
+    std::vector<query_t> queries = makeQueries(bvh, count, length);
+
+    uint32_t errors = 0;
+
+    for (int box=0; box<2; ++box) {
+
+        uint32_t hits = 0;
+        uint32_t wrong = check(bvh, queries, checked, box, radius, half, hits);
+        errors += wrong;
+
+        double rate = timeSweeps(bvh, queries, threads, box, radius, half, hits);
+
+        printf("%-6s sweeps: %.2f M/s on %d thread%s, %.1f%% hit; %u of %u checked against brute force disagree\n",
+                box ? "Box" : "Sphere", rate / 1e6, threads, threads > 1 ? "s" : "", 100. * hits / queries.size(),
+                wrong, std::min(checked, (uint32_t)queries.size()));
+    }
+
+    bvh.close();
+    errors += checkMalformed("/tmp/hackflight_bench_malformed.hfbvh");
+
+    return errors > 0;
+}
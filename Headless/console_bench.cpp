@@ -0,0 +1,232 @@
+/*
+   console_bench.cpp: cost of a firmware print into the console ring, and completeness of the
+   log the background flusher writes, without Unreal Engine
+
+   Writer threads print numbered lines into the ring, paced like a firmware loop, while a
+   ConsoleFlusher appends them to a file.  The file is then read back to check that every line
+   arrived whole and in order, with none dropped.  With -x the writers flood the ring unpaced
+   instead, and lines the flusher could not keep up with need only be reported dropped.  For comparison, the same lines
+   are also written straight to a file and flushed, as a synchronous logger would.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <thread>
+#include <vector>
+
+#include "core/console.hpp"
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// A line like the firmware's debug output, numbered so the log can be checked
+static void format(char * line, size_t size, uint32_t writer, uint32_t k)
+{
+    snprintf(line, size, "writer %u line %u: roll %+.3f pitch %+.3f yaw %+.3f\n", writer, k, .001f * k, -.002f * k, .003f * k);
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t lines = 2000;
+    uint32_t writers = 1;
+    float rateHz = 1000;
+    bool flood = false;
+    float flushSeconds = 0.1f;
+    uint32_t slots = 1024;
+    const char * path = "/tmp/console_bench.txt";
+
+    int c;
+    while ((c = getopt(argc, argv, "n:t:r:f:s:o:x")) != -1) {
+        switch (c) {
+            case 'n':
+                lines = atoi(optarg);
+                break;
+            case 't':
+                writers = atoi(optarg);
+                break;
+            case 'r':
+                rateHz = atof(optarg);
+                break;
+            case 'f':
+                flushSeconds = atof(optarg);
+                break;
+            case 's':
+                slots = atoi(optarg);
+                break;
+            case 'o':
+                path = optarg;
+                break;
+            case 'x':
+                flood = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n LINES_PER_WRITER] [-t WRITERS] [-r PRINTS_PER_SEC] [-f FLUSH_SECONDS] "
+                        "[-s SLOTS] [-o LOGFILE] [-x]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (lines == 0 || writers == 0 || slots == 0) {
+        fprintf(stderr, "Line, writer and slot counts must be positive\n");
+        return 1;
+    }
+
+    if (!flood && rateHz <= 0) {
+        fprintf(stderr, "Print rate must be positive; use -x to flood the ring\n");
+        return 1;
+    }
+
+    // Lines arriving between flushes must fit in the ring, or some are bound to be dropped
+    if (!flood && writers * rateHz * flushSeconds > slots) {
+        fprintf(stderr, "Warning: %.0f lines arrive per flush, more than the ring's %u slots\n",
+                writers * rateHz * flushSeconds, slots);
+    }
+
+    // Lines are formatted up front, so that only the print itself is timed
+    std::vector<std::vector<char>> text(writers, std::vector<char>((size_t)lines * 128));
+    for (uint32_t w=0; w<writers; ++w) {
+        for (uint32_t k=0; k<lines; ++k) {
+            format(&text[w][(size_t)k * 128], 128, w, k);
+        }
+    }
+
+    hf::ConsoleRing ring(slots);
+    hf::ConsoleFlusher flusher(ring);
+
+    unlink(path);
+    if (!flusher.start(path, flushSeconds)) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 1;
+    }
+
+    std::vector<double> printSeconds(writers);
+    std::vector<std::thread> threads;
+
+    double start = wallSeconds();
+
+    for (uint32_t w=0; w<writers; ++w) {
+        threads.emplace_back([&, w]() {
+            // Unpaced prints are timed as a batch; paced ones one at a time, less the cost of
+            // reading the clock around them
+            double busy = 0;
+            double next = wallSeconds();
+            if (flood) {
+                for (uint32_t k=0; k<lines; ++k) {
+                    ring.write(&text[w][(size_t)k * 128]);
+                }
+                busy = wallSeconds() - next;
+            }
+            else {
+                double clockStart = wallSeconds();
+                for (uint32_t k=0; k<1000; ++k) {
+                    double t0 = wallSeconds();
+                    busy -= wallSeconds() - t0;
+                }
+                busy *= lines / 1000.;
+                next += wallSeconds() - clockStart;
+                for (uint32_t k=0; k<lines; ++k) {
+                    double t0 = wallSeconds();
+                    ring.write(&text[w][(size_t)k * 128]);
+                    busy += wallSeconds() - t0;
+                    next += 1 / rateHz;
+                    while (wallSeconds() < next) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+            printSeconds[w] = busy;
+        });
+    }
+
+    for (std::thread & t : threads) {
+        t.join();
+    }
+
+    double elapsed = wallSeconds() - start;
+
+    flusher.stop();
+
+    // Every line must be there once, whole, in order for its writer, unless reported dropped
+    FILE * log = fopen(path, "r");
+    if (!log) {
+        fprintf(stderr, "Unable to read %s\n", path);
+        return 1;
+    }
+
+    std::vector<int64_t> last(writers, -1);
+    uint64_t found = 0, reported = 0, bad = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), log)) {
+        unsigned long long dropped;
+        unsigned w, k;
+        if (sscanf(line, "[%llu lines dropped]", &dropped) == 1) {
+            reported += dropped;
+            continue;
+        }
+        char expected[128];
+        if (sscanf(line, "writer %u line %u:", &w, &k) != 2 || w >= writers || (int64_t)k <= last[w]) {
+            ++bad;
+            continue;
+        }
+        format(expected, sizeof(expected), w, k);
+        if (strcmp(line, expected)) {
+            ++bad;
+            continue;
+        }
+        last[w] = k;
+        ++found;
+    }
+    fclose(log);
+
+    uint64_t total = (uint64_t)lines * writers;
+    double busy = 0;
+    for (double b : printSeconds) {
+        busy += b;
+    }
+
+    // The same lines written and flushed one at a time, on this thread
+    FILE * direct = fopen("/dev/null", "w");
+    double directStart = wallSeconds();
+    for (uint32_t k=0; k<lines; ++k) {
+        fputs(&text[0][(size_t)k * 128], direct);
+        fflush(direct);
+    }
+    double directSeconds = wallSeconds() - directStart;
+    fclose(direct);
+
+    printf("%lu lines from %u writer%s in %.3f sec: %.1f ns per print into the ring%s, "
+            "%.1f ns per direct write and flush\n", (unsigned long)total, writers, writers > 1 ? "s" : "", elapsed,
+            1e9 * busy / total, flood ? "" : " (clock reads excluded)", 1e9 * directSeconds / lines);
+    printf("%lu logged, %lu reported dropped (%lu by the flusher), %lu bad\n", (unsigned long)found,
+            (unsigned long)reported, (unsigned long)flusher.dropped(), (unsigned long)bad);
+
+    // Paced, nothing may be dropped; flooded, drops must at least be accounted for
+    bool ok = bad == 0 && found + reported == total && (flood || reported == 0);
+    printf("%s\n", ok ? (reported ? "Log complete, drops reported" : "Log complete") : "LOG INCOMPLETE");
+
+    return ok ? 0 : 1;
+}
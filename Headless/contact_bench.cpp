@@ -0,0 +1,234 @@
+/*
+   contact_bench.cpp: cost and termination of the crash, bounce and fall model, without Unreal
+   Engine
+
+   Crashes vehicles into the walls of a closed room at random heights, speeds and headings,
+   lets the contact model carry them until they come to rest, and reports the time per contact
+   and per crashed step, how many contacts and seconds each crash took, and whether two runs
+   agree.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include <random>
+
+#include "core/vehicle.hpp"
+#include "core/contact.hpp"
+#include "core/scriptedreceiver.hpp"
+
+#include <boards/sim/linux.hpp>
+
+#include "HackflightSimParams.h"
+
+// Same PID tuning as the pawn
+static const hf::Stabilizer STABILIZER = hf::Stabilizer(
+	0,//0.10f,      // Level P
+	.00001f,     // Gyro cyclic P
+	0,			// Gyro cyclic I
+	0,			// Gyro cyclic D
+	0,			// Gyro yaw P
+	0);			// Gyro yaw I
+
+void hf::Board::outbuf(char * buf)
+{
+    fputs(buf, stderr);
+}
+
+// Room half-width and vehicle radius, meters
+static const float ROOM = 5.0f;
+static const float RADIUS = 0.1f;
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+typedef struct {
+
+    uint64_t crashes;
+    uint64_t contacts;
+    uint64_t steps;
+    uint64_t timeouts;
+    uint32_t mostContacts;
+    double   longestSeconds;
+    double   contactSeconds;
+    double   stepSeconds;
+    uint64_t hash;
+
+} result_t;
+
+// The wall or floor the vehicle has reached, if any, as the center's position against it and the normal
+static bool touch(const float p[3], float position[3], float normal[3])
+{
+    for (uint8_t k=0; k<3; ++k) {
+        position[k] = p[k];
+        normal[k] = 0;
+    }
+
+    if (p[2] < RADIUS) {
+        position[2] = RADIUS;
+        normal[2] = 1;
+        return true;
+    }
+
+    for (uint8_t k=0; k<2; ++k) {
+        if (fabsf(p[k]) > ROOM - RADIUS) {
+            position[k] = copysignf(ROOM - RADIUS, p[k]);
+            normal[k] = p[k] > 0 ? -1 : +1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static result_t run(uint32_t crashes, float rateHz, uint32_t seed)
+{
+    hf::ScriptedReceiver receiver;
+    hf::SimVehicle vehicle(STABILIZER);
+    vehicle.init(&receiver);
+
+    hf::VehicleSnapshot start(vehicle);
+
+    hf::contact_params_t params = hf::CONTACT_DEFAULT;
+    params.impactRestitution = PARAM_BOUNCEBACK_FORCE;
+    params.bounceSeconds = PARAM_BOUNCEBACK_SECONDS;
+    params.restitution = PARAM_CONTACT_RESTITUTION;
+    params.friction = PARAM_CONTACT_FRICTION;
+    params.groundHeight = RADIUS;
+    hf::ContactModel contact(params);
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> height(0.5f, 4), speed(1, 10), angle(-1, 1);
+
+    result_t result = result_t();
+    result.hash = 0xcbf29ce484222325ull;
+
+    float dt = 1 / rateHz;
+
+    for (uint32_t c=0; c<crashes; ++c) {
+
+        vehicle.restore(start);
+        contact.reset();
+
+        // Flying into the +x wall, at a random height, speed and heading
+        float heading = angle(random);
+        float v = speed(random);
+        vehicle.pose.position[0] = ROOM - RADIUS;
+        vehicle.pose.position[1] = 0;
+        vehicle.pose.position[2] = height(random);
+        vehicle.translationRates[0] = v * cosf(heading);
+        vehicle.translationRates[1] = v * sinf(heading);
+        vehicle.translationRates[2] = v * angle(random) / 4;
+        const float wall[3] = { -1, 0, 0 };
+
+        double t0 = wallSeconds();
+        bool rest = contact.collide(vehicle, vehicle.pose.position, wall);
+        result.contactSeconds += wallSeconds() - t0;
+        result.contacts++;
+
+        uint32_t steps = 0;
+        bool timeout = false;
+
+        while (!rest) {
+
+            t0 = wallSeconds();
+            timeout = contact.step(vehicle, dt);
+            double t1 = wallSeconds();
+            result.stepSeconds += t1 - t0;
+            ++steps;
+
+            if (timeout) {
+                break;
+            }
+
+            float position[3], normal[3];
+            if (touch(vehicle.pose.position, position, normal)) {
+                t0 = wallSeconds();
+                rest = contact.collide(vehicle, position, normal);
+                result.contactSeconds += wallSeconds() - t0;
+                result.contacts++;
+            }
+        }
+
+        for (uint8_t k=0; k<3; ++k) {
+            uint32_t bits;
+            memcpy(&bits, &vehicle.pose.position[k], sizeof(bits));
+            result.hash = (result.hash ^ bits) * 0x100000001b3ull;
+        }
+
+        result.crashes++;
+        result.steps += steps;
+        result.timeouts += timeout;
+        result.mostContacts = contact.bounces() > result.mostContacts ? contact.bounces() : result.mostContacts;
+        result.longestSeconds = steps * dt > result.longestSeconds ? steps * dt : result.longestSeconds;
+    }
+
+    return result;
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t crashes = 10000;
+    float rateHz = 1000;
+    uint32_t seed = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:r:e:")) != -1) {
+        switch (c) {
+            case 'n':
+                crashes = atoi(optarg);
+                break;
+            case 'r':
+                rateHz = atof(optarg);
+                break;
+            case 'e':
+                seed = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n CRASHES] [-r RATE_HZ] [-e SEED]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (crashes == 0 || rateHz <= 0) {
+        fprintf(stderr, "Crash count and rate must be positive\n");
+        return 1;
+    }
+
+    result_t r = run(crashes, rateHz, seed);
+    result_t again = run(crashes, rateHz, seed);
+
+    printf("%lu crashes: %.1f contacts and %.2f sec each on average, at most %u contacts and %.2f sec; %lu timed out\n",
+            (unsigned long)r.crashes, (double)r.contacts / r.crashes, (double)r.steps / rateHz / r.crashes,
+            r.mostContacts, r.longestSeconds, (unsigned long)r.timeouts);
+    printf("%.1f ns per contact, %.1f ns per crashed step (including the clock reads)\n",
+            1e9 * r.contactSeconds / r.contacts, 1e9 * r.stepSeconds / r.steps);
+
+    bool same = r.hash == again.hash;
+    printf("%s on a second run\n", same ? "Identical" : "DIFFERENT");
+
+    return same && r.timeouts == 0 ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+/*
+   flightlog_bench.cpp: times appending records to a memory-mapped flight log, as the
+   simulator does on every firmware step, then reads the log back and checks it
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "core/flightlog.hpp"
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char ** argv)
+{
+    const char * path = "/tmp/flightlog_bench.hflog";
+    double minutes = 60;
+    float rateHz = 1000;
+
+    int c;
+    while ((c = getopt(argc, argv, "o:m:r:")) != -1) {
+        switch (c) {
+            case 'o':
+                path = optarg;
+                break;
+            case 'm':
+                minutes = atof(optarg);
+                break;
+            case 'r':
+                rateHz = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-o LOGFILE] [-m MINUTES] [-r RATE_HZ]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    uint64_t records = (uint64_t)(minutes * 60 * rateHz);
+
+    hf::FlightRecorder recorder;
+
+    double start = wallSeconds();
+    if (!recorder.open(path, records, 1 / rateHz)) {
+        fprintf(stderr, "Unable to create %s\n", path);
+        return 1;
+    }
+    double openSeconds = wallSeconds() - start;
+
+    // Time each record individually, to see the worst case on the tick path
+    std::vector<float> nanos(records);
+
+    hf::flight_record_t record = hf::flight_record_t();
+    record.dt = 1 / rateHz;
+
+    start = wallSeconds();
+
+    for (uint64_t k=0; k<records; ++k) {
+
+        record.step = k;
+        record.simSeconds = k / (double)rateHz;
+        record.position[2] = k * 1e-6f;
+        record.motorValues[0] = (k % 1000) / 1000.f;
+
+        double t = wallSeconds();
+        recorder.append(record);
+        nanos[k] = (float)(1e9 * (wallSeconds() - t));
+    }
+
+    double elapsed = wallSeconds() - start;
+
+    start = wallSeconds();
+    recorder.close();
+    double closeSeconds = wallSeconds() - start;
+
+    std::sort(nanos.begin(), nanos.end());
+
+    printf("Recorded %llu records (%.0f min at %.0f Hz, %.0f MB) in %.3f s\n",
+            (unsigned long long)records, minutes, rateHz, records * 128. / 1e6, elapsed);
+
+    printf("Per record: mean %.0f ns (timer included), p50 %.0f ns, p99 %.0f ns, p99.99 %.0f ns, max %.0f ns\n",
+            1e9 * elapsed / records, nanos[records/2], nanos[records*99/100], nanos[records*9999/10000], nanos[records-1]);
+
+    printf("Open (preallocate) %.3f s, close %.3f s\n", openSeconds, closeSeconds);
+
+    // Read it back
+    hf::FlightLogReader reader;
+
+    if (!reader.open(path)) {
+        fprintf(stderr, "Unable to read %s\n", path);
+        return 1;
+    }
+
+    uint64_t errors = 0;
+    uint64_t count = 0;
+
+    start = wallSeconds();
+
+    for (const hf::flight_record_t * r = reader.next(); r; r = reader.next()) {
+        if (r->step != count || r->position[2] != count * 1e-6f) {
+            ++errors;
+        }
+        ++count;
+    }
+
+    elapsed = wallSeconds() - start;
+
+    printf("Read back %llu records in %.3f s (%.0f MB/s), %llu errors\n",
+            (unsigned long long)count, elapsed, count * 128. / 1e6 / elapsed, (unsigned long long)errors);
+
+    reader.close();
+    unlink(path);
+
+    return errors > 0 || count != records;
+}
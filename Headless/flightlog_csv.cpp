@@ -0,0 +1,102 @@
+/*
+   flightlog_csv.cpp: converts a HackflightSim flight log to CSV, optionally following a
+   log that is still being recorded
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "core/flightlog.hpp"
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "Usage: %s [-f] LOGFILE [CSVFILE]\n", name);
+    exit(1);
+}
+
+int main(int argc, char ** argv)
+{
+    bool follow = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "f")) != -1) {
+        switch (c) {
+            case 'f':
+                follow = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+    }
+
+    hf::FlightLogReader reader;
+
+    if (!reader.open(argv[optind])) {
+        fprintf(stderr, "%s is not a flight log\n", argv[optind]);
+        return 1;
+    }
+
+    FILE * out = optind + 1 < argc ? fopen(argv[optind+1], "w") : stdout;
+
+    if (!out) {
+        fprintf(stderr, "Unable to create %s\n", argv[optind+1]);
+        return 1;
+    }
+
+    fprintf(out, "step,time,dt,"
+            "gyro_x,gyro_y,gyro_z,vel_x,vel_y,vel_z,"
+            "motor_0,motor_1,motor_2,motor_3,"
+            "pos_x,pos_y,pos_z,quat_x,quat_y,quat_z,quat_w,"
+            "throttle,roll,pitch,yaw,aux1,collision\n");
+
+    while (true) {
+
+        const hf::flight_record_t * r = reader.next();
+
+        if (!r) {
+            if (!follow) {
+                break;
+            }
+            fflush(out);
+            usleep(10000);
+            continue;
+        }
+
+        fprintf(out, "%llu,%.6f,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%u\n",
+                (unsigned long long)r->step, r->simSeconds, r->dt,
+                r->gyroRates[0], r->gyroRates[1], r->gyroRates[2],
+                r->translationRates[0], r->translationRates[1], r->translationRates[2],
+                r->motorValues[0], r->motorValues[1], r->motorValues[2], r->motorValues[3],
+                r->position[0], r->position[1], r->position[2],
+                r->orientation[0], r->orientation[1], r->orientation[2], r->orientation[3],
+                r->sticks[0], r->sticks[1], r->sticks[2], r->sticks[3], r->sticks[4],
+                r->collisionState);
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
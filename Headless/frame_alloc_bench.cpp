@@ -0,0 +1,221 @@
+/*
+   frame_alloc_bench.cpp: runs vision frames through readback, conversion and the vision
+   pipeline as the HUD does, and checks that steady state makes no heap allocations, both
+   before and after the image is resized
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "core/pixels.hpp"
+#include "core/readback.hpp"
+#include "core/vision.hpp"
+
+// Counts every heap allocation in the program, by any thread, through malloc or operator new
+static std::atomic<uint64_t> allocations(0);
+
+extern "C" {
+
+    void * __libc_malloc(size_t size);
+    void * __libc_calloc(size_t count, size_t size);
+    void * __libc_realloc(void * p, size_t size);
+    void * __libc_memalign(size_t alignment, size_t size);
+
+    void * malloc(size_t size)
+    {
+        ++allocations;
+        return __libc_malloc(size);
+    }
+
+    void * calloc(size_t count, size_t size)
+    {
+        ++allocations;
+        return __libc_calloc(count, size);
+    }
+
+    void * realloc(void * p, size_t size)
+    {
+        ++allocations;
+        return __libc_realloc(p, size);
+    }
+
+    int posix_memalign(void ** p, size_t alignment, size_t size)
+    {
+        ++allocations;
+        *p = __libc_memalign(alignment, size);
+        return *p ? 0 : 12; // ENOMEM
+    }
+
+    void * aligned_alloc(size_t alignment, size_t size)
+    {
+        ++allocations;
+        return __libc_memalign(alignment, size);
+    }
+}
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+typedef struct {
+
+    uint64_t allocations;
+    double   meanMicros;
+    double   p99Micros;
+    double   maxMicros;
+
+} phase_t;
+
+// One HUD frame: follow the image size, request a readback, and convert the newest arrival
+// straight into a vision buffer
+static void frame(hf::SyntheticFrameSource & source, hf::ReadbackPipeline & readback, hf::VisionPipeline & vision,
+        int rows, int cols, uint64_t frameNumber)
+{
+    readback.resize(rows, cols);
+    vision.resize(rows, cols);
+
+    readback.request(frameNumber, frameNumber / 60.);
+
+    hf::readback_frame_t f;
+    if (readback.pollLatest(f)) {
+        uint8_t * rgb = vision.acquire();
+        if (rgb) {
+            hf::bgraToRgb(f.bgra, rgb, (size_t)f.rows * f.cols);
+            vision.publish(f.frameNumber, f.simSeconds);
+        }
+    }
+
+    source.tick();
+}
+
+// Runs warmup frames, then times and counts allocations over the rest
+static phase_t run(hf::SyntheticFrameSource & source, hf::ReadbackPipeline & readback, hf::VisionPipeline & vision,
+        int rows, int cols, uint64_t & frameNumber, uint32_t warmup, std::vector<double> & micros)
+{
+    for (uint32_t k=0; k<warmup; ++k) {
+        frame(source, readback, vision, rows, cols, frameNumber++);
+    }
+
+    uint64_t before = allocations;
+
+    for (size_t k=0; k<micros.size(); ++k) {
+        double start = wallSeconds();
+        frame(source, readback, vision, rows, cols, frameNumber++);
+        micros[k] = 1e6 * (wallSeconds() - start);
+    }
+
+    phase_t phase;
+    phase.allocations = allocations - before;
+
+    double total = 0;
+    for (double m : micros) {
+        total += m;
+    }
+    phase.meanMicros = total / micros.size();
+
+    std::sort(micros.begin(), micros.end());
+    phase.p99Micros = micros[micros.size() * 99 / 100];
+    phase.maxMicros = micros.back();
+
+    return phase;
+}
+
+static void report(const char * label, int rows, int cols, const phase_t & phase, uint32_t frames)
+{
+    printf("%-8s %4dx%-4d  %8.2f allocations/frame  mean %7.2f  p99 %7.2f  max %8.2f usec\n",
+            label, cols, rows, (double)phase.allocations / frames, phase.meanMicros, phase.p99Micros, phase.maxMicros);
+}
+
+int main(int argc, char ** argv)
+{
+    int rows = 128;
+    int cols = 256;
+    uint32_t frames = 10000;
+    uint32_t warmup = 100;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:r:c:")) != -1) {
+        switch (c) {
+            case 'n':
+                frames = atoi(optarg);
+                break;
+            case 'r':
+                rows = atoi(optarg);
+                break;
+            case 'c':
+                cols = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n FRAMES] [-r ROWS] [-c COLS]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (frames < 1 || rows < 2 || cols < 2) {
+        fprintf(stderr, "Need at least one frame of at least 2x2 pixels\n");
+        return 1;
+    }
+
+    hf::SyntheticFrameSource source(rows, cols);
+    hf::ReadbackPipeline readback(&source, 3);
+
+    hf::VisionPipeline vision(rows, cols, 2, 2);
+    hf::BrightCentroid centroid;
+    vision.addAlgorithm(&centroid);
+    vision.start();
+
+    std::vector<double> micros(frames);
+    uint64_t frameNumber = 0;
+
+    phase_t first = run(source, readback, vision, rows, cols, frameNumber, warmup, micros);
+
+    // Halve the image, as when the render target is resized, and count what that costs once
+    int resizedRows = rows / 2;
+    int resizedCols = cols / 2;
+    uint64_t before = allocations;
+    frame(source, readback, vision, resizedRows, resizedCols, frameNumber++);
+    uint64_t resizing = allocations - before;
+
+    phase_t second = run(source, readback, vision, resizedRows, resizedCols, frameNumber, warmup, micros);
+
+    vision.stop();
+
+    report("steady", rows, cols, first, frames);
+    printf("resize   %4dx%-4d  %8llu allocations, vision buffers allocated %llu times\n",
+            resizedCols, resizedRows, (unsigned long long)resizing, (unsigned long long)vision.reallocations());
+    report("steady", resizedRows, resizedCols, second, frames);
+    printf("readback delivered %llu, skipped %llu; vision processed %llu, dropped %llu\n",
+            (unsigned long long)readback.delivered(), (unsigned long long)readback.skipped(),
+            (unsigned long long)vision.processed(), (unsigned long long)vision.dropped());
+
+    bool ok = first.allocations == 0 && second.allocations == 0 && vision.reallocations() == 2 && vision.processed() > 0;
+
+    printf("%s\n", ok ? "ok" : "FAILED");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,615 @@
+/*
+   gain_sweep.cpp: searches the stabilizer gains for the best step and hover response, without
+   Unreal Engine
+
+   Flies every combination of the given gain values through the same scripted roll, pitch and
+   yaw steps and hover, in parallel, scores each flight on overshoot, settling time, integrated
+   error and steady-state error from the commanded setpoint, then refines the best combination by pattern search.  Prints a ranked table
+   and the winning gains in the form used at the top of HackflightSimVehicle.cpp.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "core/vehicle.hpp"
+#include "core/scriptedreceiver.hpp"
+#include "core/threadpool.hpp"
+#include "core/stepresponse.hpp"
+
+#include <boards/sim/linux.hpp>
+
+// Thousands of flights' worth of firmware messages would bury the table
+void hf::Board::outbuf(char * buf)
+{
+    (void)buf;
+}
+
+// Stabilizer constructor arguments, in order
+static const int GAINS = 6;
+
+static const char * const GAIN_NAMES[GAINS] = {
+    "Level P", "Gyro cyclic P", "Gyro cyclic I", "Gyro cyclic D", "Gyro yaw P", "Gyro yaw I"
+};
+
+static const char * const GAIN_COLUMNS[GAINS] = { "levelP", "cycP", "cycI", "cycD", "yawP", "yawI" };
+
+static const char GAIN_OPTIONS[GAINS] = { 'L', 'P', 'I', 'D', 'Y', 'y' };
+
+// Values tried when none are given; level P stays at the pawn's zero, so the vehicle flies in
+// rate mode and the rates are scored.  The proportional ranges reach the gains that can hold the
+// commanded rates, so that the sweep need not fall back on the derivative kick of a stick step
+static const char * const DEFAULT_VALUES[GAINS] = {
+    "0", "0,1e-5:1e2:8", "0,1e-4:1e-1:4", "0,1e-4:1e-1:4", "0,1e-3:1e2:6", "0,1e-2"
+};
+
+// A flight is abandoned once any rate exceeds this (radians/sec)
+static const float DIVERGED_RATE = 100;
+
+// Setpoints commanded by a full stick, which must match the firmware's scaling of the sticks:
+// roll, pitch and yaw rates (radians/sec), and roll and pitch angles in level mode (radians)
+static const float RATE_PER_STICK  = 10;
+static const float ANGLE_PER_STICK = (float)M_PI / 4;
+
+// A commanded step smaller than this has nothing to scale the metrics by
+static const float MIN_STEP = 1e-3f;
+
+// Stops narrowing the pattern search once its factor is this close to one
+static const float MIN_FACTOR = 1.05f;
+
+// A scripted segment holds its sticks for its duration
+typedef struct {
+
+    float  seconds;
+    float  sticks[hf::STICK_CHANNELS];
+    int8_t axis;    // roll, pitch or yaw step whose response starts here; -1 for none
+    bool   hover;   // whether the rates are scored for steadiness
+
+} segment_t;
+
+typedef struct {
+
+    float weights[5];   // overshoot, settling seconds, integrated error, tracking error, hover
+    float scales[3];    // setpoint per unit stick on each axis
+    bool  angles;       // score roll and pitch angles instead of rates, for level mode
+
+} scoring_t;
+
+typedef struct {
+
+    float gains[GAINS];
+    float score;
+    float overshoot;        // means over the steps
+    float settlingSeconds;
+    float iae;
+    float tracking;
+    float hover;            // integrated rate magnitude while hovering (radians)
+    const char * failure;   // why the flight could not be scored; null when it was
+
+} run_t;
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Parses a comma-separated list whose items are values or LO:HI:COUNT ranges; ranges are
+// geometric when both ends are positive and linear otherwise
+static bool parseValues(const char * text, std::vector<float> & values)
+{
+    values.clear();
+
+    char buffer[256];
+    strncpy(buffer, text, sizeof(buffer)-1);
+    buffer[sizeof(buffer)-1] = 0;
+
+    for (char * item = strtok(buffer, ","); item; item = strtok(nullptr, ",")) {
+
+        float lo = 0, hi = 0;
+        int count = 0;
+
+        if (strchr(item, ':')) {
+
+            if (sscanf(item, "%f:%f:%d", &lo, &hi, &count) != 3 || count < 1) {
+                return false;
+            }
+
+            for (int k=0; k<count; ++k) {
+                float f = count > 1 ? (float)k / (count-1) : 0;
+                values.push_back(lo > 0 && hi > 0 ? lo * powf(hi/lo, f) : lo + (hi-lo) * f);
+            }
+        }
+
+        else {
+
+            char * end = nullptr;
+            values.push_back(strtof(item, &end));
+            if (end == item) {
+                return false;
+            }
+        }
+    }
+
+    return !values.empty();
+}
+
+static std::vector<segment_t> makeScript(float amplitude, float throttle, float holdSeconds)
+{
+    std::vector<segment_t> script;
+
+    segment_t arm   = { 1.0f, {-1.0f, 0, 0, 0, 0}, -1, false };
+    segment_t climb = { 2.0f, { 0.2f, 0, 0, 0, 0}, -1, false };
+    segment_t level = { 1.0f, {throttle, 0, 0, 0, 0}, -1, false };
+
+    script.push_back(arm);
+    script.push_back(climb);
+    script.push_back(level);
+
+    // Each axis is stepped out and back, so that both edges are scored
+    for (int8_t axis=0; axis<3; ++axis) {
+
+        segment_t out = { holdSeconds, {throttle, 0, 0, 0, 0}, axis, false };
+        out.sticks[hf::STICK_ROLL + axis] = amplitude;
+        script.push_back(out);
+
+        segment_t back = { holdSeconds, {throttle, 0, 0, 0, 0}, axis, false };
+        script.push_back(back);
+    }
+
+    segment_t hover = { 2.0f, {throttle, 0, 0, 0, 0}, -1, true };
+    script.push_back(hover);
+
+    return script;
+}
+
+static float scoredValue(const hf::SimVehicle & vehicle, int axis, bool angles)
+{
+    if (angles && axis < 2) {
+
+        const hf::Quaternion & q = vehicle.pose.orientation;
+
+        if (axis == 0) {
+            return atan2f(2 * (q.w*q.x + q.y*q.z), 1 - 2 * (q.x*q.x + q.y*q.y));
+        }
+
+        float s = 2 * (q.w*q.y - q.z*q.x);
+        return asinf(s > 1 ? 1 : s < -1 ? -1 : s);
+    }
+
+    return vehicle.gyroRates[axis];
+}
+
+static void fail(run_t & run, const char * failure)
+{
+    run.failure = failure;
+    run.score = INFINITY;
+}
+
+// Flies the script with the run's gains and scores it
+static void fly(run_t & run, const std::vector<segment_t> & script, float dt, const scoring_t & scoring)
+{
+    const float * g = run.gains;
+
+    hf::ScriptedReceiver receiver;
+    hf::SimVehicle vehicle(hf::Stabilizer(g[0], g[1], g[2], g[3], g[4], g[5]));
+    vehicle.init(&receiver);
+
+    float longest = 0;
+    for (const segment_t & segment : script) {
+        longest = std::max(longest, segment.seconds);
+    }
+
+    hf::StepResponse response(dt, (uint32_t)(longest / dt) + 1);
+
+    double overshoot = 0, settling = 0, iae = 0, tracking = 0, hover = 0;
+    uint32_t steps = 0;
+
+    // Commanded setpoints, which every step starts from
+    float setpoints[3] = {0, 0, 0};
+
+    run.failure = nullptr;
+
+    for (const segment_t & segment : script) {
+
+        receiver.setSticks(segment.sticks);
+
+        if (segment.axis >= 0) {
+            response.begin(scoredValue(vehicle, segment.axis, scoring.angles), setpoints[segment.axis],
+                    segment.sticks[hf::STICK_ROLL + segment.axis] * scoring.scales[segment.axis]);
+        }
+
+        for (int k=0; k<3; ++k) {
+            setpoints[k] = segment.sticks[hf::STICK_ROLL + k] * scoring.scales[k];
+        }
+
+        uint32_t count = (uint32_t)(segment.seconds / dt + 0.5f);
+
+        for (uint32_t k=0; k<count; ++k) {
+
+            vehicle.step(dt);
+
+            float magnitude = fabsf(vehicle.gyroRates[0]) + fabsf(vehicle.gyroRates[1]) + fabsf(vehicle.gyroRates[2]);
+
+            // Written so that NaN counts as diverged too
+            if (!(magnitude < DIVERGED_RATE)) {
+                fail(run, "diverged");
+                return;
+            }
+
+            if (segment.axis >= 0) {
+                response.add(scoredValue(vehicle, segment.axis, scoring.angles));
+            }
+
+            if (segment.hover) {
+                hover += magnitude * dt;
+            }
+        }
+
+        if (segment.axis >= 0) {
+
+            hf::step_metrics_t metrics;
+
+            if (!response.analyze(metrics, MIN_STEP)) {
+                fail(run, "step too small");
+                return;
+            }
+
+            overshoot += metrics.overshoot;
+            settling += metrics.settlingSeconds;
+            iae += metrics.iae;
+            tracking += metrics.trackingError;
+            ++steps;
+        }
+    }
+
+    run.overshoot = (float)(overshoot / steps);
+    run.settlingSeconds = (float)(settling / steps);
+    run.iae = (float)(iae / steps);
+    run.tracking = (float)(tracking / steps);
+    run.hover = (float)hover;
+
+    const float * w = scoring.weights;
+    run.score = w[0]*run.overshoot + w[1]*run.settlingSeconds + w[2]*run.iae + w[3]*run.tracking + w[4]*run.hover;
+}
+
+// Flies runs[first] onward across the pool
+static void flyAll(hf::ThreadPool & pool, std::vector<run_t> & runs, size_t first,
+        const std::vector<segment_t> & script, float dt, const scoring_t & scoring)
+{
+    pool.run((uint32_t)(runs.size() - first), [&](uint32_t j) {
+        fly(runs[first+j], script, dt, scoring);
+    });
+}
+
+static bool sameGains(const run_t & a, const run_t & b)
+{
+    return memcmp(a.gains, b.gains, sizeof(a.gains)) == 0;
+}
+
+static void addCandidate(std::vector<run_t> & runs, const run_t & candidate)
+{
+    for (const run_t & run : runs) {
+        if (sameGains(run, candidate)) {
+            return;
+        }
+    }
+
+    runs.push_back(candidate);
+}
+
+// Pattern search from the best run so far: tries scaling each swept gain up and down by a factor
+// (or switching it on or off), moves to the best neighbour while that improves the score, and
+// narrows the factor whenever none does
+static size_t refine(hf::ThreadPool & pool, std::vector<run_t> & runs, const std::vector<float> * values,
+        uint32_t rounds, const std::vector<segment_t> & script, float dt, const scoring_t & scoring)
+{
+    size_t best = 0;
+    for (size_t j=1; j<runs.size(); ++j) {
+        if (runs[j].score < runs[best].score) {
+            best = j;
+        }
+    }
+
+    if (!(runs[best].score < INFINITY)) {
+        return best;
+    }
+
+    float factor = 2;
+
+    for (uint32_t round=0; round<rounds && factor >= MIN_FACTOR; ++round) {
+
+        size_t first = runs.size();
+        run_t center = runs[best];
+
+        for (int k=0; k<GAINS; ++k) {
+
+            // Gains given a single value are held fixed
+            if (values[k].size() < 2) {
+                continue;
+            }
+
+            run_t candidate = center;
+
+            if (center.gains[k] == 0) {
+                float smallest = INFINITY;
+                for (float v : values[k]) {
+                    if (v > 0 && v < smallest) {
+                        smallest = v;
+                    }
+                }
+                if (smallest < INFINITY) {
+                    candidate.gains[k] = smallest;
+                    addCandidate(runs, candidate);
+                }
+            }
+
+            else {
+                candidate.gains[k] = center.gains[k] * factor;
+                addCandidate(runs, candidate);
+                candidate.gains[k] = center.gains[k] / factor;
+                addCandidate(runs, candidate);
+                candidate.gains[k] = 0;
+                addCandidate(runs, candidate);
+            }
+        }
+
+        flyAll(pool, runs, first, script, dt, scoring);
+
+        size_t next = best;
+        for (size_t j=first; j<runs.size(); ++j) {
+            if (runs[j].score < runs[next].score) {
+                next = j;
+            }
+        }
+
+        if (next == best) {
+            factor = sqrtf(factor);
+        }
+
+        best = next;
+    }
+
+    return best;
+}
+
+// Formats a gain as a C++ float literal
+static const char * literal(float value, char * buffer, size_t size)
+{
+    if (value == 0) {
+        snprintf(buffer, size, "0");
+        return buffer;
+    }
+
+    snprintf(buffer, size, "%.6g", value);
+
+    if (!strpbrk(buffer, ".e")) {
+        strncat(buffer, ".", size - strlen(buffer) - 1);
+    }
+
+    strncat(buffer, "f", size - strlen(buffer) - 1);
+
+    return buffer;
+}
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "Usage: %s [-L VALUES] [-P VALUES] [-I VALUES] [-D VALUES] [-Y VALUES] [-y VALUES]\n", name);
+    fprintf(stderr, "       [-t THREADS] [-r FIRMWARE_HZ] [-a STEP_AMPLITUDE] [-s STEP_SECONDS] [-T THROTTLE] [-A]\n");
+    fprintf(stderr, "       [-S ROLL,PITCH,YAW] [-w OVERSHOOT,SETTLING,IAE,TRACKING,HOVER] [-R REFINE_ROUNDS] [-k ROWS]\n");
+    fprintf(stderr, "VALUES are comma-separated numbers or LO:HI:COUNT ranges, for level P, gyro cyclic P, I, D,\n");
+    fprintf(stderr, "gyro yaw P and I; -A scores roll and pitch angles instead of rates, for level mode; -S gives\n");
+    fprintf(stderr, "the setpoint a full stick commands on each axis (default %g rad/s, or %g rad for -A angles)\n",
+            RATE_PER_STICK, ANGLE_PER_STICK);
+    exit(1);
+}
+
+int main(int argc, char ** argv)
+{
+    std::vector<float> values[GAINS];
+    for (int k=0; k<GAINS; ++k) {
+        parseValues(DEFAULT_VALUES[k], values[k]);
+    }
+
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    float rate = 1000;
+    float amplitude = 0.3f;
+    float holdSeconds = 1;
+    float throttle = 0;
+    uint32_t rounds = 20;
+    uint32_t rows = 20;
+    scoring_t scoring = { {1, 1, 1, 1, 1}, {0, 0, 0}, false };
+    bool scaled = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "L:P:I:D:Y:y:t:r:a:s:T:AS:w:R:k:")) != -1) {
+
+        const char * option = (const char *)memchr(GAIN_OPTIONS, c, GAINS);
+
+        if (option) {
+            if (!parseValues(optarg, values[option - GAIN_OPTIONS])) {
+                usage(argv[0]);
+            }
+            continue;
+        }
+
+        switch (c) {
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 'a':
+                amplitude = atof(optarg);
+                break;
+            case 's':
+                holdSeconds = atof(optarg);
+                break;
+            case 'T':
+                throttle = atof(optarg);
+                break;
+            case 'A':
+                scoring.angles = true;
+                break;
+            case 'S':
+                if (sscanf(optarg, "%f,%f,%f", &scoring.scales[0], &scoring.scales[1], &scoring.scales[2]) != 3) {
+                    usage(argv[0]);
+                }
+                scaled = true;
+                break;
+            case 'w':
+                if (sscanf(optarg, "%f,%f,%f,%f,%f", &scoring.weights[0], &scoring.weights[1],
+                            &scoring.weights[2], &scoring.weights[3], &scoring.weights[4]) != 5) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'R':
+                rounds = atoi(optarg);
+                break;
+            case 'k':
+                rows = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (!scaled) {
+        for (int k=0; k<3; ++k) {
+            scoring.scales[k] = scoring.angles && k < 2 ? ANGLE_PER_STICK : RATE_PER_STICK;
+        }
+    }
+
+    if (rate <= 0 || holdSeconds <= 0) {
+        usage(argv[0]);
+    }
+
+    for (int k=0; k<3; ++k) {
+        if (!(fabsf(amplitude * scoring.scales[k]) >= MIN_STEP)) {
+            fprintf(stderr, "Step amplitude %g commands too small a step on axis %d\n", amplitude, k);
+            return 1;
+        }
+    }
+
+    float dt = 1 / rate;
+    std::vector<segment_t> script = makeScript(amplitude, throttle, holdSeconds);
+
+    double flightSeconds = 0;
+    for (const segment_t & segment : script) {
+        flightSeconds += segment.seconds;
+    }
+
+    // Every combination of the given values
+    std::vector<run_t> runs;
+    size_t combinations = 1;
+    for (int k=0; k<GAINS; ++k) {
+        combinations *= values[k].size();
+    }
+    runs.reserve(combinations);
+
+    for (size_t j=0; j<combinations; ++j) {
+        run_t run = run_t();
+        size_t index = j;
+        for (int k=GAINS-1; k>=0; --k) {
+            run.gains[k] = values[k][index % values[k].size()];
+            index /= values[k].size();
+        }
+        runs.push_back(run);
+    }
+
+    printf("Sweeping %lu gain combinations on %u threads, %.0f simulated seconds each\n",
+            (unsigned long)combinations, threads+1, flightSeconds);
+
+    hf::ThreadPool pool(threads);
+
+    double start = wallSeconds();
+    flyAll(pool, runs, 0, script, dt, scoring);
+    double sweepSeconds = wallSeconds() - start;
+
+    start = wallSeconds();
+    size_t best = refine(pool, runs, values, rounds, script, dt, scoring);
+    double refineSeconds = wallSeconds() - start;
+
+    printf("Flew %lu combinations in %.2f sec (%.0f/sec, %.0fx real time) and %lu more refining in %.2f sec\n\n",
+            (unsigned long)combinations, sweepSeconds, combinations / sweepSeconds,
+            combinations * flightSeconds / sweepSeconds, (unsigned long)(runs.size() - combinations), refineSeconds);
+
+    std::vector<const run_t *> ranked;
+    for (const run_t & run : runs) {
+        ranked.push_back(&run);
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const run_t * a, const run_t * b) {
+        return a->score < b->score;
+    });
+
+    printf("%4s %9s %9s %9s %9s %9s %9s", "rank", "score", "overshoot", "settle_s", "iae_s", "tracking", "hover");
+    for (int k=0; k<GAINS; ++k) {
+        printf(" %9s", GAIN_COLUMNS[k]);
+    }
+    printf("\n");
+
+    for (uint32_t j=0; j<rows && j<ranked.size(); ++j) {
+
+        const run_t & run = *ranked[j];
+
+        if (run.failure) {
+            printf("%4u %9s %-49s", j+1, "-", run.failure);
+        }
+        else {
+            printf("%4u %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f", j+1, run.score, run.overshoot, run.settlingSeconds,
+                    run.iae, run.tracking, run.hover);
+        }
+
+        for (int k=0; k<GAINS; ++k) {
+            printf(" %9.3g", run.gains[k]);
+        }
+        printf("\n");
+    }
+
+    size_t failures = 0;
+    for (const run_t & run : runs) {
+        failures += run.failure != nullptr;
+    }
+    printf("\n%lu of %lu flights could not be scored\n\n", (unsigned long)failures, (unsigned long)runs.size());
+
+    if (runs[best].failure) {
+        printf("No combination could be scored; try other values\n");
+        return 1;
+    }
+
+    printf("Best gains (score %.4f):\n\n", runs[best].score);
+    printf("static const hf::Stabilizer STABILIZER = hf::Stabilizer(\n");
+    for (int k=0; k<GAINS; ++k) {
+        char buffer[32];
+        char value[40];
+        snprintf(value, sizeof(value), "%s%s", literal(runs[best].gains[k], buffer, sizeof(buffer)), k < GAINS-1 ? "," : ");");
+        printf("\t%-16s// %s\n", value, GAIN_NAMES[k]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+   gym_bench.cpp: drives a forked environment server over its socket the way training code
+   would, and reports environment steps per second
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <vector>
+
+#include "core/gym.hpp"
+
+#include <boards/sim/linux.hpp>
+
+// Same PID tuning as the pawn
+static const hf::Stabilizer STABILIZER = hf::Stabilizer(
+	0,//0.10f,      // Level P
+	.00001f,     // Gyro cyclic P
+	0,			// Gyro cyclic I
+	0,			// Gyro cyclic D
+	0,			// Gyro yaw P
+	0);			// Gyro yaw I
+
+void hf::Board::outbuf(char * buf)
+{
+    fputs(buf, stderr);
+}
+
+static const char * SOCKET_PATH = "/tmp/hackflight_gym_bench.sock";
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static bool transfer(int fd, void * buffer, size_t bytes, bool sending)
+{
+    uint8_t * p = (uint8_t *)buffer;
+
+    while (bytes > 0) {
+        ssize_t n = sending ? write(fd, p, bytes) : read(fd, p, bytes);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        bytes -= n;
+    }
+
+    return true;
+}
+
+// Sends a request and payload, and reads the reply's records into observations
+static bool call(int fd, uint32_t command, uint32_t count, uint32_t mode, uint32_t repeat,
+        const void * payload, size_t payloadBytes, void * records, hf::gym_reply_t & reply)
+{
+    hf::gym_request_t request = hf::gym_request_t();
+    request.magic = hf::GYM_MAGIC;
+    request.command = command;
+    request.count = count;
+    request.actionMode = mode;
+    request.repeat = repeat;
+
+    return transfer(fd, &request, sizeof(request), true) &&
+        (payloadBytes == 0 || transfer(fd, (void *)payload, payloadBytes, true)) &&
+        transfer(fd, &reply, sizeof(reply), false) &&
+        reply.status == hf::GYM_OK &&
+        (reply.count == 0 || transfer(fd, records, reply.count * reply.recordBytes, false));
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t environments = 256;
+    uint32_t threads = 0;
+    uint32_t calls = 2000;
+    uint32_t repeat = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "e:t:n:k:")) != -1) {
+        switch (c) {
+            case 'e':
+                environments = atoi(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'n':
+                calls = atoi(optarg);
+                break;
+            case 'k':
+                repeat = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-e ENVIRONMENTS] [-t SERVER_THREADS] [-n STEP_CALLS] [-k REPEAT]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    pid_t child = fork();
+
+    if (child == 0) {
+        hf::GymEnvironments envs(environments, STABILIZER, 0.001f, 1000000, 1e6f, threads);
+        hf::GymServer server(envs);
+        if (!server.listen(SOCKET_PATH)) {
+            exit(1);
+        }
+        while (server.serve()) {
+        }
+        exit(0);
+    }
+
+    struct sockaddr_un address = sockaddr_un();
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, SOCKET_PATH);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    // Wait for the server to start listening
+    for (int tries=0; connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0; ++tries) {
+        if (tries == 100) {
+            fprintf(stderr, "Unable to connect to %s\n", SOCKET_PATH);
+            return 1;
+        }
+        usleep(20000);
+    }
+
+    std::vector<hf::gym_action_t> actions(environments);
+    std::vector<hf::gym_observation_t> observations(environments);
+    hf::gym_info_t info;
+    hf::gym_reply_t reply;
+
+    bool ok = call(fd, hf::GYM_INFO, 0, 0, 0, nullptr, 0, &info, reply) &&
+        info.environments == environments && info.observationBytes == sizeof(hf::gym_observation_t);
+
+    ok = ok && call(fd, hf::GYM_RESET, 0, 0, 0, nullptr, 0, observations.data(), reply);
+
+    // Alternate the two action kinds, as a policy switching between them might
+    double start = wallSeconds();
+
+    for (uint32_t k=0; ok && k<calls; ++k) {
+
+        uint32_t mode = (k / 100) % 2 ? hf::GYM_ACTION_MOTORS : hf::GYM_ACTION_STICKS;
+
+        for (uint32_t j=0; j<environments; ++j) {
+            for (uint8_t v=0; v<5; ++v) {
+                actions[j].values[v] = mode == hf::GYM_ACTION_MOTORS ? 0.5f : (v == 0 ? 0.1f : 0);
+            }
+        }
+
+        ok = call(fd, hf::GYM_STEP, environments, mode, repeat, actions.data(),
+                environments * sizeof(hf::gym_action_t), observations.data(), reply);
+    }
+
+    double elapsed = wallSeconds() - start;
+
+    // Every environment got the same actions, so they must agree
+    bool agree = true;
+    for (uint32_t j=1; j<environments; ++j) {
+        agree = agree && memcmp(&observations[j], &observations[0], sizeof(hf::gym_observation_t)) == 0;
+    }
+
+    uint64_t steps = (uint64_t)calls * environments * (repeat ? repeat : 1);
+
+    call(fd, hf::GYM_CLOSE, 0, 0, 0, nullptr, 0, nullptr, reply);
+    close(fd);
+    waitpid(child, nullptr, 0);
+
+    printf("%u environments, %u calls of %u steps: %.0f env-steps/s  %.1f usec/call  (%s, %s)\n",
+            environments, calls, repeat ? repeat : 1, steps / elapsed, 1e6 * elapsed / calls,
+            ok ? "ok" : "FAILED", agree ? "environments agree" : "environments DISAGREE");
+
+    return ok && agree ? 0 : 1;
+}
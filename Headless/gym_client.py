@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+'''
+gym_client.py: reference client for the HackflightSim environment server (gym_server).
+Uses NumPy arrays when NumPy is installed, and lists of tuples otherwise.
+
+Copyright (C) Simon D. Levy 2017
+
+This file is part of HackflightSim.
+
+HackflightSim is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HackflightSim is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import socket
+import struct
+import sys
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+# Must match core/gymprotocol.hpp
+MAGIC = 0x59474648
+INFO, RESET, STEP, CLOSE = range(4)
+STICKS, MOTORS = range(2)
+REQUEST = struct.Struct('<8I')
+REPLY = struct.Struct('<8I')
+INFO_RECORD = struct.Struct('<4IfIf9I')
+ACTION = struct.Struct('<8f')
+OBSERVATION = struct.Struct('<17f2I')
+
+# Names of an observation's fields, in order; rates, motors, position, quaternion, steps, done
+OBSERVATION_FIELDS = (['gyro_x', 'gyro_y', 'gyro_z', 'vel_x', 'vel_y', 'vel_z',
+                       'motor_0', 'motor_1', 'motor_2', 'motor_3',
+                       'pos_x', 'pos_y', 'pos_z', 'quat_x', 'quat_y', 'quat_z', 'quat_w',
+                       'steps', 'done'])
+
+if np is not None:
+    OBSERVATION_DTYPE = np.dtype([(name, '<f4') for name in OBSERVATION_FIELDS[:17]] +
+                                 [('steps', '<u4'), ('done', '<u4')])
+
+
+class HackflightVecEnv:
+    '''
+    A batch of environments stepped together: reset() and step() return one observation
+    per environment.  Episodes that are done stay put until reset.
+    '''
+
+    def __init__(self, path='/tmp/hackflight_gym.sock'):
+
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+
+        (_, self.num_envs, _, _, self.step_seconds, self.max_steps, self.max_distance,
+         _, _, *_) = INFO_RECORD.unpack(self._call(INFO, 0)[0])
+
+    def reset(self, indices=()):
+        '''Resets the given environments (all, by default) and observes every environment'''
+        payload = struct.pack('<%dI' % len(indices), *indices)
+        return self._observations(self._call(RESET, len(indices), payload=payload))
+
+    def step(self, actions, mode=STICKS, repeat=1):
+        '''
+        Applies one action per environment: five stick values (throttle, roll, pitch, yaw,
+        aux1) or four motor values, held for repeat fixed steps
+        '''
+        if np is not None:
+            buffer = np.zeros((self.num_envs, 8), np.float32)
+            values = np.asarray(actions, np.float32)
+            buffer[:, :values.shape[1]] = values
+            payload = buffer.tobytes()
+        else:
+            payload = b''.join(ACTION.pack(*(list(a) + [0] * (8 - len(a)))) for a in actions)
+
+        return self._observations(self._call(STEP, self.num_envs, mode, repeat, payload))
+
+    def close(self):
+        self._call(CLOSE, 0)
+        self.sock.close()
+
+    def _call(self, command, count, mode=0, repeat=0, payload=b''):
+
+        self.sock.sendall(REQUEST.pack(MAGIC, command, count, mode, repeat, 0, 0, 0) + payload)
+
+        magic, status, count, record_bytes, _, _, _, _ = REPLY.unpack(self._read(REPLY.size))
+
+        if magic != MAGIC or status != 0:
+            raise RuntimeError('environment server refused the request')
+
+        data = self._read(count * record_bytes)
+
+        return [data[k*record_bytes:(k+1)*record_bytes] for k in range(count)] if np is None else [data]
+
+    def _observations(self, records):
+        if np is not None:
+            return np.frombuffer(records[0], OBSERVATION_DTYPE)
+        return [OBSERVATION.unpack(r) for r in records]
+
+    def _read(self, n):
+        chunks = []
+        while n > 0:
+            chunk = self.sock.recv(n)
+            if not chunk:
+                raise ConnectionError('environment server went away')
+            chunks.append(chunk)
+            n -= len(chunk)
+        return b''.join(chunks)
+
+
+if __name__ == '__main__':
+
+    env = HackflightVecEnv(sys.argv[1] if len(sys.argv) > 1 else '/tmp/hackflight_gym.sock')
+
+    print('%d environments, %.4f s steps' % (env.num_envs, env.step_seconds))
+
+    observations = env.reset()
+
+    # Climb for a second of simulated time, ten steps per call
+    for _ in range(100):
+        observations = env.step([[0.2, 0, 0, 0, 0]] * env.num_envs, repeat=10)
+
+    print('first environment after 1 s:', observations[0])
+
+    env.close()
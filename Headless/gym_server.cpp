@@ -0,0 +1,116 @@
+/*
+   gym_server.cpp: serves batches of simulated vehicles to training code over a Unix-domain
+   socket; see core/gymprotocol.hpp for the message layouts and gym_client.py for a client
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "core/gym.hpp"
+
+#include <boards/sim/linux.hpp>
+
+// Same PID tuning as the pawn
+static const hf::Stabilizer STABILIZER = hf::Stabilizer(
+	0,//0.10f,      // Level P
+	.00001f,     // Gyro cyclic P
+	0,			// Gyro cyclic I
+	0,			// Gyro cyclic D
+	0,			// Gyro yaw P
+	0);			// Gyro yaw I
+
+void hf::Board::outbuf(char * buf)
+{
+    fputs(buf, stderr);
+}
+
+int main(int argc, char ** argv)
+{
+    const char * path = "/tmp/hackflight_gym.sock";
+    const char * viewName = "/hackflight_gym_view";
+    uint32_t environments = 64;
+    uint32_t threads = 0;
+    uint32_t maxSteps = 10000;
+    float maxDistance = 100;
+    float rateHz = 1000;
+    int viewed = -1;
+
+    int c;
+    while ((c = getopt(argc, argv, "s:e:t:m:d:r:w:")) != -1) {
+        switch (c) {
+            case 's':
+                path = optarg;
+                break;
+            case 'e':
+                environments = atoi(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'm':
+                maxSteps = atoi(optarg);
+                break;
+            case 'd':
+                maxDistance = atof(optarg);
+                break;
+            case 'r':
+                rateHz = atof(optarg);
+                break;
+            case 'w':
+                viewed = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s SOCKET] [-e ENVIRONMENTS] [-t THREADS] [-m MAX_STEPS] "
+                        "[-d MAX_DISTANCE] [-r RATE_HZ] [-w VIEWED_ENVIRONMENT]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // Where sends cannot opt out of SIGPIPE themselves, a client that disconnects mid-reply must not kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    hf::GymEnvironments envs(environments, STABILIZER, 1 / rateHz, maxSteps, maxDistance, threads);
+    hf::GymServer server(envs);
+
+    if (!server.listen(path)) {
+        fprintf(stderr, "Unable to listen on %s\n", path);
+        return 1;
+    }
+
+    // The pawn shows this environment when PARAM_GYM_VIEW_NAME matches
+    hf::ShmMailbox<hf::gym_view_t> viewer;
+    if (viewed >= 0) {
+        if (!viewer.open(viewName, true)) {
+            fprintf(stderr, "Unable to create %s\n", viewName);
+            return 1;
+        }
+        server.setViewer(&viewer, viewed);
+    }
+
+    printf("Serving %u environments on %s\n", environments, path);
+
+    while (server.serve()) {
+    }
+
+    printf("Served %llu requests\n", (unsigned long long)server.requests());
+
+    return 0;
+}
@@ -0,0 +1,453 @@
+/*
+   headless.cpp: HackflightSim without Unreal Engine
+
+   Flies the Hackflight firmware through a scripted maneuver as fast as the CPU allows,
+   with no rendering, audio or editor, and reports the simulation throughput.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+// Per-vehicle firmware, board and pose
+#include "core/vehicle.hpp"
+#include "core/stepper.hpp"
+#include "core/flightlog.hpp"
+#include "core/inputlog.hpp"
+#include "core/bvh.hpp"
+#include "core/contact.hpp"
+
+// Scripted stick input in place of a joystick
+#include "core/scriptedreceiver.hpp"
+
+// Board simulation support
+#include <boards/sim/linux.hpp>
+
+// Same collision response as the pawn
+#include "HackflightSimParams.h"
+
+// Same PID tuning as the pawn
+static const hf::Stabilizer STABILIZER = hf::Stabilizer(
+	0,//0.10f,      // Level P
+	.00001f,     // Gyro cyclic P
+	0,			// Gyro cyclic I
+	0,			// Gyro cyclic D
+	0,			// Gyro yaw P
+	0);			// Gyro yaw I
+
+// Firmware debug output goes to the terminal instead of the game display
+void hf::Board::outbuf(char * buf)
+{
+    fputs(buf, stderr);
+}
+
+// A maneuver holds its sticks from its start time until the next maneuver starts
+typedef struct {
+
+    float startSeconds;
+    float sticks[hf::STICK_CHANNELS]; // throttle, roll, pitch, yaw, aux1
+
+} maneuver_t;
+
+static const maneuver_t FLIGHT[] = {
+
+    { 0.0f, {-1.0f,  0.0f,  0.0f,  0.0f, 0} }, // throttle down for arming
+    { 1.0f, { 0.2f,  0.0f,  0.0f,  0.0f, 0} }, // climb
+    { 3.0f, { 0.0f,  0.0f,  0.0f,  0.0f, 0} }, // hover
+    { 5.0f, { 0.0f,  0.3f,  0.0f,  0.0f, 0} }, // roll step
+    { 6.0f, { 0.0f,  0.0f,  0.3f,  0.0f, 0} }, // pitch step
+    { 7.0f, { 0.0f,  0.0f,  0.0f,  0.3f, 0} }, // yaw step
+    { 8.0f, { 0.0f,  0.0f,  0.0f,  0.0f, 0} }, // hover
+    {10.0f, {-0.3f,  0.0f,  0.0f,  0.0f, 0} }, // descend
+};
+
+static const int FLIGHT_LENGTH = sizeof(FLIGHT) / sizeof(maneuver_t);
+
+// Vehicles are swept through the map as spheres of this radius, in meters
+static const float COLLISION_RADIUS = 0.1f;
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "Usage: %s [-s SECONDS] [-r RATE_HZ] [-n FLIGHTS] [-v VEHICLES] [-l LOGFILE] [-i INPUTFILE | -p INPUTFILE]\n", name);
+    fprintf(stderr, "       [-b COLLISION_BVH] [-u IMU_RATE_HZ] [-e IMU_SEED] [-q]\n");
+    exit(1);
+}
+
+// Appends the first vehicle's state after a step to the flight log
+static void record(hf::FlightRecorder * recorder, uint64_t step, double simSeconds, float dt,
+        hf::SimVehicle * vehicle, hf::ScriptedReceiver & receiver, const hf::ContactModel & contact)
+{
+    hf::flight_record_t * r = recorder->next();
+
+    if (!r) {
+        return;
+    }
+
+    r->step = step;
+    r->simSeconds = simSeconds;
+    r->dt = dt;
+    memcpy(r->gyroRates, vehicle->gyroRates, sizeof(r->gyroRates));
+    memcpy(r->translationRates, vehicle->translationRates, sizeof(r->translationRates));
+    memcpy(r->motorValues, vehicle->motorValues, sizeof(r->motorValues));
+    memcpy(r->position, vehicle->pose.position, sizeof(r->position));
+    r->orientation[0] = vehicle->pose.orientation.x;
+    r->orientation[1] = vehicle->pose.orientation.y;
+    r->orientation[2] = vehicle->pose.orientation.z;
+    r->orientation[3] = vehicle->pose.orientation.w;
+    memcpy(r->sticks, receiver.getSticks(), sizeof(r->sticks));
+    r->collisionState = contact.state();
+
+    recorder->commit();
+}
+
+// Optional logs for a flight; any may be null
+typedef struct {
+
+    hf::FlightRecorder * flightLog;         // every step of the first vehicle
+    hf::InputRecorder  * inputLog;          // sticks and dt the first vehicle's firmware saw
+    hf::InputPlayer    * replay;            // replaces the scripted maneuvers
+    uint64_t           * trajectoryHash;    // hash of every pose of the first vehicle
+
+} flight_logs_t;
+
+// FNV-1a over the bits of the pose, so that replays can be checked for exact agreement
+static void hashPose(uint64_t & hash, const hf::Pose & pose)
+{
+    const uint8_t * bytes[2] = { (const uint8_t *)pose.position, (const uint8_t *)&pose.orientation };
+    size_t sizes[2] = { sizeof(pose.position), sizeof(pose.orientation) };
+
+    for (int j=0; j<2; ++j) {
+        for (size_t k=0; k<sizes[j]; ++k) {
+            hash = (hash ^ bytes[j][k]) * 0x100000001b3ull;
+        }
+    }
+}
+
+// Static map geometry from the collision exporter, and each vehicle's crash state
+typedef struct {
+
+    const hf::CollisionBvh * map;           // null to fly without collision
+    hf::VehicleSnapshot   ** snapshots;     // each vehicle's state at the start of a flight
+    hf::ContactModel       * contacts;      // each vehicle's crash response
+    hf::Pose                 start;
+    uint64_t                 crashes;
+
+} collision_t;
+
+// Puts a crashed vehicle back at the start, as the pawn does
+static void resetAfterCollision(collision_t & collision, hf::SimVehicle * vehicle, int j)
+{
+    vehicle->restore(*collision.snapshots[j]);
+    vehicle->pose = collision.start;
+    collision.contacts[j].reset();
+}
+
+// Same response as the pawn's NotifyHit: a crash above the ground bounces the vehicle back and
+// lets it fall; a crash on the ground, or coming to rest after a fall, resets it
+static void collide(collision_t & collision, hf::SimVehicle * vehicle, int j, const hf::sweep_hit_t & hit)
+{
+    if (!collision.contacts[j].crashed()) {
+        ++collision.crashes;
+    }
+
+    if (collision.contacts[j].collide(*vehicle, hit.position, hit.normal)) {
+        resetAfterCollision(collision, vehicle, j);
+    }
+}
+
+// Steps every vehicle once with the given sticks, then updates the logs
+static void step(float dt, double t, const float sticks[hf::STICK_CHANNELS],
+        hf::SimVehicle ** vehicles, hf::ScriptedReceiver * receivers, int count, const flight_logs_t & logs,
+        collision_t & collision)
+{
+    for (int j=0; j<count; ++j) {
+
+        float from[3];
+        memcpy(from, vehicles[j]->pose.position, sizeof(from));
+
+        receivers[j].setSticks(sticks);
+
+        // A crashed vehicle's firmware has lost control; the contact model moves it until it comes to rest
+        if (collision.contacts[j].crashed()) {
+            if (collision.contacts[j].step(*vehicles[j], dt)) {
+                resetAfterCollision(collision, vehicles[j], j);
+            }
+        }
+        else {
+            vehicles[j]->step(dt);
+        }
+
+        hf::sweep_hit_t hit;
+        if (collision.map && collision.map->sweepSphere(from, vehicles[j]->pose.position, COLLISION_RADIUS, hit)) {
+            collide(collision, vehicles[j], j, hit);
+        }
+    }
+
+    if (logs.flightLog) {
+        record(logs.flightLog, logs.flightLog->count(), t + dt, dt, vehicles[0], receivers[0], collision.contacts[0]);
+    }
+
+    if (logs.inputLog) {
+        logs.inputLog->append(dt, receivers[0].getSticks(), receivers[0].headless);
+    }
+
+    if (logs.trajectoryHash) {
+        hashPose(*logs.trajectoryHash, vehicles[0]->pose);
+    }
+}
+
+// Flies one scripted or replayed flight for each vehicle, stepping them in lockstep, and
+// returns the number of firmware steps taken
+static uint64_t fly(float flightSeconds, float rateHz, hf::SimVehicle ** vehicles, hf::ScriptedReceiver * receivers,
+        int count, const flight_logs_t & logs, collision_t & collision)
+{
+    // Every flight starts from the same state
+    for (int j=0; j<count; ++j) {
+        resetAfterCollision(collision, vehicles[j], j);
+    }
+
+    // Replays take their sticks and step lengths from the log, at full speed
+    if (logs.replay) {
+
+        logs.replay->rewind();
+
+        hf::input_record_t input;
+        double t = 0;
+
+        while (logs.replay->next(input)) {
+            for (int j=0; j<count; ++j) {
+                receivers[j].headless = (input.flags & hf::INPUT_HEADLESS) != 0;
+            }
+            step(input.dt, t, input.sticks, vehicles, receivers, count, logs, collision);
+            t += input.dt;
+        }
+
+        return logs.replay->count() * count;
+    }
+
+    hf::FixedStepper stepper(rateHz, flightSeconds);
+
+    int maneuver = 0;
+
+    stepper.advance(flightSeconds, [&](float dt) {
+
+        double t = stepper.simSeconds();
+
+        while (maneuver < FLIGHT_LENGTH-1 && t >= FLIGHT[maneuver+1].startSeconds) {
+            ++maneuver;
+        }
+
+        step(dt, t, FLIGHT[maneuver].sticks, vehicles, receivers, count, logs, collision);
+    });
+
+    return stepper.stepCount() * count;
+}
+
+int main(int argc, char ** argv)
+{
+    float flightSeconds = 12;
+    float rateHz = 1000;
+    int flights = 1;
+    int count = 1;
+    bool quiet = false;
+    const char * logfile = nullptr;
+    const char * inputfile = nullptr;
+    const char * replayfile = nullptr;
+    const char * mapfile = nullptr;
+    float imuRateHz = 0;
+    uint64_t imuSeed = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "s:r:n:v:l:i:p:b:u:e:q")) != -1) {
+        switch (c) {
+            case 's':
+                flightSeconds = atof(optarg);
+                break;
+            case 'r':
+                rateHz = atof(optarg);
+                break;
+            case 'n':
+                flights = atoi(optarg);
+                break;
+            case 'v':
+                count = atoi(optarg);
+                break;
+            case 'l':
+                logfile = optarg;
+                break;
+            case 'i':
+                inputfile = optarg;
+                break;
+            case 'p':
+                replayfile = optarg;
+                break;
+            case 'b':
+                mapfile = optarg;
+                break;
+            case 'u':
+                imuRateHz = atof(optarg);
+                break;
+            case 'e':
+                imuSeed = strtoull(optarg, nullptr, 0);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (flightSeconds <= 0 || rateHz <= 0 || flights <= 0 || count <= 0 || (inputfile && replayfile)) {
+        usage(argv[0]);
+    }
+
+    // Time the creation of each vehicle's firmware, as a pawn would do on spawn
+    double start = wallSeconds();
+    hf::ScriptedReceiver * receivers = new hf::ScriptedReceiver[count];
+    hf::SimVehicle ** vehicles = new hf::SimVehicle * [count];
+    hf::VehicleSnapshot ** snapshots = new hf::VehicleSnapshot * [count];
+    for (int j=0; j<count; ++j) {
+        vehicles[j] = new hf::SimVehicle(STABILIZER);
+        if (imuRateHz > 0) {
+            vehicles[j]->setImuModel(hf::ImuModel(imuRateHz, imuSeed + j));
+        }
+        vehicles[j]->init(&receivers[j]);
+        snapshots[j] = new hf::VehicleSnapshot(*vehicles[j]);
+    }
+    double spawnSeconds = wallSeconds() - start;
+
+    hf::InputPlayer player;
+    if (replayfile) {
+        if (!player.open(replayfile)) {
+            fprintf(stderr, "%s is not an input log\n", replayfile);
+            return 1;
+        }
+        rateHz = 1 / player.stepSeconds();
+    }
+
+    // Flights start where the map says, unless a replay says otherwise
+    hf::CollisionBvh map;
+    hf::contact_params_t contactParams = hf::CONTACT_DEFAULT;
+    contactParams.impactRestitution = PARAM_BOUNCEBACK_FORCE;
+    contactParams.bounceSeconds = PARAM_BOUNCEBACK_SECONDS;
+    contactParams.restitution = PARAM_CONTACT_RESTITUTION;
+    contactParams.friction = PARAM_CONTACT_FRICTION;
+    std::vector<hf::ContactModel> contacts(count, hf::ContactModel(contactParams));
+    collision_t collision = { nullptr, snapshots, contacts.data(), hf::Pose(), 0 };
+    if (mapfile) {
+        if (!map.open(mapfile)) {
+            fprintf(stderr, "%s is not a collision BVH\n", mapfile);
+            return 1;
+        }
+        collision.map = &map;
+        memcpy(collision.start.position, map.header()->start, sizeof(collision.start.position));
+    }
+    if (replayfile) {
+        collision.start = player.initialPose();
+    }
+
+    // Room for every step of every flight, plus one for rounding
+    hf::FlightRecorder recorder;
+    if (logfile && !recorder.open(logfile, (uint64_t)(flights * (flightSeconds * rateHz + 1)), 1 / rateHz)) {
+        fprintf(stderr, "Unable to create %s\n", logfile);
+        return 1;
+    }
+
+    hf::InputRecorder inputRecorder;
+    if (inputfile && !inputRecorder.open(inputfile, 1 / rateHz, collision.start)) {
+        fprintf(stderr, "Unable to create %s\n", inputfile);
+        return 1;
+    }
+
+    // Only the first flight's inputs are recorded, and only its trajectory is hashed
+    uint64_t trajectoryHash = 0xcbf29ce484222325ull;
+    flight_logs_t logs = {
+        logfile ? &recorder : nullptr,
+        inputfile ? &inputRecorder : nullptr,
+        replayfile ? &player : nullptr,
+        (inputfile || replayfile) ? &trajectoryHash : nullptr
+    };
+
+    uint64_t steps = 0;
+
+    start = wallSeconds();
+
+    for (int k=0; k<flights; ++k) {
+        steps += fly(flightSeconds, rateHz, vehicles, receivers, count, logs, collision);
+        logs.inputLog = nullptr;
+        logs.trajectoryHash = nullptr;
+    }
+
+    double elapsed = wallSeconds() - start;
+
+    if (!quiet) {
+        hf::Pose & pose = vehicles[0]->pose;
+        printf("final position: %+.3f %+.3f %+.3f m\n", pose.position[0], pose.position[1], pose.position[2]);
+    }
+
+    printf("vehicles: %d  spawn: %.2f usec/vehicle  memory: %d bytes/vehicle\n",
+            count, 1e6*spawnSeconds/count, (int)(sizeof(hf::SimVehicle) + sizeof(hf::VehicleSnapshot) + sizeof(hf::ScriptedReceiver)));
+
+    printf("flights: %d  steps: %llu  wall: %.3f s  steps/s: %.0f  usec/vehicle-step: %.3f  realtime x%.0f\n",
+            flights, (unsigned long long)steps, elapsed, steps/elapsed, 1e6*elapsed/steps, steps/count/rateHz/elapsed);
+
+    if (mapfile) {
+        printf("collisions: %llu against %u triangles of %s\n", (unsigned long long)collision.crashes, map.triangleCount(), mapfile);
+    }
+
+    if (HF_TIMING) {
+        hf::Timing::instance().dump(stdout);
+    }
+
+    if (inputfile) {
+        printf("inputs: %llu steps recorded to %s\n", (unsigned long long)inputRecorder.count(), inputfile);
+        inputRecorder.close();
+    }
+
+    if (inputfile || replayfile) {
+        printf("trajectory: %016llx\n", (unsigned long long)trajectoryHash);
+    }
+
+    if (logfile) {
+        printf("logged: %llu records to %s\n", (unsigned long long)recorder.count(), logfile);
+        recorder.close();
+    }
+
+    for (int j=0; j<count; ++j) {
+        delete vehicles[j];
+        delete snapshots[j];
+    }
+    delete[] vehicles;
+    delete[] snapshots;
+    delete[] receivers;
+
+    return 0;
+}
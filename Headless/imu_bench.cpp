@@ -0,0 +1,207 @@
+/*
+   imu_bench.cpp: cost and statistics of the IMU model in core/imu.hpp
+
+   Times the block noise generator against the standard library's, and the model per sensor
+   sample, then checks that what the firmware reads has the configured noise, delay and bias
+   walk, and that the same seed gives the same readings.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include <random>
+
+#include "core/imu.hpp"
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Reads a gyro at a constant rate, through a model with only the given errors, and returns the
+// standard deviation of what the firmware sees
+static double readingDeviation(float sensorHz, float firmwareHz, const hf::imu_sensor_t & gyro, uint32_t reads)
+{
+    hf::ImuModel imu(sensorHz, 1, 0, gyro, gyro);
+
+    double sum = 0, squares = 0;
+
+    for (uint32_t k=0; k<reads; ++k) {
+        float euler[3] = {0, 0, 0};
+        float rates[3] = {1, 1, 1};
+        imu.read((uint64_t)(1e9 * k / firmwareHz), euler, rates);
+        sum += rates[0];
+        squares += rates[0] * rates[0];
+    }
+
+    double mean = sum / reads;
+    return sqrt(squares / reads - mean * mean);
+}
+
+int main(int argc, char ** argv)
+{
+    float sensorHz = 8000;
+    float firmwareHz = 1000;
+    double seconds = 10;
+
+    int c;
+    while ((c = getopt(argc, argv, "r:f:t:")) != -1) {
+        switch (c) {
+            case 'r':
+                sensorHz = atof(optarg);
+                break;
+            case 'f':
+                firmwareHz = atof(optarg);
+                break;
+            case 't':
+                seconds = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r SENSOR_HZ] [-f FIRMWARE_HZ] [-t SECONDS]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (sensorHz <= 0 || firmwareHz <= 0 || seconds <= 0) {
+        fprintf(stderr, "Rates and duration must be positive\n");
+        return 1;
+    }
+
+    static const uint32_t NUMBERS = 20000000;
+
+    // Noise generators
+    {
+        hf::NormalBlockRng rng(1);
+        double sum = 0, squares = 0, fourths = 0;
+        double start = wallSeconds();
+        for (uint32_t k=0; k<NUMBERS; ++k) {
+            double x = rng.next();
+            sum += x;
+            squares += x*x;
+            fourths += x*x*x*x;
+        }
+        double blockNanos = 1e9 * (wallSeconds() - start) / NUMBERS;
+
+        std::mt19937 engine(1);
+        std::normal_distribution<float> normal;
+        double check = 0;
+        start = wallSeconds();
+        for (uint32_t k=0; k<NUMBERS; ++k) {
+            check += normal(engine);
+        }
+        double standardNanos = 1e9 * (wallSeconds() - start) / NUMBERS;
+
+        double mean = sum / NUMBERS;
+        double variance = squares / NUMBERS - mean*mean;
+        printf("noise: block %.2f ns/number, std::normal_distribution %.2f ns/number (%.1fx)%s\n",
+                blockNanos, standardNanos, standardNanos / blockNanos, check == 0 ? " " : "");
+        printf("       mean %+.4f  std dev %.4f  kurtosis %.3f (normal 3, sum of four uniforms 2.7)\n",
+                mean, sqrt(variance), fourths / NUMBERS / (variance*variance));
+    }
+
+    uint64_t reads = (uint64_t)(seconds * firmwareHz);
+
+    // Cost of the whole model, read by the firmware at its rate
+    {
+        hf::ImuModel imu(sensorHz, 1);
+        float check = 0;
+        double start = wallSeconds();
+        for (uint64_t k=0; k<reads; ++k) {
+            float euler[3] = {0.1f, 0.2f, 0};
+            float rates[3] = {1, 2, 3};
+            imu.read((uint64_t)(1e9 * k / firmwareHz), euler, rates);
+            check += rates[0] + euler[0];
+        }
+        double elapsed = wallSeconds() - start;
+        printf("\nmodel: %.0f Hz sensor read at %.0f Hz: %.1f ns/sample, %.0f ns/read, %.3f%% of real time%s\n",
+                sensorHz, firmwareHz, 1e9 * elapsed / imu.samples(), 1e9 * elapsed / reads,
+                100 * elapsed / seconds, check == 0 ? " " : "");
+    }
+
+    // White noise alone, averaged over the samples between reads
+    {
+        hf::imu_sensor_t gyro = { hf::IMU_GYRO_DEFAULT.noise, 0, 0, 0 };
+        double expected = gyro.noise / sqrt(sensorHz / firmwareHz);
+        printf("\nnoise:  %.5f rad/sec read, %.5f expected from %.5f per sample\n",
+                readingDeviation(sensorHz, firmwareHz, gyro, (uint32_t)reads), expected, gyro.noise);
+    }
+
+    // Delay: a step in the true rate, read at the sensor rate so the delay shows to the sample
+    {
+        static const float DELAY = 0.002f;
+        hf::imu_sensor_t ideal = { 0, 0, 0, 0 };
+        hf::ImuModel imu(sensorHz, 1, DELAY, ideal, ideal);
+        uint64_t period = (uint64_t)(1e9 / sensorHz + 0.5);
+        double seen = -1;
+        for (uint64_t k=0; k<(uint64_t)(sensorHz * (1 + DELAY * 10)) && seen < 0; ++k) {
+            float euler[3] = {0, 0, 0};
+            float rates[3] = {k * period >= 1000000000ull ? 1.f : 0, 0, 0};
+            imu.read(k * period, euler, rates);
+            if (rates[0] > 0.5f) {
+                seen = k * period / 1e9 - 1;
+            }
+        }
+        printf("delay:  %.5f sec, configured %.5f\n", seen, DELAY);
+    }
+
+    // Bias walk: spread of the bias across seeds after the run
+    {
+        static const uint32_t SEEDS = 100;
+        hf::imu_sensor_t gyro = { 0, hf::IMU_GYRO_DEFAULT.biasWalk, 0, 0 };
+        double squares = 0;
+        for (uint32_t s=0; s<SEEDS; ++s) {
+            hf::ImuModel imu(sensorHz, s+1, 0, gyro, gyro);
+            float rates[3] = {0, 0, 0};
+            for (uint64_t k=0; k<reads; ++k) {
+                float euler[3] = {0, 0, 0};
+                rates[0] = 0;
+                imu.read((uint64_t)(1e9 * k / firmwareHz), euler, rates);
+            }
+            squares += rates[0] * rates[0];
+        }
+        printf("walk:   %.5f rad/sec after %.0f sec, %.5f expected\n", sqrt(squares / SEEDS), seconds,
+                gyro.biasWalk * sqrt(seconds));
+    }
+
+    // Determinism: the same seed must give identical readings, another seed different ones
+    {
+        hf::ImuModel a(sensorHz, 7), b(sensorHz, 7), other(sensorHz, 8);
+        uint64_t mismatches = 0, matches = 0;
+        for (uint64_t k=0; k<reads; ++k) {
+            float ea[3] = {0.1f, 0.2f, 0}, eb[3] = {0.1f, 0.2f, 0}, eo[3] = {0.1f, 0.2f, 0};
+            float ra[3] = {1, 2, 3}, rb[3] = {1, 2, 3}, ro[3] = {1, 2, 3};
+            uint64_t nanos = (uint64_t)(1e9 * k / firmwareHz);
+            a.read(nanos, ea, ra);
+            b.read(nanos, eb, rb);
+            other.read(nanos, eo, ro);
+            mismatches += ra[0] != rb[0] || ra[1] != rb[1] || ra[2] != rb[2] || ea[0] != eb[0] || ea[1] != eb[1];
+            matches += ra[0] == ro[0];
+        }
+        printf("seeds:  %lu of %lu reads differ with the same seed, %lu of %lu match with another\n",
+                (unsigned long)mismatches, (unsigned long)reads, (unsigned long)matches, (unsigned long)reads);
+    }
+
+    return 0;
+}
@@ -0,0 +1,330 @@
+/*
+   integrator_bench.cpp: accuracy against cost of the pose integrators in core/pose.hpp
+
+   Feeds each scheme the rates of a smooth, aggressive synthetic flight (coning roll and pitch,
+   yawing, translating) sampled at the end of each step as the board reports them, compares the
+   resulting pose against a much finer double-precision reference, and times the steps.  For
+   each firmware rate it names the cheapest scheme that stays within the given tolerances.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include <vector>
+
+#include "core/pose.hpp"
+
+static const float RATES_HZ[] = { 1000, 10000 };
+
+// The reference takes this many steps for each step at the highest rate
+static const int REFERENCE_SUBSTEPS = 20;
+
+typedef struct {
+
+    double coningRate;      // roll and pitch amplitude, radians/sec
+    double coningHz;
+    double yawRate;         // radians/sec
+    double yawHz;
+    double speed;           // meters/sec
+
+} motion_t;
+
+// Body-frame gyro and translation rates at time t, in the same conventions as the board's
+static void rates(const motion_t & m, double t, double gyro[3], double translation[3])
+{
+    double c = 2 * M_PI * m.coningHz * t;
+    double y = 2 * M_PI * m.yawHz * t + 0.3;
+
+    gyro[0] = m.coningRate * sin(c);
+    gyro[1] = m.coningRate * cos(c);
+    gyro[2] = m.yawRate * sin(y);
+
+    translation[0] = m.speed;
+    translation[1] = 0.5 * m.speed * sin(y);
+    translation[2] = 0.2 * m.speed * cos(c);
+}
+
+// Double-precision pose: quaternion x, y, z, w, then position
+typedef struct {
+
+    double q[4];
+    double p[3];
+
+} reference_t;
+
+// Derivative of the reference pose, with the same mapping from gyro rates to rotation as Pose
+static void derivative(const reference_t & s, const double gyro[3], const double translation[3], reference_t & d)
+{
+    double v[3] = { -gyro[0], -gyro[1], gyro[2] };
+    const double * q = s.q;
+
+    d.q[0] = 0.5 * ( q[3]*v[0] + q[1]*v[2] - q[2]*v[1]);
+    d.q[1] = 0.5 * ( q[3]*v[1] - q[0]*v[2] + q[2]*v[0]);
+    d.q[2] = 0.5 * ( q[3]*v[2] + q[0]*v[1] - q[1]*v[0]);
+    d.q[3] = 0.5 * (-q[0]*v[0] - q[1]*v[1] - q[2]*v[2]);
+
+    double n = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+    double x = q[0]/n, y = q[1]/n, z = q[2]/n, w = q[3]/n;
+    const double * t = translation;
+
+    double tx = 2 * (y*t[2] - z*t[1]);
+    double ty = 2 * (z*t[0] - x*t[2]);
+    double tz = 2 * (x*t[1] - y*t[0]);
+
+    d.p[0] = t[0] + w*tx + (y*tz - z*ty);
+    d.p[1] = t[1] + w*ty + (z*tx - x*tz);
+    d.p[2] = t[2] + w*tz + (x*ty - y*tx);
+}
+
+static reference_t advance(const reference_t & s, const reference_t & d, double h)
+{
+    reference_t r;
+
+    for (int k=0; k<4; ++k) {
+        r.q[k] = s.q[k] + h * d.q[k];
+    }
+
+    for (int k=0; k<3; ++k) {
+        r.p[k] = s.p[k] + h * d.p[k];
+    }
+
+    return r;
+}
+
+// Classic RK4 on the continuous motion, recording the pose at the end of each of steps steps
+static void reference(const motion_t & m, double dt, uint32_t steps, std::vector<reference_t> & poses)
+{
+    reference_t s = { {0, 0, 0, 1}, {0, 0, 0} };
+
+    double h = dt / REFERENCE_SUBSTEPS;
+
+    poses.resize(steps);
+
+    for (uint32_t k=0; k<steps; ++k) {
+
+        for (int j=0; j<REFERENCE_SUBSTEPS; ++j) {
+
+            double t = k * dt + j * h;
+            double g[3], v[3];
+            reference_t d1, d2, d3, d4;
+
+            rates(m, t, g, v);
+            derivative(s, g, v, d1);
+            rates(m, t + h/2, g, v);
+            derivative(advance(s, d1, h/2), g, v, d2);
+            derivative(advance(s, d2, h/2), g, v, d3);
+            rates(m, t + h, g, v);
+            derivative(advance(s, d3, h), g, v, d4);
+
+            for (int i=0; i<4; ++i) {
+                s.q[i] += h/6 * (d1.q[i] + 2*d2.q[i] + 2*d3.q[i] + d4.q[i]);
+            }
+            for (int i=0; i<3; ++i) {
+                s.p[i] += h/6 * (d1.p[i] + 2*d2.p[i] + 2*d3.p[i] + d4.p[i]);
+            }
+
+            double n = sqrt(s.q[0]*s.q[0] + s.q[1]*s.q[1] + s.q[2]*s.q[2] + s.q[3]*s.q[3]);
+            for (int i=0; i<4; ++i) {
+                s.q[i] /= n;
+            }
+        }
+
+        poses[k] = s;
+    }
+}
+
+// Angle between two attitudes, in degrees
+static double attitudeError(const hf::Quaternion & a, const reference_t & r)
+{
+    // Vector and scalar parts of conj(r) * a
+    double x = r.q[3]*a.x - r.q[0]*a.w - r.q[1]*a.z + r.q[2]*a.y;
+    double y = r.q[3]*a.y + r.q[0]*a.z - r.q[1]*a.w - r.q[2]*a.x;
+    double z = r.q[3]*a.z - r.q[0]*a.y + r.q[1]*a.x - r.q[2]*a.w;
+    double w = r.q[3]*a.w + r.q[0]*a.x + r.q[1]*a.y + r.q[2]*a.z;
+
+    return 2 * atan2(sqrt(x*x + y*y + z*z), fabs(w)) * 180 / M_PI;
+}
+
+static double positionError(const float p[3], const reference_t & r)
+{
+    double dx = p[0] - r.p[0], dy = p[1] - r.p[1], dz = p[2] - r.p[2];
+    return sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Rates at the end of each step, with those at time zero first so that the schemes needing the
+// start of the first step have it
+static void sampleRates(const motion_t & m, float dt, uint32_t steps, std::vector<float> & gyro, std::vector<float> & translation)
+{
+    gyro.resize(3 * (steps+1));
+    translation.resize(3 * (steps+1));
+
+    for (uint32_t k=0; k<=steps; ++k) {
+        double g[3], v[3];
+        rates(m, (double)k * dt, g, v);
+        for (int i=0; i<3; ++i) {
+            gyro[3*k+i] = (float)g[i];
+            translation[3*k+i] = (float)v[i];
+        }
+    }
+}
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "Usage: %s [-t SECONDS] [-c CONING_RATE] [-f CONING_HZ] [-y YAW_RATE] [-v SPEED]\n", name);
+    fprintf(stderr, "       [-a ATTITUDE_TOLERANCE_DEGREES] [-p POSITION_TOLERANCE_METERS] [-n TIMING_REPEATS]\n");
+    exit(1);
+}
+
+int main(int argc, char ** argv)
+{
+    double seconds = 10;
+    motion_t motion = { 8, 4, 3, 1.3, 5 };
+    double attitudeTolerance = 0.1;
+    double positionTolerance = 0.01;
+    int repeats = 5;
+
+    int c;
+    while ((c = getopt(argc, argv, "t:c:f:y:v:a:p:n:")) != -1) {
+        switch (c) {
+            case 't':
+                seconds = atof(optarg);
+                break;
+            case 'c':
+                motion.coningRate = atof(optarg);
+                break;
+            case 'f':
+                motion.coningHz = atof(optarg);
+                break;
+            case 'y':
+                motion.yawRate = atof(optarg);
+                break;
+            case 'v':
+                motion.speed = atof(optarg);
+                break;
+            case 'a':
+                attitudeTolerance = atof(optarg);
+                break;
+            case 'p':
+                positionTolerance = atof(optarg);
+                break;
+            case 'n':
+                repeats = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (seconds <= 0 || repeats < 1) {
+        usage(argv[0]);
+    }
+
+    printf("%.0f sec of coning at %.1f rad/sec and %.1f Hz, yawing at up to %.1f rad/sec, moving at %.1f m/sec\n",
+            seconds, motion.coningRate, motion.coningHz, motion.yawRate, motion.speed);
+    printf("Tolerances: %.3g deg attitude, %.3g m position, over the whole flight\n\n", attitudeTolerance, positionTolerance);
+
+    printf("%8s  %-14s %9s %13s %11s\n", "rate_hz", "scheme", "ns/step", "max_att_deg", "max_pos_m");
+
+    for (float rate : RATES_HZ) {
+
+        float dt = 1 / rate;
+        uint32_t steps = (uint32_t)(seconds * rate + 0.5);
+
+        std::vector<reference_t> truth;
+        reference(motion, dt, steps, truth);
+
+        std::vector<float> gyro, translation;
+        sampleRates(motion, dt, steps, gyro, translation);
+
+        int cheapest = -1;
+        double cheapestNanos = 0;
+
+        for (int scheme=0; scheme<hf::INTEGRATOR_COUNT; ++scheme) {
+
+            hf::integrator_t integrator = (hf::integrator_t)scheme;
+
+            // Accuracy, checked after every step
+            hf::Pose pose;
+            pose.integrate(&gyro[0], &translation[0], 0, integrator);
+
+            double maxAttitude = 0, maxPosition = 0;
+
+            for (uint32_t k=0; k<steps; ++k) {
+                pose.integrate(&gyro[3*(k+1)], &translation[3*(k+1)], dt, integrator);
+                maxAttitude = fmax(maxAttitude, attitudeError(pose.orientation, truth[k]));
+                maxPosition = fmax(maxPosition, positionError(pose.position, truth[k]));
+            }
+
+            // Cost, best of several untimed-check runs
+            double best = INFINITY;
+            float sink = 0;
+
+            for (int r=0; r<repeats; ++r) {
+
+                hf::Pose timed;
+                timed.integrate(&gyro[0], &translation[0], 0, integrator);
+
+                double start = wallSeconds();
+                for (uint32_t k=0; k<steps; ++k) {
+                    timed.integrate(&gyro[3*(k+1)], &translation[3*(k+1)], dt, integrator);
+                }
+                best = fmin(best, wallSeconds() - start);
+
+                sink += timed.position[0] + timed.orientation.w;
+            }
+
+            double nanos = 1e9 * best / steps;
+
+            bool ok = maxAttitude <= attitudeTolerance && maxPosition <= positionTolerance;
+
+            printf("%8.0f  %-14s %9.1f %13.3g %11.3g%s\n", rate, hf::INTEGRATOR_NAMES[scheme], nanos,
+                    maxAttitude, maxPosition, ok ? "" : "  (out of tolerance)");
+
+            if (ok && (cheapest < 0 || nanos < cheapestNanos)) {
+                cheapest = scheme;
+                cheapestNanos = nanos;
+            }
+
+            // Keeps the timed runs from being optimized away
+            if (sink == 12345.f) {
+                printf(" ");
+            }
+        }
+
+        if (cheapest >= 0) {
+            printf("%8s  cheapest within tolerance at %.0f Hz: %s\n\n", "", rate, hf::INTEGRATOR_NAMES[cheapest]);
+        }
+        else {
+            printf("%8s  no scheme is within tolerance at %.0f Hz\n\n", "", rate);
+        }
+    }
+
+    return 0;
+}
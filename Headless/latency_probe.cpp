@@ -0,0 +1,175 @@
+/*
+   latency_probe.cpp: stick-to-motion latency of the simulator, without Unreal Engine
+
+   Runs one vehicle in real time, stepping the firmware in batches once per emulated frame as
+   the pawn does, while the latency probe steps a stick and follows the response.  Rendering is
+   taken to happen at the end of the frame; a real renderer adds its own frame or two.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "core/vehicle.hpp"
+#include "core/stepper.hpp"
+#include "core/scriptedreceiver.hpp"
+#include "core/stickmailbox.hpp"  // steadyNanos()
+#include "core/latencyprobe.hpp"
+
+#include <boards/sim/linux.hpp>
+
+// Same PID tuning as the pawn
+static const hf::Stabilizer STABILIZER = hf::Stabilizer(
+	0,//0.10f,      // Level P
+	.00001f,     // Gyro cyclic P
+	0,			// Gyro cyclic I
+	0,			// Gyro cyclic D
+	0,			// Gyro yaw P
+	0);			// Gyro yaw I
+
+void hf::Board::outbuf(char * buf)
+{
+    fputs(buf, stderr);
+}
+
+static const char * const CHANNELS[] = { "Throttle", "Roll", "Pitch", "Yaw" };
+
+static void sleepUntil(uint64_t nanos)
+{
+    uint64_t now = hf::steadyNanos();
+    if (nanos > now) {
+        struct timespec t;
+        t.tv_sec = (nanos - now) / 1000000000ull;
+        t.tv_nsec = (nanos - now) % 1000000000ull;
+        nanosleep(&t, nullptr);
+    }
+}
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "Usage: %s [-t SECONDS] [-f FRAMES_PER_SECOND (0 = one per step)] [-r FIRMWARE_HZ]\n", name);
+    fprintf(stderr, "       [-c CHANNEL (0 throttle, 1 roll, 2 pitch, 3 yaw)] [-a AMPLITUDE] [-p PERIOD_SECONDS] [-T THROTTLE]\n");
+    fprintf(stderr, "       [-m MOTOR_THRESHOLD] [-n MOTION_THRESHOLD (0 = measured before the first input)]\n");
+    exit(1);
+}
+
+int main(int argc, char ** argv)
+{
+    double seconds = 10;
+    double fps = 60;
+    float rate = 1000;
+    int channel = hf::STICK_THROTTLE;
+    float amplitude = 0.5f;
+    float period = 0.25f;
+    float throttle = 0;
+    float motorThreshold = 0;
+    float motionThreshold = 0;
+
+    int c;
+    while ((c = getopt(argc, argv, "t:f:r:c:a:p:T:m:n:")) != -1) {
+        switch (c) {
+            case 't':
+                seconds = atof(optarg);
+                break;
+            case 'f':
+                fps = atof(optarg);
+                break;
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 'c':
+                channel = atoi(optarg);
+                break;
+            case 'a':
+                amplitude = atof(optarg);
+                break;
+            case 'p':
+                period = atof(optarg);
+                break;
+            case 'T':
+                throttle = atof(optarg);
+                break;
+            case 'm':
+                motorThreshold = atof(optarg);
+                break;
+            case 'n':
+                motionThreshold = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (channel < hf::STICK_THROTTLE || channel > hf::STICK_YAW) {
+        usage(argv[0]);
+    }
+
+    hf::ScriptedReceiver receiver;
+    hf::SimVehicle vehicle(STABILIZER);
+    vehicle.init(&receiver);
+
+    hf::FixedStepper stepper(rate);
+    hf::LatencyProbe probe(channel, amplitude, period, throttle, motorThreshold, motionThreshold);
+
+    double frameSeconds = fps > 0 ? 1 / fps : 1 / rate;
+    uint64_t frames = (uint64_t)(seconds / frameSeconds);
+
+    uint64_t start = hf::steadyNanos();
+    probe.start(start);
+
+    for (uint64_t k=0; k<frames; ++k) {
+
+        sleepUntil(start + (uint64_t)(1e9 * k * frameSeconds));
+
+        stepper.advance(frameSeconds, [&](float dt) {
+            float sticks[hf::STICK_CHANNELS];
+            probe.beforeStep(hf::steadyNanos(), stepper.simSeconds(), sticks);
+            receiver.setSticks(sticks);
+            vehicle.step(dt);
+            probe.afterStep(hf::steadyNanos(), stepper.simSeconds() + dt, vehicle.motorValues,
+                    vehicle.gyroRates, vehicle.translationRates);
+        });
+
+        // The frame is done: anything it moved counts as shown now
+        uint32_t ticket = probe.renderTicket();
+        if (ticket) {
+            probe.rendered(ticket, hf::steadyNanos());
+        }
+    }
+
+    probe.poll();
+
+    if (fps > 0) {
+        printf("%s steps of %.2f every %.3f s, %.0f Hz firmware, %.0f frames/s\n", CHANNELS[channel], amplitude, period, rate, fps);
+    }
+    else {
+        printf("%s steps of %.2f every %.3f s, %.0f Hz firmware, one frame per step\n", CHANNELS[channel], amplitude, period, rate);
+    }
+
+    probe.dump(stdout);
+    fflush(stdout);
+
+    if (probe.completed() == 0) {
+        fprintf(stderr, "No input was followed through to motion; try another channel, a larger amplitude or lower thresholds\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+/*
+   pixels_bench.cpp: checks and times the vision pixel conversions
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/pixels.hpp"
+
+typedef void (*convert_t)(const uint8_t * bgra, uint8_t * out, size_t pixels);
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// The HUD's original loop: column-major, so consecutive reads are a whole row apart
+static int columnCols;
+static int columnRows;
+
+static void bgraToRgbColumnMajor(const uint8_t * bgra, uint8_t * rgb, size_t pixels)
+{
+    (void)pixels;
+
+    for (int x = 0; x < columnCols; ++x) {
+        for (int y = 0; y < columnRows; ++y) {
+            int k = x + y * columnCols;
+            rgb[k * 3]     = bgra[k * 4 + 2];
+            rgb[k * 3 + 1] = bgra[k * 4 + 1];
+            rgb[k * 3 + 2] = bgra[k * 4];
+        }
+    }
+}
+
+// Keeps the optimizer from collapsing repeated conversions of the same frame
+static void clobber(void * p)
+{
+    asm volatile("" : : "g"(p) : "memory");
+}
+
+// Returns milliseconds per frame
+static double timeConversion(convert_t convert, const uint8_t * bgra, uint8_t * out, size_t pixels)
+{
+    int frames = (int)(2e8 / pixels) + 1;
+
+    // Once untimed, so that whichever version goes first is not charged for a cold cache
+    convert(bgra, out, pixels);
+
+    double start = wallSeconds();
+    for (int k=0; k<frames; ++k) {
+        convert(bgra, out, pixels);
+        clobber(out);
+    }
+    return 1e3 * (wallSeconds() - start) / frames;
+}
+
+static bool compare(const char * name, convert_t reference, convert_t fast,
+        const uint8_t * bgra, uint8_t * a, uint8_t * b, size_t pixels, size_t outBytes,
+        int cols, int rows)
+{
+    memset(a, 0, outBytes);
+    memset(b, 0, outBytes);
+
+    reference(bgra, a, pixels);
+    fast(bgra, b, pixels);
+
+    bool same = memcmp(a, b, outBytes) == 0;
+
+    double slow = timeConversion(reference, bgra, a, pixels);
+    double quick = timeConversion(fast, bgra, b, pixels);
+
+    printf("%4dx%-4d %-9s reference %7.4f ms  fast %7.4f ms  speedup x%5.2f  %s\n",
+            cols, rows, name, slow, quick, slow/quick, same ? "match" : "MISMATCH");
+
+    return same;
+}
+
+int main(int argc, char ** argv)
+{
+    static const int SIZES[][2] = { {256, 128}, {640, 480}, {1280, 720}, {1920, 1080}, {257, 129} };
+
+    bool ok = true;
+
+    for (unsigned s=0; s<sizeof(SIZES)/sizeof(SIZES[0]); ++s) {
+
+        int cols = SIZES[s][0];
+        int rows = SIZES[s][1];
+        size_t pixels = (size_t)rows * cols;
+
+        uint8_t * bgra = new uint8_t[4*pixels];
+        uint8_t * a = new uint8_t[3*pixels];
+        uint8_t * b = new uint8_t[3*pixels];
+
+        srand(s);
+        for (size_t k=0; k<4*pixels; ++k) {
+            bgra[k] = (uint8_t)rand();
+        }
+
+        columnCols = cols;
+        columnRows = rows;
+
+        ok &= compare("rgb-cols", bgraToRgbColumnMajor, hf::bgraToRgb, bgra, a, b, pixels, 3*pixels, cols, rows);
+        ok &= compare("rgb",    hf::bgraToRgbScalar,    hf::bgraToRgb,    bgra, a, b, pixels, 3*pixels, cols, rows);
+        ok &= compare("gray",   hf::bgraToGrayScalar,   hf::bgraToGray,   bgra, a, b, pixels, pixels,   cols, rows);
+        ok &= compare("planar", hf::bgraToPlanarScalar, hf::bgraToPlanar, bgra, a, b, pixels, 3*pixels, cols, rows);
+
+        delete[] bgra;
+        delete[] a;
+        delete[] b;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/*
+   readback_bench.cpp: exercises the vision readback pipeline with a synthetic, GPU-free
+   frame source, checking frame ordering and tags and reporting latency and cost
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <vector>
+
+#include "core/readback.hpp"
+#include "core/pixels.hpp"
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char ** argv)
+{
+    int rows = 128;
+    int cols = 256;
+    uint32_t depth = 3;
+    uint32_t latency = 2;
+    uint32_t frames = 10000;
+
+    int c;
+    while ((c = getopt(argc, argv, "d:l:n:")) != -1) {
+        switch (c) {
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 'l':
+                latency = atoi(optarg);
+                break;
+            case 'n':
+                frames = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-d DEPTH] [-l LATENCY_FRAMES] [-n FRAMES]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    hf::SyntheticFrameSource source(rows, cols, latency);
+    hf::ReadbackPipeline pipeline(&source, depth);
+
+    std::vector<uint8_t> rgb(3 * rows * cols);
+
+    // Capture index for each requested frame, so we can check that pixels match their tags
+    std::vector<int64_t> captureOf(frames, -1);
+    int64_t captures = 0;
+
+    uint64_t lastFrame = 0;
+    uint64_t latencySum = 0;
+    uint64_t errors = 0;
+
+    double start = wallSeconds();
+
+    for (uint32_t n=0; n<frames; ++n) {
+
+        if (pipeline.request(n, n / 60.0)) {
+            captureOf[n] = captures++;
+        }
+
+        hf::readback_frame_t frame;
+
+        if (pipeline.pollLatest(frame)) {
+
+            hf::bgraToRgb(frame.bgra, &rgb[0], rows*cols);
+
+            bool ordered = pipeline.delivered() == 1 || frame.frameNumber > lastFrame;
+            bool tagged = rgb[0] == (uint8_t)captureOf[frame.frameNumber] && frame.simSeconds == frame.frameNumber / 60.0;
+
+            errors += !(ordered && tagged);
+
+            latencySum += n - frame.frameNumber;
+            lastFrame = frame.frameNumber;
+        }
+
+        source.tick();
+    }
+
+    double elapsed = wallSeconds() - start;
+
+    printf("%ux%u frames, depth %u, source latency %u frames\n", cols, rows, pipeline.depth(), latency);
+    printf("requested %u  delivered %llu  skipped %llu  superseded %llu  errors %llu\n",
+            frames, (unsigned long long)pipeline.delivered(), (unsigned long long)pipeline.skipped(),
+            (unsigned long long)pipeline.superseded(), (unsigned long long)errors);
+    printf("mean latency %.2f frames  game-thread cost %.4f ms/frame\n",
+            pipeline.delivered() ? latencySum / (double)pipeline.delivered() : 0, 1e3 * elapsed / frames);
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+/*
+   reset_bench.cpp: times episode resets by restoring a vehicle snapshot, against restarting
+   the firmware, and checks that restored episodes repeat exactly and allocate nothing
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <atomic>
+#include <new>
+
+#include "core/vehicle.hpp"
+#include "core/scriptedreceiver.hpp"
+
+#include <boards/sim/linux.hpp>
+
+// Same PID tuning as the pawn
+static const hf::Stabilizer STABILIZER = hf::Stabilizer(
+	0,//0.10f,      // Level P
+	.00001f,     // Gyro cyclic P
+	0,			// Gyro cyclic I
+	0,			// Gyro cyclic D
+	0,			// Gyro yaw P
+	0);			// Gyro yaw I
+
+void hf::Board::outbuf(char * buf)
+{
+    fputs(buf, stderr);
+}
+
+// Counts every heap allocation in the program
+static std::atomic<uint64_t> allocations(0);
+
+void * operator new(size_t size)
+{
+    ++allocations;
+    void * p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+    free(p);
+}
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Flies one episode of deterministic pseudo-random sticks; returns a hash of every pose
+static uint64_t episode(hf::SimVehicle & vehicle, hf::ScriptedReceiver & receiver, uint32_t steps, float dt)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    uint32_t seed = 12345;
+
+    for (uint32_t k=0; k<steps; ++k) {
+
+        for (uint8_t c=0; c<4; ++c) {
+            seed = seed * 1664525u + 1013904223u;
+            receiver.setStick(c, (seed >> 8) / 8388608.f - 1);
+        }
+
+        vehicle.step(dt);
+
+        const uint8_t * bytes = (const uint8_t *)vehicle.pose.position;
+        for (size_t j=0; j<sizeof(vehicle.pose.position); ++j) {
+            hash = (hash ^ bytes[j]) * 0x100000001b3ull;
+        }
+    }
+
+    return hash;
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t resets = 1000000;
+    uint32_t steps = 200;
+    uint32_t episodes = 10000;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:s:e:")) != -1) {
+        switch (c) {
+            case 'n':
+                resets = atoi(optarg);
+                break;
+            case 's':
+                steps = atoi(optarg);
+                break;
+            case 'e':
+                episodes = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n RESETS] [-e EPISODES] [-s STEPS_PER_EPISODE]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    const float dt = 0.001f;
+
+    hf::ScriptedReceiver receiver;
+    hf::SimVehicle vehicle(STABILIZER);
+    vehicle.init(&receiver);
+
+    // Capture once, up front
+    hf::VehicleSnapshot start(vehicle);
+
+    // Restored episodes must repeat the first one exactly
+    uint64_t first = episode(vehicle, receiver, steps, dt);
+    vehicle.restore(start);
+    uint64_t second = episode(vehicle, receiver, steps, dt);
+
+    // Restarting the firmware instead leaves the board's dynamics where the crash left them
+    vehicle.init(&receiver);
+    vehicle.pose = hf::Pose();
+    uint64_t restarted = episode(vehicle, receiver, steps, dt);
+
+    printf("episode hash: first %016llx  restored %016llx (%s)  restarted firmware %016llx (%s)\n",
+            (unsigned long long)first, (unsigned long long)second, first == second ? "same" : "DIFFERENT",
+            (unsigned long long)restarted, first == restarted ? "same" : "different");
+
+    uint64_t allocationsBefore = allocations;
+
+    double t = wallSeconds();
+    for (uint32_t k=0; k<resets; ++k) {
+        vehicle.restore(start);
+    }
+    double restoreSeconds = wallSeconds() - t;
+
+    t = wallSeconds();
+    for (uint32_t k=0; k<resets; ++k) {
+        vehicle.init(&receiver);
+        vehicle.pose = hf::Pose();
+    }
+    double initSeconds = wallSeconds() - t;
+
+    t = wallSeconds();
+    for (uint32_t k=0; k<episodes; ++k) {
+        vehicle.restore(start);
+        episode(vehicle, receiver, steps, dt);
+    }
+    double episodeSeconds = wallSeconds() - t;
+
+    uint64_t allocated = allocations - allocationsBefore;
+
+    printf("snapshot: %d bytes\n", (int)sizeof(hf::VehicleSnapshot));
+    printf("restore: %.3f usec/reset (%.0f resets/s)  firmware restart: %.3f usec/reset\n",
+            1e6 * restoreSeconds / resets, resets / restoreSeconds, 1e6 * initSeconds / resets);
+    printf("episodes of %u steps with restore: %.0f episodes/s\n", steps, episodes / episodeSeconds);
+    printf("heap allocations while resetting: %llu\n", (unsigned long long)allocated);
+
+    return first == second && allocated == 0 ? 0 : 1;
+}
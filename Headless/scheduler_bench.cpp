@@ -0,0 +1,250 @@
+/*
+   scheduler_bench.cpp: determinism and overhead of the multi-rate scheduler, without Unreal
+   Engine
+
+   Flies one vehicle with the firmware at the base rate, telemetry at 100 Hz, audio at 20 Hz
+   and a vision task at 30 Hz whose work runs on a worker thread.  The vision task renders a
+   bright target from the vehicle's heading and steers the yaw stick toward it, closing the
+   loop through the worker.  The flight is flown again with random wall-clock delays in the
+   worker, and must come out identical.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include <random>
+#include <vector>
+
+#include "core/vehicle.hpp"
+#include "core/scriptedreceiver.hpp"
+#include "core/vision.hpp"
+#include "core/scheduler.hpp"
+
+#include <boards/sim/linux.hpp>
+
+// Same PID tuning as the pawn
+static const hf::Stabilizer STABILIZER = hf::Stabilizer(
+	0,//0.10f,      // Level P
+	.00001f,     // Gyro cyclic P
+	0,			// Gyro cyclic I
+	0,			// Gyro cyclic D
+	0,			// Gyro yaw P
+	0);			// Gyro yaw I
+
+void hf::Board::outbuf(char * buf)
+{
+    fputs(buf, stderr);
+}
+
+static const int ROWS = 120;
+static const int COLS = 160;
+
+// Target bearing, radians from the starting heading, and camera field of view
+static const float TARGET_BEARING = 0.5f;
+static const float FIELD_OF_VIEW = 1.5f;
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void hash(uint64_t & h, const void * data, size_t size)
+{
+    const uint8_t * bytes = (const uint8_t *)data;
+    for (size_t k=0; k<size; ++k) {
+        h = (h ^ bytes[k]) * 0x100000001b3ull;
+    }
+}
+
+typedef struct {
+
+    uint64_t telemetryHash;
+    uint64_t audioHash;
+    uint64_t visionRuns;
+    uint64_t stalls;
+    float    finalHeading;
+    double   wallSeconds;
+
+} flight_t;
+
+static flight_t fly(float rateHz, float seconds, float visionLatency, float jitterMillis)
+{
+    hf::ScriptedReceiver receiver;
+    hf::SimVehicle vehicle(STABILIZER);
+    vehicle.init(&receiver);
+
+    float sticks[hf::STICK_CHANNELS] = {-1, 0, 0, 0, 0};
+
+    flight_t flight = flight_t();
+    flight.telemetryHash = 0xcbf29ce484222325ull;
+    flight.audioHash = 0xcbf29ce484222325ull;
+
+    // Vision inputs and outputs, owned by the task
+    hf::Quaternion visionPose = hf::Quaternion::identity();
+    std::vector<uint8_t> frame(ROWS * COLS * 3);
+    hf::BrightCentroid centroid;
+    std::mt19937 jitter(std::random_device{}());
+
+    hf::Scheduler scheduler(rateHz);
+
+    scheduler.add("firmware", rateHz, 0, [&](float dt) {
+        double t = scheduler.stepCount() / rateHz;
+        sticks[hf::STICK_THROTTLE] = t < 1 ? -1 : t < 3 ? 0.2f : 0;
+        receiver.setSticks(sticks);
+        vehicle.step(dt);
+    });
+
+    int vision = scheduler.addWorker("vision", 30, 0, visionLatency,
+
+            // Copies the pose on the scheduler's thread
+            [&](float) { visionPose = vehicle.pose.orientation; },
+
+            // Renders the target where the camera would see it and finds it, on the worker
+            [&]() {
+                const hf::Quaternion & q = visionPose;
+                float heading = atan2f(2 * (q.w*q.z + q.x*q.y), 1 - 2 * (q.y*q.y + q.z*q.z));
+                int column = (int)(COLS/2 + (TARGET_BEARING - heading) / FIELD_OF_VIEW * COLS);
+                memset(frame.data(), 0, frame.size());
+                for (int y=ROWS/2-4; y<ROWS/2+4; ++y) {
+                    for (int x=column-4; x<column+4; ++x) {
+                        if (x >= 0 && x < COLS) {
+                            memset(&frame[3 * (y*COLS + x)], 255, 3);
+                        }
+                    }
+                }
+                hf::vision_frame_t f = { 0, 0, ROWS, COLS, frame.data() };
+                centroid.process(f);
+                if (jitterMillis > 0) {
+                    usleep((useconds_t)(std::uniform_real_distribution<float>(0, 1000 * jitterMillis)(jitter)));
+                }
+            },
+
+            // Steers toward the target on the scheduler's thread
+            [&](float) {
+                hf::vision_centroid_t c;
+                if (centroid.result.read(c) && c.count > 0) {
+                    sticks[hf::STICK_YAW] = (c.x - COLS/2) / (COLS/2);
+                }
+            });
+
+    scheduler.add("telemetry", 100, 0, [&](float) {
+        hash(flight.telemetryHash, vehicle.pose.position, sizeof(vehicle.pose.position));
+        hash(flight.telemetryHash, &vehicle.pose.orientation, sizeof(vehicle.pose.orientation));
+    });
+
+    scheduler.add("audio", 20, 0.0005f, [&](float) {
+        float level = (vehicle.motorValues[0] + vehicle.motorValues[1] + vehicle.motorValues[2] + vehicle.motorValues[3]) / 4;
+        hash(flight.audioHash, &level, sizeof(level));
+    });
+
+    uint64_t steps = (uint64_t)(seconds * rateHz);
+
+    double start = wallSeconds();
+    for (uint64_t k=0; k<steps; ++k) {
+        scheduler.step();
+    }
+    scheduler.drain();
+    flight.wallSeconds = wallSeconds() - start;
+
+    const hf::Quaternion & q = vehicle.pose.orientation;
+    flight.finalHeading = atan2f(2 * (q.w*q.z + q.x*q.y), 1 - 2 * (q.y*q.y + q.z*q.z));
+    flight.visionRuns = scheduler.runs(vision);
+    flight.stalls = scheduler.stalls(vision);
+
+    return flight;
+}
+
+// Scheduler cost per base step with the given number of trivial tasks at assorted rates
+static double overhead(float rateHz, int tasks)
+{
+    hf::Scheduler scheduler(rateHz);
+    volatile uint64_t count = 0;
+
+    static const float RATES[] = { 1000, 500, 100, 30, 20, 1 };
+
+    for (int k=0; k<tasks; ++k) {
+        scheduler.add("task", RATES[k % 6], 0, [&](float) { count = count + 1; });
+    }
+
+    static const uint32_t STEPS = 2000000;
+    double start = wallSeconds();
+    for (uint32_t k=0; k<STEPS; ++k) {
+        scheduler.step();
+    }
+    return 1e9 * (wallSeconds() - start) / STEPS;
+}
+
+int main(int argc, char ** argv)
+{
+    float rateHz = 1000;
+    float seconds = 20;
+    float latency = 1.f / 30;
+    float jitterMillis = 30;
+
+    int c;
+    while ((c = getopt(argc, argv, "r:s:l:j:")) != -1) {
+        switch (c) {
+            case 'r':
+                rateHz = atof(optarg);
+                break;
+            case 's':
+                seconds = atof(optarg);
+                break;
+            case 'l':
+                latency = atof(optarg);
+                break;
+            case 'j':
+                jitterMillis = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r BASE_HZ] [-s SECONDS] [-l VISION_LATENCY_SECONDS] [-j WORKER_JITTER_MS]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (rateHz <= 0 || seconds <= 0) {
+        fprintf(stderr, "Rate and duration must be positive\n");
+        return 1;
+    }
+
+    flight_t steady = fly(rateHz, seconds, latency, 0);
+    flight_t jittery = fly(rateHz, seconds, latency, jitterMillis);
+
+    for (const flight_t * f : { &steady, &jittery }) {
+        printf("%s: %.2f sec wall, heading %+.4f rad (target %+.4f), %lu vision runs, %lu late joins, "
+                "telemetry %016llx, audio %016llx\n", f == &steady ? "steady " : "jittery", f->wallSeconds,
+                f->finalHeading, TARGET_BEARING, (unsigned long)f->visionRuns, (unsigned long)f->stalls,
+                (unsigned long long)f->telemetryHash, (unsigned long long)f->audioHash);
+    }
+
+    bool same = steady.telemetryHash == jittery.telemetryHash && steady.audioHash == jittery.audioHash;
+    printf("%s with up to %.0f ms of worker jitter\n\n", same ? "Identical" : "DIFFERENT", jitterMillis);
+
+    for (int tasks : { 1, 4, 16 }) {
+        printf("%2d tasks: %.1f ns per base step\n", tasks, overhead(rateHz, tasks));
+    }
+
+    return same ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+/*
+   shm_bench.cpp: loopback benchmark for the shared-memory vision frame ring.  A child
+   process maps the ring read-only and follows the frames that this process publishes,
+   reporting throughput and the delay from publication to pickup.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "core/shmring.hpp"
+#include "core/pixels.hpp"
+
+static const char * SEGMENT = "/hackflight_shm_bench";
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Follows the ring until the given number of frames has been published; returns nonzero on error
+static int follow(uint64_t frames, int rows, int cols)
+{
+    hf::ShmRingReader reader;
+
+    if (!reader.open(SEGMENT)) {
+        fprintf(stderr, "reader: unable to open %s\n", SEGMENT);
+        return 1;
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(frames);
+
+    uint64_t next = 0;
+    uint64_t missed = 0;
+    uint64_t torn = 0;
+    uint64_t errors = 0;
+
+    while (next < frames) {
+
+        uint64_t published = reader.published();
+
+        if (published == next) {
+            sched_yield();
+            continue;
+        }
+
+        // Frames published faster than we could follow are skipped, like a slow consumer would
+        if (published > next + 1) {
+            missed += published - next - 1;
+        }
+        next = published;
+
+        const hf::shm_frame_header_t * frame = nullptr;
+        const uint8_t * pixels = nullptr;
+        uint64_t lock = reader.get(published-1, &frame, &pixels);
+
+        double latency = (hf::monotonicNanos() - frame->monotonicNanos) / 1e3;
+
+        // Check the pixels in place against the pattern the writer used
+        uint8_t expected = (uint8_t)frame->frameNumber;
+        bool match = pixels[0] == expected && pixels[3*rows*cols-1] == expected;
+
+        if (!reader.valid(frame, lock)) {
+            ++torn;
+            continue;
+        }
+
+        if (!match) {
+            ++errors;
+        }
+
+        latencies.push_back(latency);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    size_t n = latencies.size();
+
+    printf("Reader: %llu frames picked up, %llu skipped, %llu overwritten while read, %llu pixel errors\n",
+            (unsigned long long)n, (unsigned long long)missed, (unsigned long long)torn,
+            (unsigned long long)errors);
+
+    if (n > 0) {
+        printf("Latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+                latencies[n/2], latencies[n*99/100], latencies[n-1]);
+    }
+
+    return errors > 0;
+}
+
+int main(int argc, char ** argv)
+{
+    int rows = 128;
+    int cols = 256;
+    uint32_t slots = 4;
+    uint64_t frames = 10000;
+    double rate = 1000;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:r:s:w:h:")) != -1) {
+        switch (c) {
+            case 'n':
+                frames = strtoull(optarg, nullptr, 10);
+                break;
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 's':
+                slots = atoi(optarg);
+                break;
+            case 'w':
+                cols = atoi(optarg);
+                break;
+            case 'h':
+                rows = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n FRAMES] [-r RATE_HZ (0 = flat out)] [-s SLOTS] [-w WIDTH] [-h HEIGHT]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    hf::ShmRingWriter writer;
+
+    if (!writer.open(SEGMENT, slots, rows, cols)) {
+        fprintf(stderr, "Unable to create %s\n", SEGMENT);
+        return 1;
+    }
+
+    pid_t child = fork();
+
+    if (child == 0) {
+        exit(follow(frames, rows, cols));
+    }
+
+    // Give the reader a moment to map the ring before we start timing
+    usleep(100000);
+
+    std::vector<uint8_t> bgra(4 * rows * cols);
+
+    float position[3] = { 0, 0, 0 };
+    float orientation[4] = { 0, 0, 0, 1 };
+
+    double publishSeconds = 0;
+    double start = wallSeconds();
+
+    for (uint64_t k=0; k<frames; ++k) {
+
+        if (rate > 0) {
+            while (wallSeconds() - start < k / rate) {
+                sched_yield();
+            }
+        }
+
+        std::fill(bgra.begin(), bgra.end(), (uint8_t)k);
+        position[2] = k / 1000.f;
+
+        double t = wallSeconds();
+        hf::bgraToRgb(bgra.data(), writer.begin(), rows*cols);
+        writer.commit(k, k / 1000., position, orientation);
+        publishSeconds += wallSeconds() - t;
+    }
+
+    double elapsed = wallSeconds() - start;
+
+    int status = 0;
+    waitpid(child, &status, 0);
+
+    double megabytes = frames * 3. * rows * cols / 1e6;
+
+    printf("Writer: %llu %dx%d frames in %.3f s (%.0f frames/s, %.0f MB/s), %.2f us to convert and publish each\n",
+            (unsigned long long)frames, cols, rows, elapsed, frames / elapsed, megabytes / elapsed,
+            1e6 * publishSeconds / frames);
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
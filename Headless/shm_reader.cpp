@@ -0,0 +1,101 @@
+/*
+   shm_reader.cpp: reference reader for the vision frames that HackflightSim exports to
+   shared memory.  Prints each new frame's tags and how long after publication it was seen.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "core/shmring.hpp"
+
+int main(int argc, char ** argv)
+{
+    const char * name = "/hackflight_vision";
+    uint64_t count = 0;
+
+    int c;
+    while ((c = getopt(argc, argv, "s:n:")) != -1) {
+        switch (c) {
+            case 's':
+                name = optarg;
+                break;
+            case 'n':
+                count = strtoull(optarg, nullptr, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s SEGMENT] [-n FRAMES]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    hf::ShmRingReader reader;
+
+    // Wait for the simulator to create the segment
+    while (!reader.open(name)) {
+        usleep(100000);
+    }
+
+    const hf::shm_ring_header_t * ring = reader.ring();
+    printf("%s: %u slots of %ux%ux%u\n", name, ring->slots, ring->rows, ring->cols, ring->channels);
+
+    uint64_t seen = 0;
+    uint64_t last = reader.published();
+
+    while (count == 0 || seen < count) {
+
+        uint64_t published = reader.published();
+
+        if (published == last) {
+            usleep(500);
+            continue;
+        }
+
+        last = published;
+
+        const hf::shm_frame_header_t * frame = nullptr;
+        const uint8_t * pixels = nullptr;
+        uint64_t lock = reader.latest(&frame, &pixels);
+
+        // Use the pixels in place: here, the brightness of the center pixel
+        uint32_t center = 3 * (ring->rows/2 * ring->cols + ring->cols/2);
+        uint32_t brightness = pixels ? pixels[center] + pixels[center+1] + pixels[center+2] : 0;
+
+        // Copy out the tags, then make sure the writer didn't lap us while we read
+        uint64_t sequence = frame ? frame->sequence : 0;
+        uint64_t frameNumber = frame ? frame->frameNumber : 0;
+        double simSeconds = frame ? frame->simSeconds : 0;
+        uint64_t latency = frame ? hf::monotonicNanos() - frame->monotonicNanos : 0;
+        float x = frame ? frame->position[0] : 0;
+        float y = frame ? frame->position[1] : 0;
+        float z = frame ? frame->position[2] : 0;
+
+        if (!reader.valid(frame, lock)) {
+            continue;
+        }
+
+        printf("#%llu frame %llu t=%.3fs pos=(%+.2f,%+.2f,%+.2f) center=%u latency=%.1fus\n",
+                (unsigned long long)sequence, (unsigned long long)frameNumber, simSeconds,
+                x, y, z, brightness, latency / 1e3);
+
+        ++seen;
+    }
+
+    return 0;
+}
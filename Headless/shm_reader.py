@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+'''
+shm_reader.py: reference Python reader for the vision frames that HackflightSim exports
+to shared memory.  Needs NumPy; add OpenCV to display the frames.
+
+Copyright (C) Simon D. Levy 2017
+
+This file is part of HackflightSim.
+
+HackflightSim is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HackflightSim is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import mmap
+import os
+import struct
+import sys
+import time
+
+import numpy as np
+
+# Must match core/shmring.hpp
+MAGIC = 0x48465652
+VERSION = 1
+RING_HEADER_BYTES = 256
+FRAME_HEADER_BYTES = 128
+RING_HEADER = struct.Struct('<8IQ')
+FRAME_HEADER = struct.Struct('<QQQdQ3f4f2I')
+
+
+class NotReadyError(Exception):
+    '''The segment exists but its writer has not finished setting it up.'''
+
+
+class ShmRingReader:
+
+    def __init__(self, name='/hackflight_vision'):
+
+        with open('/dev/shm/' + name.lstrip('/'), 'rb') as f:
+            size = os.fstat(f.fileno()).st_size
+            if size < RING_HEADER_BYTES:
+                raise NotReadyError(name)
+            self.mem = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+        (magic, version, self.slots, self.slotBytes, self.rows, self.cols,
+         self.channels, _, _) = RING_HEADER.unpack_from(self.mem, 0)
+
+        if magic == 0:
+            raise NotReadyError(name)
+
+        if magic != MAGIC or version != VERSION:
+            raise ValueError('%s is not a HackflightSim vision ring' % name)
+
+        # Slots are read at offsets taken from the header, so a short segment would fault or misread
+        needed = RING_HEADER_BYTES + self.slots * self.slotBytes
+        if len(self.mem) < needed:
+            raise ValueError('%s maps %d bytes, but its header describes %d slots of %d bytes (%d in all)' %
+                             (name, len(self.mem), self.slots, self.slotBytes, needed))
+
+        if self.slotBytes < FRAME_HEADER_BYTES + self.rows * self.cols * self.channels:
+            raise ValueError('%s has %d-byte slots, too small for %dx%dx%d frames' %
+                             (name, self.slotBytes, self.rows, self.cols, self.channels))
+
+    def published(self):
+        return RING_HEADER.unpack_from(self.mem, 0)[8]
+
+    def latest(self):
+        '''
+        Returns (sequence, frameNumber, simSeconds, monotonicNanos, position, orientation, image)
+        for the newest frame, or None.  The image is a view of shared memory, not a copy;
+        call valid() after using it.
+        '''
+        count = self.published()
+        if count == 0:
+            return None
+
+        sequence = count - 1
+        offset = RING_HEADER_BYTES + (sequence % self.slots) * self.slotBytes
+        fields = FRAME_HEADER.unpack_from(self.mem, offset)
+
+        if fields[0] != 2 * sequence + 2:
+            return None
+
+        image = np.frombuffer(self.mem, np.uint8, self.rows*self.cols*self.channels,
+                              offset + FRAME_HEADER_BYTES).reshape(self.rows, self.cols, self.channels)
+
+        self.lock = fields[0]
+        self.offset = offset
+
+        return fields[1], fields[2], fields[3], fields[4], fields[5:8], fields[8:12], image
+
+    def valid(self):
+        return struct.unpack_from('<Q', self.mem, self.offset)[0] == self.lock
+
+
+if __name__ == '__main__':
+
+    name = sys.argv[1] if len(sys.argv) > 1 else '/hackflight_vision'
+
+    while True:
+        try:
+            reader = ShmRingReader(name)
+            break
+        except (FileNotFoundError, NotReadyError):
+            time.sleep(0.1)
+
+    last = 0
+
+    while True:
+
+        if reader.published() == last:
+            time.sleep(0.001)
+            continue
+
+        last = reader.published()
+
+        frame = reader.latest()
+        if frame is None:
+            continue
+
+        sequence, frameNumber, simSeconds, stamp, position, _, image = frame
+        brightness = image.mean()
+
+        if reader.valid():
+            print('#%d frame %d t=%.3fs pos=(%+.2f,%+.2f,%+.2f) mean=%.1f' %
+                  ((sequence, frameNumber, simSeconds) + tuple(position) + (brightness,)))
@@ -0,0 +1,179 @@
+/*
+   stick_bench.cpp: measures how old external stick input is when the firmware first uses it
+
+   A child process sends timestamped stick samples through the mailbox at one rate, while
+   this process plays the simulator, reading the mailbox once per fixed step at another.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "core/stickmailbox.hpp"
+
+static const char * MAILBOX = "/hackflight_stick_bench";
+
+// Sleeps until the given steady-clock time, or spins when the rate is flat out
+static void waitUntil(uint64_t nanos, bool spin)
+{
+    if (spin) {
+        while (hf::steadyNanos() < nanos) {
+            sched_yield();
+        }
+        return;
+    }
+
+    uint64_t now = hf::steadyNanos();
+    if (nanos > now) {
+        struct timespec t;
+        t.tv_sec = (nanos - now) / 1000000000ull;
+        t.tv_nsec = (nanos - now) % 1000000000ull;
+        nanosleep(&t, nullptr);
+    }
+}
+
+static int send(double seconds, double rate)
+{
+    hf::StickMailboxSender sender;
+
+    if (!sender.open(MAILBOX)) {
+        fprintf(stderr, "sender: unable to open %s\n", MAILBOX);
+        return 1;
+    }
+
+    uint64_t start = hf::steadyNanos();
+    uint64_t samples = (uint64_t)(seconds * rate);
+
+    for (uint64_t k=0; k<samples; ++k) {
+
+        waitUntil(start + (uint64_t)(1e9 * k / rate), false);
+
+        // A slow throttle ramp, so each sample differs
+        float sticks[hf::STICK_CHANNELS] = { (float)k / samples, 0, 0, 0, 0 };
+        sender.send(sticks);
+    }
+
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    double seconds = 5;
+    double sendRate = 500;
+    double stepRate = 1000;
+
+    int c;
+    while ((c = getopt(argc, argv, "t:s:r:")) != -1) {
+        switch (c) {
+            case 't':
+                seconds = atof(optarg);
+                break;
+            case 's':
+                sendRate = atof(optarg);
+                break;
+            case 'r':
+                stepRate = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-t SECONDS] [-s SEND_RATE_HZ] [-r STEP_RATE_HZ (0 = flat out)]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    hf::StickMailboxReader reader;
+
+    if (!reader.open(MAILBOX)) {
+        fprintf(stderr, "Unable to create %s\n", MAILBOX);
+        return 1;
+    }
+
+    pid_t child = fork();
+
+    if (child == 0) {
+        exit(send(seconds, sendRate));
+    }
+
+    std::vector<double> ages;
+    ages.reserve((size_t)(seconds * sendRate));
+
+    uint64_t start = hf::steadyNanos();
+    uint64_t steps = 0;
+    uint64_t fresh = 0;
+    uint64_t received = 0;
+
+    // Step until the sender has finished, then once more to see its last sample
+    int status = 0;
+    bool sending = true;
+    bool last = false;
+    while (!last) {
+
+        last = !sending;
+
+        if (stepRate > 0) {
+            waitUntil(start + (uint64_t)(1e9 * steps / stepRate), false);
+        }
+        else {
+            sched_yield();
+        }
+
+        float sticks[hf::STICK_CHANNELS];
+        if (reader.read(sticks)) {
+            ++fresh;
+        }
+        ++steps;
+
+        if (reader.received() != received) {
+            received = reader.received();
+            ages.push_back(reader.lastAgeNanos() / 1e3);
+        }
+
+        if (sending && waitpid(child, &status, WNOHANG) == child) {
+            sending = false;
+        }
+    }
+
+    std::sort(ages.begin(), ages.end());
+
+    size_t n = ages.size();
+    uint64_t sent = reader.lastSequence();
+
+    printf("Sender: %llu samples at %.0f Hz; simulator: %llu steps at %s, %llu with fresh input\n",
+            (unsigned long long)sent, sendRate, (unsigned long long)steps,
+            stepRate > 0 ? "fixed rate" : "flat out", (unsigned long long)fresh);
+
+    printf("Used: %llu samples, %llu superseded before a step saw them\n",
+            (unsigned long long)n, (unsigned long long)(sent - n));
+
+    if (n > 0) {
+        printf("Input age at first use: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+                ages[n/2], ages[n*99/100], ages[n-1]);
+    }
+
+    if (HF_TIMING) {
+        hf::Timing::instance().dump(stdout);
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
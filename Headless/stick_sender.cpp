@@ -0,0 +1,117 @@
+/*
+   stick_sender.cpp: flies a simulated vehicle from another process, through its stick mailbox
+
+   Sends each line of standard input ("throttle roll pitch yaw aux", each in [-1,+1]) as it
+   arrives, so scripts and autopilots can pipe commands in; or, with -p, replays a recorded
+   input log in real time.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "core/stickmailbox.hpp"
+#include "core/inputlog.hpp"
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "Usage: %s [-p INPUT_LOG] MAILBOX\n", name);
+    fprintf(stderr, "       e.g. %s /hackflight_sticks_HackflightSimVehicle_1 < sticks.txt\n", name);
+    exit(1);
+}
+
+static int replay(hf::StickMailboxSender & sender, const char * path)
+{
+    hf::InputPlayer player;
+
+    if (!player.open(path)) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 1;
+    }
+
+    // Each sample is sent when its step would start, on the log's own clock
+    uint64_t start = hf::steadyNanos();
+    double elapsed = 0;
+
+    hf::input_record_t input;
+    while (player.next(input)) {
+
+        uint64_t due = start + (uint64_t)(1e9 * elapsed);
+        uint64_t now = hf::steadyNanos();
+        if (due > now) {
+            struct timespec t;
+            t.tv_sec = (due - now) / 1000000000ull;
+            t.tv_nsec = (due - now) % 1000000000ull;
+            nanosleep(&t, nullptr);
+        }
+
+        sender.send(input.sticks);
+        elapsed += input.dt;
+    }
+
+    printf("Sent %llu samples over %.1f s\n", (unsigned long long)sender.sent(), elapsed);
+
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    const char * logPath = nullptr;
+
+    int c;
+    while ((c = getopt(argc, argv, "p:")) != -1) {
+        switch (c) {
+            case 'p':
+                logPath = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc-1) {
+        usage(argv[0]);
+    }
+
+    hf::StickMailboxSender sender;
+
+    if (!sender.open(argv[optind])) {
+        fprintf(stderr, "Unable to open %s; is the simulator running?\n", argv[optind]);
+        return 1;
+    }
+
+    if (logPath) {
+        return replay(sender, logPath);
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), stdin)) {
+
+        float sticks[hf::STICK_CHANNELS] = { -1, 0, 0, 0, 0 };
+
+        if (sscanf(line, "%f %f %f %f %f", &sticks[0], &sticks[1], &sticks[2], &sticks[3], &sticks[4]) < 1) {
+            continue;
+        }
+
+        sender.send(sticks);
+    }
+
+    return 0;
+}
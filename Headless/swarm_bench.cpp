@@ -0,0 +1,121 @@
+/*
+   swarm_bench.cpp: throughput benchmark for the structure-of-arrays swarm kernels
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "core/swarm.hpp"
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Hover thrust plus a small, fixed per-vehicle perturbation, so vehicles diverge
+static void setMotors(hf::Swarm & swarm)
+{
+    srand(0);
+
+    for (uint32_t i=0; i<swarm.count(); ++i) {
+        float motors[4];
+        for (uint8_t k=0; k<4; ++k) {
+            motors[k] = 0.5f + 0.01f * (rand() / (float)RAND_MAX - 0.5f);
+        }
+        swarm.setMotors(i, motors);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t count = 10000;
+    float rateHz = 1000;
+    float seconds = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "v:r:s:")) != -1) {
+        switch (c) {
+            case 'v':
+                count = atoi(optarg);
+                break;
+            case 'r':
+                rateHz = atof(optarg);
+                break;
+            case 's':
+                seconds = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-v VEHICLES] [-r RATE_HZ] [-s SECONDS]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    static const char * NAMES[] = {"scalar", "sse", "avx2"};
+
+    uint32_t steps = (uint32_t)(rateHz * seconds);
+    float dt = 1 / rateHz;
+
+    hf::Swarm reference(count);
+    setMotors(reference);
+    for (uint32_t k=0; k<steps; ++k) {
+        reference.step(dt, hf::Swarm::KERNEL_SCALAR);
+    }
+
+    printf("%u vehicles, %u steps at %.0f Hz\n", count, steps, rateHz);
+
+    for (int k=hf::Swarm::KERNEL_SCALAR; k<=hf::Swarm::KERNEL_AVX2; ++k) {
+
+        hf::Swarm::kernel_t kernel = (hf::Swarm::kernel_t)k;
+
+        if (!hf::Swarm::haveKernel(kernel)) {
+            printf("%-7s not compiled in\n", NAMES[k]);
+            continue;
+        }
+
+        hf::Swarm swarm(count);
+        setMotors(swarm);
+
+        double start = wallSeconds();
+        for (uint32_t j=0; j<steps; ++j) {
+            swarm.step(dt, kernel);
+        }
+        double elapsed = wallSeconds() - start;
+
+        // Lanes differ from scalar only by rounding
+        float error = 0;
+        for (uint32_t i=0; i<count; ++i) {
+            for (int f=hf::Swarm::POS_X; f<=hf::Swarm::POS_Z; ++f) {
+                float e = fabsf(swarm.field(f)[i] - reference.field(f)[i]);
+                error = e > error ? e : error;
+            }
+        }
+
+        double rate = (double)count * steps / elapsed;
+
+        printf("%-7s %8.2f M vehicle-steps/s  %6.2f ns/vehicle-step  realtime x%5.2f  max error vs scalar %.2e m\n",
+                NAMES[k], rate/1e6, 1e9/rate, seconds/elapsed, error);
+    }
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+   vision_bench.cpp: feeds synthetic frames through the off-thread vision pipeline,
+   checking that every frame is either processed or counted as dropped, and reporting
+   the cost to the publishing (game) thread
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <chrono>
+#include <thread>
+
+#include "core/vision.hpp"
+
+static double wallSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Stands in for an expensive algorithm
+class SlowAlgorithm : public hf::VisionAlgorithm {
+
+    private:
+
+        int _micros;
+
+    public:
+
+        SlowAlgorithm(int micros) : _micros(micros) { }
+
+        void process(const hf::vision_frame_t & frame) override
+        {
+            (void)frame;
+            std::this_thread::sleep_for(std::chrono::microseconds(_micros));
+        }
+};
+
+int main(int argc, char ** argv)
+{
+    int rows = 128;
+    int cols = 256;
+    uint32_t frames = 2000;
+    uint32_t depth = 2;
+    uint32_t workers = 2;
+    int frameMicros = 1000;
+    int algorithmMicros = 1500;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:d:w:f:a:")) != -1) {
+        switch (c) {
+            case 'n':
+                frames = atoi(optarg);
+                break;
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 'w':
+                workers = atoi(optarg);
+                break;
+            case 'f':
+                frameMicros = atoi(optarg);
+                break;
+            case 'a':
+                algorithmMicros = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n FRAMES] [-d QUEUE_DEPTH] [-w WORKERS] [-f FRAME_USEC] [-a ALGORITHM_USEC]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    hf::VisionPipeline pipeline(rows, cols, depth, workers);
+
+    hf::BrightCentroid centroid;
+    SlowAlgorithm slow(algorithmMicros);
+    pipeline.addAlgorithm(&centroid);
+    pipeline.addAlgorithm(&slow);
+
+    pipeline.start();
+
+    double publishSeconds = 0;
+    double readSeconds = 0;
+    uint32_t skipped = 0;
+
+    for (uint32_t n=0; n<frames; ++n) {
+
+        double start = wallSeconds();
+
+        uint8_t * rgb = pipeline.acquire();
+
+        if (rgb) {
+            // A single bright pixel that moves along the top row
+            memset(rgb, 0, 3 * rows * cols);
+            memset(rgb + 3 * (n % cols), 255, 3);
+            pipeline.publish(n, n * frameMicros / 1e6);
+        }
+        else {
+            ++skipped;
+        }
+
+        double middle = wallSeconds();
+
+        hf::vision_centroid_t result;
+        centroid.result.read(result);
+
+        double end = wallSeconds();
+
+        publishSeconds += middle - start;
+        readSeconds += end - middle;
+
+        std::this_thread::sleep_for(std::chrono::microseconds(frameMicros));
+    }
+
+    pipeline.stop();
+
+    hf::vision_centroid_t result = {};
+    centroid.result.read(result);
+
+    bool accounted = pipeline.published() == pipeline.processed() + pipeline.dropped() + pipeline.queued();
+    bool correct = result.count == 1 && (uint32_t)result.x == result.frameNumber % cols && result.y == 0;
+
+    printf("frames %u  published %llu  processed %llu  dropped %llu  still queued %u  no buffer %u\n",
+            frames, (unsigned long long)pipeline.published(), (unsigned long long)pipeline.processed(),
+            (unsigned long long)pipeline.dropped(), pipeline.queued(), skipped);
+    printf("game thread: acquire+fill+publish %.2f usec/frame  result read %.3f usec/frame\n",
+            1e6 * publishSeconds / frames, 1e6 * readSeconds / frames);
+    printf("last result: frame %llu centroid (%.1f, %.1f)  %s\n", (unsigned long long)result.frameNumber,
+            result.x, result.y, accounted && correct ? "ok" : "FAILED");
+
+    if (HF_TIMING) {
+        hf::Timing::instance().dump(stdout);
+    }
+
+    return accounted && correct ? 0 : 1;
+}
@@ -28,7 +28,10 @@ public class HackflightSim : ModuleRules
     {
         PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
-        PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "UMG" });
+        PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "UMG", "RenderCore", "RHI" });
+
+        // Per-stage timing histograms (see core/timing.hpp); set to 0 to compile the timers out
+        Definitions.Add("HF_TIMING=1");
 
         // Un-comment and edit one of these lines to point to your Hackflight/src library
         //PrivateIncludePaths.Add("/home/slevy/Documents/Arduino/libraries/Hackflight/src");         // Linux
@@ -21,5 +21,17 @@ along with HackfilghtSim.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include "Engine.h"
+#include "Misc/App.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Parse.h"
+
+// Dedicated simulation, for render-less servers: launched with -HackflightDedicated, or with no renderer at
+// all (-nullrhi).  Vehicles then build no cameras, propeller sound or props, and the vision HUD stays idle,
+// leaving only collision and the firmware.
+inline bool HackflightSimDedicated(void)
+{
+	static const bool dedicated = !FApp::CanEverRender() || FParse::Param(FCommandLine::Get(), TEXT("HackflightDedicated"));
+	return dedicated;
+}
 
 //DECLARE_LOG_CATEGORY_EXTERN(LogFlying, Log, All);
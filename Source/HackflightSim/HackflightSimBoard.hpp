@@ -1,7 +1,8 @@
 /*
    HackflihtSimBoard.hpp: Hackflight SimBoard class implementation for Unreal Engine
 
-   Provides Board::outbuf() method that displays debugging text to the game display
+   Provides Board::outbuf() method that puts debugging text into a console ring, whose newest
+   lines are shown on the game display at a capped rate and all of which go to a log file
 
    Copyright (C) Simon D. Levy 2017
 
@@ -26,6 +27,11 @@
 #include <boards/sim/sim.hpp>
 
 #include "Engine/Engine.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+
+#include "HackflightSimParams.h"
+#include "core/console.hpp"
 
 
 #ifdef _WIN32
@@ -37,14 +43,65 @@
 static FColor TEXT_COLOR = FColor::Yellow;
 static float  TEXT_SCALE = 2.f;
 
+// Shared by every vehicle's firmware; allocated once, when the module loads
+static hf::ConsoleRing    CONSOLE(PARAM_CONSOLE_LINES);
+static hf::ConsoleFlusher CONSOLE_FLUSHER(CONSOLE);
+
+// Vehicles in play, and the lines written when the overlay was last refreshed
+static uint32_t consoleUsers;
+static uint64_t consoleShown;
+
+// Firmware prints cost only a copy into the ring
 void hf::Board::outbuf(char * buf)
 {
-	if (GEngine) {
+	CONSOLE.write(buf);
+}
+
+// Starts logging firmware output to Saved/Logs/HackflightConsole.txt with the first vehicle in play
+static void startConsole(void)
+{
+	if (consoleUsers++ == 0 && PARAM_CONSOLE_LOG) {
+		FString dir = FPaths::ConvertRelativePathToFull(FPaths::ProjectLogDir());
+		IFileManager::Get().MakeDirectory(*dir, true);
+		FString path = dir + TEXT("HackflightConsole.txt");
+		if (!CONSOLE_FLUSHER.start(TCHAR_TO_UTF8(*path), PARAM_CONSOLE_FLUSH_SECONDS)) {
+			UE_LOG(LogTemp, Warning, TEXT("Unable to open console log %s"), *path);
+		}
+	}
+}
+
+// And stops it, writing out what remains, with the last
+static void stopConsole(void)
+{
+	if (consoleUsers > 0 && --consoleUsers == 0) {
+		CONSOLE_FLUSHER.stop();
+	}
+}
+
+// Shows the newest lines, if any have arrived since the last refresh, one row each
+static void showConsole(void)
+{
+	uint64_t written = CONSOLE.written();
+
+	if (!GEngine || written == consoleShown) {
+		return;
+	}
+
+	uint64_t first = written > PARAM_CONSOLE_OVERLAY_LINES ? written - PARAM_CONSOLE_OVERLAY_LINES : 0;
+
+	char text[hf::ConsoleRing::LINE + 1];
+	uint32_t length = 0;
+
+	for (uint64_t line = first; line < written; ++line) {
+		if (CONSOLE.read(line, text, length) == hf::CONSOLE_READY) {
 
-		// 0 = overwrite; 5.0f = arbitrary time to display
-		GEngine->AddOnScreenDebugMessage(0, 5.0f, TEXT_COLOR, FString(buf), true, FVector2D(TEXT_SCALE,TEXT_SCALE));
+			// Row number as key, so that each row is overwritten in place; 5.0f = arbitrary time to display
+			GEngine->AddOnScreenDebugMessage((int32)(line - first), 5.0f, TEXT_COLOR, FString(text), true,
+				FVector2D(TEXT_SCALE,TEXT_SCALE));
+		}
 	}
 
+	consoleShown = written;
 }
 
 
@@ -0,0 +1,238 @@
+/*
+HackflightSimExportCollisionCommandlet.cpp: exports a map's static collision for the headless simulator
+
+Copyright (C) Simon D. Levy 2017
+
+This file is part of HackflightSim.
+
+HackflightSim is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HackflightSim is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "HackflightSimExportCollisionCommandlet.h"
+#include "HackflightSimVehicle.h"
+
+#include "core/bvh.hpp"
+
+#include "Engine/World.h"
+#include "Engine/Level.h"
+#include "Engine/Polys.h"
+#include "Engine/StaticMesh.h"
+#include "Components/StaticMeshComponent.h"
+#include "GameFramework/PlayerStart.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "StaticMeshResources.h"
+#include "Model.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/PackageName.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogHackflightCollision, Log, All);
+
+UHackflightSimExportCollisionCommandlet::UHackflightSimExportCollisionCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 UHackflightSimExportCollisionCommandlet::Main(const FString & Params)
+{
+	FString maps;
+	if (!FParse::Value(*Params, TEXT("map="), maps)) {
+		UE_LOG(LogHackflightCollision, Error, TEXT("Usage: -run=HackflightSimExportCollision -map=/Game/Path/Map[,...] [-out=FILE]"));
+		return 1;
+	}
+
+	TArray<FString> mapNames;
+	maps.ParseIntoArray(mapNames, TEXT(","), true);
+
+	FString out;
+	bool haveOut = FParse::Value(*Params, TEXT("out="), out) && mapNames.Num() == 1;
+
+	int32 failures = 0;
+
+	for (const FString & mapName : mapNames) {
+		FString path = haveOut ? out : FPaths::ProjectSavedDir() + TEXT("Collision/") + FPackageName::GetShortName(mapName) + TEXT(".hfbvh");
+		failures += exportMap(mapName, path) ? 0 : 1;
+	}
+
+	return failures;
+}
+
+bool UHackflightSimExportCollisionCommandlet::exportMap(const FString & mapName, const FString & outPath)
+{
+	UPackage * package = LoadPackage(nullptr, *mapName, LOAD_None);
+	UWorld * world = package ? UWorld::FindWorldInPackage(package) : nullptr;
+
+	if (!world || !world->PersistentLevel) {
+		UE_LOG(LogHackflightCollision, Error, TEXT("Unable to load map %s"), *mapName);
+		return false;
+	}
+
+	ULevel * level = world->PersistentLevel;
+
+	hf::BvhBuilder builder;
+
+	uint32 bspTriangles = addBsp(level, builder);
+	uint32 meshTriangles = 0;
+	bool haveStart = false;
+
+	for (AActor * actor : level->Actors) {
+
+		if (!actor) {
+			continue;
+		}
+
+		// Vehicles start where one is placed, or else at the player start
+		FVector location = actor->GetActorLocation() / 100; // cm => m
+		if (actor->IsA(AHackflightSimVehicle::StaticClass()) || (!haveStart && actor->IsA(APlayerStart::StaticClass()))) {
+			float start[3] = { location.X, location.Y, location.Z };
+			builder.setStart(start);
+			haveStart = actor->IsA(AHackflightSimVehicle::StaticClass());
+		}
+
+		// Moving things are not part of the map
+		if (actor->IsA(APawn::StaticClass()) || actor->IsRootComponentMovable()) {
+			continue;
+		}
+
+		TInlineComponentArray<UStaticMeshComponent *> components;
+		actor->GetComponents(components);
+
+		for (UStaticMeshComponent * component : components) {
+			meshTriangles += addStaticMesh(component, builder);
+		}
+	}
+
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(outPath), true);
+
+	if (!builder.write(TCHAR_TO_UTF8(*outPath))) {
+		UE_LOG(LogHackflightCollision, Error, TEXT("Unable to write %s (%u triangles)"), *outPath, builder.triangleCount());
+		return false;
+	}
+
+	UE_LOG(LogHackflightCollision, Display, TEXT("%s: %u BSP and %u mesh triangles written to %s"), *mapName,
+		bspTriangles, meshTriangles, *outPath);
+
+	return true;
+}
+
+void UHackflightSimExportCollisionCommandlet::addTriangle(hf::BvhBuilder & builder, const FVector & a, const FVector & b, const FVector & c)
+{
+	// UE4 uses cm; the simulator, meters
+	float va[3] = { a.X / 100, a.Y / 100, a.Z / 100 };
+	float vb[3] = { b.X / 100, b.Y / 100, b.Z / 100 };
+	float vc[3] = { c.X / 100, c.Y / 100, c.Z / 100 };
+
+	builder.addTriangle(va, vb, vc);
+}
+
+uint32 UHackflightSimExportCollisionCommandlet::addBsp(ULevel * level, hf::BvhBuilder & builder)
+{
+	UModel * model = level->Model;
+
+	if (!model) {
+		return 0;
+	}
+
+	uint32 count = 0;
+
+	// Each node is a convex polygon; fan it into triangles
+	for (const FBspNode & node : model->Nodes) {
+
+		if (model->Surfs[node.iSurf].PolyFlags & PF_NotSolid) {
+			continue;
+		}
+
+		const FVector & first = model->Points[model->Verts[node.iVertPool].pVertex];
+
+		for (int32 k = 2; k < node.NumVertices; ++k) {
+			addTriangle(builder, first,
+				model->Points[model->Verts[node.iVertPool + k - 1].pVertex],
+				model->Points[model->Verts[node.iVertPool + k].pVertex]);
+			++count;
+		}
+	}
+
+	return count;
+}
+
+uint32 UHackflightSimExportCollisionCommandlet::addStaticMesh(UStaticMeshComponent * component, hf::BvhBuilder & builder)
+{
+	UStaticMesh * mesh = component->GetStaticMesh();
+
+	if (!mesh || component->GetCollisionEnabled() == ECollisionEnabled::NoCollision ||
+		component->GetCollisionResponseToChannel(ECC_Pawn) != ECR_Block) {
+		return 0;
+	}
+
+	const FTransform & transform = component->GetComponentTransform();
+	UBodySetup * body = mesh->BodySetup;
+
+	uint32 count = 0;
+
+	// Simple collision made only of boxes is exported exactly; anything else falls back to the mesh itself
+	if (body && body->CollisionTraceFlag != CTF_UseComplexAsSimple && body->AggGeom.BoxElems.Num() > 0 &&
+		body->AggGeom.GetElementCount() == body->AggGeom.BoxElems.Num()) {
+
+		static const int32 FACES[6][4] = {
+			{0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5}
+		};
+
+		for (const FKBoxElem & box : body->AggGeom.BoxElems) {
+
+			FTransform boxTransform = box.GetTransform() * transform;
+			FVector half(box.X / 2, box.Y / 2, box.Z / 2);
+
+			FVector corners[8];
+			for (int32 k = 0; k < 8; ++k) {
+				corners[k] = boxTransform.TransformPosition(FVector(
+					(k & 1) ? half.X : -half.X, (k & 2) ? half.Y : -half.Y, (k & 4) ? half.Z : -half.Z));
+			}
+
+			for (int32 f = 0; f < 6; ++f) {
+				addTriangle(builder, corners[FACES[f][0]], corners[FACES[f][1]], corners[FACES[f][2]]);
+				addTriangle(builder, corners[FACES[f][0]], corners[FACES[f][2]], corners[FACES[f][3]]);
+				count += 2;
+			}
+		}
+
+		return count;
+	}
+
+	if (!mesh->RenderData || mesh->RenderData->LODResources.Num() == 0) {
+		return 0;
+	}
+
+	const FStaticMeshLODResources & lod = mesh->RenderData->LODResources[0];
+	FIndexArrayView indices = lod.IndexBuffer.GetArrayView();
+
+	for (const FStaticMeshSection & section : lod.Sections) {
+
+		if (!section.bEnableCollision) {
+			continue;
+		}
+
+		for (uint32 k = 0; k < section.NumTriangles; ++k) {
+			uint32 i = section.FirstIndex + 3 * k;
+			addTriangle(builder,
+				transform.TransformPosition(lod.PositionVertexBuffer.VertexPosition(indices[i])),
+				transform.TransformPosition(lod.PositionVertexBuffer.VertexPosition(indices[i + 1])),
+				transform.TransformPosition(lod.PositionVertexBuffer.VertexPosition(indices[i + 2])));
+			++count;
+		}
+	}
+
+	return count;
+}
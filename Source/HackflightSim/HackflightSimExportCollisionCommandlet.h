@@ -0,0 +1,62 @@
+/*
+HackflightSimExportCollisionCommandlet.h: exports a map's static collision for the headless simulator
+
+Run from the editor's command line, e.g.:
+
+  UE4Editor-Cmd HackflightSim.uproject -run=HackflightSimExportCollision -map=/Game/Hackflight/Maps/BigFlatMap
+
+to write Saved/Collision/BigFlatMap.hfbvh (see core/bvh.hpp); -out=FILE writes elsewhere, and -map
+takes several maps separated by commas.
+
+Copyright (C) Simon D. Levy 2017
+
+This file is part of HackflightSim.
+
+HackflightSim is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HackflightSim is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "HackflightSimExportCollisionCommandlet.generated.h"
+
+namespace hf {
+	class BvhBuilder;
+}
+
+UCLASS()
+class UHackflightSimExportCollisionCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UHackflightSimExportCollisionCommandlet();
+
+	virtual int32 Main(const FString & Params) override;
+
+private:
+
+	// Returns false if the map could not be loaded or written
+	bool exportMap(const FString & mapName, const FString & outPath);
+
+	// BSP brushes that block
+	static uint32 addBsp(class ULevel * level, hf::BvhBuilder & builder);
+
+	// Static meshes that block pawns: their simple boxes, or else their render triangles
+	static uint32 addStaticMesh(class UStaticMeshComponent * component, hf::BvhBuilder & builder);
+
+	static void addTriangle(hf::BvhBuilder & builder, const FVector & a, const FVector & b, const FVector & c);
+};
@@ -35,7 +35,12 @@ along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
 #include "GameFramework/SpringArmComponent.h"
 #include "Engine/World.h"
 
-HackflightSimMotor::HackflightSimMotor(APawn * vehicle, UStaticMeshComponent* VehicleMesh, float motorX, float motorY, int8_t direction, uint8_t index)
+HackflightSimMotor::HackflightSimMotor(void)
+	: PropMesh(nullptr), PropSpringArm(nullptr), MotorMesh(nullptr), MotorSpringArm(nullptr), _direction(0)
+{
+}
+
+void HackflightSimMotor::create(APawn * vehicle, UStaticMeshComponent* VehicleMesh, float motorX, float motorY, int8_t direction, uint8_t index)
 {
 
 	// We can reuse the same static mesh for all four motor barrels
@@ -80,8 +85,8 @@ HackflightSimMotor::HackflightSimMotor(APawn * vehicle, UStaticMeshComponent* Ve
 
 	UStaticMesh *staticPropMesh = nullptr;
 
-	// Use the appropriate propeller mesh based on the motor index
-	switch (index) {
+	// Use the appropriate propeller mesh based on the motor index, reusing the four for larger airframes
+	switch (index % 4) {
 
 	case 0:
 		staticPropMesh = Prop1ConstructorStatics.PropMesh1.Get();
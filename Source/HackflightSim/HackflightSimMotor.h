@@ -39,7 +39,10 @@ private:
 
 public:
 
-	HackflightSimMotor(APawn * vehicle, UStaticMeshComponent* VehicleMesh, float motorX, float motorY, int8_t direction,  uint8_t index);
+	// Motors live inline in the pawn, so their components are created afterward, from the pawn's constructor
+	HackflightSimMotor(void);
+
+	void create(APawn * vehicle, UStaticMeshComponent* VehicleMesh, float motorX, float motorY, int8_t direction,  uint8_t index);
 
 	void rotate(float speed);
 };
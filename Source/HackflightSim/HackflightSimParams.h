@@ -20,6 +20,8 @@ along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include "core/airframe.hpp"
+
 // Arbitrary prop-rotation speed scaleup
 static const float PARAM_PROP_SPEED = 60.f;
 
@@ -27,12 +29,103 @@ static const float PARAM_PROP_SPEED = 60.f;
 static const float PARAM_CAM_DISTANCE  = 60.f;
 static const float PARAM_CAM_ELEVATION = 17.f;
 
-// Centimer dispacements, appropriate for 3DFly frame
-static const float PARAM_MOTOR_REAR_X  = -3.7f;
-static const float PARAM_MOTOR_FRONT_X = +3.7f;
-static const float PARAM_MOTOR_RIGHT_Y = +2.8f;
-static const float PARAM_MOTOR_LEFT_Y  = -4.7f;
+// Airframe whose motors are shown (hf::QuadX, QuadPlus, Hexa or Octo; see core/airframe.hpp); the firmware
+// mixes for quad-X, and its motor values are remixed for the others
+typedef hf::QuadX PARAM_AIRFRAME;
 
 // Duration and extent of bounce-back on collision
 static const float PARAM_BOUNCEBACK_SECONDS = 1.0f;
 static const float PARAM_BOUNCEBACK_FORCE = 1.0f;
+
+// Fraction of the impact speed kept, and of the sliding speed lost, at each contact after a crash (see core/contact.hpp)
+static const float PARAM_CONTACT_RESTITUTION = 0.3f;
+static const float PARAM_CONTACT_FRICTION = 0.5f;
+
+// Fixed rate at which firmware and physics are stepped, independent of frame rate
+static const float PARAM_FIRMWARE_RATE_HZ = 1000.f;
+
+// How the pose is advanced through each fixed step (0 explicit Euler, 1 semi-implicit, 2 RK4; see core/pose.hpp)
+static const uint8_t PARAM_POSE_INTEGRATOR = 1;
+
+// Model the IMU's bias, noise, quantization and delay at this sample rate (see core/imu.hpp); zero for ideal readings
+static const float PARAM_IMU_RATE_HZ = 0;
+
+// Seeds the IMU noise, so that flights with the same input see the same readings
+static const uint32_t PARAM_IMU_SEED = 1;
+
+// Rates at which the latest vision result is picked up and the propeller sound follows the motors
+static const float PARAM_VISION_RATE_HZ = 30;
+static const float PARAM_AUDIO_RATE_HZ = 20;
+
+// Longest frame we will catch up on; anything beyond this is dropped rather than simulated
+static const float PARAM_MAX_FRAME_SECONDS = 0.1f;
+
+// Length of the per-vehicle flight log in Saved/Flights (Linux and Mac only); zero to disable.  Each minute
+// reserves about 7.7 MB of disk per vehicle at 1000 Hz, and each session replaces the last one's log.
+static const float PARAM_FLIGHT_LOG_MINUTES = 0;
+
+// Record each vehicle's controller input to Saved/Inputs/<vehicle>.hfin, for replay; each session
+// replaces the previous one's recordings
+static const bool PARAM_INPUT_RECORD = false;
+
+// Input log in Saved/Inputs to replay in place of the controller; empty to fly live
+static const char PARAM_INPUT_REPLAY_FILE[] = "";
+
+// Firmware console output: lines kept in the ring, how often and how many of the newest are shown on screen,
+// and whether and how often all of it goes to Saved/Logs/HackflightConsole.txt
+static const uint32_t PARAM_CONSOLE_LINES = 1024;
+static const float PARAM_CONSOLE_OVERLAY_HZ = 4;
+static const uint32_t PARAM_CONSOLE_OVERLAY_LINES = 4;
+static const bool PARAM_CONSOLE_LOG = true;
+static const float PARAM_CONSOLE_FLUSH_SECONDS = 0.1f;
+
+// Show per-stage timing percentiles on the HUD (needs HF_TIMING, set in HackflightSim.Build.cs)
+static const bool PARAM_TIMING_OVERLAY = false;
+
+// How often to refresh the Hackflight stat group from the timing histograms
+static const float PARAM_TIMING_STATS_SECONDS = 0.25f;
+
+// Shared-memory mailbox through which other processes send stick input, suffixed with _<vehicle>; empty to disable
+static const char PARAM_STICK_MAILBOX_PREFIX[] = "/hackflight_sticks";
+
+// External stick input older than this is ignored, handing control back to the controller
+static const float PARAM_STICK_MAILBOX_TIMEOUT_SECONDS = 0.5f;
+
+// Fly synthetic stick steps instead of the controller, timing each one's response through to the rendered
+// frame; results go to Saved/Logs/HackflightLatency_<vehicle>.txt at the end of play
+static const bool PARAM_LATENCY_PROBE = false;
+
+// Channel stepped by the latency probe (0 throttle, 1 roll, 2 pitch, 3 yaw), by how much, how often,
+// and the throttle held meanwhile.  Throttle moves the motors whatever the gains; a cyclic channel
+// needs gains that turn its steps into motion
+static const uint8_t PARAM_LATENCY_PROBE_CHANNEL = 0;
+static const float PARAM_LATENCY_PROBE_AMPLITUDE = 0.5f;
+static const float PARAM_LATENCY_PROBE_PERIOD_SECONDS = 0.5f;
+static const float PARAM_LATENCY_PROBE_THROTTLE = 0.f;
+
+// Change in motor output, and in rate (rad/s, or m/s for throttle), taken as the response to a step;
+// zero measures each from the quiet period before the first step
+static const float PARAM_LATENCY_PROBE_MOTOR_THRESHOLD = 0.f;
+static const float PARAM_LATENCY_PROBE_MOTION_THRESHOLD = 0.f;
+
+// Shared-memory name under which Headless/gym_server -w posts the environment to show; empty to always fly
+static const char PARAM_GYM_VIEW_NAME[] = "/hackflight_gym_view";
+
+// A served environment not stepped for this long is no longer shown, so a server that has died leaves the
+// vehicle flying on its own again
+static const float PARAM_GYM_VIEW_TIMEOUT_SECONDS = 1.0f;
+
+// Number of vision frames being read back from the GPU at once
+static const uint32_t PARAM_VISION_READBACK_DEPTH = 3;
+
+// Vision frames that may wait for the vision workers before the oldest is dropped
+static const uint32_t PARAM_VISION_QUEUE_DEPTH = 2;
+
+// Threads running vision algorithms
+static const uint32_t PARAM_VISION_WORKERS = 2;
+
+// Shared-memory segment exporting vision frames to other processes (Linux and Mac only); empty to disable
+static const char PARAM_VISION_SHM_NAME[] = "/hackflight_vision";
+
+// Frames kept in the shared-memory ring, so that slow readers can still catch a complete one
+static const uint32_t PARAM_VISION_SHM_SLOTS = 4;
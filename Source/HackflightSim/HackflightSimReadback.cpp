@@ -0,0 +1,247 @@
+/*
+   HackflightSimReadback.cpp: frame source reading a render target without stalling the game thread
+
+   Each capture queues a copy into a staging texture on the render thread, followed by a GPU
+   query.  Nothing maps the staging texture until a later frame finds that query complete, so
+   neither the game thread nor the render thread waits for the GPU; the game thread only checks
+   a flag, and waits on the render thread only at shutdown or a resize.  Frames go through our
+   own staging textures into pooled buffers, so steady state allocates nothing.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HackflightSimReadback.h"
+
+#include "RenderCommandFence.h"
+#include "RenderingThread.h"
+
+#include "core/timing.hpp"
+
+HackflightSimRenderTargetSource::HackflightSimRenderTargetSource(FRenderTarget * renderTarget, int rows, int cols)
+{
+	_renderTarget = renderTarget;
+	_rows = rows;
+	_cols = cols;
+	_depth = 0;
+
+	for (uint32_t k = 0; k < hf::ReadbackPipeline::MAX_DEPTH; ++k) {
+		_copying[k] = false;
+		_ready[k] = false;
+	}
+	_collecting = false;
+}
+
+HackflightSimRenderTargetSource::~HackflightSimRenderTargetSource()
+{
+	// The render thread may still have commands of ours queued
+	waitForRenderThread();
+
+	// Staging textures and queries are released on the render thread, like they were created
+	HackflightSimRenderTargetSource * source = this;
+	ENQUEUE_UNIQUE_RENDER_COMMAND_ONEPARAMETER(
+		HackflightSimReleaseStagingCommand,
+		HackflightSimRenderTargetSource *, Source, source,
+		{
+			for (uint32_t k = 0; k < hf::ReadbackPipeline::MAX_DEPTH; ++k) {
+				Source->_staging[k].SafeRelease();
+				Source->_queries[k].SafeRelease();
+			}
+		});
+
+	waitForRenderThread();
+}
+
+void HackflightSimRenderTargetSource::waitForRenderThread()
+{
+	FRenderCommandFence fence;
+	fence.BeginFence();
+	fence.Wait();
+}
+
+// Forgets copies still on the GPU, so that nothing writes into the pixel buffers once this returns
+void HackflightSimRenderTargetSource::discardCopies()
+{
+	HackflightSimRenderTargetSource * source = this;
+	ENQUEUE_UNIQUE_RENDER_COMMAND_ONEPARAMETER(
+		HackflightSimDiscardCopiesCommand,
+		HackflightSimRenderTargetSource *, Source, source,
+		{
+			for (uint32_t k = 0; k < hf::ReadbackPipeline::MAX_DEPTH; ++k) {
+				Source->_copying[k] = false;
+			}
+		});
+
+	waitForRenderThread();
+
+	for (uint32_t k = 0; k < hf::ReadbackPipeline::MAX_DEPTH; ++k) {
+		_ready[k] = false;
+	}
+}
+
+// Replaces any staging textures of the old size; the render thread drops the old ones once no copy uses them
+void HackflightSimRenderTargetSource::createStaging()
+{
+	HackflightSimRenderTargetSource * source = this;
+	ENQUEUE_UNIQUE_RENDER_COMMAND_ONEPARAMETER(
+		HackflightSimCreateStagingCommand,
+		HackflightSimRenderTargetSource *, Source, source,
+		{
+			FRHIResourceCreateInfo CreateInfo;
+			for (uint32_t k = 0; k < Source->_depth; ++k) {
+				Source->_staging[k] = RHICreateTexture2D(Source->_cols, Source->_rows, PF_B8G8R8A8, 1, 1, TexCreate_CPUReadback, CreateInfo);
+
+				// Without timestamp queries a copy is taken to be done by the frame after it was issued
+				if (GSupportsTimestampRenderQueries && !Source->_queries[k].IsValid()) {
+					Source->_queries[k] = RHICreateRenderQuery(RQT_AbsoluteTime);
+				}
+			}
+		});
+}
+
+void HackflightSimRenderTargetSource::allocate(uint32_t depth)
+{
+	_depth = depth;
+	_pixels.reserve(_depth, (size_t)4 * _rows * _cols);
+	createStaging();
+}
+
+void HackflightSimRenderTargetSource::resize(int rows, int cols)
+{
+	discardCopies();
+
+	_rows = rows;
+	_cols = cols;
+	_pixels.reserve(_depth, (size_t)4 * _rows * _cols);
+	createStaging();
+}
+
+void HackflightSimRenderTargetSource::capture(uint32_t slot)
+{
+	_ready[slot].store(false, std::memory_order_relaxed);
+
+	struct FCopyContext {
+		HackflightSimRenderTargetSource * Source;
+		uint32_t Slot;
+	};
+
+	FCopyContext context = { this, slot };
+
+	ENQUEUE_UNIQUE_RENDER_COMMAND_ONEPARAMETER(
+		HackflightSimReadbackCommand,
+		FCopyContext, Context, context,
+		{
+			Context.Source->collect(RHICmdList);
+			Context.Source->copy(RHICmdList, Context.Slot);
+		});
+}
+
+// Queues the GPU copy and the query that marks its completion; the copy is mapped by a later collect()
+void HackflightSimRenderTargetSource::copy(FRHICommandListImmediate & RHICmdList, uint32_t slot)
+{
+	HF_TIME_STAGE(hf::STAGE_READBACK);
+
+	// T_Vision is 8-bit BGRA; until a resize has reached the render thread the sizes can disagree
+	// for a frame, which then comes back black rather than torn
+	const FTexture2DRHIRef & Source = _renderTarget->GetRenderTargetTexture();
+	if (!Source.IsValid() || !_staging[slot].IsValid() || Source->GetFormat() != PF_B8G8R8A8 ||
+		Source->GetSizeX() != (uint32)_cols || Source->GetSizeY() != (uint32)_rows) {
+		FMemory::Memzero(_pixels.buffer(slot), (size_t)4 * _cols * _rows);
+		_ready[slot].store(true, std::memory_order_release);
+		return;
+	}
+
+	RHICmdList.CopyToResolveTarget(Source, _staging[slot], true, FResolveParams());
+
+	if (_queries[slot].IsValid()) {
+		RHICmdList.EndRenderQuery(_queries[slot]);
+	}
+
+	_copying[slot] = true;
+}
+
+// Reads back every slot whose copy the GPU has finished, without waiting for any that it has not
+void HackflightSimRenderTargetSource::collect(FRHICommandListImmediate & RHICmdList)
+{
+	_collecting.store(false, std::memory_order_relaxed);
+
+	size_t rowBytes = (size_t)4 * _cols;
+
+	for (uint32_t k = 0; k < _depth; ++k) {
+
+		if (!_copying[k]) {
+			continue;
+		}
+
+		uint64 timestamp = 0;
+		if (_queries[k].IsValid() && !RHIGetRenderQueryResult(_queries[k], timestamp, false)) {
+			continue;
+		}
+
+		HF_TIME_STAGE(hf::STAGE_READBACK);
+
+		// Mapped rows may be padded out to a wider pitch
+		void * Data = nullptr;
+		int32 Width = 0;
+		int32 Height = 0;
+		RHICmdList.MapStagingSurface(_staging[k], Data, Width, Height);
+		uint8_t * pixels = _pixels.buffer(k);
+		if (Data) {
+			for (int y = 0; y < _rows; ++y) {
+				FMemory::Memcpy(pixels + y * rowBytes, (const uint8_t *)Data + (size_t)4 * Width * y, rowBytes);
+			}
+		}
+		else {
+			FMemory::Memzero(pixels, rowBytes * _rows);
+		}
+		RHICmdList.UnmapStagingSurface(_staging[k]);
+
+		_copying[k] = false;
+		_ready[k].store(true, std::memory_order_release);
+	}
+}
+
+// Has the render thread look for finished copies, at most once per queued command
+void HackflightSimRenderTargetSource::requestCollect()
+{
+	if (_collecting.exchange(true, std::memory_order_relaxed)) {
+		return;
+	}
+
+	HackflightSimRenderTargetSource * source = this;
+	ENQUEUE_UNIQUE_RENDER_COMMAND_ONEPARAMETER(
+		HackflightSimCollectCommand,
+		HackflightSimRenderTargetSource *, Source, source,
+		{
+			Source->collect(RHICmdList);
+		});
+}
+
+bool HackflightSimRenderTargetSource::ready(uint32_t slot)
+{
+	if (_ready[slot].load(std::memory_order_acquire)) {
+		return true;
+	}
+
+	requestCollect();
+
+	return false;
+}
+
+const uint8_t * HackflightSimRenderTargetSource::pixels(uint32_t slot)
+{
+	return _pixels.buffer(slot);
+}
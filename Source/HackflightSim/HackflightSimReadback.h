@@ -0,0 +1,90 @@
+/*
+   HackflightSimReadback.h: frame source reading a render target without stalling the game thread
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "core/framepool.hpp"
+#include "core/readback.hpp"
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "RHI.h"
+#include "RHICommandList.h"
+#include "UnrealClient.h"
+
+class HackflightSimRenderTargetSource : public hf::FrameSource {
+
+private:
+
+	FRenderTarget * _renderTarget;
+
+	int _rows;
+	int _cols;
+	uint32_t _depth;
+
+	// One CPU-readable staging texture, pooled pixel buffer and GPU query per pipeline slot, all made
+	// once per image size: the engine's ReadSurfaceData() creates a staging texture and reallocates
+	// its output array on every call
+	FTexture2DRHIRef _staging[hf::ReadbackPipeline::MAX_DEPTH];
+	FRenderQueryRHIRef _queries[hf::ReadbackPipeline::MAX_DEPTH];
+	hf::FramePool _pixels;
+
+	// Render thread only: slots whose copy has been issued to the GPU but not yet read back
+	bool _copying[hf::ReadbackPipeline::MAX_DEPTH];
+
+	// Set by the render thread once a slot's pixels are in its buffer
+	std::atomic<bool> _ready[hf::ReadbackPipeline::MAX_DEPTH];
+
+	// Whether a collect command is queued and has not yet started
+	std::atomic<bool> _collecting;
+
+	void waitForRenderThread(void);
+	void discardCopies(void);
+	void createStaging(void);
+	void requestCollect(void);
+
+	// Run on the render thread
+	void copy(FRHICommandListImmediate & RHICmdList, uint32_t slot);
+	void collect(FRHICommandListImmediate & RHICmdList);
+
+public:
+
+	HackflightSimRenderTargetSource(FRenderTarget * renderTarget, int rows, int cols);
+
+	virtual ~HackflightSimRenderTargetSource();
+
+	virtual void allocate(uint32_t depth) override;
+
+	virtual void resize(int rows, int cols) override;
+
+	// For when the render target's resource has been replaced
+	void setRenderTarget(FRenderTarget * renderTarget) { _renderTarget = renderTarget; }
+
+	virtual void capture(uint32_t slot) override;
+
+	virtual bool ready(uint32_t slot) override;
+
+	virtual const uint8_t * pixels(uint32_t slot) override;
+
+	virtual int rows(void) override { return _rows; }
+
+	virtual int cols(void) override { return _cols; }
+};
@@ -0,0 +1,111 @@
+/*
+HackflightSimSwarm.cpp: class implementation for AHackflightSimSwarm
+
+Steps the swarm at a fixed rate and reads back poses once per frame
+
+Copyright (C) Simon D. Levy 2017
+
+This file is part of HackflightSim.
+
+HackflightSim is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HackflightSim is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "HackflightSim.h"
+#include "HackflightSimSwarm.h"
+
+#include "core/swarm.hpp"
+
+#include "UObject/ConstructorHelpers.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+
+// Edit this file to adjust
+#include "HackflightSimParams.h"
+
+AHackflightSimSwarm::AHackflightSimSwarm()
+{
+	PrimaryActorTick.bCanEverTick = true;
+
+	static ConstructorHelpers::FObjectFinderOptional<UStaticMesh> VehicleMesh(TEXT("/Game/Hackflight/Meshes/3DFly"));
+
+	SwarmMesh = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("SwarmMesh"));
+	SwarmMesh->SetStaticMesh(VehicleMesh.Get());
+	SwarmMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	RootComponent = SwarmMesh;
+
+	swarm = nullptr;
+	stepper = hf::FixedStepper(PARAM_FIRMWARE_RATE_HZ, PARAM_MAX_FRAME_SECONDS);
+}
+
+void AHackflightSimSwarm::BeginPlay()
+{
+	Super::BeginPlay();
+
+	swarm = new hf::Swarm(VehicleCount);
+
+	// Start on a square grid, at hover thrust with a little per-vehicle variation
+	int32 side = FMath::CeilToInt(FMath::Sqrt((float)VehicleCount));
+	FRandomStream random(0);
+
+	for (int32 i = 0; i < VehicleCount; ++i) {
+
+		float position[3] = { (i % side) * GridSpacing / 100, (i / side) * GridSpacing / 100, 0 };
+		swarm->setPosition(i, position);
+
+		float motors[4];
+		for (uint8_t k = 0; k < 4; ++k) {
+			motors[k] = 0.5f + 0.01f * (random.FRand() - 0.5f);
+		}
+		swarm->setMotors(i, motors);
+
+		// A dedicated simulation shows nothing, so keeps no instances
+		if (HackflightSimDedicated()) {
+			continue;
+		}
+
+		SwarmMesh->AddInstance(FTransform(100 * FVector(position[0], position[1], position[2])));
+	}
+}
+
+void AHackflightSimSwarm::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	delete swarm;
+	swarm = nullptr;
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AHackflightSimSwarm::Tick(float deltaSeconds)
+{
+	Super::Tick(deltaSeconds);
+
+	stepper.advance(deltaSeconds, [this](float dt) { swarm->step(dt); });
+
+	if (HackflightSimDedicated()) {
+		return;
+	}
+
+	// Read back poses once per frame; mark render state dirty once, after the last instance
+	for (int32 i = 0; i < VehicleCount; ++i) {
+
+		float position[3];
+		float quaternion[4];
+		swarm->getPose(i, position, quaternion);
+
+		FTransform transform(
+			FQuat(quaternion[0], quaternion[1], quaternion[2], quaternion[3]),
+			100 * FVector(position[0], position[1], position[2]));
+
+		SwarmMesh->UpdateInstanceTransform(i, transform, false, i == VehicleCount-1, true);
+	}
+}
@@ -0,0 +1,72 @@
+/*
+HackflightSimSwarm.h: swarm actor class header for HackflightSim
+
+Draws a structure-of-arrays swarm as instances of a single mesh
+
+Copyright (C) Simon D. Levy 2017
+
+This file is part of HackflightSim.
+
+HackflightSim is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HackflightSim is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+
+#include "core/stepper.hpp"
+
+#include "HackflightSimSwarm.generated.h"
+
+namespace hf {
+	class Swarm;
+}
+
+UCLASS(Config=Game)
+class AHackflightSimSwarm : public AActor
+{
+	GENERATED_BODY()
+
+	// One instance of the vehicle mesh per swarm member
+	UPROPERTY(Category = Mesh, VisibleDefaultsOnly, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
+	class UInstancedStaticMeshComponent* SwarmMesh;
+
+public:
+
+	AHackflightSimSwarm();
+
+	// Number of vehicles to fly
+	UPROPERTY(Category = Swarm, EditAnywhere, BlueprintReadOnly)
+	int32 VehicleCount = 1000;
+
+	// Distance between vehicles on the starting grid, in cm
+	UPROPERTY(Category = Swarm, EditAnywhere, BlueprintReadOnly)
+	float GridSpacing = 50.f;
+
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	// Swarm experiments write motor values and read state here
+	hf::Swarm * GetSwarm() const { return swarm; }
+
+private:
+
+	hf::Swarm * swarm;
+
+	// Runs the swarm dynamics at a fixed rate, independent of the frame rate
+	hf::FixedStepper stepper;
+};
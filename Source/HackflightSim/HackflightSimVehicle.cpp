@@ -20,8 +20,10 @@ You should have received a copy of the GNU General Public License
 along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "HackflightSim.h"
 #include "HackflightSimVehicle.h"
 #include "HackflightSimMotor.h"
+#include "HackflightSimVisionHUD.h"
 
 #include "UObject/ConstructorHelpers.h"
 #include "Camera/CameraComponent.h"
@@ -32,6 +34,12 @@ along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
 #include "Engine/World.h"
 #include "Engine/StaticMesh.h"
 #include "Engine/Engine.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
+#include "RenderingThread.h"
+#include "RHI.h"
+#include "RHICommandList.h"
 
 // Edit this file to adjust
 #include "HackflightSimParams.h"
@@ -42,9 +50,8 @@ along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
 
 // Hackflight support ---------------------------------------------
 
-// Main firmware
-#include <hackflight.hpp>
-hf::Hackflight hackflight;
+// Per-vehicle firmware, board and pose
+#include "core/vehicle.hpp"
 
 // Controller input
 #ifdef _WIN32
@@ -52,13 +59,32 @@ hf::Hackflight hackflight;
 #else
 #include <receivers/sim/linux.hpp>
 #endif
-hf::Controller controller;
+#include "core/tappedreceiver.hpp"
+
+// Flight recording, and recording and replay of controller input
+#include "core/flightlog.hpp"
+#include "core/inputlog.hpp"
+
+// Viewing an environment served to training code
+#include "core/shmmailbox.hpp"
+
+// Stick input from other processes
+#include "core/stickmailbox.hpp"
+
+// Stick-to-motion latency measurement
+#include "core/latencyprobe.hpp"
+
+// Runs the firmware, vision pickup, audio and console overlay each at its own rate
+#include "core/scheduler.hpp"
+
+// Crash, bounce and fall
+#include "core/contact.hpp"
 
 // Board simulation
 #include "HackflightSimBoard.hpp"
 
-// PID tuning
-hf::Stabilizer stabilizer = hf::Stabilizer(
+// PID tuning, copied into each vehicle's own stabilizer
+static const hf::Stabilizer STABILIZER = hf::Stabilizer(
 	0,//0.10f,      // Level P
 	.00001f,     // Gyro cyclic P
 	0,			// Gyro cyclic I
@@ -66,10 +92,63 @@ hf::Stabilizer stabilizer = hf::Stabilizer(
 	0,			// Gyro yaw P
 	0);			// Gyro yaw I
 
+// Frame fence ----------------------------------------------------
 
-// Board simulation
-#include <boards/sim/sim.hpp>
-hf::SimBoard board;
+// The render thread takes up a frame's commands before the frame is drawn, so a probed frame is
+// stamped only once the GPU is seen to have passed a timestamp query issued behind the frame's
+// scene and present.  The query goes in with the next frame's commands, which follow the previous
+// frame's draw, and is polled once a frame without waiting, so the stamp is late by up to a frame.
+// Without timestamp queries the frame is stamped once its drawing has been queued, leaving out the
+// GPU's time.
+class HackflightSimFrameFence {
+
+	hf::LatencyProbe * _probe;
+
+	// A ticket whose frame has yet to be queued for drawing, and one whose query is in flight
+	uint32_t _waiting;
+	uint32_t _issued;
+
+	FRenderQueryRHIRef _query;
+
+public:
+
+	HackflightSimFrameFence(hf::LatencyProbe * probe) : _probe(probe), _waiting(0), _issued(0)
+	{
+	}
+
+	~HackflightSimFrameFence()
+	{
+		_query.SafeRelease();
+	}
+
+	// Once a frame, from the game thread's per-frame command, with the frame's ticket if any
+	void frame(FRHICommandListImmediate & RHICmdList, uint32_t ticket)
+	{
+		uint64 timestamp = 0;
+		if (_issued && RHIGetRenderQueryResult(_query, timestamp, false)) {
+			_probe->rendered(_issued, hf::steadyNanos());
+			_issued = 0;
+		}
+
+		if (_waiting && !_issued) {
+			if (GSupportsTimestampRenderQueries) {
+				if (!_query.IsValid()) {
+					_query = RHICreateRenderQuery(RQT_AbsoluteTime);
+				}
+				RHICmdList.EndRenderQuery(_query);
+				_issued = _waiting;
+			}
+			else {
+				_probe->rendered(_waiting, hf::steadyNanos());
+			}
+			_waiting = 0;
+		}
+
+		if (ticket) {
+			_waiting = ticket;
+		}
+	}
+};
 
 // Pawn methods ---------------------------------------------------
 
@@ -88,37 +167,71 @@ AHackflightSimVehicle::AHackflightSimVehicle()
 	VehicleMesh->SetStaticMesh(VehicleConstructorStatics.VehicleMesh.Get());	// Set static mesh
 	RootComponent = VehicleMesh;
 
-	// Create the follow camera
-    createCameraWithSpringArm( L"FollowCamera", &FollowCamera, L"FollowCameraSpringArm", 
-            &FollowCameraSpringArm, PARAM_CAM_DISTANCE, PARAM_CAM_ELEVATION, true);
-
-	// Create the chase camera
-    createCameraWithSpringArm( L"ChaseCamera", &ChaseCamera, L"ChaseCameraSpringArm", 
-            &ChaseCameraSpringArm, PARAM_CAM_DISTANCE, PARAM_CAM_ELEVATION, false);
-
-	// Create the FPV camera
-    createCameraWithSpringArm( L"FpvCamera", &FpvCamera, L"FpvCameraSpringArm", 
-            &FpvCameraSpringArm, 0, 0, false);
-
+	// A dedicated simulation keeps the vehicle mesh, for collision, and builds nothing only seen or heard
+	dedicated = HackflightSimDedicated();
+	tickSeconds = 0;
+	tickCount = 0;
+
+	FollowCamera = nullptr;
+	FollowCameraSpringArm = nullptr;
+	ChaseCamera = nullptr;
+	ChaseCameraSpringArm = nullptr;
+	FpvCamera = nullptr;
+	FpvCameraSpringArm = nullptr;
+	propellerAudioCue = nullptr;
+	propellerAudioComponent = nullptr;
+
+	if (!dedicated) {
+
+		// Create the follow camera
+		createCameraWithSpringArm( L"FollowCamera", &FollowCamera, L"FollowCameraSpringArm", 
+				&FollowCameraSpringArm, PARAM_CAM_DISTANCE, PARAM_CAM_ELEVATION, true);
+
+		// Create the chase camera
+		createCameraWithSpringArm( L"ChaseCamera", &ChaseCamera, L"ChaseCameraSpringArm", 
+				&ChaseCameraSpringArm, PARAM_CAM_DISTANCE, PARAM_CAM_ELEVATION, false);
+
+		// Create the FPV camera
+		createCameraWithSpringArm( L"FpvCamera", &FpvCamera, L"FpvCameraSpringArm", 
+				&FpvCameraSpringArm, 0, 0, false);
+
+		// Simulate the airframe's motors at its positions, with its rotation directions
+		hf::Airframe<PARAM_AIRFRAME>::forEachMotor([this](uint8_t k) {
+			const hf::airframe_motor_t & motor = PARAM_AIRFRAME::motor(k);
+			motors[k].create(this, VehicleMesh, motor.x, motor.y, motor.direction, k);
+		});
+	}
 
-	// Simulate four motors at specified positions, with specified rotation directions
-	motors[0] = new HackflightSimMotor(this, VehicleMesh, PARAM_MOTOR_REAR_X, PARAM_MOTOR_RIGHT_Y,  +1, 0);
-	motors[1] = new HackflightSimMotor(this, VehicleMesh, PARAM_MOTOR_FRONT_X, PARAM_MOTOR_RIGHT_Y, -1, 1);
-	motors[2] = new HackflightSimMotor(this, VehicleMesh, PARAM_MOTOR_REAR_X, PARAM_MOTOR_LEFT_Y,   -1, 2);
-	motors[3] = new HackflightSimMotor(this, VehicleMesh, PARAM_MOTOR_FRONT_X, PARAM_MOTOR_LEFT_Y,  +1, 3);
+	// Firmware is created per vehicle in BeginPlay, so the class-default object carries none
+	simVehicle = nullptr;
+	initialState = nullptr;
+	controller = nullptr;
+	recorder = nullptr;
+	inputRecorder = nullptr;
+	inputPlayer = nullptr;
+	gymView = nullptr;
+	stickMailbox = nullptr;
+	latencyProbe = nullptr;
+	frameFence = nullptr;
+	scheduler = nullptr;
+	contact = nullptr;
 
-	// Start Hackflight firmware
-	hackflight.init(&board, &controller, &stabilizer);
-	
 	// Store initial position, orientation for recovery after collision
 	initialLocation = GetActorLocation();
 	initialRotation = GetActorRotation();
 
-	// No collision yet
-	collisionState = NORMAL;
+	// No vision result yet
+	visionCentroid = hf::vision_centroid_t();
+
+	// Step firmware and physics at a fixed rate
+	stepper = hf::FixedStepper(PARAM_FIRMWARE_RATE_HZ, PARAM_MAX_FRAME_SECONDS);
 
 	initCamera();
 
+	if (dedicated) {
+		return;
+	}
+
 	// http://bendemott.blogspot.com/2016/10/unreal-4-playing-sound-from-c-with.html 
 
 	// Load our Sound Cue for the propeller sound we created in the editor... 
@@ -148,7 +261,7 @@ void AHackflightSimVehicle::PostInitializeComponents()
 {
 	Super::PostInitializeComponents();
 
-	if (propellerAudioCue->IsValidLowLevelFast()) {
+	if (propellerAudioComponent && propellerAudioCue->IsValidLowLevelFast()) {
 		propellerAudioComponent->SetSound(propellerAudioCue);
 	}
 }
@@ -156,11 +269,102 @@ void AHackflightSimVehicle::PostInitializeComponents()
 // Called when the game starts or when spawned
 void AHackflightSimVehicle::BeginPlay()
 {
+	// Give this vehicle its own firmware instances, and start the firmware
+	double spawnStart = FPlatformTime::Seconds();
+	controller = new hf::TappedReceiver<hf::Controller>();
+	simVehicle = new hf::SimVehicle(STABILIZER);
+	simVehicle->setIntegrator((hf::integrator_t)PARAM_POSE_INTEGRATOR);
+	if (PARAM_IMU_RATE_HZ > 0) {
+		simVehicle->setImuModel(hf::ImuModel(PARAM_IMU_RATE_HZ, PARAM_IMU_SEED));
+	}
+	simVehicle->init(controller);
+	initialState = new hf::VehicleSnapshot(*simVehicle);
+
+	// Crash response, with the bounce-back set up in HackflightSimParams.h
+	hf::contact_params_t contactParams = hf::CONTACT_DEFAULT;
+	contactParams.impactRestitution = PARAM_BOUNCEBACK_FORCE;
+	contactParams.bounceSeconds = PARAM_BOUNCEBACK_SECONDS;
+	contactParams.restitution = PARAM_CONTACT_RESTITUTION;
+	contactParams.friction = PARAM_CONTACT_FRICTION;
+	contact = new hf::ContactModel(contactParams);
+	UE_LOG(LogTemp, Log, TEXT("%s: firmware created in %.1f usec (%d bytes)"), *GetName(),
+		1e6 * (FPlatformTime::Seconds() - spawnStart),
+		(int)(sizeof(hf::SimVehicle) + sizeof(hf::VehicleSnapshot) + sizeof(*controller)));
+
+	// Start from where the level put the vehicle, unless a replay moves it
+	poseFromActor();
+
+	// Before the flight log, because a replay may change the step rate
+	startInputLog();
+
+	// Other processes can fly this vehicle through /hackflight_sticks_<name>, overriding the controller
+	if (*PARAM_STICK_MAILBOX_PREFIX) {
+		FString name = FString(PARAM_STICK_MAILBOX_PREFIX) + TEXT("_") + GetName();
+		stickMailbox = new hf::StickMailboxReader();
+		if (stickMailbox->open(TCHAR_TO_UTF8(*name), PARAM_STICK_MAILBOX_TIMEOUT_SECONDS)) {
+			UE_LOG(LogTemp, Log, TEXT("%s: accepting stick input on %s"), *GetName(), *name);
+		}
+		else {
+			delete stickMailbox;
+			stickMailbox = nullptr;
+		}
+	}
+
+	if (PARAM_LATENCY_PROBE) {
+		latencyProbe = new hf::LatencyProbe(PARAM_LATENCY_PROBE_CHANNEL, PARAM_LATENCY_PROBE_AMPLITUDE,
+			PARAM_LATENCY_PROBE_PERIOD_SECONDS, PARAM_LATENCY_PROBE_THROTTLE,
+			PARAM_LATENCY_PROBE_MOTOR_THRESHOLD, PARAM_LATENCY_PROBE_MOTION_THRESHOLD);
+		latencyProbe->start(hf::steadyNanos());
+		frameFence = new HackflightSimFrameFence(latencyProbe);
+	}
+
+	if (*PARAM_GYM_VIEW_NAME) {
+		gymView = new hf::ShmMailbox<hf::gym_view_t>();
+		if (!gymView->open(PARAM_GYM_VIEW_NAME, false)) {
+			delete gymView;
+			gymView = nullptr;
+		}
+	}
+
+	// Subsystems run against simulated time on the firmware's clock, set above by any replay
+	scheduler = new hf::Scheduler(1 / stepper.stepSeconds());
+	scheduler->add("firmware", 1 / stepper.stepSeconds(), 0, [this](float) { step(stepper.stepSeconds()); });
+	if (!dedicated) {
+		scheduler->add("vision", PARAM_VISION_RATE_HZ, 0, [this](float) { pickUpVision(); });
+		scheduler->add("audio", PARAM_AUDIO_RATE_HZ, 0, [this](float) { soundMotors(simVehicle->motorValues); });
+		scheduler->add("console", PARAM_CONSOLE_OVERLAY_HZ, 0, [](float) { showConsole(); });
+	}
+
+	// Firmware output goes to the console log while any vehicle is in play
+	startConsole();
+
+#ifndef _WIN32
+	// Disk space for the whole log is reserved now, at the step rate any replay has set, so that
+	// recording cannot run out of it midway
+	if (PARAM_FLIGHT_LOG_MINUTES > 0) {
+		FString dir = FPaths::ProjectSavedDir() + TEXT("Flights/");
+		FString path = dir + GetName() + TEXT(".hflog");
+		IFileManager::Get().MakeDirectory(*dir, true);
+		recorder = new hf::FlightRecorder();
+		if (!recorder->open(TCHAR_TO_UTF8(*path), (uint64_t)(PARAM_FLIGHT_LOG_MINUTES * 60 / stepper.stepSeconds()),
+				stepper.stepSeconds())) {
+			UE_LOG(LogTemp, Warning, TEXT("%s: unable to create flight log %s"), *GetName(), *path);
+			delete recorder;
+			recorder = nullptr;
+		}
+	}
+#endif
+
 	Super::BeginPlay();
 
 	// Start with the follow camera activated, headless mode
 	initCamera();
 
+	if (dedicated) {
+		UE_LOG(LogTemp, Log, TEXT("%s: dedicated simulation, without cameras, props, sound or vision"), *GetName());
+		return;
+	}
+
 	// Note because the Cue Asset is set to loop the sound,
 	// once we start playing the sound, it will play 
 	// continiously...
@@ -174,132 +378,464 @@ void AHackflightSimVehicle::BeginPlay()
 	// Or you can start playing the sound immediately.
 	propellerAudioComponent->Play();
 }
+
+void AHackflightSimVehicle::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	stopConsole();
+
+	if (simVehicle) {
+		reportFootprint();
+	}
+
+#ifndef _WIN32
+	if (recorder && recorder->dropped() > 0) {
+		UE_LOG(LogTemp, Warning, TEXT("%s: flight log full, %llu steps not recorded"), *GetName(),
+			(unsigned long long)recorder->dropped());
+	}
+	delete recorder;
+#endif
+	recorder = nullptr;
+
+	delete inputRecorder;
+	delete inputPlayer;
+	inputRecorder = nullptr;
+	inputPlayer = nullptr;
+
+	delete gymView;
+	gymView = nullptr;
+
+	delete stickMailbox;
+	stickMailbox = nullptr;
+
+	if (latencyProbe) {
+		// The fence belongs to the render thread, which may still be about to stamp a frame
+		ENQUEUE_UNIQUE_RENDER_COMMAND_ONEPARAMETER(
+			HackflightSimDeleteFrameFenceCommand,
+			HackflightSimFrameFence *, Fence, frameFence,
+			{
+				delete Fence;
+			});
+		frameFence = nullptr;
+		FlushRenderingCommands();
+		dumpLatency();
+		delete latencyProbe;
+		latencyProbe = nullptr;
+	}
+
+	delete scheduler;
+	scheduler = nullptr;
+
+	delete contact;
+	delete simVehicle;
+	delete initialState;
+	delete controller;
+	contact = nullptr;
+	simVehicle = nullptr;
+	initialState = nullptr;
+	controller = nullptr;
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void AHackflightSimVehicle::Tick(float deltaSeconds)
 {
+	HF_TIME_STAGE(hf::STAGE_TICK);
+
+	// Times this vehicle's tick, however it returns
+	struct TickTimer {
+		AHackflightSimVehicle * vehicle;
+		double start;
+		~TickTimer() { vehicle->tickSeconds += FPlatformTime::Seconds() - start; ++vehicle->tickCount; }
+	} tickTimer = { this, FPlatformTime::Seconds() };
+
 	// Call any parent class Tick implementation
 	Super::Tick(deltaSeconds);
 
 	// Spacebar cycles through cameras
-	if (GetWorld()->GetFirstPlayerController()->GetInputKeyTimeDown(FKey("Spacebar")) > 0) {
-		keyDownTime += deltaSeconds;
+	if (!dedicated) {
+		if (GetWorld()->GetFirstPlayerController()->GetInputKeyTimeDown(FKey("Spacebar")) > 0) {
+			keyDownTime += deltaSeconds;
+		}
+		else {
+			if (keyDownTime > 0) {
+				cycleCamera();
+			}
+			keyDownTime = 0;
+		}
 	}
-	else {
-		if (keyDownTime > 0) {
-			cycleCamera();
+
+	if (showGymView()) {
+		return;
+	}
+
+	// Start from wherever the engine left the vehicle if it has moved it (the gym view, say); otherwise
+	// the integrated pose carries over without a trip through centimetres, so that the steps a frame
+	// happens to hold cannot change the flight
+	if (GetActorLocation() != placedLocation) {
+		poseFromActor();
+	}
+
+	// Run as many fixed firmware/physics steps as this frame owes us, and whatever else falls due on them
+	stepper.advance(deltaSeconds, [this](float) { scheduler->step(); });
+
+	spinProps(simVehicle->motorValues);
+
+	// Hand the integrated pose to UE4 once per frame (UE4 uses cm, so multiply by 100 first); a sweep
+	// that stops short leaves the vehicle where the engine put it
+	{
+		HF_TIME_STAGE(hf::STAGE_SWEEP);
+		hf::Pose & pose = simVehicle->pose;
+		FHitResult hit;
+		SetActorLocationAndRotation(
+			100 * FVector(pose.position[0], pose.position[1], pose.position[2]),
+			FQuat(pose.orientation.x, pose.orientation.y, pose.orientation.z, pose.orientation.w),
+			true, &hit);
+		if (hit.bBlockingHit) {
+			poseFromActor();
 		}
-		keyDownTime = 0;
+		placedLocation = GetActorLocation();
 	}
 
-	if (collidingSeconds > 1) {
-		collidingSeconds -= deltaSeconds;
-		collisionState = BOUNCING;
+	// Every frame while probing, so that the fence can follow the previous frame's draw; the ticket is
+	// nonzero if this frame is the first to show a probed input's response
+	if (latencyProbe) {
+		HackflightSimFrameFence * fence = frameFence;
+		uint32_t ticket = latencyProbe->renderTicket();
+		ENQUEUE_UNIQUE_RENDER_COMMAND_TWOPARAMETER(
+			HackflightSimLatencyCommand,
+			HackflightSimFrameFence *, Fence, fence,
+			uint32_t, Ticket, ticket,
+			{
+				Fence->frame(RHICmdList, Ticket);
+			});
 	}
+}
+
+// Writes the probe's per-stage latencies to Saved/Logs/HackflightLatency_<name>.txt
+void AHackflightSimVehicle::dumpLatency(void)
+{
+	latencyProbe->poll();
 
-	else if (collidingSeconds > 0) {
-		collisionState = FALLING;
+	FString path = FPaths::ProjectLogDir() + TEXT("HackflightLatency_") + GetName() + TEXT(".txt");
+
+	// A table of zeros would read as a measurement
+	if (latencyProbe->completed() == 0) {
+		FString text = TEXT("No input was followed through to motion; try another channel, a larger amplitude or lower thresholds");
+		UE_LOG(LogTemp, Warning, TEXT("%s: %s"), *GetName(), *text);
+		FFileHelper::SaveStringToFile(text + TEXT("\n"), *path);
+		return;
 	}
 
-	float motorValues[4] = { 0.5f, 0.5f, 0.5f, 0.5f };
+	FString text = FString::Printf(TEXT("Responses are motor changes of %g and motion of %g or more\n"),
+		latencyProbe->motorThreshold(), latencyProbe->motionThreshold());
 
-	switch (collisionState) {
+	text += FString::Printf(TEXT("%-14s %8s %10s %10s %10s %10s\n"),
+		TEXT("stage"), TEXT("count"), TEXT("mean ms"), TEXT("p50 ms"), TEXT("p99 ms"), TEXT("max ms"));
 
-	case BOUNCING:
-		break;
-		
-	case FALLING:
-		VehicleMesh->SetSimulatePhysics(true);
-		break;
+	for (uint32_t stage = 0; stage < hf::LATENCY_COUNT; ++stage) {
+		hf::latency_stats_t s = latencyProbe->stats(stage);
+		text += FString::Printf(TEXT("%-14s %8llu %10.3f %10.3f %10.3f %10.3f\n"), UTF8_TO_TCHAR(hf::LATENCY_NAMES[stage]),
+			(unsigned long long)s.count, s.meanMillis, s.p50Millis, s.p99Millis, s.maxMillis);
+	}
 
-	default:
+	text += FString::Printf(TEXT("%llu inputs not followed through before the next\n"), (unsigned long long)latencyProbe->incomplete());
+	text += GSupportsTimestampRenderQueries ?
+		TEXT("Frames are stamped once the GPU has drawn them, up to a frame late\n") :
+		TEXT("Frames are stamped once queued for drawing; GPU time is not included\n");
 
-		// Update our flight controller
-		hackflight.update();
+	FFileHelper::SaveStringToFile(text, *path);
+}
 
-		// Get current vehicle state from board
-		board.simGetVehicleState(gyroRates, translationRates, motorValues);
+// Logs what this vehicle took: the actor, its components and its firmware objects, and its mean tick time.
+// Engine memory is what the actor and its components hold for themselves (physics bodies, scene proxies,
+// sound and the like) as the engine accounts for it, leaving out assets shared between vehicles; the
+// objects' own sizes are given apart.
+void AHackflightSimVehicle::reportFootprint(void)
+{
+	TInlineComponentArray<UActorComponent*> components(this);
+
+	int64 engineBytes = GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+	int64 objectBytes = GetClass()->GetStructureSize();
+	for (UActorComponent * component : components) {
+		engineBytes += component->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+		objectBytes += component->GetClass()->GetStructureSize();
 	}
 
-	// Spin props, accumulating average motor value
+	int64 firmwareBytes = (int64)(sizeof(hf::SimVehicle) + sizeof(hf::VehicleSnapshot) + sizeof(*controller) +
+		sizeof(hf::ContactModel) + sizeof(hf::Scheduler));
+
+	UE_LOG(LogTemp, Log, TEXT("%s: %s, %d components, %lld bytes (%lld engine, %lld firmware; %lld in engine objects themselves), %.1f usec per tick over %llu ticks"),
+		*GetName(), dedicated ? TEXT("dedicated") : TEXT("rendered"), components.Num(), engineBytes + firmwareBytes,
+		engineBytes, firmwareBytes, objectBytes, tickCount ? 1e6 * tickSeconds / tickCount : 0., (unsigned long long)tickCount);
+}
+
+void AHackflightSimVehicle::showMotors(const float * motorValues)
+{
+	spinProps(motorValues);
+	soundMotors(motorValues);
+}
+
+void AHackflightSimVehicle::spinProps(const float * motorValues)
+{
+	if (dedicated) {
+		return;
+	}
+
+	HF_TIME_STAGE(hf::STAGE_MOTORS);
+
+	float shown[PARAM_AIRFRAME::MOTORS];
+	hf::Airframe<PARAM_AIRFRAME>::fromQuadX(motorValues, shown);
+
+	hf::Airframe<PARAM_AIRFRAME>::forEachMotor([&](uint8_t k) {
+		motors[k].rotate(shown[k]);
+	});
+}
+
+// Modulates the pitch and volume of the propeller sound by the average motor value
+void AHackflightSimVehicle::soundMotors(const float * motorValues)
+{
+	if (dedicated) {
+		return;
+	}
+
+	HF_TIME_STAGE(hf::STAGE_AUDIO);
+
 	float motorSum = 0;
 	for (int k = 0; k < 4; ++k) {
-		motors[k]->rotate(motorValues[k]);
 		motorSum += motorValues[k];
 	}
 
-	// Modulate the pitch and voume of the propeller sound
 	propellerAudioComponent->SetFloatParameter(FName("pitch"), motorSum / 4);
 	propellerAudioComponent->SetFloatParameter(FName("volume"), motorSum / 4);
+}
 
-	// Rotate copter in simulation, after converting radians to degrees
-	AddActorLocalRotation(deltaSeconds * FRotator(gyroRates[1], gyroRates[2], gyroRates[0]) * (180 / M_PI));
-
-	// Move copter (UE4 uses cm, so multiply by 100 first)
-	AddActorLocalOffset(100 * deltaSeconds*FVector(translationRates[0], translationRates[1], translationRates[2]), true);
+// Picks up the latest vision result, without waiting on the vision workers
+void AHackflightSimVehicle::pickUpVision(void)
+{
+	AHackflightSimVisionHUD* hud = Cast<AHackflightSimVisionHUD>(GetWorld()->GetFirstPlayerController()->GetHUD());
+	if (hud) {
+		hud->GetVisionCentroid(visionCentroid);
+	}
 }
 
-// Collision handling
-void AHackflightSimVehicle::NotifyHit(
-        class UPrimitiveComponent* MyComp, 
-        class AActor* Other, 
-        class UPrimitiveComponent* OtherComp, 
-        bool bSelfMoved, 
-        FVector HitLocation, 
-        FVector HitNormal, 
-        FVector NormalImpulse, 
-        const FHitResult& Hit)
+// Moves the vehicle to the served environment's latest pose, relative to where it started;
+// returns false if there is nothing to show, or the server has stopped posting
+bool AHackflightSimVehicle::showGymView(void)
 {
-    Super::NotifyHit(MyComp, Other, OtherComp, bSelfMoved, HitLocation, HitNormal, NormalImpulse, Hit);
+	hf::gym_view_t view;
 
-	switch (collisionState) {
+	if (!gymView || !gymView->read(view)) {
+		return false;
+	}
 
-	case NORMAL:
+	uint64_t now = hf::steadyNanos();
+	if (now > view.postedNanos && now - view.postedNanos > (uint64_t)(1e9 * PARAM_GYM_VIEW_TIMEOUT_SECONDS)) {
+		return false;
+	}
 
-		// Crash above ground; start falling
-		if (GetActorLocation().Z > 0) {
+	showMotors(view.motorValues);
 
-			// Set movement trajectory to inverse of current trajectory
-			for (uint8_t k = 0; k < 3; ++k) {
-				translationRates[k] *= -PARAM_BOUNCEBACK_FORCE;
-			}
+	SetActorLocationAndRotation(
+		initialLocation + 100 * FVector(view.position[0], view.position[1], view.position[2]),
+		FQuat(view.orientation[0], view.orientation[1], view.orientation[2], view.orientation[3]));
 
-			// Start collision countdown
-			collidingSeconds = PARAM_BOUNCEBACK_SECONDS;
+	return true;
+}
+
+void AHackflightSimVehicle::step(float dt)
+{
+	float sticks[hf::STICK_CHANNELS];
 
-			collisionState = FALLING;
+	// Measuring latency, the probe's synthetic steps take the controller's place
+	if (latencyProbe) {
+		latencyProbe->beforeStep(hf::steadyNanos(), stepper.simSeconds(), sticks);
+		controller->play(sticks);
+	}
+
+	// When replaying, the recording supplies this step's sticks and length
+	else if (inputPlayer) {
+		hf::input_record_t input;
+		if (inputPlayer->next(input)) {
+			controller->play(input.sticks);
+			controller->headless = (input.flags & hf::INPUT_HEADLESS) != 0;
+			dt = input.dt;
+		}
+		else {
+			UE_LOG(LogTemp, Log, TEXT("%s: replay finished after %llu steps"), *GetName(),
+				(unsigned long long)inputPlayer->count());
+			controller->stopPlaying();
+			delete inputPlayer;
+			inputPlayer = nullptr;
 		}
+	}
 
-		// Crash on ground; reset
+	// Otherwise the newest external sample, if one is fresh, takes the controller's place
+	else if (stickMailbox) {
+		if (stickMailbox->read(sticks)) {
+			controller->play(sticks);
+		}
 		else {
+			controller->stopPlaying();
+		}
+	}
 
+	// After a crash the contact model moves the vehicle until it comes to rest
+	if (contact->crashed()) {
+		if (contact->step(*simVehicle, dt)) {
 			resetAfterCollision();
 		}
+	}
+
+	// Otherwise update our flight controller and get current vehicle state from board
+	else {
+		simVehicle->step(dt);
+	}
+
+	if (latencyProbe) {
+		latencyProbe->afterStep(hf::steadyNanos(), stepper.simSeconds() + dt, simVehicle->motorValues,
+			simVehicle->gyroRates, simVehicle->translationRates);
+	}
+
+	if (inputRecorder) {
+		inputRecorder->append(dt, controller->getSticks(), controller->headless);
+	}
+
+	record(dt);
+}
+
+// Replays the input log named by PARAM_INPUT_REPLAY_FILE if there is one, or else starts recording
+void AHackflightSimVehicle::startInputLog(void)
+{
+	FString dir = FPaths::ProjectSavedDir() + TEXT("Inputs/");
+
+	// A replay starts from the recording's initial pose exactly, and puts the actor there too; UE4 uses
+	// cm, so multiply by 100
+	if (*PARAM_INPUT_REPLAY_FILE) {
+		FString path = dir + UTF8_TO_TCHAR(PARAM_INPUT_REPLAY_FILE);
+		inputPlayer = new hf::InputPlayer();
+		if (inputPlayer->open(TCHAR_TO_UTF8(*path))) {
+			hf::Pose start = inputPlayer->initialPose();
+			simVehicle->pose = start;
+			SetActorLocationAndRotation(
+				100 * FVector(start.position[0], start.position[1], start.position[2]),
+				FQuat(start.orientation.x, start.orientation.y, start.orientation.z, start.orientation.w));
+			placedLocation = GetActorLocation();
+			stepper.setRate(1 / inputPlayer->stepSeconds());
+			UE_LOG(LogTemp, Log, TEXT("%s: replaying %s"), *GetName(), *path);
+			return;
+		}
+		UE_LOG(LogTemp, Warning, TEXT("%s: unable to replay %s"), *GetName(), *path);
+		delete inputPlayer;
+		inputPlayer = nullptr;
+	}
 
-		break;
+	if (PARAM_INPUT_RECORD) {
+		FString path = dir + GetName() + TEXT(".hfin");
+		IFileManager::Get().MakeDirectory(*dir, true);
+		inputRecorder = new hf::InputRecorder();
+		if (!inputRecorder->open(TCHAR_TO_UTF8(*path), stepper.stepSeconds(), simVehicle->pose)) {
+			UE_LOG(LogTemp, Warning, TEXT("%s: unable to record input to %s"), *GetName(), *path);
+			delete inputRecorder;
+			inputRecorder = nullptr;
+		}
+	}
+}
 
-	case FALLING:
+// Takes the pose from wherever the engine has put the vehicle (UE4 uses cm, so divide by 100)
+void AHackflightSimVehicle::poseFromActor(void)
+{
+	hf::Pose & pose = simVehicle->pose;
+	FVector location = GetActorLocation();
+	FQuat rotation = GetActorQuat();
+	pose.position[0] = location.X / 100;
+	pose.position[1] = location.Y / 100;
+	pose.position[2] = location.Z / 100;
+	pose.orientation.x = rotation.X;
+	pose.orientation.y = rotation.Y;
+	pose.orientation.z = rotation.Z;
+	pose.orientation.w = rotation.W;
+	placedLocation = location;
+}
 
-		resetAfterCollision();
+// Appends this step to the flight log, in place in the mapped file
+void AHackflightSimVehicle::record(float dt)
+{
+#ifndef _WIN32
+	if (!recorder) {
+		return;
+	}
 
-		break;
+	hf::flight_record_t * r = recorder->next();
+	if (!r) {
+		return;
 	}
-	
+
+	r->step = stepper.stepCount();
+	r->simSeconds = stepper.simSeconds() + dt;
+	r->dt = dt;
+	FMemory::Memcpy(r->gyroRates, simVehicle->gyroRates, sizeof(r->gyroRates));
+	FMemory::Memcpy(r->translationRates, simVehicle->translationRates, sizeof(r->translationRates));
+	FMemory::Memcpy(r->motorValues, simVehicle->motorValues, sizeof(r->motorValues));
+	FMemory::Memcpy(r->position, simVehicle->pose.position, sizeof(r->position));
+	r->orientation[0] = simVehicle->pose.orientation.x;
+	r->orientation[1] = simVehicle->pose.orientation.y;
+	r->orientation[2] = simVehicle->pose.orientation.z;
+	r->orientation[3] = simVehicle->pose.orientation.w;
+	FMemory::Memcpy(r->sticks, controller->getSticks(), sizeof(r->sticks));
+	r->collisionState = contact->state();
+
+	recorder->commit();
+#endif
 }
 
-void AHackflightSimVehicle::resetAfterCollision(void)
+// Collision handling
+void AHackflightSimVehicle::NotifyHit(
+        class UPrimitiveComponent* MyComp, 
+        class AActor* Other, 
+        class UPrimitiveComponent* OtherComp, 
+        bool bSelfMoved, 
+        FVector HitLocation, 
+        FVector HitNormal, 
+        FVector NormalImpulse, 
+        const FHitResult& Hit)
 {
-	// Return control of physics to firmware
-	VehicleMesh->SetSimulatePhysics(false);
+    Super::NotifyHit(MyComp, Other, OtherComp, bSelfMoved, HitLocation, HitNormal, NormalImpulse, Hit);
 
-	// Start Hackflight firmware
-	hackflight.init(&board, new hf::Controller(), &stabilizer);
+	if (!simVehicle) {
+		return;
+	}
 
-	// No collision
-	collisionState = NORMAL;
-	collidingSeconds = 0;
+	// A crash above ground bounces the vehicle back and lets it fall; a crash on the ground, or coming to rest, resets it
+	FVector location = GetActorLocation() / 100;
+	const float position[3] = { location.X, location.Y, location.Z };
+	const float normal[3] = { HitNormal.X, HitNormal.Y, HitNormal.Z };
+	if (contact->collide(*simVehicle, position, normal)) {
+		resetAfterCollision();
+	}
+}
 
-	// Return vehicle to its starting position and orientation
-	SetActorLocation(initialLocation);
-	SetActorRotation(initialRotation);
+void AHackflightSimVehicle::resetAfterCollision(void)
+{
+	// Put firmware, board, stabilizer, rates and pose back as they were at the start of play,
+	// without restarting the firmware or allocating anything
+	simVehicle->restore(*initialState);
+
+	// No collision
+	contact->reset();
+
+	// Start the pose there too, since a crash can end partway through a frame's steps
+	hf::Pose & pose = simVehicle->pose;
+	FQuat rotation = initialRotation.Quaternion();
+	pose.position[0] = initialLocation.X / 100;
+	pose.position[1] = initialLocation.Y / 100;
+	pose.position[2] = initialLocation.Z / 100;
+	pose.orientation.x = rotation.X;
+	pose.orientation.y = rotation.Y;
+	pose.orientation.z = rotation.Z;
+	pose.orientation.w = rotation.W;
+
+	// Return vehicle to its starting position and orientation, in one move
+	SetActorLocationAndRotation(initialLocation, initialRotation, false, nullptr, ETeleportType::TeleportPhysics);
 }
 
 // Cycles among our three cameras
@@ -313,19 +849,19 @@ void AHackflightSimVehicle::cycleCamera(void)
             FollowCamera->Deactivate();
             ChaseCamera->Activate();
             FpvCamera->Deactivate();
-			controller.headless = false;
+			controller->headless = false;
             break;
         case 2:
             FollowCamera->Deactivate();
             ChaseCamera->Deactivate();
             FpvCamera->Activate();
-			controller.headless = false;
+			controller->headless = false;
             break;
         default:
             FollowCamera->Activate();
             ChaseCamera->Deactivate();
             FpvCamera->Deactivate();
-			controller.headless = true;
+			controller->headless = true;
     }
 }
 
@@ -358,11 +894,15 @@ void AHackflightSimVehicle::createCameraWithSpringArm(
 void AHackflightSimVehicle::initCamera()
 {
 
-	// Start with the follow camera activated, headless mode
-	FollowCamera->Activate();
-	ChaseCamera->Deactivate();
-	FpvCamera->Deactivate();
+	// Start with the follow camera activated, headless mode; a dedicated simulation has no cameras
+	if (FollowCamera) {
+		FollowCamera->Activate();
+		ChaseCamera->Deactivate();
+		FpvCamera->Deactivate();
+	}
 	activeCameraIndex = 0;
-	controller.headless = true;
+	if (controller) {
+		controller->headless = true;
+	}
 	keyDownTime = 0;
 }
@@ -30,9 +30,34 @@ along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
 #include "Components/AudioComponent.h"
 
 #include "HackflightSimMotor.h"
+#include "HackflightSimParams.h"
+
+#include "core/stepper.hpp"
+#include "core/vision.hpp"
+#include "core/gymprotocol.hpp"
 
 #include "HackflightSimVehicle.generated.h"
 
+// Firmware classes; their definitions are kept out of this header, because the platform
+// support they pull in may only be compiled once per module
+namespace hf {
+	class SimVehicle;
+	class VehicleSnapshot;
+	class Controller;
+	class FlightRecorder;
+	class InputRecorder;
+	class InputPlayer;
+	template <class R> class TappedReceiver;
+	template <typename T> class ShmMailbox;
+	class StickMailboxReader;
+	class LatencyProbe;
+	class Scheduler;
+	class ContactModel;
+}
+
+// Stamps the latency probe's frames once the GPU has drawn them; used only on the render thread
+class HackflightSimFrameFence;
+
 UCLASS(Config=Game)
 class AHackflightSimVehicle : public APawn
 {
@@ -87,6 +112,8 @@ public:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	virtual void PostInitializeComponents() override;
 
 	virtual void Tick(float DeltaSeconds) override;
@@ -104,18 +131,70 @@ public:
 
 private:
 
-	typedef enum {
+	// One per motor of the airframe, held inline
+	HackflightSimMotor motors[PARAM_AIRFRAME::MOTORS];
+
+	// This vehicle's own firmware, board, stabilizer and pose
+	hf::SimVehicle * simVehicle;
+
+	// The vehicle's state at the start of play, restored after each crash
+	hf::VehicleSnapshot * initialState;
+
+	// This vehicle's own controller input, with the sticks it read kept for the flight log
+	hf::TappedReceiver<hf::Controller> * controller;
+
+	// Logs every fixed step to Saved/Flights/<name>.hflog; null where unsupported or disabled
+	hf::FlightRecorder * recorder;
+	void record(float dt);
+
+	// Records the controller input to Saved/Inputs/<name>.hfin, or replays a recording in its place
+	hf::InputRecorder * inputRecorder;
+	hf::InputPlayer * inputPlayer;
+	void startInputLog(void);
+
+	// Stick input posted by another process; null where unsupported or disabled
+	hf::StickMailboxReader * stickMailbox;
 
-		NORMAL,
-		BOUNCING,
-		FALLING
+	// Steps a stick and times the response through to rendering, in place of the controller
+	hf::LatencyProbe * latencyProbe;
+	HackflightSimFrameFence * frameFence;
+	void dumpLatency(void);
 
-	} collision_state_t;
+	// Runs firmware and physics at a fixed rate, independent of the frame rate
+	hf::FixedStepper stepper;
 
-	// Everything we should need to display the vehicle
-    float gyroRates[3];
-    float translationRates[3];
-	HackflightSimMotor * motors[4];
+	// The integrated pose carries over from frame to frame; it is taken back from the actor only
+	// when the engine has moved the vehicle from where it was last placed
+	FVector placedLocation;
+	void poseFromActor(void);
+
+	// Runs one fixed step of firmware and physics
+	void step(float dt);
+
+	// Runs the firmware, vision pickup, audio and console overlay, each at its own rate, on the fixed steps
+	hf::Scheduler * scheduler;
+
+	// When the environment server (Headless/gym_server -w) is running, shows the environment
+	// it posts instead of flying this vehicle's own firmware
+	hf::ShmMailbox<hf::gym_view_t> * gymView;
+	bool showGymView(void);
+
+	// Spins props and sets the propeller sound from the motor values
+	void showMotors(const float * motorValues);
+	void spinProps(const float * motorValues);
+	void soundMotors(const float * motorValues);
+
+	// Latest result published by the vision workers
+	hf::vision_centroid_t visionCentroid;
+	void pickUpVision(void);
+
+	// Set in dedicated simulation (see HackflightSim.h), where presentation-only components are never built
+	bool dedicated;
+
+	// Time spent in Tick, for the per-vehicle report at the end of play
+	double tickSeconds;
+	uint64_t tickCount;
+	void reportFootprint(void);
 
 	// Intializes camera and headless mode
 	void initCamera();
@@ -135,15 +214,12 @@ private:
 	float keyDownTime;
 	void cycleCamera(void);
 
-	// NORMAL, BOUNCING, FALLING
-	collision_state_t collisionState;
+	// Takes over the vehicle's motion from a crash until it comes to rest
+	hf::ContactModel * contact;
 
 	// Resets everything after collisions
 	void resetAfterCollision(void);
 
-	// Counts down time during which simulation is taken over by collision recovery
-	float collidingSeconds;
-
 	// We need initial location and orientation to restore vehicle after a collision
 	FVector initialLocation;
 	FRotator initialRotation;
@@ -155,4 +231,5 @@ public:
 	FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
 	FORCEINLINE class USpringArmComponent* GetChaseCameraSpringArm() const { return ChaseCameraSpringArm; }
 	FORCEINLINE class UCameraComponent* GetChaseCamera() const { return ChaseCamera; }
+	FORCEINLINE double GetSimSeconds() const { return stepper.simSeconds(); }
 };
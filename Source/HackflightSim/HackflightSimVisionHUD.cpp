@@ -18,31 +18,130 @@
    along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "HackflightSim.h"
 #include "HackflightSimVisionHUD.h"
+#include "HackflightSimReadback.h"
+#include "HackflightSimVehicle.h"
 
+#include "core/pixels.hpp"
+#include "core/shmring.hpp"
+#include "core/timing.hpp"
+
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+// Edit this file to adjust
+#include "HackflightSimParams.h"
 
 #include <debug.hpp>
 
+// Stage latencies, in microseconds, for "stat Hackflight"
+DECLARE_STATS_GROUP(TEXT("Hackflight"), STATGROUP_Hackflight, STATCAT_Advanced);
+
+#define DECLARE_HF_STAGE_STATS(Name, Label) \
+	DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT(Label " p50 (us)"), STAT_HF_##Name##_P50, STATGROUP_Hackflight); \
+	DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT(Label " p99 (us)"), STAT_HF_##Name##_P99, STATGROUP_Hackflight); \
+	DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT(Label " max (us)"), STAT_HF_##Name##_Max, STATGROUP_Hackflight)
+
+#define SET_HF_STAGE_STATS(Name, Stage) { \
+	hf::stage_stats_t s = hf::Timing::instance().stats(Stage); \
+	SET_FLOAT_STAT(STAT_HF_##Name##_P50, s.p50Micros); \
+	SET_FLOAT_STAT(STAT_HF_##Name##_P99, s.p99Micros); \
+	SET_FLOAT_STAT(STAT_HF_##Name##_Max, s.maxMicros); }
+
+DECLARE_HF_STAGE_STATS(Tick, "Tick");
+DECLARE_HF_STAGE_STATS(Firmware, "Firmware");
+DECLARE_HF_STAGE_STATS(VehicleState, "Vehicle state");
+DECLARE_HF_STAGE_STATS(Integrate, "Integrate");
+DECLARE_HF_STAGE_STATS(Motors, "Motors");
+DECLARE_HF_STAGE_STATS(Audio, "Audio");
+DECLARE_HF_STAGE_STATS(Sweep, "Sweep");
+DECLARE_HF_STAGE_STATS(Readback, "Readback");
+DECLARE_HF_STAGE_STATS(Convert, "Convert");
+DECLARE_HF_STAGE_STATS(Vision, "Vision");
+DECLARE_HF_STAGE_STATS(InputAge, "Input age");
+
 AHackflightSimVisionHUD::AHackflightSimVisionHUD()
 {
+	// Readback and vision pipelines are created in BeginPlay, so the class-default object carries none
+	readbackSource = nullptr;
+	readback = nullptr;
+	vision = nullptr;
+	centroid = nullptr;
+	shmRing = nullptr;
+	statsSeconds = 0;
+
+	// A dedicated simulation renders nothing to read back
+	VisionTextureRenderTarget = nullptr;
+	VisionRenderTarget = nullptr;
+	rows = 0;
+	cols = 0;
+	if (HackflightSimDedicated()) {
+		return;
+	}
+
 	// Get Vision render target from blueprint
 	static ConstructorHelpers::FObjectFinder<UTextureRenderTarget2D> VisionTexObj(TEXT("/Game/Hackflight/T_Vision"));
 	VisionTextureRenderTarget = VisionTexObj.Object;
 
-	// Creates Texture2D to store VisionTex content
-	UTexture2D* VisionTexture = UTexture2D::CreateTransient(VisionTextureRenderTarget->SizeX, VisionTextureRenderTarget->SizeY, PF_B8G8R8A8);
-
-#if WITH_EDITORONLY_DATA
-	VisionTexture->MipGenSettings = TMGS_NoMipmaps;
-#endif
-	VisionTexture->SRGB = VisionTextureRenderTarget->SRGB;
-
 	VisionRenderTarget = VisionTextureRenderTarget->GameThread_GetRenderTargetResource();
 
-	// Allocate memory for RGB image bytes
+	// Vision image dimensions
 	rows = VisionTextureRenderTarget->SizeY;
 	cols = VisionTextureRenderTarget->SizeX;
-	imagergb = new uint8_t[rows*cols * 3];
+}
+
+void AHackflightSimVisionHUD::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Stage latencies are per session; threads from earlier sessions have given their slots back
+	hf::Timing::instance().reset();
+
+	if (HackflightSimDedicated()) {
+		return;
+	}
+
+	readbackSource = new HackflightSimRenderTargetSource(VisionRenderTarget, rows, cols);
+	readback = new hf::ReadbackPipeline(readbackSource, PARAM_VISION_READBACK_DEPTH);
+
+	// Vision algorithms run on worker threads
+	vision = new hf::VisionPipeline(rows, cols, PARAM_VISION_QUEUE_DEPTH, PARAM_VISION_WORKERS);
+	centroid = new hf::BrightCentroid();
+	vision->addAlgorithm(centroid);
+	vision->start();
+
+#ifndef _WIN32
+	if (*PARAM_VISION_SHM_NAME) {
+		shmRing = new hf::ShmRingWriter();
+		if (!shmRing->open(PARAM_VISION_SHM_NAME, PARAM_VISION_SHM_SLOTS, rows, cols)) {
+			UE_LOG(LogTemp, Warning, TEXT("Unable to export vision frames to shared memory"));
+			delete shmRing;
+			shmRing = nullptr;
+		}
+	}
+#endif
+}
+
+void AHackflightSimVisionHUD::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Stop the vision workers before freeing anything they use
+	delete vision;
+	delete centroid;
+	delete readback;
+	delete readbackSource;
+#ifndef _WIN32
+	delete shmRing;
+#endif
+	shmRing = nullptr;
+	vision = nullptr;
+	centroid = nullptr;
+	readback = nullptr;
+	readbackSource = nullptr;
+
+	dumpTiming();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 
@@ -50,26 +149,68 @@ void AHackflightSimVisionHUD::DrawHUD()
 {
 	Super::DrawHUD();
 
+	if (!readback) {
+		return;
+	}
+
 	// Draw the image to the HUD
 	DrawTextureSimple(VisionTextureRenderTarget, LEFTX, TOPY, 1.0f, true);
 
-	// Read the pixels from the RenderTarget and store them in a FColor array
-	VisionRenderTarget->ReadPixels(VisionSurfData);
-
-	// Convert the FColor array to an RGB byte array
+	// The vision buffers only ever change size along with the render target
+	if (VisionTextureRenderTarget->SizeY != rows || VisionTextureRenderTarget->SizeX != cols) {
+		resizeVision(VisionTextureRenderTarget->SizeY, VisionTextureRenderTarget->SizeX);
+	}
 
-	for (int x = 0; x < cols; ++x) {
+	// Tag this frame with the vehicle's simulated time and pose, and start reading it back
+	AHackflightSimVehicle* vehicle = Cast<AHackflightSimVehicle>(GetOwningPawn());
+	double simSeconds = vehicle ? vehicle->GetSimSeconds() : GetWorld()->GetTimeSeconds();
+	float position[3] = { 0, 0, 0 };
+	float orientation[4] = { 0, 0, 0, 1 };
+	if (vehicle) {
+		FVector location = vehicle->GetActorLocation() / 100; // cm => m
+		FQuat quat = vehicle->GetActorQuat();
+		position[0] = location.X;
+		position[1] = location.Y;
+		position[2] = location.Z;
+		orientation[0] = quat.X;
+		orientation[1] = quat.Y;
+		orientation[2] = quat.Z;
+		orientation[3] = quat.W;
+	}
+	readback->request(GFrameNumber, simSeconds, position, orientation);
 
-		for (int y = 0; y < rows; ++y) {
+	// Convert the newest frame that has arrived, if any, from BGRA to RGB, straight into a
+	// vision buffer, and hand it to the vision workers
+	hf::readback_frame_t frame;
+	if (readback->pollLatest(frame)) {
+		uint8_t* imagergb = vision->acquire();
+		if (imagergb) {
+			{
+				HF_TIME_STAGE(hf::STAGE_CONVERT);
+				hf::bgraToRgb(frame.bgra, imagergb, rows*cols);
+			}
+			vision->publish(frame.frameNumber, frame.simSeconds);
+		}
+#ifndef _WIN32
+		// Other processes get the same frame, converted straight into the shared ring
+		if (shmRing) {
+			hf::bgraToRgb(frame.bgra, shmRing->begin(), rows*cols);
+			shmRing->commit(frame.frameNumber, frame.simSeconds, frame.position, frame.orientation);
+		}
+#endif
+	}
 
-			int k = x + y * cols;
+	drawVisionStatus(LEFTX, TOPY + HEIGHT + 10);
 
-			FColor PixelColor = VisionSurfData[k];
+	// Percentiles take a pass over every thread's histograms, so refresh them a few times a second
+	statsSeconds += GetWorld()->GetDeltaSeconds();
+	if (statsSeconds >= PARAM_TIMING_STATS_SECONDS) {
+		statsSeconds = 0;
+		publishTimingStats();
+	}
 
-			imagergb[k * 3] = PixelColor.R;
-			imagergb[k * 3 + 1] = PixelColor.G;
-			imagergb[k * 3 + 2] = PixelColor.B;
-		}
+	if (PARAM_TIMING_OVERLAY) {
+		drawTimingOverlay(LEFTX, TOPY + HEIGHT + 40);
 	}
 
 	// Draw a border around the image
@@ -83,10 +224,103 @@ void AHackflightSimVisionHUD::DrawHUD()
 	drawBorder(LEFTX, bottomy, LEFTX, TOPY);
 }
 
+// Frames in flight or waiting for the vision workers are dropped; everything after sees the new size
+void AHackflightSimVisionHUD::resizeVision(int newRows, int newCols)
+{
+	rows = newRows;
+	cols = newCols;
+
+	readback->resize(rows, cols);
+	VisionRenderTarget = VisionTextureRenderTarget->GameThread_GetRenderTargetResource();
+	readbackSource->setRenderTarget(VisionRenderTarget);
+
+	vision->resize(rows, cols);
+
+#ifndef _WIN32
+	if (shmRing && !shmRing->open(PARAM_VISION_SHM_NAME, PARAM_VISION_SHM_SLOTS, rows, cols)) {
+		UE_LOG(LogTemp, Warning, TEXT("Unable to export resized vision frames to shared memory"));
+		delete shmRing;
+		shmRing = nullptr;
+	}
+#endif
+}
+
 void AHackflightSimVisionHUD::drawBorder(float lx, float uy, float rx, float by)
 {
 	DrawLine(lx, uy, rx, by, BORDER_COLOR, BORDER_WIDTH);
 }
 
+// Shows whether the vision workers are keeping up
+void AHackflightSimVisionHUD::drawVisionStatus(float lx, float y)
+{
+	DrawText(FString::Printf(TEXT("Vision: %llu processed, %llu dropped"),
+		(unsigned long long)vision->processed(), (unsigned long long)vision->dropped()), STATUS_COLOR, lx, y);
+}
+
+void AHackflightSimVisionHUD::publishTimingStats()
+{
+	SET_HF_STAGE_STATS(Tick, hf::STAGE_TICK);
+	SET_HF_STAGE_STATS(Firmware, hf::STAGE_FIRMWARE);
+	SET_HF_STAGE_STATS(VehicleState, hf::STAGE_VEHICLE_STATE);
+	SET_HF_STAGE_STATS(Integrate, hf::STAGE_INTEGRATE);
+	SET_HF_STAGE_STATS(Motors, hf::STAGE_MOTORS);
+	SET_HF_STAGE_STATS(Audio, hf::STAGE_AUDIO);
+	SET_HF_STAGE_STATS(Sweep, hf::STAGE_SWEEP);
+	SET_HF_STAGE_STATS(Readback, hf::STAGE_READBACK);
+	SET_HF_STAGE_STATS(Convert, hf::STAGE_CONVERT);
+	SET_HF_STAGE_STATS(Vision, hf::STAGE_VISION);
+	SET_HF_STAGE_STATS(InputAge, hf::STAGE_INPUT_AGE);
+}
+
+// One line per timed stage: sample count, p50, p99 and max
+void AHackflightSimVisionHUD::drawTimingOverlay(float lx, float y)
+{
+	for (uint32_t stage = 0; stage < hf::STAGE_COUNT; ++stage) {
+		hf::stage_stats_t s = hf::Timing::instance().stats(stage);
+		if (s.count > 0) {
+			DrawText(FString::Printf(TEXT("%-14s p50 %7.1f  p99 %7.1f  max %8.1f us"), UTF8_TO_TCHAR(hf::STAGE_NAMES[stage]),
+				s.p50Micros, s.p99Micros, s.maxMicros), STATUS_COLOR, lx, y);
+			y += 15;
+		}
+	}
+
+	uint64_t dropped = hf::Timing::instance().dropped();
+	if (dropped > 0) {
+		DrawText(FString::Printf(TEXT("%llu samples dropped"), (unsigned long long)dropped), STATUS_COLOR, lx, y);
+	}
+}
+
+// Writes the whole session's stage latencies to Saved/Logs/HackflightTiming.txt
+void AHackflightSimVisionHUD::dumpTiming()
+{
+	if (!HF_TIMING) {
+		return;
+	}
+
+	FString text = FString::Printf(TEXT("%-14s %12s %10s %10s %10s %10s\n"),
+		TEXT("stage"), TEXT("count"), TEXT("mean us"), TEXT("p50 us"), TEXT("p99 us"), TEXT("max us"));
+
+	for (uint32_t stage = 0; stage < hf::STAGE_COUNT; ++stage) {
+		hf::stage_stats_t s = hf::Timing::instance().stats(stage);
+		if (s.count > 0) {
+			text += FString::Printf(TEXT("%-14s %12llu %10.2f %10.2f %10.2f %10.2f\n"), UTF8_TO_TCHAR(hf::STAGE_NAMES[stage]),
+				(unsigned long long)s.count, s.meanMicros, s.p50Micros, s.p99Micros, s.maxMicros);
+		}
+	}
+
+	uint64_t dropped = hf::Timing::instance().dropped();
+	if (dropped > 0) {
+		text += FString::Printf(TEXT("%llu samples dropped: more than %u threads recording at once\n"),
+			(unsigned long long)dropped, hf::Timing::MAX_THREADS);
+	}
+
+	FFileHelper::SaveStringToFile(text, *(FPaths::ProjectLogDir() + TEXT("HackflightTiming.txt")));
+}
+
+bool AHackflightSimVisionHUD::GetVisionCentroid(hf::vision_centroid_t & result) const
+{
+	return centroid && centroid->result.read(result);
+}
+
 
 
@@ -25,8 +25,17 @@
 #include "GameFramework/Character.h"
 #include "Engine/TextureRenderTarget2D.h"
 
+#include "core/vision.hpp"
+
 #include "HackflightSimVisionHUD.generated.h"
 
+namespace hf {
+	class ReadbackPipeline;
+	class ShmRingWriter;
+}
+
+class HackflightSimRenderTargetSource;
+
 UCLASS(Config = Game)
 class HACKFLIGHTSIM_API AHackflightSimVisionHUD : public AHUD
 {
@@ -34,6 +43,10 @@ class HACKFLIGHTSIM_API AHackflightSimVisionHUD : public AHUD
 
 	AHackflightSimVisionHUD();
 
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	virtual void DrawHUD() override;
 
 	const float LEFTX  = 45.f;
@@ -49,10 +62,34 @@ class HACKFLIGHTSIM_API AHackflightSimVisionHUD : public AHUD
 	// Access to Vision camera
 	UTextureRenderTarget2D* VisionTextureRenderTarget;
 	FRenderTarget* VisionRenderTarget;
-	TArray<FColor> VisionSurfData;
 
-	// Support for vision algorithms
+	// Reads Vision camera frames back a few frames late, instead of stalling every frame
+	HackflightSimRenderTargetSource* readbackSource;
+	hf::ReadbackPipeline* readback;
+
+	// Support for vision algorithms, which run off the game thread
 	int rows;
 	int cols;
-	uint8_t* imagergb;
+	hf::VisionPipeline* vision;
+	hf::BrightCentroid* centroid;
+
+	// Exports each vision frame to other processes; null where shared memory is unavailable
+	hf::ShmRingWriter* shmRing;
+
+	// Follows a resized render target, reallocating the frame buffers once
+	void resizeVision(int newRows, int newCols);
+
+	const FLinearColor STATUS_COLOR = FLinearColor::Yellow;
+	void drawVisionStatus(float lx, float y);
+
+	// Stage timing: "stat Hackflight", an optional overlay, and a report at the end of play
+	float statsSeconds;
+	void publishTimingStats();
+	void drawTimingOverlay(float lx, float y);
+	void dumpTiming();
+
+public:
+
+	// Latest result from the vision algorithms; lock-free, so safe to call every tick
+	bool GetVisionCentroid(hf::vision_centroid_t & result) const;
 };
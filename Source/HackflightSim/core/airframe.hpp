@@ -0,0 +1,245 @@
+/*
+   airframe.hpp: compile-time airframe traits for HackflightSim
+
+   Each airframe gives its motor count and, for each motor, its position, spin direction and
+   row of the mixer matrix.  Airframe<Frame> mixes demands into motor values and sums the
+   motors' thrust and torque with the per-motor loop unrolled for the frame, so that the
+   motor count and mixer coefficients are constants to the compiler.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace hf {
+
+    // Demands mixed into motor values, in the order the mixer matrix columns follow
+    enum {
+
+        DEMAND_THROTTLE,
+        DEMAND_ROLL,
+        DEMAND_PITCH,
+        DEMAND_YAW,
+        DEMAND_COUNT
+    };
+
+    typedef struct {
+
+        float  x;           // centimeters forward of center
+        float  y;           // centimeters right of center
+        int8_t direction;   // +1 clockwise, -1 counterclockwise, seen from above
+
+        // Mixer row: how much roll, pitch and yaw demand this motor takes, throttle being one
+        float  roll;
+        float  pitch;
+        float  yaw;
+
+    } airframe_motor_t;
+
+    // The firmware's own layout, in its motor order, with the 3DFly frame's displacements
+    struct QuadX {
+
+        static const uint8_t MOTORS = 4;
+
+        static const char * name(void) { return "quad-X"; }
+
+        static const airframe_motor_t & motor(uint8_t k)
+        {
+            static const airframe_motor_t MOTOR[MOTORS] = {
+                { -3.7f, +2.8f, +1, -1, +1, +1 },   // rear right
+                { +3.7f, +2.8f, -1, -1, -1, -1 },   // front right
+                { -3.7f, -4.7f, -1, +1, +1, -1 },   // rear left
+                { +3.7f, -4.7f, +1, +1, -1, +1 },   // front left
+            };
+            return MOTOR[k];
+        }
+    };
+
+    struct QuadPlus {
+
+        static const uint8_t MOTORS = 4;
+
+        static const char * name(void) { return "quad-+"; }
+
+        static const airframe_motor_t & motor(uint8_t k)
+        {
+            static const airframe_motor_t MOTOR[MOTORS] = {
+                { -4.5f,  0.0f, +1,  0, +1, +1 },   // rear
+                {  0.0f, +4.5f, -1, -1,  0, -1 },   // right
+                {  0.0f, -4.5f, -1, +1,  0, -1 },   // left
+                { +4.5f,  0.0f, +1,  0, -1, +1 },   // front
+            };
+            return MOTOR[k];
+        }
+    };
+
+    // Six motors every 60 degrees clockwise from 30 degrees right of the nose
+    struct Hexa {
+
+        static const uint8_t MOTORS = 6;
+
+        static const char * name(void) { return "hexa"; }
+
+        static const airframe_motor_t & motor(uint8_t k)
+        {
+            static const airframe_motor_t MOTOR[MOTORS] = {
+                { +4.763f, +2.750f, +1, -0.500f, -0.866f, +1 },
+                {  0.000f, +5.500f, -1, -1.000f,  0.000f, -1 },
+                { -4.763f, +2.750f, +1, -0.500f, +0.866f, +1 },
+                { -4.763f, -2.750f, -1, +0.500f, +0.866f, -1 },
+                {  0.000f, -5.500f, +1, +1.000f,  0.000f, +1 },
+                { +4.763f, -2.750f, -1, +0.500f, -0.866f, -1 },
+            };
+            return MOTOR[k];
+        }
+    };
+
+    // Eight motors every 45 degrees clockwise from 22.5 degrees right of the nose
+    struct Octo {
+
+        static const uint8_t MOTORS = 8;
+
+        static const char * name(void) { return "octo"; }
+
+        static const airframe_motor_t & motor(uint8_t k)
+        {
+            static const airframe_motor_t MOTOR[MOTORS] = {
+                { +6.005f, +2.487f, +1, -0.383f, -0.924f, +1 },
+                { +2.487f, +6.005f, -1, -0.924f, -0.383f, -1 },
+                { -2.487f, +6.005f, +1, -0.924f, +0.383f, +1 },
+                { -6.005f, +2.487f, -1, -0.383f, +0.924f, -1 },
+                { -6.005f, -2.487f, +1, +0.383f, +0.924f, +1 },
+                { -2.487f, -6.005f, -1, +0.924f, +0.383f, -1 },
+                { +2.487f, -6.005f, +1, +0.924f, -0.383f, +1 },
+                { +6.005f, -2.487f, -1, +0.383f, -0.924f, -1 },
+            };
+            return MOTOR[k];
+        }
+    };
+
+    // Calls body(K), ..., body(N-1) with the loop written out by the compiler
+    template <uint8_t K, uint8_t N>
+    struct Unroll {
+
+        template <typename Body>
+        static inline void run(const Body & body)
+        {
+            body(K);
+            Unroll<K+1, N>::run(body);
+        }
+    };
+
+    template <uint8_t N>
+    struct Unroll<N, N> {
+
+        template <typename Body>
+        static inline void run(const Body &) { }
+    };
+
+    template <class Frame>
+    class Airframe {
+
+        public:
+
+            static const uint8_t MOTORS = Frame::MOTORS;
+
+            template <typename Body>
+            static inline void forEachMotor(const Body & body)
+            {
+                Unroll<0, MOTORS>::run(body);
+            }
+
+            // Mixes throttle, roll, pitch and yaw demands into motor values in [0,1].  When a
+            // motor would pass full power all are lowered together, giving up throttle before
+            // attitude, and then clamped.
+            static void mix(const float demands[DEMAND_COUNT], float motorValues[MOTORS])
+            {
+                float highest = 0;
+
+                forEachMotor([&](uint8_t k) {
+                    const airframe_motor_t & m = Frame::motor(k);
+                    motorValues[k] = demands[DEMAND_THROTTLE] + demands[DEMAND_ROLL] * m.roll +
+                        demands[DEMAND_PITCH] * m.pitch + demands[DEMAND_YAW] * m.yaw;
+                    highest = motorValues[k] > highest ? motorValues[k] : highest;
+                });
+
+                float excess = highest > 1 ? highest - 1 : 0;
+
+                forEachMotor([&](uint8_t k) {
+                    float v = motorValues[k] - excess;
+                    motorValues[k] = v < 0 ? 0 : v > 1 ? 1 : v;
+                });
+            }
+
+            // Recovers the demands behind motor values, by least squares; the mixer matrices
+            // above have orthogonal columns, so this is exact for unclamped values
+            static void unmix(const float motorValues[MOTORS], float demands[DEMAND_COUNT])
+            {
+                float sums[DEMAND_COUNT] = {0, 0, 0, 0};
+                float norms[DEMAND_COUNT] = {0, 0, 0, 0};
+
+                forEachMotor([&](uint8_t k) {
+                    const airframe_motor_t & m = Frame::motor(k);
+                    const float row[DEMAND_COUNT] = { 1, m.roll, m.pitch, m.yaw };
+                    for (uint8_t j=0; j<DEMAND_COUNT; ++j) {
+                        sums[j] += motorValues[k] * row[j];
+                        norms[j] += row[j] * row[j];
+                    }
+                });
+
+                for (uint8_t j=0; j<DEMAND_COUNT; ++j) {
+                    demands[j] = sums[j] / norms[j];
+                }
+            }
+
+            // Shows the firmware's quad-X motor values on this airframe, by remixing its demands
+            static void fromQuadX(const float quadX[4], float motorValues[MOTORS])
+            {
+                float demands[DEMAND_COUNT];
+                Airframe<QuadX>::unmix(quadX, demands);
+                mix(demands, motorValues);
+            }
+
+            // Sums the motors' thrust and the torque about the center, thrust and drag growing
+            // with the square of the motor value.  Torque is in thrust units times meters, signed
+            // so that a positive roll, pitch or yaw demand gives a positive torque.
+            static void wrench(const float motorValues[MOTORS], float thrustCoefficient, float dragCoefficient,
+                    float & thrust, float torque[3])
+            {
+                float t = 0, roll = 0, pitch = 0, yaw = 0;
+
+                forEachMotor([&](uint8_t k) {
+                    const airframe_motor_t & m = Frame::motor(k);
+                    float squared = motorValues[k] * motorValues[k];
+                    float lift = thrustCoefficient * squared;
+                    t     += lift;
+                    roll  -= m.y * .01f * lift;
+                    pitch -= m.x * .01f * lift;
+                    yaw   += m.direction * dragCoefficient * squared;
+                });
+
+                thrust = t;
+                torque[0] = roll;
+                torque[1] = pitch;
+                torque[2] = yaw;
+            }
+
+    }; // class Airframe
+
+} // namespace hf
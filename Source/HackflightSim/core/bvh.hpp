@@ -0,0 +1,937 @@
+/*
+   bvh.hpp: static collision geometry as a bounding-volume hierarchy in one flat file
+
+   The file is a header, the nodes and the triangles, in that order and with no pointers, so
+   it can be memory-mapped and queried as it lies.  BvhBuilder writes it from triangles (the
+   editor exports maps with the HackflightSimExportCollision commandlet); CollisionBvh maps it
+   and sweeps spheres and axis-aligned boxes through it, for collision outside the engine.
+   Units are meters, in the same frame as Pose.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#include <stdlib.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace hf {
+
+    static const uint32_t BVH_MAGIC = 0x56424648; // "HFBV"
+    static const uint32_t BVH_VERSION = 1;
+
+    // Deepest tree the sweeps can walk; the builder stays within it, and files past it are refused
+    static const uint32_t BVH_MAX_DEPTH = 80;
+
+    typedef struct {
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t triangleCount;
+        uint32_t nodeCount;
+        float    boundsMin[3];
+        float    boundsMax[3];
+        float    start[3];          // where vehicles start, e.g. the map's player start
+        uint32_t reserved[3];
+
+    } bvh_header_t;
+
+    typedef struct {
+
+        float    min[3];
+        uint32_t first;             // a leaf's first triangle, or an interior node's left child (right is next)
+        float    max[3];
+        uint32_t count;             // a leaf's triangles; zero for interior nodes
+
+    } bvh_node_t;
+
+    typedef struct {
+
+        float v0[3];
+        float v1[3];
+        float v2[3];
+        float normal[3];            // unit, (v1-v0) x (v2-v0)
+
+    } bvh_triangle_t;
+
+    static_assert(sizeof(bvh_header_t) == 64, "BVH header must be 64 bytes");
+    static_assert(sizeof(bvh_node_t) == 32, "BVH node must be 32 bytes");
+    static_assert(sizeof(bvh_triangle_t) == 48, "BVH triangle must be 48 bytes");
+
+    typedef struct {
+
+        float    fraction;          // of the way from start to end at first contact
+        float    position[3];       // the shape's center at contact
+        float    normal[3];         // unit, pointing from the surface toward the shape
+        uint32_t triangle;
+
+    } sweep_hit_t;
+
+    struct Vec3 {
+
+        float x, y, z;
+
+        Vec3(void) : x(0), y(0), z(0) { }
+        Vec3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) { }
+        Vec3(const float v[3]) : x(v[0]), y(v[1]), z(v[2]) { }
+
+        Vec3 operator+(const Vec3 & v) const { return Vec3(x+v.x, y+v.y, z+v.z); }
+        Vec3 operator-(const Vec3 & v) const { return Vec3(x-v.x, y-v.y, z-v.z); }
+        Vec3 operator*(float s) const { return Vec3(x*s, y*s, z*s); }
+
+        float operator[](int k) const { return k == 0 ? x : k == 1 ? y : z; }
+
+        void store(float v[3]) const
+        {
+            v[0] = x;
+            v[1] = y;
+            v[2] = z;
+        }
+    };
+
+    inline float dot(const Vec3 & a, const Vec3 & b)
+    {
+        return a.x*b.x + a.y*b.y + a.z*b.z;
+    }
+
+    inline Vec3 cross(const Vec3 & a, const Vec3 & b)
+    {
+        return Vec3(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+    }
+
+    // Triangle tests used by the sweeps; each finds the first contact no later than tmax, treating
+    // triangles as two-sided.  A shape that starts touching a triangle hits it at zero only if it is
+    // moving further in, so that it can always move away.
+    class SweepTests {
+
+        private:
+
+            static bool insideTriangle(const Vec3 & q, const bvh_triangle_t & tri)
+            {
+                Vec3 n(tri.normal), a(tri.v0), b(tri.v1), c(tri.v2);
+
+                return dot(cross(b - a, q - a), n) >= 0 && dot(cross(c - b, q - b), n) >= 0 &&
+                    dot(cross(a - c, q - c), n) >= 0;
+            }
+
+            // Sphere of radius r about c, entered by p + t d
+            static bool raySphere(const Vec3 & p, const Vec3 & d, const Vec3 & c, float r, float tmax, float & t)
+            {
+                Vec3 m = p - c;
+                float a = dot(d, d);
+                float b = dot(m, d);
+                float k = dot(m, m) - r*r;
+
+                if (k <= 0) {
+                    t = 0;
+                    return b < 0;
+                }
+
+                float disc = b*b - a*k;
+                if (b >= 0 || disc < 0 || a == 0) {
+                    return false;
+                }
+
+                t = (-b - sqrtf(disc)) / a;
+                return t <= tmax;
+            }
+
+            // Cylinder of radius r about the segment ab, entered by p + t d within the segment
+            static bool rayCylinder(const Vec3 & p, const Vec3 & d, const Vec3 & a, const Vec3 & b, float r,
+                    float tmax, float & t)
+            {
+                Vec3 e = b - a;
+                float ee = dot(e, e);
+                Vec3 m = p - a;
+
+                Vec3 mp = m - e * (dot(m, e) / ee);
+                Vec3 dp = d - e * (dot(d, e) / ee);
+
+                float A = dot(dp, dp);
+                float B = dot(mp, dp);
+                float C = dot(mp, mp) - r*r;
+
+                if (C <= 0) {
+                    t = 0;
+                }
+                else {
+                    float disc = B*B - A*C;
+                    if (B >= 0 || disc < 0 || A < 1e-12f) {
+                        return false;
+                    }
+                    t = (-B - sqrtf(disc)) / A;
+                    if (t > tmax) {
+                        return false;
+                    }
+                }
+
+                float s = dot(m + d * t, e) / ee;
+
+                return s >= 0 && s <= 1 && (C > 0 || B < 0);
+            }
+
+            static Vec3 closestOnSegment(const Vec3 & q, const Vec3 & a, const Vec3 & b)
+            {
+                Vec3 e = b - a;
+                float s = dot(q - a, e) / dot(e, e);
+                s = s < 0 ? 0 : s > 1 ? 1 : s;
+                return a + e * s;
+            }
+
+        public:
+
+            static bool sphere(const Vec3 & p, const Vec3 & d, float r, const bvh_triangle_t & tri, float tmax,
+                    float & t, Vec3 & normal)
+            {
+                Vec3 n(tri.normal), v0(tri.v0);
+
+                float dist = dot(n, p - v0);
+                float s = dist >= 0 ? 1.f : -1.f;
+                float approach = -s * dot(n, d);
+
+                // Contact needs the center within r of the plane, which happens first at tplane
+                float tplane = 0;
+                if (s * dist > r) {
+                    if (approach <= 0) {
+                        return false;
+                    }
+                    tplane = (s * dist - r) / approach;
+                    if (tplane > tmax) {
+                        return false;
+                    }
+                }
+
+                // Touching the face itself, where the center is over the triangle
+                Vec3 c = p + d * tplane;
+                if (insideTriangle(c - n * dot(n, c - v0), tri)) {
+                    if (tplane == 0 && approach <= 0) {
+                        return false;
+                    }
+                    t = tplane;
+                    normal = n * s;
+                    return true;
+                }
+
+                // Otherwise the first of the edges and corners
+                Vec3 v[3] = { Vec3(tri.v0), Vec3(tri.v1), Vec3(tri.v2) };
+                bool found = false;
+                float tk;
+
+                for (int k=0; k<3; ++k) {
+                    if (rayCylinder(p, d, v[k], v[(k+1)%3], r, tmax, tk) && (!found || tk < t)) {
+                        t = tk;
+                        found = true;
+                    }
+                    if (raySphere(p, d, v[k], r, tmax, tk) && (!found || tk < t)) {
+                        t = tk;
+                        found = true;
+                    }
+                }
+
+                if (found) {
+                    c = p + d * t;
+                    Vec3 nearest = closestOnSegment(c, v[0], v[1]);
+                    for (int k=1; k<3; ++k) {
+                        Vec3 q = closestOnSegment(c, v[k], v[(k+1)%3]);
+                        if (dot(c - q, c - q) < dot(c - nearest, c - nearest)) {
+                            nearest = q;
+                        }
+                    }
+                    Vec3 away = c - nearest;
+                    float len = sqrtf(dot(away, away));
+                    normal = len > 0 ? away * (1 / len) : n * s;
+                }
+
+                return found;
+            }
+
+            // Separating-axis test, swept: the box and triangle touch once every axis' intervals overlap
+            static bool box(const Vec3 & p, const Vec3 & d, const Vec3 & h, const bvh_triangle_t & tri, float tmax,
+                    float & t, Vec3 & normal)
+            {
+                Vec3 n(tri.normal);
+                Vec3 v[3] = { Vec3(tri.v0) - p, Vec3(tri.v1) - p, Vec3(tri.v2) - p };
+                Vec3 e[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+
+                Vec3 axes[13] = { Vec3(1, 0, 0), Vec3(0, 1, 0), Vec3(0, 0, 1), n };
+                int count = 4;
+                for (int i=0; i<3; ++i) {
+                    for (int k=0; k<3; ++k) {
+                        axes[count++] = cross(axes[i], e[k]);
+                    }
+                }
+
+                float enter = -1e30f;
+                float exit = 1e30f;
+                Vec3 enterAxis = n;
+
+                for (int k=0; k<count; ++k) {
+
+                    const Vec3 & L = axes[k];
+                    if (dot(L, L) < 1e-12f) {
+                        continue;
+                    }
+
+                    float r = h.x * fabsf(L.x) + h.y * fabsf(L.y) + h.z * fabsf(L.z);
+                    float p0 = dot(L, v[0]), p1 = dot(L, v[1]), p2 = dot(L, v[2]);
+                    float lo = std::min(p0, std::min(p1, p2)) - r;
+                    float hi = std::max(p0, std::max(p1, p2)) + r;
+                    float speed = dot(L, d);
+
+                    // The box's center, at t * speed along this axis, must lie in [lo, hi]
+                    if (fabsf(speed) < 1e-12f) {
+                        if (lo > 0 || hi < 0) {
+                            return false;
+                        }
+                        continue;
+                    }
+
+                    float t0 = lo / speed, t1 = hi / speed;
+                    if (t0 > t1) {
+                        std::swap(t0, t1);
+                    }
+
+                    if (t0 > enter) {
+                        enter = t0;
+                        enterAxis = speed > 0 ? L * -1 : L;
+                    }
+                    exit = std::min(exit, t1);
+
+                    if (enter > exit || enter > tmax || exit < 0) {
+                        return false;
+                    }
+                }
+
+                if (enter < 0) {
+                    float s = dot(n, v[0]) <= 0 ? 1.f : -1.f;
+                    if (s * dot(n, d) >= 0) {
+                        return false;
+                    }
+                    t = 0;
+                    normal = n * s;
+                    return true;
+                }
+
+                t = enter;
+                normal = enterAxis * (1 / sqrtf(dot(enterAxis, enterAxis)));
+                return true;
+            }
+
+    }; // class SweepTests
+
+    class CollisionBvh {
+
+        private:
+
+            const uint8_t * _base;
+            size_t _bytes;
+            bool _mapped;
+
+            const bvh_header_t * _header;
+            const bvh_node_t * _nodes;
+            const bvh_triangle_t * _triangles;
+
+            uint32_t _depth;
+
+            // A depth-first walk holds at most one pending sibling per level, plus the node in hand
+            static const int STACK_DEPTH = BVH_MAX_DEPTH + 1;
+
+            // Entry into the node's box grown by the shape's extent, if no later than tmax
+            static bool enters(const bvh_node_t & node, const Vec3 & p, const Vec3 & invd, const Vec3 & ext,
+                    float tmax, float & tenter)
+            {
+                float t0 = 0, t1 = tmax;
+
+                for (int k=0; k<3; ++k) {
+                    float lo = node.min[k] - ext[k], hi = node.max[k] + ext[k];
+                    if (invd[k] == INFINITY || invd[k] == -INFINITY) {
+                        if (p[k] < lo || p[k] > hi) {
+                            return false;
+                        }
+                        continue;
+                    }
+                    float a = (lo - p[k]) * invd[k], b = (hi - p[k]) * invd[k];
+                    if (a > b) {
+                        std::swap(a, b);
+                    }
+                    t0 = std::max(t0, a);
+                    t1 = std::min(t1, b);
+                    if (t0 > t1) {
+                        return false;
+                    }
+                }
+
+                tenter = t0;
+                return true;
+            }
+
+            template <typename TriangleTest>
+            bool sweep(const float start[3], const float end[3], const Vec3 & ext, sweep_hit_t & hit, TriangleTest test) const
+            {
+                if (!_header || _header->nodeCount == 0) {
+                    return false;
+                }
+
+                Vec3 p(start);
+                Vec3 d = Vec3(end) - p;
+                Vec3 invd(1 / d.x, 1 / d.y, 1 / d.z);
+
+                float best = 1;
+                bool found = false;
+                Vec3 bestNormal;
+                uint32_t bestTriangle = 0;
+
+                uint32_t stack[STACK_DEPTH];
+                int top = 0;
+                stack[top++] = 0;
+
+                while (top > 0) {
+
+                    const bvh_node_t & node = _nodes[stack[--top]];
+
+                    float tenter;
+                    if (!enters(node, p, invd, ext, best, tenter)) {
+                        continue;
+                    }
+
+                    if (node.count > 0) {
+                        for (uint32_t k=node.first; k<node.first+node.count; ++k) {
+                            float t;
+                            Vec3 normal;
+                            if (test(p, d, _triangles[k], best, t, normal) && (!found || t < best)) {
+                                best = t;
+                                bestNormal = normal;
+                                bestTriangle = k;
+                                found = true;
+                            }
+                        }
+                        continue;
+                    }
+
+                    // attach() has bounded the depth, so this only guards against a file changed under us
+                    if (top > STACK_DEPTH - 2) {
+                        continue;
+                    }
+
+                    // Visit the nearer child first, so that its hits prune the other
+                    float tl = 0, tr = 0;
+                    bool l = enters(_nodes[node.first], p, invd, ext, best, tl);
+                    bool r = enters(_nodes[node.first+1], p, invd, ext, best, tr);
+
+                    if (l && r) {
+                        bool leftFirst = tl <= tr;
+                        stack[top++] = leftFirst ? node.first+1 : node.first;
+                        stack[top++] = leftFirst ? node.first : node.first+1;
+                    }
+                    else if (l) {
+                        stack[top++] = node.first;
+                    }
+                    else if (r) {
+                        stack[top++] = node.first+1;
+                    }
+                }
+
+                if (found) {
+                    hit.fraction = best;
+                    (p + d * best).store(hit.position);
+                    bestNormal.store(hit.normal);
+                    hit.triangle = bestTriangle;
+                }
+
+                return found;
+            }
+
+            bool attach(const uint8_t * base, size_t bytes)
+            {
+                const bvh_header_t * header = (const bvh_header_t *)base;
+
+                if (bytes < sizeof(bvh_header_t) || header->magic != BVH_MAGIC || header->version != BVH_VERSION ||
+                        bytes < sizeof(bvh_header_t) + header->nodeCount * sizeof(bvh_node_t) +
+                        header->triangleCount * sizeof(bvh_triangle_t)) {
+                    return false;
+                }
+
+                const bvh_node_t * nodes = (const bvh_node_t *)(base + sizeof(bvh_header_t));
+
+                // The file is only trusted as far as it checks out: leaves' triangles and children must lie
+                // within the arrays, and children must follow their parents, so that every path down ends,
+                // within BVH_MAX_DEPTH.  Parents come first, so each node's depth is final when it is reached.
+                std::vector<uint8_t> depths(header->nodeCount, 0);
+                uint32_t deepest = 0;
+
+                for (uint32_t k=0; k<header->nodeCount; ++k) {
+
+                    const bvh_node_t & node = nodes[k];
+
+                    if (node.count > 0) {
+                        if (node.first > header->triangleCount || node.count > header->triangleCount - node.first) {
+                            return false;
+                        }
+                        continue;
+                    }
+
+                    if (node.first <= k || header->nodeCount < 2 || node.first > header->nodeCount - 2 ||
+                            depths[k] + 1u > BVH_MAX_DEPTH) {
+                        return false;
+                    }
+
+                    uint8_t child = depths[k] + 1;
+                    depths[node.first] = std::max(depths[node.first], child);
+                    depths[node.first+1] = std::max(depths[node.first+1], child);
+                    deepest = std::max(deepest, (uint32_t)child);
+                }
+
+                _header = header;
+                _nodes = nodes;
+                _triangles = (const bvh_triangle_t *)(_nodes + header->nodeCount);
+                _depth = deepest;
+
+                return true;
+            }
+
+        public:
+
+            CollisionBvh(void) : _base(nullptr), _bytes(0), _mapped(false), _header(nullptr), _nodes(nullptr), _triangles(nullptr),
+                _depth(0)
+            {
+            }
+
+            ~CollisionBvh(void)
+            {
+                close();
+            }
+
+            // Maps the file read-only where possible; elsewhere reads it into memory
+            bool open(const char * path)
+            {
+                close();
+
+#ifdef _WIN32
+                FILE * fp = fopen(path, "rb");
+                if (!fp) {
+                    return false;
+                }
+                fseek(fp, 0, SEEK_END);
+                long bytes = ftell(fp);
+                fseek(fp, 0, SEEK_SET);
+                uint8_t * base = bytes > 0 ? (uint8_t *)malloc(bytes) : nullptr;
+                bool ok = base && fread(base, 1, bytes, fp) == (size_t)bytes;
+                fclose(fp);
+                if (!ok) {
+                    free(base);
+                    return false;
+                }
+                _base = base;
+                _bytes = bytes;
+#else
+                int fd = ::open(path, O_RDONLY);
+                if (fd < 0) {
+                    return false;
+                }
+                struct stat st;
+                if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                    ::close(fd);
+                    return false;
+                }
+                void * base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (base == MAP_FAILED) {
+                    return false;
+                }
+                _base = (const uint8_t *)base;
+                _bytes = st.st_size;
+                _mapped = true;
+#endif
+
+                if (!attach(_base, _bytes)) {
+                    close();
+                    return false;
+                }
+
+                return true;
+            }
+
+            void close(void)
+            {
+                if (_base) {
+#ifdef _WIN32
+                    free((void *)_base);
+#else
+                    munmap((void *)_base, _bytes);
+#endif
+                }
+
+                _base = nullptr;
+                _bytes = 0;
+                _mapped = false;
+                _header = nullptr;
+                _nodes = nullptr;
+                _triangles = nullptr;
+                _depth = 0;
+            }
+
+            bool isOpen(void) const
+            {
+                return _header != nullptr;
+            }
+
+            // First contact of a sphere moving from start to end, if any
+            bool sweepSphere(const float start[3], const float end[3], float radius, sweep_hit_t & hit) const
+            {
+                return sweep(start, end, Vec3(radius, radius, radius), hit,
+                        [radius](const Vec3 & p, const Vec3 & d, const bvh_triangle_t & tri, float tmax, float & t, Vec3 & n) {
+                        return SweepTests::sphere(p, d, radius, tri, tmax, t, n);
+                        });
+            }
+
+            // First contact of an axis-aligned box, given by its half extents, moving from start to end
+            bool sweepBox(const float start[3], const float end[3], const float halfExtents[3], sweep_hit_t & hit) const
+            {
+                Vec3 h(halfExtents);
+
+                return sweep(start, end, h, hit,
+                        [h](const Vec3 & p, const Vec3 & d, const bvh_triangle_t & tri, float tmax, float & t, Vec3 & n) {
+                        return SweepTests::box(p, d, h, tri, tmax, t, n);
+                        });
+            }
+
+            uint32_t triangleCount(void) const
+            {
+                return _header ? _header->triangleCount : 0;
+            }
+
+            uint32_t nodeCount(void) const
+            {
+                return _header ? _header->nodeCount : 0;
+            }
+
+            const bvh_triangle_t * triangles(void) const
+            {
+                return _triangles;
+            }
+
+            // Levels below the root
+            uint32_t depth(void) const
+            {
+                return _depth;
+            }
+
+            const bvh_header_t * header(void) const
+            {
+                return _header;
+            }
+
+            bool isMapped(void) const
+            {
+                return _mapped;
+            }
+
+    }; // class CollisionBvh
+
+    // Collects triangles and writes them out as a BVH file, split by the surface-area heuristic
+    class BvhBuilder {
+
+        private:
+
+            static const uint32_t LEAF_TRIANGLES = 4;
+            static const uint32_t MAX_LEAF_TRIANGLES = 16;
+            static const int BINS = 16;
+
+            // Skewed geometry can lead the SAH to peel off a few triangles per level; below this depth nodes
+            // are halved by count instead, which reaches single triangles within 32 more levels
+            static const uint32_t SAH_DEPTH = 48;
+            static_assert(SAH_DEPTH + 32 <= BVH_MAX_DEPTH, "BVH builder could exceed the depth sweeps can walk");
+
+            std::vector<bvh_triangle_t> _triangles;
+            float _start[3];
+
+            typedef struct {
+                Vec3 min;
+                Vec3 max;
+            } box_t;
+
+            static box_t empty(void)
+            {
+                box_t b = { Vec3(1e30f, 1e30f, 1e30f), Vec3(-1e30f, -1e30f, -1e30f) };
+                return b;
+            }
+
+            static void grow(box_t & b, const Vec3 & v)
+            {
+                b.min = Vec3(std::min(b.min.x, v.x), std::min(b.min.y, v.y), std::min(b.min.z, v.z));
+                b.max = Vec3(std::max(b.max.x, v.x), std::max(b.max.y, v.y), std::max(b.max.z, v.z));
+            }
+
+            static void grow(box_t & b, const bvh_triangle_t & tri)
+            {
+                grow(b, Vec3(tri.v0));
+                grow(b, Vec3(tri.v1));
+                grow(b, Vec3(tri.v2));
+            }
+
+            static float area(const box_t & b)
+            {
+                Vec3 e = b.max - b.min;
+                return e.x < 0 ? 0 : e.x*e.y + e.y*e.z + e.z*e.x;
+            }
+
+            static Vec3 centroid(const bvh_triangle_t & tri)
+            {
+                return (Vec3(tri.v0) + Vec3(tri.v1) + Vec3(tri.v2)) * (1.f/3);
+            }
+
+            // Builds nodes over _triangles, reordering the triangles so that each leaf's are contiguous
+            void build(std::vector<bvh_node_t> & nodes)
+            {
+                uint32_t n = (uint32_t)_triangles.size();
+
+                std::vector<uint32_t> order(n);
+                std::vector<Vec3> centroids(n);
+                for (uint32_t k=0; k<n; ++k) {
+                    order[k] = k;
+                    centroids[k] = centroid(_triangles[k]);
+                }
+
+                nodes.clear();
+                nodes.push_back(bvh_node_t());
+
+                typedef struct {
+                    uint32_t node;
+                    uint32_t begin;
+                    uint32_t end;
+                    uint32_t depth;
+                } range_t;
+
+                std::vector<range_t> work;
+                work.push_back({0, 0, n, 0});
+
+                while (!work.empty()) {
+
+                    range_t r = work.back();
+                    work.pop_back();
+
+                    box_t bounds = empty(), cbounds = empty();
+                    for (uint32_t k=r.begin; k<r.end; ++k) {
+                        grow(bounds, _triangles[order[k]]);
+                        grow(cbounds, centroids[order[k]]);
+                    }
+
+                    bvh_node_t & node = nodes[r.node];
+                    bounds.min.store(node.min);
+                    bounds.max.store(node.max);
+                    node.first = r.begin;
+                    node.count = r.end - r.begin;
+
+                    if (node.count <= LEAF_TRIANGLES) {
+                        continue;
+                    }
+
+                    Vec3 extent = cbounds.max - cbounds.min;
+                    int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+                    float lo = cbounds.min[axis];
+                    float width = extent[axis];
+
+                    uint32_t mid = r.begin;
+
+                    if (width > 0 && r.depth < SAH_DEPTH) {
+
+                        // Binned SAH: pick the bin boundary with the least area-weighted triangle count
+                        box_t binBounds[BINS];
+                        uint32_t binCounts[BINS] = {};
+                        for (int b=0; b<BINS; ++b) {
+                            binBounds[b] = empty();
+                        }
+
+                        auto binOf = [&](uint32_t k) {
+                            int b = (int)(BINS * (centroids[k][axis] - lo) / width);
+                            return b < 0 ? 0 : b >= BINS ? BINS-1 : b;
+                        };
+
+                        for (uint32_t k=r.begin; k<r.end; ++k) {
+                            int b = binOf(order[k]);
+                            ++binCounts[b];
+                            grow(binBounds[b], _triangles[order[k]]);
+                        }
+
+                        float rightAreas[BINS];
+                        uint32_t rightCounts[BINS];
+                        box_t acc = empty();
+                        uint32_t count = 0;
+                        for (int b=BINS-1; b>0; --b) {
+                            count += binCounts[b];
+                            if (binCounts[b]) {
+                                grow(acc, binBounds[b].min);
+                                grow(acc, binBounds[b].max);
+                            }
+                            rightAreas[b] = area(acc);
+                            rightCounts[b] = count;
+                        }
+
+                        float bestCost = 1e30f;
+                        int bestSplit = 0;
+                        acc = empty();
+                        count = 0;
+                        for (int b=0; b<BINS-1; ++b) {
+                            count += binCounts[b];
+                            if (binCounts[b]) {
+                                grow(acc, binBounds[b].min);
+                                grow(acc, binBounds[b].max);
+                            }
+                            float cost = area(acc) * count + rightAreas[b+1] * rightCounts[b+1];
+                            if (count > 0 && rightCounts[b+1] > 0 && cost < bestCost) {
+                                bestCost = cost;
+                                bestSplit = b;
+                            }
+                        }
+
+                        if (bestCost >= area(bounds) * node.count && node.count <= MAX_LEAF_TRIANGLES) {
+                            continue;
+                        }
+
+                        mid = (uint32_t)(std::partition(order.begin() + r.begin, order.begin() + r.end,
+                                    [&](uint32_t k) { return binOf(k) <= bestSplit; }) - order.begin());
+                    }
+
+                    // Too deep, identical centroids, or a split that left one side empty: halve by count
+                    if (mid == r.begin || mid == r.end) {
+                        mid = (r.begin + r.end) / 2;
+                        std::nth_element(order.begin() + r.begin, order.begin() + mid, order.begin() + r.end,
+                                [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+                    }
+
+                    uint32_t left = (uint32_t)nodes.size();
+                    nodes[r.node].first = left;
+                    nodes[r.node].count = 0;
+                    nodes.push_back(bvh_node_t());
+                    nodes.push_back(bvh_node_t());
+
+                    work.push_back({left, r.begin, mid, r.depth+1});
+                    work.push_back({left+1, mid, r.end, r.depth+1});
+                }
+
+                std::vector<bvh_triangle_t> ordered(n);
+                for (uint32_t k=0; k<n; ++k) {
+                    ordered[k] = _triangles[order[k]];
+                }
+                _triangles.swap(ordered);
+            }
+
+        public:
+
+            BvhBuilder(void)
+            {
+                _start[0] = _start[1] = _start[2] = 0;
+            }
+
+            // Degenerate triangles are dropped; returns false if this one was
+            bool addTriangle(const float a[3], const float b[3], const float c[3])
+            {
+                Vec3 n = cross(Vec3(b) - Vec3(a), Vec3(c) - Vec3(a));
+                float len = sqrtf(dot(n, n));
+
+                if (!(len > 1e-12f)) {
+                    return false;
+                }
+
+                bvh_triangle_t tri;
+                memcpy(tri.v0, a, sizeof(tri.v0));
+                memcpy(tri.v1, b, sizeof(tri.v1));
+                memcpy(tri.v2, c, sizeof(tri.v2));
+                (n * (1 / len)).store(tri.normal);
+
+                _triangles.push_back(tri);
+
+                return true;
+            }
+
+            // Twelve triangles for an axis-aligned box
+            void addBox(const float min[3], const float max[3])
+            {
+                float c[8][3];
+                for (int k=0; k<8; ++k) {
+                    c[k][0] = (k & 1) ? max[0] : min[0];
+                    c[k][1] = (k & 2) ? max[1] : min[1];
+                    c[k][2] = (k & 4) ? max[2] : min[2];
+                }
+
+                static const int FACES[6][4] = {
+                    {0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5}
+                };
+
+                for (int f=0; f<6; ++f) {
+                    addTriangle(c[FACES[f][0]], c[FACES[f][1]], c[FACES[f][2]]);
+                    addTriangle(c[FACES[f][0]], c[FACES[f][2]], c[FACES[f][3]]);
+                }
+            }
+
+            void setStart(const float start[3])
+            {
+                memcpy(_start, start, sizeof(_start));
+            }
+
+            uint32_t triangleCount(void) const
+            {
+                return (uint32_t)_triangles.size();
+            }
+
+            bool write(const char * path)
+            {
+                if (_triangles.empty()) {
+                    return false;
+                }
+
+                std::vector<bvh_node_t> nodes;
+                build(nodes);
+
+                bvh_header_t header = {};
+                header.magic = BVH_MAGIC;
+                header.version = BVH_VERSION;
+                header.triangleCount = (uint32_t)_triangles.size();
+                header.nodeCount = (uint32_t)nodes.size();
+                memcpy(header.boundsMin, nodes[0].min, sizeof(header.boundsMin));
+                memcpy(header.boundsMax, nodes[0].max, sizeof(header.boundsMax));
+                memcpy(header.start, _start, sizeof(header.start));
+
+                FILE * fp = fopen(path, "wb");
+                if (!fp) {
+                    return false;
+                }
+
+                bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                    fwrite(nodes.data(), sizeof(bvh_node_t), nodes.size(), fp) == nodes.size() &&
+                    fwrite(_triangles.data(), sizeof(bvh_triangle_t), _triangles.size(), fp) == _triangles.size();
+
+                return fclose(fp) == 0 && ok;
+            }
+
+    }; // class BvhBuilder
+
+} // namespace hf
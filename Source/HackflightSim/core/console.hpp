@@ -0,0 +1,269 @@
+/*
+   console.hpp: preallocated, lock-free ring of firmware console lines
+
+   A firmware print claims the next slot with one atomic increment and copies its text in;
+   nothing is formatted, allocated or locked.  Each slot carries a sequence lock, odd while
+   being written and 2*(line + 1) once complete, so readers on other threads can take a line
+   without stopping the writers and tell when one was overwritten before they got to it.
+   ConsoleFlusher drains the ring to a file from a background thread.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace hf {
+
+    typedef enum {
+
+        CONSOLE_READY,      // copied out
+        CONSOLE_PENDING,    // not written yet, or still being written
+        CONSOLE_LOST        // overwritten before it was read
+
+    } console_read_t;
+
+    class ConsoleRing {
+
+        public:
+
+            // Bytes kept of each print; longer prints are cut short
+            static const uint32_t LINE = 116;
+
+        private:
+
+            typedef struct {
+
+                std::atomic<uint64_t> lock;
+                uint32_t              length;
+                char                  text[LINE];
+
+            } slot_t;
+
+            static_assert(sizeof(slot_t) == 128, "Console slots should be two cache lines");
+
+            slot_t * _slots;
+            uint64_t _mask;
+
+            std::atomic<uint64_t> _head;
+
+        public:
+
+            // Slots are rounded up to a power of two
+            ConsoleRing(uint32_t slots=1024) : _head(0)
+            {
+                uint64_t count = 1;
+                while (count < slots) {
+                    count *= 2;
+                }
+
+                _slots = new slot_t[count];
+                _mask = count - 1;
+
+                for (uint64_t k=0; k<count; ++k) {
+                    _slots[k].lock.store(0, std::memory_order_relaxed);
+                    _slots[k].length = 0;
+                }
+            }
+
+            ~ConsoleRing(void)
+            {
+                delete[] _slots;
+            }
+
+            ConsoleRing(const ConsoleRing &) = delete;
+            ConsoleRing & operator=(const ConsoleRing &) = delete;
+
+            // Safe from any number of threads, as long as no writer falls a whole ring behind another
+            void write(const char * text)
+            {
+                uint64_t line = _head.fetch_add(1, std::memory_order_relaxed);
+
+                slot_t & s = _slots[line & _mask];
+
+                s.lock.store(2 * line + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                uint32_t length = (uint32_t)strnlen(text, LINE);
+                memcpy(s.text, text, length);
+                s.length = length;
+
+                s.lock.store(2 * line + 2, std::memory_order_release);
+            }
+
+            // Lines written so far; line numbers start at zero
+            uint64_t written(void) const
+            {
+                return _head.load(std::memory_order_acquire);
+            }
+
+            uint64_t slots(void) const
+            {
+                return _mask + 1;
+            }
+
+            // Copies out the given line, NUL-terminated; text must hold LINE+1 bytes
+            console_read_t read(uint64_t line, char * text, uint32_t & length) const
+            {
+                const slot_t & s = _slots[line & _mask];
+
+                uint64_t lock = s.lock.load(std::memory_order_acquire);
+
+                if (lock != 2 * line + 2) {
+                    return lock < 2 * line + 2 ? CONSOLE_PENDING : CONSOLE_LOST;
+                }
+
+                length = s.length < LINE ? s.length : LINE;
+                memcpy(text, s.text, length);
+                text[length] = 0;
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                return s.lock.load(std::memory_order_relaxed) == lock ? CONSOLE_READY : CONSOLE_LOST;
+            }
+
+    }; // class ConsoleRing
+
+    // Appends every line of a console ring to a file, a batch every period, on its own thread
+    class ConsoleFlusher {
+
+        private:
+
+            ConsoleRing & _ring;
+
+            FILE *   _file;
+            uint64_t _next;
+            uint64_t _dropped;
+
+            std::chrono::microseconds _period;
+
+            std::atomic<bool> _running;
+
+            std::thread _thread;
+
+            // Writes out whatever lines are complete; runs on the flushing thread, or after it stops
+            void flush(void)
+            {
+                char text[ConsoleRing::LINE + 1];
+                uint32_t length = 0;
+
+                uint64_t written = _ring.written();
+
+                while (_next < written) {
+
+                    console_read_t result = _ring.read(_next, text, length);
+
+                    if (result == CONSOLE_PENDING) {
+                        break;
+                    }
+
+                    // Fell a ring behind the writers; pick up at the oldest line still there
+                    if (result == CONSOLE_LOST) {
+                        uint64_t oldest = written > _ring.slots() ? written - _ring.slots() : 0;
+                        uint64_t resume = oldest > _next + 1 ? oldest : _next + 1;
+                        fprintf(_file, "[%llu lines dropped]\n", (unsigned long long)(resume - _next));
+                        _dropped += resume - _next;
+                        _next = resume;
+                        continue;
+                    }
+
+                    fwrite(text, 1, length, _file);
+                    if (length == 0 || text[length-1] != '\n') {
+                        fputc('\n', _file);
+                    }
+
+                    ++_next;
+                }
+
+                fflush(_file);
+            }
+
+            void run(void)
+            {
+                while (_running.load(std::memory_order_acquire)) {
+                    flush();
+                    std::this_thread::sleep_for(_period);
+                }
+            }
+
+        public:
+
+            ConsoleFlusher(ConsoleRing & ring)
+                : _ring(ring), _file(nullptr), _next(0), _dropped(0), _period(0), _running(false)
+            {
+            }
+
+            ~ConsoleFlusher(void)
+            {
+                stop();
+            }
+
+            // Starts appending lines written from now on to the file at path
+            bool start(const char * path, float periodSeconds)
+            {
+                stop();
+
+                _file = fopen(path, "a");
+                if (!_file) {
+                    return false;
+                }
+
+                _next = _ring.written();
+                _dropped = 0;
+                _period = std::chrono::microseconds((int64_t)(periodSeconds * 1e6f));
+
+                _running.store(true, std::memory_order_release);
+                _thread = std::thread(&ConsoleFlusher::run, this);
+
+                return true;
+            }
+
+            // Writes out the remaining lines and closes the file
+            void stop(void)
+            {
+                if (_thread.joinable()) {
+                    _running.store(false, std::memory_order_release);
+                    _thread.join();
+                }
+
+                if (_file) {
+                    flush();
+                    fclose(_file);
+                    _file = nullptr;
+                }
+            }
+
+            uint64_t flushed(void) const
+            {
+                return _next;
+            }
+
+            uint64_t dropped(void) const
+            {
+                return _dropped;
+            }
+
+    }; // class ConsoleFlusher
+
+} // namespace hf
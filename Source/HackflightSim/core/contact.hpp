@@ -0,0 +1,226 @@
+/*
+   contact.hpp: crash, bounce and fall dynamics for HackflightSim
+
+   Once a vehicle hits something above the ground its firmware has lost control, and this
+   model takes over its motion: a ballistic fall under gravity with a damped tumble, and a
+   restitution-and-friction response at each contact the caller reports, whether from the
+   engine's sweeps or the collision BVH.  Each contact costs a fixed handful of arithmetic,
+   and a crash ends after a bounded number of contacts or seconds, when the vehicle has come
+   to rest and should be reset.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "vehicle.hpp"
+
+namespace hf {
+
+    // Same values as the flight log's collisionState
+    typedef enum {
+
+        CONTACT_NORMAL,
+        CONTACT_BOUNCING,
+        CONTACT_FALLING
+
+    } contact_state_t;
+
+    typedef struct {
+
+        float    impactRestitution; // fraction of the normal speed kept by the crash itself
+        float    restitution;       // and by each later contact
+        float    friction;          // fraction of the tangential speed lost at each contact
+        float    tumble;            // radians/sec of spin per m/s of sliding at a contact
+        float    spinDamping;       // per second
+        float    gravity;           // m/s^2
+        float    groundHeight;      // meters; hits at or below this are landings, not crashes
+        float    bounceSeconds;     // reported as bouncing, rather than falling, for this long
+        float    restSpeed;         // m/s into an upward-facing surface below which the vehicle is at rest
+        uint32_t maxBounces;        // contacts after the crash before the vehicle is taken to be at rest
+        float    maxSeconds;        // longest a crash can last, for vehicles that fall out of the map
+
+    } contact_params_t;
+
+    static const contact_params_t CONTACT_DEFAULT = { 1.0f, 0.3f, 0.5f, 5.0f, 2.0f, 9.80665f, 0, 1.0f, 0.5f, 8, 10.0f };
+
+    class ContactModel {
+
+        private:
+
+            // Motor value shown while the firmware is out of the loop
+            static constexpr float CRASH_MOTOR_VALUE = 0.5f;
+
+            contact_params_t _params;
+
+            bool     _crashed;
+            float    _seconds;
+            uint32_t _bounces;
+
+            // World-frame velocity, m/s
+            float _velocity[3];
+
+            static void toBody(const Quaternion & q, const float world[3], float body[3])
+            {
+                Quaternion conjugate = { -q.x, -q.y, -q.z, q.w };
+                conjugate.rotate(world, body);
+            }
+
+        public:
+
+            ContactModel(const contact_params_t & params=CONTACT_DEFAULT)
+                : _params(params)
+            {
+                reset();
+            }
+
+            void reset(void)
+            {
+                _crashed = false;
+                _seconds = 0;
+                _bounces = 0;
+                memset(_velocity, 0, sizeof(_velocity));
+            }
+
+            bool crashed(void) const
+            {
+                return _crashed;
+            }
+
+            contact_state_t state(void) const
+            {
+                return !_crashed ? CONTACT_NORMAL : _seconds < _params.bounceSeconds ? CONTACT_BOUNCING : CONTACT_FALLING;
+            }
+
+            // Contacts since the crash, the crash itself being the first
+            uint32_t bounces(void) const
+            {
+                return _bounces;
+            }
+
+            // Responds to a contact with the vehicle's center at position and the surface normal
+            // pointing back toward it.  Returns true when the vehicle should be reset: a hit on the
+            // ground before any crash, or a crashed vehicle come to rest.
+            bool collide(SimVehicle & vehicle, const float position[3], const float normal[3])
+            {
+                Pose & pose = vehicle.pose;
+
+                float restitution = _params.restitution;
+
+                if (!_crashed) {
+
+                    if (position[2] <= _params.groundHeight) {
+                        return true;
+                    }
+
+                    _crashed = true;
+                    _seconds = 0;
+                    _bounces = 0;
+                    pose.orientation.rotate(vehicle.translationRates, _velocity);
+                    restitution = _params.impactRestitution;
+                }
+
+                memcpy(pose.position, position, sizeof(pose.position));
+
+                float into = _velocity[0]*normal[0] + _velocity[1]*normal[1] + _velocity[2]*normal[2];
+
+                // Already separating; nothing to respond to
+                if (into >= 0) {
+                    return false;
+                }
+
+                if (_bounces > 0 && -into < _params.restSpeed && normal[2] > 0.7f) {
+                    return true;
+                }
+
+                if (++_bounces > _params.maxBounces) {
+                    return true;
+                }
+
+                // Keep what friction leaves of the sliding, and send back what restitution leaves of the impact
+                float sliding[3];
+                for (uint8_t k=0; k<3; ++k) {
+                    sliding[k] = _velocity[k] - into * normal[k];
+                    _velocity[k] = (1 - _params.friction) * sliding[k] - restitution * into * normal[k];
+                }
+
+                // Sliding against the surface sets the frame tumbling about the axis across it
+                float axis[3] = {
+                    normal[1]*sliding[2] - normal[2]*sliding[1],
+                    normal[2]*sliding[0] - normal[0]*sliding[2],
+                    normal[0]*sliding[1] - normal[1]*sliding[0]
+                };
+                // The spin is a body angular velocity; gyro rates turn the other way in roll and pitch
+                float spin[3], rates[3];
+                toBody(pose.orientation, axis, spin);
+                Pose::angularVelocity(spin, rates);
+                for (uint8_t k=0; k<3; ++k) {
+                    vehicle.gyroRates[k] += _params.tumble * _params.friction * rates[k];
+                }
+
+                toBody(pose.orientation, _velocity, vehicle.translationRates);
+
+                return false;
+            }
+
+            // Moves a crashed vehicle for one step in place of its firmware.  Returns true when the
+            // crash has gone on too long and the vehicle should be reset.
+            bool step(SimVehicle & vehicle, float dt)
+            {
+                HF_TIME_STAGE(STAGE_INTEGRATE);
+
+                Pose & pose = vehicle.pose;
+
+                for (uint8_t k=0; k<4; ++k) {
+                    vehicle.motorValues[k] = CRASH_MOTOR_VALUE;
+                }
+
+                _velocity[2] -= _params.gravity * dt;
+
+                for (uint8_t k=0; k<3; ++k) {
+                    pose.position[k] += _velocity[k] * dt;
+                }
+
+                float damping = 1 - _params.spinDamping * dt;
+                damping = damping > 0 ? damping : 0;
+
+                // Turn the way the firmware's pose integration would at these gyro rates, so that a crash
+                // carries on the spin the vehicle had
+                float rotation[3];
+                for (uint8_t k=0; k<3; ++k) {
+                    vehicle.gyroRates[k] *= damping;
+                }
+                Pose::angularVelocity(vehicle.gyroRates, rotation);
+                for (uint8_t k=0; k<3; ++k) {
+                    rotation[k] *= dt;
+                }
+                pose.orientation = pose.orientation * Quaternion::fromRotationVector(rotation);
+                pose.orientation.normalize();
+
+                toBody(pose.orientation, _velocity, vehicle.translationRates);
+
+                _seconds += dt;
+
+                return _seconds >= _params.maxSeconds;
+            }
+
+    }; // class ContactModel
+
+} // namespace hf
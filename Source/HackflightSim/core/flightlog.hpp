@@ -0,0 +1,387 @@
+/*
+   flightlog.hpp: fixed-size flight records appended to a preallocated, memory-mapped file
+
+   Layout (little-endian): a 128-byte flight_log_header_t, then flight_record_t records of
+   128 bytes each.  The header's count is updated after every record, so a reader can
+   follow a log while it is being written.  On close the file is trimmed to its records.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "sticks.hpp"
+
+// Older C libraries lack this; kernels before 5.14 reject it, and we fall back to touching pages
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+namespace hf {
+
+    static const uint32_t FLIGHT_LOG_MAGIC   = 0x4C464648; // "HFFL"
+    static const uint32_t FLIGHT_LOG_VERSION = 1;
+
+    static const uint32_t FLIGHT_RECORD_BYTES = 128;
+
+    typedef struct {
+
+        uint64_t step;                  // fixed-step index since the log started
+        double   simSeconds;            // simulated time at the end of the step
+        float    dt;
+        float    gyroRates[3];
+        float    translationRates[3];
+        float    motorValues[4];
+        float    position[3];           // meters
+        float    orientation[4];        // quaternion x, y, z, w
+        float    sticks[STICK_CHANNELS];
+        uint32_t collisionState;
+
+        uint8_t  reserved[16];
+
+    } flight_record_t;
+
+    typedef struct {
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t recordBytes;
+        float    stepSeconds;
+        uint64_t capacity;
+
+        // Records written so far
+        std::atomic<uint64_t> count;
+
+        uint8_t reserved[96];
+
+    } flight_log_header_t;
+
+    static_assert(sizeof(flight_record_t) == FLIGHT_RECORD_BYTES, "flight record must stay 128 bytes");
+    static_assert(sizeof(flight_log_header_t) == FLIGHT_RECORD_BYTES, "flight log header must stay 128 bytes");
+
+    class FlightRecorder {
+
+        private:
+
+            // A helper thread maps pages in this far ahead of the writer, so that the record
+            // path never takes a page fault
+            static const size_t PREFAULT_BYTES = 4 << 20;
+
+            int       _fd;
+            uint8_t * _base;
+            size_t    _bytes;
+            uint64_t  _count;
+            uint64_t  _capacity;
+            uint64_t  _dropped;
+
+            std::thread _prefaulter;
+            std::atomic<bool> _running;
+            std::atomic<size_t> _written;
+
+            flight_log_header_t * header(void)
+            {
+                return (flight_log_header_t *)_base;
+            }
+
+            void prefault(void)
+            {
+                size_t page = (size_t)sysconf(_SC_PAGESIZE);
+                size_t done = 0;
+
+                while (_running.load(std::memory_order_relaxed)) {
+
+                    size_t target = _written.load(std::memory_order_relaxed) + PREFAULT_BYTES;
+                    if (target > _bytes) {
+                        target = _bytes;
+                    }
+
+                    if (done < target) {
+
+                        if (madvise(_base + done, target - done, MADV_POPULATE_WRITE) != 0) {
+
+                            // Reading maps the page; the writer then only takes a cheap permission upgrade
+                            for (size_t k=done; k<target; k+=page) {
+                                (void)*(volatile uint8_t *)(_base + k);
+                            }
+                        }
+
+                        done = target;
+                    }
+
+                    if (done == _bytes) {
+                        break;
+                    }
+
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+
+        public:
+
+            FlightRecorder(void) : _fd(-1), _base(nullptr), _bytes(0), _count(0), _capacity(0), _dropped(0),
+                _running(false), _written(0)
+            {
+            }
+
+            ~FlightRecorder(void)
+            {
+                close();
+            }
+
+            // Creates the file with room for the given number of records; all disk space is
+            // reserved up front, so that recording never extends the file
+            bool open(const char * path, uint64_t capacity, float stepSeconds)
+            {
+                close();
+
+                _fd = ::open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+                if (_fd < 0) {
+                    return false;
+                }
+
+                _bytes = (size_t)(capacity + 1) * FLIGHT_RECORD_BYTES;
+
+                if (posix_fallocate(_fd, 0, _bytes) != 0) {
+                    ::close(_fd);
+                    _fd = -1;
+                    return false;
+                }
+
+                void * base = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+                if (base == MAP_FAILED) {
+                    ::close(_fd);
+                    _fd = -1;
+                    return false;
+                }
+
+                _base = (uint8_t *)base;
+                _count = 0;
+                _capacity = capacity;
+                _dropped = 0;
+                _written = 0;
+
+                madvise(_base, _bytes, MADV_SEQUENTIAL);
+
+                flight_log_header_t * h = header();
+                memset((void *)h, 0, sizeof(flight_log_header_t));
+                h->magic = FLIGHT_LOG_MAGIC;
+                h->version = FLIGHT_LOG_VERSION;
+                h->recordBytes = FLIGHT_RECORD_BYTES;
+                h->stepSeconds = stepSeconds;
+                h->capacity = capacity;
+
+                _running = true;
+                _prefaulter = std::thread(&FlightRecorder::prefault, this);
+
+                return true;
+            }
+
+            // Flushes the records and trims the file to them
+            void close(void)
+            {
+                _running = false;
+                if (_prefaulter.joinable()) {
+                    _prefaulter.join();
+                }
+
+                if (_base) {
+                    munmap(_base, _bytes);
+                    _base = nullptr;
+                }
+
+                if (_fd >= 0) {
+                    if (ftruncate(_fd, (off_t)(_count + 1) * FLIGHT_RECORD_BYTES) != 0) {
+                        // Leave the file at full size; readers go by the header's count anyway
+                    }
+                    ::close(_fd);
+                    _fd = -1;
+                }
+            }
+
+            bool isOpen(void) const
+            {
+                return _base != nullptr;
+            }
+
+            // Returns the next record to fill in place, or nullptr when the file is full;
+            // commit() makes it visible
+            flight_record_t * next(void)
+            {
+                if (_count == _capacity) {
+                    ++_dropped;
+                    return nullptr;
+                }
+
+                return (flight_record_t *)(_base + (size_t)(_count + 1) * FLIGHT_RECORD_BYTES);
+            }
+
+            void commit(void)
+            {
+                header()->count.store(++_count, std::memory_order_release);
+                _written.store((size_t)(_count + 1) * FLIGHT_RECORD_BYTES, std::memory_order_relaxed);
+            }
+
+            bool append(const flight_record_t & record)
+            {
+                flight_record_t * r = next();
+
+                if (!r) {
+                    return false;
+                }
+
+                *r = record;
+                commit();
+
+                return true;
+            }
+
+            uint64_t count(void) const
+            {
+                return _count;
+            }
+
+            uint64_t capacity(void) const
+            {
+                return _capacity;
+            }
+
+            // Records that did not fit
+            uint64_t dropped(void) const
+            {
+                return _dropped;
+            }
+
+    }; // class FlightRecorder
+
+    class FlightLogReader {
+
+        private:
+
+            const uint8_t * _base;
+            size_t _bytes;
+            uint64_t _position;
+
+            const flight_log_header_t * header(void) const
+            {
+                return (const flight_log_header_t *)_base;
+            }
+
+        public:
+
+            FlightLogReader(void) : _base(nullptr), _bytes(0), _position(0)
+            {
+            }
+
+            ~FlightLogReader(void)
+            {
+                close();
+            }
+
+            // Maps a log read-only; works on logs that are still being recorded
+            bool open(const char * path)
+            {
+                close();
+
+                int fd = ::open(path, O_RDONLY);
+                if (fd < 0) {
+                    return false;
+                }
+
+                struct stat st;
+                if (fstat(fd, &st) != 0 || st.st_size < (off_t)FLIGHT_RECORD_BYTES) {
+                    ::close(fd);
+                    return false;
+                }
+
+                void * base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+
+                if (base == MAP_FAILED) {
+                    return false;
+                }
+
+                _base = (const uint8_t *)base;
+                _bytes = st.st_size;
+                _position = 0;
+
+                if (header()->magic != FLIGHT_LOG_MAGIC || header()->version != FLIGHT_LOG_VERSION ||
+                        header()->recordBytes != FLIGHT_RECORD_BYTES) {
+                    close();
+                    return false;
+                }
+
+                madvise((void *)_base, _bytes, MADV_SEQUENTIAL);
+
+                return true;
+            }
+
+            void close(void)
+            {
+                if (_base) {
+                    munmap((void *)_base, _bytes);
+                    _base = nullptr;
+                }
+            }
+
+            // Records available now; grows while the log is being recorded
+            uint64_t count(void) const
+            {
+                uint64_t n = header()->count.load(std::memory_order_acquire);
+                uint64_t mapped = _bytes / FLIGHT_RECORD_BYTES - 1;
+
+                return n < mapped ? n : mapped;
+            }
+
+            float stepSeconds(void) const
+            {
+                return header()->stepSeconds;
+            }
+
+            const flight_record_t * record(uint64_t index) const
+            {
+                return (const flight_record_t *)(_base + (size_t)(index + 1) * FLIGHT_RECORD_BYTES);
+            }
+
+            // Streams records in order; returns nullptr when caught up with the writer
+            const flight_record_t * next(void)
+            {
+                return _position < count() ? record(_position++) : nullptr;
+            }
+
+            void rewind(void)
+            {
+                _position = 0;
+            }
+
+    }; // class FlightLogReader
+
+} // namespace hf
+
+#endif // _WIN32
@@ -0,0 +1,126 @@
+/*
+   framepool.hpp: fixed pool of equally sized frame buffers in one aligned block
+
+   Per-frame image memory comes from here rather than from the heap: the block is sized
+   once for a frame geometry and only reallocated when that geometry changes, such as
+   when a render target is resized, so a long run makes no allocations per frame.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "simd.hpp"
+
+namespace hf {
+
+    class FramePool {
+
+        private:
+
+            uint8_t * _block;
+
+            uint32_t _count;
+            size_t   _bytes;
+            size_t   _stride;
+
+            uint64_t _reallocations;
+
+            void release(void)
+            {
+                simdFree(_block);
+                _block = nullptr;
+            }
+
+        public:
+
+            FramePool(void) : _block(nullptr), _count(0), _bytes(0), _stride(0), _reallocations(0)
+            {
+            }
+
+            ~FramePool(void)
+            {
+                release();
+            }
+
+            FramePool(const FramePool &) = delete;
+            FramePool & operator=(const FramePool &) = delete;
+
+            // Makes room for count buffers of bytes each.  Does nothing if the pool already has
+            // that geometry; otherwise discards the old buffers.  Returns false if out of memory.
+            bool reserve(uint32_t count, size_t bytes)
+            {
+                if (_block && count == _count && bytes == _bytes) {
+                    return true;
+                }
+
+                release();
+
+                _count = count;
+                _bytes = bytes;
+                // Every buffer starts SIMD-aligned, for the pixel converters
+                _stride = (bytes + SIMD_ALIGNMENT - 1) / SIMD_ALIGNMENT * SIMD_ALIGNMENT;
+
+                if (_count == 0 || _stride == 0) {
+                    return true;
+                }
+
+                _block = (uint8_t *)simdAlloc(_count * _stride);
+
+                if (!_block) {
+                    _count = 0;
+                    _bytes = 0;
+                    return false;
+                }
+
+                ++_reallocations;
+
+                return true;
+            }
+
+            uint8_t * buffer(uint32_t index)
+            {
+                return _block + index * _stride;
+            }
+
+            const uint8_t * buffer(uint32_t index) const
+            {
+                return _block + index * _stride;
+            }
+
+            uint32_t count(void) const
+            {
+                return _count;
+            }
+
+            size_t bytes(void) const
+            {
+                return _bytes;
+            }
+
+            // Times the block has been (re)allocated; stays put in steady state
+            uint64_t reallocations(void) const
+            {
+                return _reallocations;
+            }
+
+    }; // class FramePool
+
+} // namespace hf
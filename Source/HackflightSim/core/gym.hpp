@@ -0,0 +1,431 @@
+/*
+   gym.hpp: batches of simulated vehicles stepped together for training code, and a server
+   that exposes them over a Unix-domain socket with the layouts in gymprotocol.hpp
+
+   Includes the platform receiver (through ScriptedReceiver), so use it in one translation
+   unit per program.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include "gymprotocol.hpp"
+#include "scriptedreceiver.hpp"
+#include "shmmailbox.hpp"
+#include "threadpool.hpp"
+#include "timing.hpp"
+#include "vehicle.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+namespace hf {
+
+    class GymEnvironments {
+
+        private:
+
+            // Each environment has its own firmware, receiver and starting snapshot
+            std::vector<SimVehicle *>       _vehicles;
+            std::vector<VehicleSnapshot *>  _snapshots;
+            std::vector<ScriptedReceiver>   _receivers;
+            std::vector<uint32_t>           _steps;
+
+            float    _stepSeconds;
+            uint32_t _maxSteps;
+            float    _maxDistance;
+
+            ThreadPool _pool;
+            uint32_t   _chunk;
+
+            void observe(uint32_t index, gym_observation_t & o) const
+            {
+                const SimVehicle & v = *_vehicles[index];
+
+                memcpy(o.gyroRates, v.gyroRates, sizeof(o.gyroRates));
+                memcpy(o.translationRates, v.translationRates, sizeof(o.translationRates));
+                memcpy(o.motorValues, v.motorValues, sizeof(o.motorValues));
+                memcpy(o.position, v.pose.position, sizeof(o.position));
+                o.orientation[0] = v.pose.orientation.x;
+                o.orientation[1] = v.pose.orientation.y;
+                o.orientation[2] = v.pose.orientation.z;
+                o.orientation[3] = v.pose.orientation.w;
+                o.steps = _steps[index];
+
+                float d2 = 0;
+                for (uint8_t k=0; k<3; ++k) {
+                    d2 += o.position[k] * o.position[k];
+                }
+
+                // NaN distances fail the comparison and end the episode too
+                o.done = (_steps[index] >= _maxSteps || !(d2 <= _maxDistance * _maxDistance)) ? 1 : 0;
+            }
+
+            // Runs task(index) for every environment, spread over the pool in chunks
+            template <typename Task>
+            void forEach(Task task)
+            {
+                uint32_t count = (uint32_t)_vehicles.size();
+                uint32_t chunks = (count + _chunk - 1) / _chunk;
+
+                _pool.run(chunks, [&](uint32_t c) {
+                    uint32_t end = (c + 1) * _chunk < count ? (c + 1) * _chunk : count;
+                    for (uint32_t j = c * _chunk; j < end; ++j) {
+                        task(j);
+                    }
+                });
+            }
+
+        public:
+
+            GymEnvironments(uint32_t count, const Stabilizer & stabilizer, float stepSeconds=0.001f,
+                    uint32_t maxSteps=10000, float maxDistance=100, uint32_t threads=0)
+                : _receivers(count), _steps(count, 0),
+                _stepSeconds(stepSeconds), _maxSteps(maxSteps), _maxDistance(maxDistance), _pool(threads)
+            {
+                for (uint32_t j=0; j<count; ++j) {
+                    _vehicles.push_back(new SimVehicle(stabilizer));
+                    _vehicles[j]->init(&_receivers[j]);
+                    _snapshots.push_back(new VehicleSnapshot(*_vehicles[j]));
+                }
+
+                // Several chunks per thread, so that a slow chunk doesn't hold up the batch
+                uint32_t workers = _pool.size() + 1;
+                _chunk = count / (4 * workers);
+                _chunk = _chunk < 64 ? 64 : _chunk;
+            }
+
+            ~GymEnvironments(void)
+            {
+                for (uint32_t j=0; j<_vehicles.size(); ++j) {
+                    delete _vehicles[j];
+                    delete _snapshots[j];
+                }
+            }
+
+            GymEnvironments(const GymEnvironments &) = delete;
+            GymEnvironments & operator=(const GymEnvironments &) = delete;
+
+            uint32_t count(void) const
+            {
+                return (uint32_t)_vehicles.size();
+            }
+
+            gym_info_t info(void) const
+            {
+                gym_info_t i = gym_info_t();
+
+                i.version = GYM_VERSION;
+                i.environments = count();
+                i.actionBytes = sizeof(gym_action_t);
+                i.observationBytes = sizeof(gym_observation_t);
+                i.stepSeconds = _stepSeconds;
+                i.maxSteps = _maxSteps;
+                i.maxDistance = _maxDistance;
+
+                return i;
+            }
+
+            // Puts the given environments (all, if count is 0) back at their start, and
+            // observes every environment
+            void reset(const uint32_t * indices, uint32_t n, gym_observation_t * observations)
+            {
+                if (n == 0) {
+                    forEach([&](uint32_t j) {
+                        _vehicles[j]->restore(*_snapshots[j]);
+                        _steps[j] = 0;
+                    });
+                }
+
+                for (uint32_t k=0; k<n; ++k) {
+                    if (indices[k] < count()) {
+                        _vehicles[indices[k]]->restore(*_snapshots[indices[k]]);
+                        _steps[indices[k]] = 0;
+                    }
+                }
+
+                forEach([&](uint32_t j) { observe(j, observations[j]); });
+            }
+
+            // Applies one action per environment for repeat fixed steps, and observes the results.
+            // Environments whose episode is done are left as they are until reset.
+            void step(uint32_t mode, const gym_action_t * actions, uint32_t repeat, gym_observation_t * observations)
+            {
+                repeat = repeat == 0 ? 1 : repeat;
+
+                forEach([&](uint32_t j) {
+
+                    for (uint32_t r=0; r<repeat; ++r) {
+
+                        observe(j, observations[j]);
+
+                        if (observations[j].done) {
+                            break;
+                        }
+
+                        if (mode == GYM_ACTION_MOTORS) {
+                            _vehicles[j]->stepMotors(actions[j].values, _stepSeconds);
+                        }
+                        else {
+                            _receivers[j].setSticks(actions[j].values);
+                            _vehicles[j]->step(_stepSeconds);
+                        }
+
+                        ++_steps[j];
+                    }
+
+                    observe(j, observations[j]);
+                });
+            }
+
+            const SimVehicle & vehicle(uint32_t index) const
+            {
+                return *_vehicles[index];
+            }
+
+    }; // class GymEnvironments
+
+#ifndef _WIN32
+
+    class GymServer {
+
+        private:
+
+            GymEnvironments & _envs;
+
+            int  _listener;
+            char _path[108];
+
+            // One buffer of each kind, sized for the whole batch up front
+            std::vector<gym_action_t>      _actions;
+            std::vector<gym_observation_t> _observations;
+            std::vector<uint32_t>          _indices;
+
+            ShmMailbox<gym_view_t> * _viewer;
+            uint32_t _viewed;
+
+            uint64_t _requests;
+
+            static bool readAll(int fd, void * buffer, size_t bytes)
+            {
+                uint8_t * p = (uint8_t *)buffer;
+
+                while (bytes > 0) {
+                    ssize_t n = ::read(fd, p, bytes);
+                    if (n <= 0) {
+                        return false;
+                    }
+                    p += n;
+                    bytes -= n;
+                }
+
+                return true;
+            }
+
+            static bool writeAll(int fd, const void * buffer, size_t bytes)
+            {
+                const uint8_t * p = (const uint8_t *)buffer;
+
+                while (bytes > 0) {
+                    // A client gone mid-reply is an error for this connection, not a SIGPIPE for the server
+#ifdef MSG_NOSIGNAL
+                    ssize_t n = ::send(fd, p, bytes, MSG_NOSIGNAL);
+#else
+                    ssize_t n = ::send(fd, p, bytes, 0);
+#endif
+                    if (n <= 0) {
+                        return false;
+                    }
+                    p += n;
+                    bytes -= n;
+                }
+
+                return true;
+            }
+
+            static bool reply(int fd, uint32_t status, uint32_t count, uint32_t recordBytes, const void * records)
+            {
+                gym_reply_t r = gym_reply_t();
+                r.magic = GYM_MAGIC;
+                r.status = status;
+                r.count = count;
+                r.recordBytes = recordBytes;
+
+                return writeAll(fd, &r, sizeof(r)) && (count == 0 || writeAll(fd, records, count * recordBytes));
+            }
+
+            void postView(void)
+            {
+                if (!_viewer) {
+                    return;
+                }
+
+                const SimVehicle & v = _envs.vehicle(_viewed);
+
+                gym_view_t view;
+                view.environment = _viewed;
+                view.steps = _observations[_viewed].steps;
+                view.postedNanos = steadyNanos();
+                memcpy(view.position, v.pose.position, sizeof(view.position));
+                view.orientation[0] = v.pose.orientation.x;
+                view.orientation[1] = v.pose.orientation.y;
+                view.orientation[2] = v.pose.orientation.z;
+                view.orientation[3] = v.pose.orientation.w;
+                memcpy(view.motorValues, v.motorValues, sizeof(view.motorValues));
+
+                _viewer->write(view);
+            }
+
+        public:
+
+            GymServer(GymEnvironments & envs)
+                : _envs(envs), _listener(-1), _actions(envs.count()), _observations(envs.count()),
+                _indices(envs.count()), _viewer(nullptr), _viewed(0), _requests(0)
+            {
+                _path[0] = 0;
+            }
+
+            ~GymServer(void)
+            {
+                if (_listener >= 0) {
+                    ::close(_listener);
+                    unlink(_path);
+                }
+            }
+
+            // Posts one environment's pose after every request, for a viewer such as the pawn
+            void setViewer(ShmMailbox<gym_view_t> * viewer, uint32_t environment)
+            {
+                _viewer = viewer;
+                _viewed = environment < _envs.count() ? environment : 0;
+            }
+
+            bool listen(const char * path)
+            {
+                struct sockaddr_un address = sockaddr_un();
+                address.sun_family = AF_UNIX;
+
+                if (strlen(path) >= sizeof(address.sun_path)) {
+                    return false;
+                }
+
+                strcpy(address.sun_path, path);
+                strcpy(_path, path);
+                unlink(path);
+
+                _listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+                return _listener >= 0 &&
+                    bind(_listener, (struct sockaddr *)&address, sizeof(address)) == 0 &&
+                    ::listen(_listener, 1) == 0;
+            }
+
+            // Serves one client until it disconnects; returns false once a client sends GYM_CLOSE
+            bool serve(void)
+            {
+                int fd = accept(_listener, nullptr, nullptr);
+                if (fd < 0) {
+                    return true;
+                }
+
+                bool running = true;
+                gym_request_t request;
+
+                while (readAll(fd, &request, sizeof(request))) {
+
+                    ++_requests;
+
+                    if (request.magic != GYM_MAGIC) {
+                        reply(fd, GYM_BAD_REQUEST, 0, 0, nullptr);
+                        break;
+                    }
+
+                    bool ok = true;
+
+                    switch (request.command) {
+
+                        case GYM_INFO: {
+                            gym_info_t info = _envs.info();
+                            ok = reply(fd, GYM_OK, 1, sizeof(info), &info);
+                            break;
+                        }
+
+                        case GYM_RESET:
+                            if (request.count > _envs.count() ||
+                                    !readAll(fd, _indices.data(), request.count * sizeof(uint32_t))) {
+                                ok = false;
+                                break;
+                            }
+                            _envs.reset(_indices.data(), request.count, _observations.data());
+                            postView();
+                            ok = reply(fd, GYM_OK, _envs.count(), sizeof(gym_observation_t), _observations.data());
+                            break;
+
+                        case GYM_STEP:
+                            if (request.count != _envs.count() ||
+                                    !readAll(fd, _actions.data(), request.count * sizeof(gym_action_t))) {
+                                ok = false;
+                                break;
+                            }
+                            _envs.step(request.actionMode, _actions.data(), request.repeat, _observations.data());
+                            postView();
+                            ok = reply(fd, GYM_OK, _envs.count(), sizeof(gym_observation_t), _observations.data());
+                            break;
+
+                        case GYM_CLOSE:
+                            reply(fd, GYM_OK, 0, 0, nullptr);
+                            running = false;
+                            ok = false;
+                            break;
+
+                        default:
+                            ok = false;
+                    }
+
+                    if (!ok) {
+                        if (running && request.command != GYM_CLOSE) {
+                            reply(fd, GYM_BAD_REQUEST, 0, 0, nullptr);
+                        }
+                        break;
+                    }
+                }
+
+                ::close(fd);
+
+                return running;
+            }
+
+            uint64_t requests(void) const
+            {
+                return _requests;
+            }
+
+    }; // class GymServer
+
+#endif // _WIN32
+
+} // namespace hf
@@ -0,0 +1,130 @@
+/*
+   gymprotocol.hpp: fixed binary layouts exchanged with the HackflightSim environment server
+
+   Every message is a 32-byte header followed by a payload of fixed-size records, all
+   little-endian.  A client sends a gym_request_t and then:
+
+     GYM_INFO   nothing                          reply: one gym_info_t
+     GYM_RESET  count uint32_t environment       reply: one gym_observation_t per environment
+                indices (count 0 resets all)
+     GYM_STEP   one gym_action_t per environment reply: one gym_observation_t per environment
+     GYM_CLOSE  nothing                          reply: header only; the server then exits
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace hf {
+
+    static const uint32_t GYM_MAGIC   = 0x59474648; // "HFGY"
+    static const uint32_t GYM_VERSION = 1;
+
+    enum {
+        GYM_INFO,
+        GYM_RESET,
+        GYM_STEP,
+        GYM_CLOSE
+    };
+
+    // What a gym_action_t's values are
+    enum {
+        GYM_ACTION_STICKS,      // throttle, roll, pitch, yaw, aux1 in [-1,+1], flown through the firmware
+        GYM_ACTION_MOTORS       // four motor values in [0,1], bypassing the firmware
+    };
+
+    enum {
+        GYM_OK,
+        GYM_BAD_REQUEST
+    };
+
+    typedef struct {
+
+        uint32_t magic;
+        uint32_t command;
+        uint32_t count;         // environments (GYM_STEP) or indices (GYM_RESET) that follow
+        uint32_t actionMode;    // GYM_STEP only
+        uint32_t repeat;        // GYM_STEP only: fixed steps to hold each action for; 0 means 1
+        uint32_t reserved[3];
+
+    } gym_request_t;
+
+    typedef struct {
+
+        uint32_t magic;
+        uint32_t status;
+        uint32_t count;         // records that follow
+        uint32_t recordBytes;
+        uint32_t imageBytes;    // per environment, following the records; 0 when images are off
+        uint32_t reserved[3];
+
+    } gym_reply_t;
+
+    typedef struct {
+
+        uint32_t version;
+        uint32_t environments;
+        uint32_t actionBytes;
+        uint32_t observationBytes;
+        float    stepSeconds;
+        uint32_t maxSteps;
+        float    maxDistance;
+        uint32_t imageRows;     // 0 when the server renders no images
+        uint32_t imageCols;
+        uint32_t reserved[7];
+
+    } gym_info_t;
+
+    typedef struct {
+
+        float values[8];        // sticks or motors, by actionMode; unused values are ignored
+
+    } gym_action_t;
+
+    typedef struct {
+
+        float    gyroRates[3];
+        float    translationRates[3];
+        float    motorValues[4];
+        float    position[3];   // meters, relative to the environment's start
+        float    orientation[4];
+        uint32_t steps;         // since the last reset
+        uint32_t done;          // 1 once the episode hit maxSteps or maxDistance; reset it to go on
+
+    } gym_observation_t;
+
+    // What the server posts for a viewer to draw one of its environments
+    typedef struct {
+
+        uint32_t environment;
+        uint32_t steps;
+        uint64_t postedNanos;   // server's steady clock, so a viewer can tell a server that has gone away
+        float    position[3];
+        float    orientation[4];
+        float    motorValues[4];
+
+    } gym_view_t;
+
+    static_assert(sizeof(gym_request_t) == 32, "gym request header must stay 32 bytes");
+    static_assert(sizeof(gym_reply_t) == 32, "gym reply header must stay 32 bytes");
+    static_assert(sizeof(gym_info_t) == 64, "gym info must stay 64 bytes");
+    static_assert(sizeof(gym_action_t) == 32, "gym action must stay 32 bytes");
+    static_assert(sizeof(gym_observation_t) == 76, "gym observation must stay 76 bytes");
+
+} // namespace hf
@@ -0,0 +1,357 @@
+/*
+   imu.hpp: gyro and accelerometer model between the simulated vehicle and the firmware
+
+   The board reports ideal rates and attitude.  ImuModel samples them at a real sensor rate
+   on the simulation clock, independent of firmware and render rates, and adds turn-on bias,
+   bias random walk, white noise, quantization and delay.  Noise comes from NormalBlockRng,
+   which fills a block at a time across independent generator lanes so that the compiler
+   can vectorize it.  Everything follows from the seed, so replayed flights reproduce.
+
+   The accelerometer sees gravity only, since the board reports no linear acceleration; its
+   errors reach the firmware through the roll and pitch it implies.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+namespace hf {
+
+    // Normally distributed numbers, a block at a time, from LANES xoshiro128+ generators run
+    // side by side.  Each number is the scaled sum of four 16-bit uniforms from its lane: its tails
+    // stop at +-3.46 standard deviations, which is immaterial for sensor noise.
+    class NormalBlockRng {
+
+        public:
+
+            static const uint32_t LANES = 32;
+
+        private:
+
+            uint32_t _s0[LANES];
+            uint32_t _s1[LANES];
+            uint32_t _s2[LANES];
+            uint32_t _s3[LANES];
+
+            float    _block[LANES];
+            uint32_t _next;
+
+            static uint64_t splitmix(uint64_t & x)
+            {
+                uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                return z ^ (z >> 31);
+            }
+
+            // One xoshiro128+ step of a lane
+            static uint32_t step(uint32_t & s0, uint32_t & s1, uint32_t & s2, uint32_t & s3)
+            {
+                uint32_t r = s0 + s3;
+                uint32_t t = s1 << 9;
+
+                s2 ^= s0;
+                s3 ^= s1;
+                s1 ^= s2;
+                s0 ^= s3;
+                s2 ^= t;
+                s3 = (s3 << 11) | (s3 >> 21);
+
+                return r;
+            }
+
+            // Each lane makes one number of the block from two steps, each giving two 16-bit
+            // uniforms; the loop over lanes is a plain vectorizable loop
+            void fill(void)
+            {
+                static const float SCALE = 1.f / 65536;
+                static const float SQRT3 = 1.7320508f;
+
+                for (uint32_t l=0; l<LANES; ++l) {
+
+                    uint32_t s0 = _s0[l], s1 = _s1[l], s2 = _s2[l], s3 = _s3[l];
+
+                    uint32_t a = step(s0, s1, s2, s3);
+                    uint32_t b = step(s0, s1, s2, s3);
+
+                    _s0[l] = s0;
+                    _s1[l] = s1;
+                    _s2[l] = s2;
+                    _s3[l] = s3;
+
+                    float sum = (float)((a >> 16) + (a & 0xFFFF) + (b >> 16) + (b & 0xFFFF));
+                    _block[l] = (sum * SCALE - 2) * SQRT3;
+                }
+
+                _next = 0;
+            }
+
+        public:
+
+            NormalBlockRng(uint64_t seed=1)
+            {
+                this->seed(seed);
+            }
+
+            void seed(uint64_t seed)
+            {
+                for (uint32_t l=0; l<LANES; ++l) {
+                    _s0[l] = (uint32_t)splitmix(seed);
+                    _s1[l] = (uint32_t)splitmix(seed);
+                    _s2[l] = (uint32_t)splitmix(seed);
+                    _s3[l] = (uint32_t)splitmix(seed);
+                    // xoshiro's only bad state
+                    if (!(_s0[l] | _s1[l] | _s2[l] | _s3[l])) {
+                        _s0[l] = 1;
+                    }
+                }
+
+                _next = LANES;
+            }
+
+            float next(void)
+            {
+                if (_next == LANES) {
+                    fill();
+                }
+
+                return _block[_next++];
+            }
+
+            // The next count numbers (at most LANES) together; any left in the block that are
+            // too few are skipped
+            const float * take(uint32_t count)
+            {
+                if (_next + count > LANES) {
+                    fill();
+                }
+
+                const float * numbers = &_block[_next];
+                _next += count;
+                return numbers;
+            }
+
+    }; // class NormalBlockRng
+
+    typedef struct {
+
+        float noise;        // white noise standard deviation, per sample
+        float biasWalk;     // bias random walk, per root second
+        float initialBias;  // turn-on bias standard deviation
+        float resolution;   // least significant bit; zero for none
+
+    } imu_sensor_t;
+
+    // MPU-6000 class parts at 8 kHz: gyro at +-2000 deg/sec (radians/sec), accelerometer at
+    // +-16 g (meters/sec^2), both 16 bits, with the turn-on bias left after a level calibration
+    static const imu_sensor_t IMU_GYRO_DEFAULT  = { 0.0055f, 0.0001f, 0.003f, 0.001065f };
+    static const imu_sensor_t IMU_ACCEL_DEFAULT = { 0.05f,   0.001f,  0.02f,  0.0048f  };
+
+    class ImuModel {
+
+        public:
+
+            // Longest delay, in samples, plus the most samples the firmware may leave unread
+            static const uint32_t CAPACITY = 32;
+
+        private:
+
+            static const int CHANNELS = 6;  // gyro x, y, z, then accelerometer x, y, z
+
+            static constexpr float GRAVITY = 9.80665f;
+
+            NormalBlockRng _rng;
+            uint64_t       _seed;
+
+            imu_sensor_t _sensors[2];
+            float        _steps[2];      // reciprocal resolutions, zero for none
+            float        _walk;          // bias walk per sample, per unit of biasWalk
+            uint64_t     _periodNanos;   // zero when the model is off
+            uint32_t     _delaySamples;
+
+            float    _bias[CHANNELS];
+            float    _samples[CAPACITY][CHANNELS];
+            uint64_t _count;            // samples taken
+            uint64_t _read;             // samples the firmware has seen
+            uint64_t _nextNanos;        // simulation time of the next sample
+            uint64_t _lastNanos;        // and of the last read, with its true values
+            float    _lastTruth[CHANNELS];
+            float    _output[CHANNELS];
+
+            // Gravity in the body frame for roll and pitch (radians), with z up when level
+            static void gravity(const float euler[3], float accel[3])
+            {
+                accel[0] = -GRAVITY * sinf(euler[1]);
+                accel[1] = +GRAVITY * sinf(euler[0]) * cosf(euler[1]);
+                accel[2] = +GRAVITY * cosf(euler[0]) * cosf(euler[1]);
+            }
+
+            void setSensors(const imu_sensor_t & gyro, const imu_sensor_t & accel)
+            {
+                _sensors[0] = gyro;
+                _sensors[1] = accel;
+
+                for (int k=0; k<2; ++k) {
+                    _steps[k] = _sensors[k].resolution > 0 ? 1 / _sensors[k].resolution : 0;
+                }
+
+                _walk = sqrtf(_periodNanos / 1e9f);
+            }
+
+            void sample(const float truth[CHANNELS])
+            {
+                float * s = _samples[_count % CAPACITY];
+                const float * n = _rng.take(2*CHANNELS);
+
+                for (int k=0; k<CHANNELS; ++k) {
+
+                    const imu_sensor_t & sensor = _sensors[k/3];
+
+                    float value = truth[k] + _bias[k] + sensor.noise * n[k];
+                    _bias[k] += sensor.biasWalk * _walk * n[CHANNELS+k];
+
+                    // floorf(x + 0.5) compiles to a single instruction where roundf is a call
+                    float step = _steps[k/3];
+                    s[k] = step > 0 ? floorf(value * step + 0.5f) * sensor.resolution : value;
+                }
+
+                ++_count;
+            }
+
+        public:
+
+            // An ImuModel made without a rate passes the ideal values through
+            ImuModel(void) : _seed(1), _periodNanos(0), _delaySamples(0)
+            {
+                setSensors(IMU_GYRO_DEFAULT, IMU_ACCEL_DEFAULT);
+                reset();
+            }
+
+            ImuModel(float rateHz, uint64_t seed, float delaySeconds=0.0005f,
+                    const imu_sensor_t & gyro=IMU_GYRO_DEFAULT, const imu_sensor_t & accel=IMU_ACCEL_DEFAULT)
+                : _seed(seed), _periodNanos((uint64_t)(1e9 / rateHz + 0.5))
+            {
+                setSensors(gyro, accel);
+
+                uint32_t delay = (uint32_t)(delaySeconds * rateHz + 0.5f);
+                _delaySamples = delay < CAPACITY/2 ? delay : CAPACITY/2;
+
+                reset();
+            }
+
+            bool enabled(void) const
+            {
+                return _periodNanos > 0;
+            }
+
+            // Starts again from the turn-on bias and the seed, with the clock at zero
+            void reset(void)
+            {
+                _rng.seed(_seed);
+
+                for (int k=0; k<CHANNELS; ++k) {
+                    _bias[k] = _sensors[k/3].initialBias * _rng.next();
+                    _lastTruth[k] = 0;
+                    _output[k] = 0;
+                }
+
+                _count = 0;
+                _read = 0;
+                _nextNanos = 0;
+                _lastNanos = 0;
+            }
+
+            // Takes the samples due up to the given simulation time, with the true values
+            // interpolated from the last read, and replaces the ideal gyro rates and roll and
+            // pitch with what the firmware would see: the mean of the samples that have come
+            // through the delay since its last read, as from a FIFO it drains each loop
+            void read(uint64_t nanos, float euler[3], float gyro[3])
+            {
+                if (!enabled()) {
+                    return;
+                }
+
+                float truth[CHANNELS];
+                memcpy(truth, gyro, 3*sizeof(float));
+                gravity(euler, &truth[3]);
+
+                if (_count == 0) {
+                    memcpy(_lastTruth, truth, sizeof(truth));
+                }
+
+                float scale = nanos > _lastNanos ? 1.f / (nanos - _lastNanos) : 0;
+
+                for (; _nextNanos <= nanos; _nextNanos += _periodNanos) {
+
+                    float f = scale > 0 ? (_nextNanos - _lastNanos) * scale : 1;
+
+                    float interpolated[CHANNELS];
+                    for (int k=0; k<CHANNELS; ++k) {
+                        interpolated[k] = _lastTruth[k] + f * (truth[k] - _lastTruth[k]);
+                    }
+
+                    sample(interpolated);
+                }
+
+                memcpy(_lastTruth, truth, sizeof(truth));
+                _lastNanos = nanos;
+
+                // Samples through the delay line; a slow reader only sees the newest that still fit
+                uint64_t visible = _count > _delaySamples ? _count - _delaySamples : 0;
+                uint64_t oldest = _count > CAPACITY - 1 ? _count - (CAPACITY - 1) : 0;
+                uint64_t first = _read > oldest ? _read : oldest;
+
+                if (visible > first) {
+
+                    float sum[CHANNELS] = {};
+                    for (uint64_t j=first; j<visible; ++j) {
+                        for (int k=0; k<CHANNELS; ++k) {
+                            sum[k] += _samples[j % CAPACITY][k];
+                        }
+                    }
+
+                    for (int k=0; k<CHANNELS; ++k) {
+                        _output[k] = sum[k] / (visible - first);
+                    }
+
+                    _read = visible;
+                }
+
+                // Until the first sample is through the delay, the ideal values pass through
+                if (_read == 0) {
+                    return;
+                }
+
+                memcpy(gyro, _output, 3*sizeof(float));
+
+                const float * a = &_output[3];
+                euler[0] = atan2f(a[1], a[2]);
+                euler[1] = atan2f(-a[0], sqrtf(a[1]*a[1] + a[2]*a[2]));
+            }
+
+            uint64_t samples(void) const
+            {
+                return _count;
+            }
+
+    }; // class ImuModel
+
+} // namespace hf
@@ -0,0 +1,93 @@
+/*
+   indexqueue.hpp: bounded lock-free ring of buffer indices
+
+   One thread pushes; the other thread pops.  Because popping is a compare-and-swap on
+   the head, the pushing thread may also remove the oldest entry itself, which is how
+   a drop-oldest policy is applied without the two sides ever blocking each other.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+namespace hf {
+
+    template <uint32_t CAPACITY>
+    class IndexQueue {
+
+        static_assert((CAPACITY & (CAPACITY-1)) == 0, "IndexQueue capacity must be a power of two");
+
+        private:
+
+            // Head and tail on their own cache lines, so the two threads don't false-share
+            alignas(64) std::atomic<uint32_t> _head;
+            alignas(64) std::atomic<uint32_t> _tail;
+
+            std::atomic<uint32_t> _slots[CAPACITY];
+
+        public:
+
+            IndexQueue(void) : _head(0), _tail(0)
+            {
+            }
+
+            // Pushing thread only; returns false if full
+            bool push(uint32_t value)
+            {
+                uint32_t tail = _tail.load(std::memory_order_relaxed);
+
+                if (tail - _head.load(std::memory_order_acquire) >= CAPACITY) {
+                    return false;
+                }
+
+                _slots[tail % CAPACITY].store(value, std::memory_order_relaxed);
+                _tail.store(tail + 1, std::memory_order_release);
+
+                return true;
+            }
+
+            // Either thread; returns false if empty.  The slot is read before the head is
+            // claimed, which is safe because the pusher can only reuse it after a full lap.
+            bool pop(uint32_t & value)
+            {
+                uint32_t head = _head.load(std::memory_order_relaxed);
+
+                while (true) {
+
+                    if (head == _tail.load(std::memory_order_acquire)) {
+                        return false;
+                    }
+
+                    value = _slots[head % CAPACITY].load(std::memory_order_relaxed);
+
+                    if (_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                        return true;
+                    }
+                }
+            }
+
+            uint32_t size(void) const
+            {
+                return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+            }
+
+    }; // class IndexQueue
+
+} // namespace hf
@@ -0,0 +1,244 @@
+/*
+   inputlog.hpp: records the stick values, stick mode and step lengths a vehicle's firmware
+   sees, and plays them back, so that a flight can be repeated exactly
+
+   Layout (little-endian): an input_log_header_t, then one input_record_t per fixed step.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sticks.hpp"
+#include "pose.hpp"
+
+namespace hf {
+
+    static const uint32_t INPUT_LOG_MAGIC   = 0x4E494648; // "HFIN"
+    static const uint32_t INPUT_LOG_VERSION = 2;
+
+    // Record flags
+    static const uint32_t INPUT_HEADLESS = 1;   // roll and pitch were read in headless mode
+
+    typedef struct {
+
+        float    dt;
+        float    sticks[STICK_CHANNELS];
+        uint32_t flags;
+
+    } input_record_t;
+
+    typedef struct {
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t channels;
+        float    stepSeconds;
+
+        // Pose before the first step, so that a replay can start from the same place
+        float    position[3];
+        float    orientation[4];
+
+        uint32_t reserved;
+
+    } input_log_header_t;
+
+    class InputRecorder {
+
+        private:
+
+            FILE *   _file;
+            uint64_t _count;
+            char     _buffer[1 << 16];
+
+        public:
+
+            InputRecorder(void) : _file(nullptr), _count(0)
+            {
+            }
+
+            ~InputRecorder(void)
+            {
+                close();
+            }
+
+            bool open(const char * path, float stepSeconds, const Pose & initialPose)
+            {
+                close();
+
+                _file = fopen(path, "wb");
+                if (!_file) {
+                    return false;
+                }
+
+                setvbuf(_file, _buffer, _IOFBF, sizeof(_buffer));
+
+                input_log_header_t header = input_log_header_t();
+                header.magic = INPUT_LOG_MAGIC;
+                header.version = INPUT_LOG_VERSION;
+                header.channels = STICK_CHANNELS;
+                header.stepSeconds = stepSeconds;
+                memcpy(header.position, initialPose.position, sizeof(header.position));
+                header.orientation[0] = initialPose.orientation.x;
+                header.orientation[1] = initialPose.orientation.y;
+                header.orientation[2] = initialPose.orientation.z;
+                header.orientation[3] = initialPose.orientation.w;
+
+                _count = 0;
+
+                return fwrite(&header, sizeof(header), 1, _file) == 1;
+            }
+
+            void close(void)
+            {
+                if (_file) {
+                    fclose(_file);
+                    _file = nullptr;
+                }
+            }
+
+            bool isOpen(void) const
+            {
+                return _file != nullptr;
+            }
+
+            // Call once per step, with the sticks the firmware read on that step and the mode it
+            // read them in
+            void append(float dt, const float sticks[STICK_CHANNELS], bool headless)
+            {
+                input_record_t record;
+                record.dt = dt;
+                memcpy(record.sticks, sticks, sizeof(record.sticks));
+                record.flags = headless ? INPUT_HEADLESS : 0;
+
+                fwrite(&record, sizeof(record), 1, _file);
+
+                ++_count;
+            }
+
+            uint64_t count(void) const
+            {
+                return _count;
+            }
+
+    }; // class InputRecorder
+
+    class InputPlayer {
+
+        private:
+
+            FILE *   _file;
+            uint64_t _count;
+            char     _buffer[1 << 16];
+
+            input_log_header_t _header;
+
+        public:
+
+            InputPlayer(void) : _file(nullptr), _count(0)
+            {
+            }
+
+            ~InputPlayer(void)
+            {
+                close();
+            }
+
+            bool open(const char * path)
+            {
+                close();
+
+                _file = fopen(path, "rb");
+                if (!_file) {
+                    return false;
+                }
+
+                setvbuf(_file, _buffer, _IOFBF, sizeof(_buffer));
+
+                if (fread(&_header, sizeof(_header), 1, _file) != 1 ||
+                        _header.magic != INPUT_LOG_MAGIC || _header.version != INPUT_LOG_VERSION ||
+                        _header.channels != STICK_CHANNELS) {
+                    close();
+                    return false;
+                }
+
+                _count = 0;
+
+                return true;
+            }
+
+            void close(void)
+            {
+                if (_file) {
+                    fclose(_file);
+                    _file = nullptr;
+                }
+            }
+
+            bool isOpen(void) const
+            {
+                return _file != nullptr;
+            }
+
+            // Starts over from the first step
+            void rewind(void)
+            {
+                fseek(_file, sizeof(input_log_header_t), SEEK_SET);
+                _count = 0;
+            }
+
+            // Reads the next step; returns false at the end of the log
+            bool next(input_record_t & record)
+            {
+                if (!_file || fread(&record, sizeof(record), 1, _file) != 1) {
+                    return false;
+                }
+
+                ++_count;
+
+                return true;
+            }
+
+            float stepSeconds(void) const
+            {
+                return _header.stepSeconds;
+            }
+
+            Pose initialPose(void) const
+            {
+                Pose pose;
+                memcpy(pose.position, _header.position, sizeof(pose.position));
+                pose.orientation.x = _header.orientation[0];
+                pose.orientation.y = _header.orientation[1];
+                pose.orientation.z = _header.orientation[2];
+                pose.orientation.w = _header.orientation[3];
+                return pose;
+            }
+
+            // Steps played so far
+            uint64_t count(void) const
+            {
+                return _count;
+            }
+
+    }; // class InputPlayer
+
+} // namespace hf
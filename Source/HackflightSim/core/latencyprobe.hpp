@@ -0,0 +1,416 @@
+/*
+   latencyprobe.hpp: end-to-end stick-to-motion latency measurement
+
+   The probe takes the controller's place, stepping one stick channel up and down on a
+   wall-clock schedule, and follows each step through the chain: the firmware step that first
+   reads it, that step's completion, the first change in motor output, the first motion
+   about the matching axis, and the rendering of the frame that shows it.  Motor and motion
+   response are also given in simulated time, which is what the firmware and dynamics alone
+   contribute; the rest is stepping, batching and rendering.  A frame counts as rendered when the
+   GPU has finished drawing it, not when the render thread takes up its commands.
+
+   What counts as a change in motor output or as motion is taken, unless given, from how far
+   they wander during the quiet period before the first input, so that the thresholds suit
+   whatever gains and sensor noise the vehicle flies with.  Motion is measured from the trend
+   at the input rather than from its value, so that a vehicle already accelerating (falling,
+   say, before a throttle step) is not taken to be responding.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "sticks.hpp"
+
+namespace hf {
+
+    enum {
+        LATENCY_INPUT_TO_READ,      // scheduled input to the start of the step that reads it
+        LATENCY_FIRMWARE_STEP,      // that step, firmware through integration
+        LATENCY_TO_MOTORS,          // end of that step to the end of the first with changed motors
+        LATENCY_TO_MOTION,          // on to the end of the first step with motion about the axis
+        LATENCY_TO_RENDER,          // on to the rendering of the frame showing that motion
+        LATENCY_END_TO_END,         // scheduled input to rendering
+        LATENCY_SIM_MOTORS,         // simulated time from reading the input to changed motors
+        LATENCY_SIM_MOTION,         // simulated time from reading the input to motion
+        LATENCY_COUNT
+    };
+
+    static const char * const LATENCY_NAMES[LATENCY_COUNT] = {
+        "input to read",
+        "firmware step",
+        "to motors",
+        "to motion",
+        "to render",
+        "end to end",
+        "motors (sim)",
+        "motion (sim)"
+    };
+
+    // Measured thresholds are this many times the quiet period's wander, and never below the floor
+    static const float LATENCY_NOISE_MARGIN = 4;
+    static const float LATENCY_MIN_THRESHOLD = 1e-6f;
+
+    typedef struct {
+
+        uint64_t count;
+        double   meanMillis;
+        double   p50Millis;
+        double   p99Millis;
+        double   maxMillis;
+
+    } latency_stats_t;
+
+    class LatencyProbe {
+
+        private:
+
+            typedef enum {
+
+                IDLE,
+                WAIT_STEP_END,
+                WAIT_MOTORS,
+                WAIT_MOTION,
+                WAIT_RENDER
+
+            } state_t;
+
+            uint8_t _channel;
+            float   _amplitude;
+            uint64_t _periodNanos;
+            float   _throttle;
+
+            float _motorThreshold;
+            float _motionThreshold;
+
+            // Largest wander of the motors from their first values and of motion from its first
+            // trend during the quiet period, while it lasts
+            uint32_t _quietSteps;
+            float    _quietMotors[4];
+            float    _quietMotion;
+            float    _quietTrend;
+            float    _motorNoise;
+            float    _motionNoise;
+
+            // Inputs come once per period, each a little after its place in the schedule
+            uint64_t _schedule;
+            uint64_t _nextInput;
+            bool     _high;
+            uint32_t _seed;
+
+            // The event in flight; only one at a time, since the period far exceeds the latency
+            state_t  _state;
+            uint32_t _event;
+            float    _direction;
+            uint64_t _input;
+            uint64_t _read;
+            uint64_t _stepEnd;
+            uint64_t _motors;
+            uint64_t _motion;
+            double   _simRead;
+            double   _simMotors;
+            double   _simMotion;
+            float    _baselineMotors[4];
+            float    _baselineMotion;
+            float    _baselineTrend;
+            uint32_t _eventSteps;
+            uint32_t _ticketed;
+
+            // Motor values and motion after the latest step, and motion's change over that step:
+            // the baseline for the next event
+            float _lastMotors[4];
+            float _lastMotion;
+            float _lastTrend;
+
+            // Written by whichever thread sees the frame rendered
+            std::atomic<uint32_t> _renderedEvent;
+            std::atomic<uint64_t> _renderedNanos;
+
+            std::vector<float> _samples[LATENCY_COUNT];
+            uint64_t _incomplete;
+
+            static float threshold(float given, float noise)
+            {
+                return given > 0 ? given : std::max(LATENCY_MIN_THRESHOLD, LATENCY_NOISE_MARGIN * noise);
+            }
+
+            // Up to a fifth of a period, so that inputs land anywhere within a frame, as a pilot's would
+            uint64_t jitter(void)
+            {
+                _seed = _seed * 1664525u + 1013904223u;
+                return (uint64_t)((_seed >> 8) / 16777216. * _periodNanos / 5);
+            }
+
+            void add(uint32_t stage, double millis)
+            {
+                _samples[stage].push_back((float)millis);
+            }
+
+            static double millis(uint64_t from, uint64_t to)
+            {
+                return to > from ? (to - from) / 1e6 : 0;
+            }
+
+            void complete(uint64_t rendered)
+            {
+                add(LATENCY_INPUT_TO_READ, millis(_input, _read));
+                add(LATENCY_FIRMWARE_STEP, millis(_read, _stepEnd));
+                add(LATENCY_TO_MOTORS, millis(_stepEnd, _motors));
+                add(LATENCY_TO_MOTION, millis(_motors, _motion));
+                add(LATENCY_TO_RENDER, millis(_motion, rendered));
+                add(LATENCY_END_TO_END, millis(_input, rendered));
+                add(LATENCY_SIM_MOTORS, 1e3 * _simMotors);
+                add(LATENCY_SIM_MOTION, 1e3 * _simMotion);
+
+                _state = IDLE;
+            }
+
+        public:
+
+            // Steps the given channel between zero and amplitude every periodSeconds, holding the
+            // throttle.  Motion is gyro rate (rad/s) about the channel's axis, or climb rate (m/s)
+            // for the throttle channel.  Thresholds of zero are measured before the first input.
+            LatencyProbe(uint8_t channel=STICK_THROTTLE, float amplitude=0.5f, float periodSeconds=0.5f,
+                    float throttle=0, float motorThreshold=0, float motionThreshold=0)
+                : _channel(channel > STICK_YAW ? STICK_THROTTLE : channel), _amplitude(amplitude), _periodNanos((uint64_t)(1e9 * periodSeconds)),
+                _throttle(throttle), _motorThreshold(motorThreshold), _motionThreshold(motionThreshold),
+                _quietSteps(0), _quietMotion(0), _quietTrend(0), _motorNoise(0), _motionNoise(0), _schedule(0), _nextInput(0), _high(false), _seed(1),
+                _state(IDLE), _event(0), _eventSteps(0), _ticketed(0), _lastMotion(0), _lastTrend(0),
+                _renderedEvent(0), _renderedNanos(0), _incomplete(0)
+            {
+                for (uint8_t k=0; k<4; ++k) {
+                    _lastMotors[k] = 0;
+                }
+
+                for (auto & s : _samples) {
+                    s.reserve(1024);
+                }
+            }
+
+            // The first input is scheduled one period after this
+            void start(uint64_t nowNanos)
+            {
+                _schedule = nowNanos + _periodNanos;
+                _nextInput = _schedule + jitter();
+            }
+
+            // Call before each firmware step, and feed the firmware the sticks it fills in
+            void beforeStep(uint64_t nowNanos, double simSeconds, float sticks[STICK_CHANNELS])
+            {
+                poll();
+
+                if (_nextInput && nowNanos >= _nextInput) {
+
+                    if (_state != IDLE) {
+                        ++_incomplete;
+                    }
+
+                    // The quiet period ends with the first input
+                    if (_event == 0) {
+                        _motorThreshold = threshold(_motorThreshold, _motorNoise);
+                        _motionThreshold = threshold(_motionThreshold, _motionNoise);
+                    }
+
+                    _high = !_high;
+                    _direction = (_high ? 1 : -1) * (_amplitude < 0 ? -1 : 1);
+
+                    _state = WAIT_STEP_END;
+                    ++_event;
+                    _input = _nextInput;
+                    _read = nowNanos;
+                    _simRead = simSeconds;
+                    for (uint8_t k=0; k<4; ++k) {
+                        _baselineMotors[k] = _lastMotors[k];
+                    }
+                    _baselineMotion = _lastMotion;
+                    _baselineTrend = _lastTrend;
+                    _eventSteps = 0;
+
+                    // Inputs stay on schedule even if steps fall behind
+                    do {
+                        _schedule += _periodNanos;
+                    } while (_schedule <= nowNanos);
+                    _nextInput = _schedule + jitter();
+                }
+
+                for (uint8_t k=0; k<STICK_CHANNELS; ++k) {
+                    sticks[k] = 0;
+                }
+                sticks[STICK_THROTTLE] = _throttle;
+                sticks[_channel] = (_channel == STICK_THROTTLE ? _throttle : 0) + (_high ? _amplitude : 0);
+            }
+
+            // Call after each step, with its motor values and rates; simSeconds is after the step
+            void afterStep(uint64_t nowNanos, double simSeconds, const float motors[4],
+                    const float gyroRates[3], const float translationRates[3])
+            {
+                float motion = _channel == STICK_THROTTLE ? translationRates[2] : gyroRates[_channel-1];
+
+                if (_event == 0) {
+                    if (_quietSteps == 0) {
+                        for (uint8_t k=0; k<4; ++k) {
+                            _quietMotors[k] = motors[k];
+                        }
+                        _quietMotion = motion;
+                    }
+                    else if (_quietSteps == 1) {
+                        _quietTrend = motion - _quietMotion;
+                    }
+                    for (uint8_t k=0; k<4; ++k) {
+                        _motorNoise = std::max(_motorNoise, fabsf(motors[k] - _quietMotors[k]));
+                    }
+                    _motionNoise = std::max(_motionNoise, fabsf(motion - (_quietMotion + _quietTrend * _quietSteps)));
+                    ++_quietSteps;
+                }
+
+                if (_state != IDLE) {
+                    ++_eventSteps;
+                }
+
+                if (_state == WAIT_STEP_END) {
+                    _stepEnd = nowNanos;
+                    _state = WAIT_MOTORS;
+                }
+
+                if (_state == WAIT_MOTORS) {
+                    float change = 0;
+                    for (uint8_t k=0; k<4; ++k) {
+                        change = std::max(change, fabsf(motors[k] - _baselineMotors[k]));
+                    }
+                    if (change >= _motorThreshold) {
+                        _motors = nowNanos;
+                        _simMotors = simSeconds - _simRead;
+                        _state = WAIT_MOTION;
+                    }
+                }
+
+                float expected = _baselineMotion + _baselineTrend * _eventSteps;
+
+                if (_state == WAIT_MOTION && (motion - expected) * _direction >= _motionThreshold) {
+                    _motion = nowNanos;
+                    _simMotion = simSeconds - _simRead;
+                    _state = WAIT_RENDER;
+                }
+
+                for (uint8_t k=0; k<4; ++k) {
+                    _lastMotors[k] = motors[k];
+                }
+                _lastTrend = motion - _lastMotion;
+                _lastMotion = motion;
+            }
+
+            // Once per frame, after the vehicle has been moved: nonzero if this frame is the first to
+            // show the current event's motion, to be passed to rendered() when it has been drawn
+            uint32_t renderTicket(void)
+            {
+                if (_state == WAIT_RENDER && _ticketed != _event) {
+                    _ticketed = _event;
+                    return _event;
+                }
+
+                return 0;
+            }
+
+            // Once the frame for the ticket has been drawn, not merely queued; may be called from the
+            // render thread
+            void rendered(uint32_t ticket, uint64_t nowNanos)
+            {
+                _renderedNanos.store(nowNanos, std::memory_order_relaxed);
+                _renderedEvent.store(ticket, std::memory_order_release);
+            }
+
+            // Completes the current event once its frame has been rendered; called by beforeStep()
+            void poll(void)
+            {
+                if (_state == WAIT_RENDER && _renderedEvent.load(std::memory_order_acquire) == _event) {
+                    complete(_renderedNanos.load(std::memory_order_relaxed));
+                }
+            }
+
+            latency_stats_t stats(uint32_t stage) const
+            {
+                std::vector<float> sorted = _samples[stage];
+                std::sort(sorted.begin(), sorted.end());
+
+                latency_stats_t s = {};
+
+                s.count = sorted.size();
+
+                if (s.count > 0) {
+                    double total = 0;
+                    for (float v : sorted) {
+                        total += v;
+                    }
+                    s.meanMillis = total / s.count;
+                    s.p50Millis = sorted[s.count/2];
+                    s.p99Millis = sorted[s.count*99/100];
+                    s.maxMillis = sorted[s.count-1];
+                }
+
+                return s;
+            }
+
+            // Inputs whose response had not been rendered when the next input came
+            uint64_t incomplete(void) const
+            {
+                return _incomplete;
+            }
+
+            // Inputs followed all the way through to the rendered frame
+            uint64_t completed(void) const
+            {
+                return _samples[LATENCY_END_TO_END].size();
+            }
+
+            // Change in motor output and motion taken as a response; measured ones are zero until
+            // the first input
+            float motorThreshold(void) const
+            {
+                return _motorThreshold;
+            }
+
+            float motionThreshold(void) const
+            {
+                return _motionThreshold;
+            }
+
+            void dump(FILE * out) const
+            {
+                fprintf(out, "Responses are motor changes of %g and motion of %g or more\n", motorThreshold(), motionThreshold());
+
+                fprintf(out, "%-14s %8s %10s %10s %10s %10s\n", "stage", "count", "mean ms", "p50 ms", "p99 ms", "max ms");
+
+                for (uint32_t stage=0; stage<LATENCY_COUNT; ++stage) {
+                    latency_stats_t s = stats(stage);
+                    fprintf(out, "%-14s %8llu %10.3f %10.3f %10.3f %10.3f\n", LATENCY_NAMES[stage],
+                            (unsigned long long)s.count, s.meanMillis, s.p50Millis, s.p99Millis, s.maxMillis);
+                }
+
+                fprintf(out, "%llu inputs not followed through before the next\n", (unsigned long long)_incomplete);
+            }
+
+    }; // class LatencyProbe
+
+} // namespace hf
@@ -0,0 +1,106 @@
+/*
+   mailbox.hpp: lock-free, single-writer mailbox holding the latest value of a plain struct
+
+   The writer never waits.  Readers retry in the rare case that they overlap a write
+   (a sequence lock), so they never see a half-written value.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+namespace hf {
+
+    template <typename T>
+    class Mailbox {
+
+        private:
+
+            // Odd while a write is in progress; zero until the first write
+            std::atomic<uint32_t> _sequence;
+
+            // Stored as words so that racing reads are well defined; torn copies are discarded
+            std::atomic<uint32_t> _words[(sizeof(T) + 3) / 4];
+
+        public:
+
+            Mailbox(void) : _sequence(0)
+            {
+                for (auto & w : _words) {
+                    w.store(0, std::memory_order_relaxed);
+                }
+            }
+
+            void write(const T & value)
+            {
+                uint32_t words[(sizeof(T) + 3) / 4] = {};
+                memcpy(words, &value, sizeof(T));
+
+                uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+                _sequence.store(sequence + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                for (uint32_t k=0; k<sizeof(words)/4; ++k) {
+                    _words[k].store(words[k], std::memory_order_relaxed);
+                }
+
+                _sequence.store(sequence + 2, std::memory_order_release);
+            }
+
+            // Returns false if nothing has been written yet
+            bool read(T & value) const
+            {
+                uint32_t words[(sizeof(T) + 3) / 4];
+
+                while (true) {
+
+                    uint32_t before = _sequence.load(std::memory_order_acquire);
+
+                    if (before == 0) {
+                        return false;
+                    }
+
+                    if (before & 1) {
+                        continue;
+                    }
+
+                    for (uint32_t k=0; k<sizeof(words)/4; ++k) {
+                        words[k] = _words[k].load(std::memory_order_relaxed);
+                    }
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+
+                    if (_sequence.load(std::memory_order_relaxed) == before) {
+                        memcpy(&value, words, sizeof(T));
+                        return true;
+                    }
+                }
+            }
+
+            // Number of completed writes; changes whenever a new value arrives
+            uint32_t version(void) const
+            {
+                return _sequence.load(std::memory_order_acquire) / 2;
+            }
+
+    }; // class Mailbox
+
+} // namespace hf
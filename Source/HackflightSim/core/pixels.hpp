@@ -0,0 +1,168 @@
+/*
+   pixels.hpp: conversions from UE4's BGRA render-target pixels to the formats
+   expected by vision algorithms
+
+   Every conversion walks memory in row-major order, exactly as the render target
+   stores it, and has a scalar reference version that the SIMD version must match
+   byte for byte.  The SSSE3 versions are chosen at run time, and kept only where they
+   beat the compiler's own vectorization of the scalar loop.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "simd.hpp"
+
+namespace hf {
+
+    // Integer BT.601 luma weights, summing to 256
+    static const uint32_t GRAY_WEIGHT_R = 77;
+    static const uint32_t GRAY_WEIGHT_G = 150;
+    static const uint32_t GRAY_WEIGHT_B = 29;
+
+    // Scalar reference versions --------------------------------------------------------------
+
+    inline void bgraToRgbScalar(const uint8_t * bgra, uint8_t * rgb, size_t pixels)
+    {
+        for (size_t k=0; k<pixels; ++k) {
+            rgb[3*k]   = bgra[4*k+2];
+            rgb[3*k+1] = bgra[4*k+1];
+            rgb[3*k+2] = bgra[4*k];
+        }
+    }
+
+    inline void bgraToGrayScalar(const uint8_t * bgra, uint8_t * gray, size_t pixels)
+    {
+        for (size_t k=0; k<pixels; ++k) {
+            gray[k] = (uint8_t)((GRAY_WEIGHT_B*bgra[4*k] + GRAY_WEIGHT_G*bgra[4*k+1] + GRAY_WEIGHT_R*bgra[4*k+2] + 128) >> 8);
+        }
+    }
+
+    // Planar output is three consecutive planes of R, G and B
+    inline void bgraToPlanarScalar(const uint8_t * bgra, uint8_t * planar, size_t pixels)
+    {
+        uint8_t * r = planar;
+        uint8_t * g = planar + pixels;
+        uint8_t * b = planar + 2*pixels;
+
+        for (size_t k=0; k<pixels; ++k) {
+            r[k] = bgra[4*k+2];
+            g[k] = bgra[4*k+1];
+            b[k] = bgra[4*k];
+        }
+    }
+
+#ifdef HF_HAVE_SSSE3
+
+    // SSSE3 versions, for CPUs that have it: each converts whole groups of sixteen pixels and
+    // returns how many it converted, leaving the rest to the scalar versions ------------------
+
+    HF_TARGET_SSSE3 inline size_t bgraToRgbSsse3(const uint8_t * bgra, uint8_t * rgb, size_t pixels)
+    {
+        size_t k = 0;
+
+        // Sixteen pixels in, three full registers out: each group of four pixels shuffles down to
+        // twelve bytes, and neighbouring groups are shifted together to fill the gaps
+        const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+        for (; k+16 <= pixels; k+=16) {
+
+            __m128i s0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(bgra + 4*k)),      shuffle);
+            __m128i s1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(bgra + 4*k + 16)), shuffle);
+            __m128i s2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(bgra + 4*k + 32)), shuffle);
+            __m128i s3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(bgra + 4*k + 48)), shuffle);
+
+            _mm_storeu_si128((__m128i *)(rgb + 3*k),      _mm_or_si128(s0, _mm_slli_si128(s1, 12)));
+            _mm_storeu_si128((__m128i *)(rgb + 3*k + 16), _mm_or_si128(_mm_srli_si128(s1, 4), _mm_slli_si128(s2, 8)));
+            _mm_storeu_si128((__m128i *)(rgb + 3*k + 32), _mm_or_si128(_mm_srli_si128(s2, 8), _mm_slli_si128(s3, 4)));
+        }
+
+        return k;
+    }
+
+    HF_TARGET_SSSE3 inline size_t bgraToGraySsse3(const uint8_t * bgra, uint8_t * gray, size_t pixels)
+    {
+        size_t k = 0;
+
+        const __m128i weights = _mm_setr_epi16(
+                GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0, GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0);
+        const __m128i round = _mm_set1_epi32(128);
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; k+16 <= pixels; k+=16) {
+
+            __m128i sums[4];
+
+            for (int j=0; j<4; ++j) {
+
+                __m128i in = _mm_loadu_si128((const __m128i *)(bgra + 4*(k+4*j)));
+
+                // B*wb + G*wg and R*wr + A*0 for each pixel, then add the two halves
+                __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(in, zero), weights);
+                __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(in, zero), weights);
+                sums[j] = _mm_srli_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), round), 8);
+            }
+
+            __m128i words = _mm_packs_epi32(sums[0], sums[1]);
+            __m128i words2 = _mm_packs_epi32(sums[2], sums[3]);
+            _mm_storeu_si128((__m128i *)(gray + k), _mm_packus_epi16(words, words2));
+        }
+
+        return k;
+    }
+
+#endif
+
+    // Fastest available versions ---------------------------------------------------------------
+
+    inline void bgraToRgb(const uint8_t * bgra, uint8_t * rgb, size_t pixels)
+    {
+        size_t k = 0;
+
+#ifdef HF_HAVE_SSSE3
+        if (cpuHasSsse3()) {
+            k = bgraToRgbSsse3(bgra, rgb, pixels);
+        }
+#endif
+
+        bgraToRgbScalar(bgra + 4*k, rgb + 3*k, pixels - k);
+    }
+
+    inline void bgraToGray(const uint8_t * bgra, uint8_t * gray, size_t pixels)
+    {
+        size_t k = 0;
+
+#ifdef HF_HAVE_SSSE3
+        if (cpuHasSsse3()) {
+            k = bgraToGraySsse3(bgra, gray, pixels);
+        }
+#endif
+
+        bgraToGrayScalar(bgra + 4*k, gray + k, pixels - k);
+    }
+
+    // Compilers vectorize the scalar version as well as SSSE3 shuffles do
+    inline void bgraToPlanar(const uint8_t * bgra, uint8_t * planar, size_t pixels)
+    {
+        bgraToPlanarScalar(bgra, planar, pixels);
+    }
+
+} // namespace hf
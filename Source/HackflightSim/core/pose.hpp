@@ -0,0 +1,257 @@
+/*
+   pose.hpp: engine-independent vehicle pose and its integration for HackflightSim
+
+   Uses the same quaternion conventions as UE4's FQuat (x, y, z, w; Hamilton product),
+   so a Pose can be handed to the engine with no conversion other than meters to cm.
+
+   The rates a step is given are those at its end, as the board reports them after updating;
+   the pose keeps the previous step's rates for the schemes that also need the start.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+namespace hf {
+
+    // Ways of advancing the pose through a step
+    typedef enum {
+
+        INTEGRATOR_EXPLICIT_EULER,  // first order, from the attitude and rates at the start of the step
+        INTEGRATOR_SEMI_IMPLICIT,   // exact rotation by the end rates, then translation in the new attitude
+        INTEGRATOR_RK4,             // four stages, with the rates interpolated linearly across the step;
+                                    // fourth order in the attitude, second in the sampled rates
+        INTEGRATOR_COUNT
+
+    } integrator_t;
+
+    static const char * const INTEGRATOR_NAMES[INTEGRATOR_COUNT] = {
+        "explicit Euler",
+        "semi-implicit",
+        "RK4"
+    };
+
+    struct Quaternion {
+
+        float x, y, z, w;
+
+        static Quaternion identity(void)
+        {
+            Quaternion q = {0, 0, 0, 1};
+            return q;
+        }
+
+        // Rotation by the angle |v| about the axis v/|v|
+        static Quaternion fromRotationVector(const float v[3])
+        {
+            float angle = sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+
+            if (angle < 1e-9f) {
+                Quaternion q = {v[0]/2, v[1]/2, v[2]/2, 1};
+                return q;
+            }
+
+            float s = sinf(angle/2) / angle;
+            Quaternion q = {v[0]*s, v[1]*s, v[2]*s, cosf(angle/2)};
+            return q;
+        }
+
+        Quaternion operator*(const Quaternion & q) const
+        {
+            Quaternion r = {
+                w*q.x + x*q.w + y*q.z - z*q.y,
+                w*q.y - x*q.z + y*q.w + z*q.x,
+                w*q.z + x*q.y - y*q.x + z*q.w,
+                w*q.w - x*q.x - y*q.y - z*q.z
+            };
+            return r;
+        }
+
+        // Rate of change of the quaternion under body-frame angular velocity v (radians/sec)
+        Quaternion derivative(const float v[3]) const
+        {
+            Quaternion r = {
+                0.5f * ( w*v[0] + y*v[2] - z*v[1]),
+                0.5f * ( w*v[1] - x*v[2] + z*v[0]),
+                0.5f * ( w*v[2] + x*v[1] - y*v[0]),
+                0.5f * (-x*v[0] - y*v[1] - z*v[2])
+            };
+            return r;
+        }
+
+        // This plus h times d, unnormalized
+        Quaternion plus(const Quaternion & d, float h) const
+        {
+            Quaternion r = { x + h*d.x, y + h*d.y, z + h*d.z, w + h*d.w };
+            return r;
+        }
+
+        void normalize(void)
+        {
+            float n = 1 / sqrtf(x*x + y*y + z*z + w*w);
+            x *= n;
+            y *= n;
+            z *= n;
+            w *= n;
+        }
+
+        // Rotates a body-frame vector into the world frame
+        void rotate(const float v[3], float out[3]) const
+        {
+            // t = 2 * cross(q.xyz, v)
+            float tx = 2 * (y*v[2] - z*v[1]);
+            float ty = 2 * (z*v[0] - x*v[2]);
+            float tz = 2 * (x*v[1] - y*v[0]);
+
+            // v' = v + w*t + cross(q.xyz, t)
+            out[0] = v[0] + w*tx + (y*tz - z*ty);
+            out[1] = v[1] + w*ty + (z*tx - x*tz);
+            out[2] = v[2] + w*tz + (x*ty - y*tx);
+        }
+    };
+
+    class Pose {
+
+        private:
+
+            // Rates given to the previous step, i.e. those at the start of the next one
+            float _gyroRates[3];
+            float _translationRates[3];
+
+            void integrateSemiImplicit(const float gyroRates[3], const float translationRates[3], float dt)
+            {
+                float rotation[3] = { -gyroRates[0]*dt, -gyroRates[1]*dt, gyroRates[2]*dt };
+                orientation = orientation * Quaternion::fromRotationVector(rotation);
+                orientation.normalize();
+
+                float offset[3] = { translationRates[0]*dt, translationRates[1]*dt, translationRates[2]*dt };
+                float world[3];
+                orientation.rotate(offset, world);
+
+                for (int k=0; k<3; ++k) {
+                    position[k] += world[k];
+                }
+            }
+
+            void integrateExplicitEuler(float dt)
+            {
+                float world[3];
+                orientation.rotate(_translationRates, world);
+
+                float v[3];
+                angularVelocity(_gyroRates, v);
+                orientation = orientation.plus(orientation.derivative(v), dt);
+                orientation.normalize();
+
+                for (int k=0; k<3; ++k) {
+                    position[k] += world[k] * dt;
+                }
+            }
+
+            // Stage of RK4: attitude and velocity derivatives at quaternion q.  Translation is
+            // rotated by q normalized, since an unnormalized stage would also scale it.
+            static Quaternion stage(const Quaternion & q, const float v[3], const float translationRates[3], float world[3])
+            {
+                Quaternion unit = q;
+                unit.normalize();
+                unit.rotate(translationRates, world);
+                return q.derivative(v);
+            }
+
+            void integrateRK4(const float gyroRates[3], const float translationRates[3], float dt)
+            {
+                float v0[3], v1[3], vm[3], tm[3];
+                angularVelocity(_gyroRates, v0);
+                angularVelocity(gyroRates, v1);
+                for (int k=0; k<3; ++k) {
+                    vm[k] = (v0[k] + v1[k]) / 2;
+                    tm[k] = (_translationRates[k] + translationRates[k]) / 2;
+                }
+
+                float p1[3], p2[3], p3[3], p4[3];
+                Quaternion q1 = stage(orientation, v0, _translationRates, p1);
+                Quaternion q2 = stage(orientation.plus(q1, dt/2), vm, tm, p2);
+                Quaternion q3 = stage(orientation.plus(q2, dt/2), vm, tm, p3);
+                Quaternion q4 = stage(orientation.plus(q3, dt), v1, translationRates, p4);
+
+                orientation = orientation.plus(q1, dt/6).plus(q2, dt/3).plus(q3, dt/3).plus(q4, dt/6);
+                orientation.normalize();
+
+                for (int k=0; k<3; ++k) {
+                    position[k] += dt/6 * (p1[k] + 2*p2[k] + 2*p3[k] + p4[k]);
+                }
+            }
+
+        public:
+
+            // Body-frame angular velocity for the quaternion from the gyro rates; see integrate().  The
+            // mapping is its own inverse, so it also gives the gyro rates for a body angular velocity.
+            static void angularVelocity(const float gyroRates[3], float v[3])
+            {
+                v[0] = -gyroRates[0];
+                v[1] = -gyroRates[1];
+                v[2] = +gyroRates[2];
+            }
+
+            // Meters, world frame
+            float position[3];
+
+            Quaternion orientation;
+
+            Pose(void)
+            {
+                position[0] = position[1] = position[2] = 0;
+                orientation = Quaternion::identity();
+
+                for (int k=0; k<3; ++k) {
+                    _gyroRates[k] = 0;
+                    _translationRates[k] = 0;
+                }
+            }
+
+            // Advances the pose by one step of body-frame gyro rates (radians/sec) and
+            // body-frame translation rates (meters/sec).  This is the fixed-step equivalent of
+            // AddActorLocalRotation(FRotator(gyro[1], gyro[2], gyro[0])) followed by
+            // AddActorLocalOffset(translation): an FRotator's roll and pitch turn about -X and
+            // -Y, and its yaw about +Z.
+            void integrate(const float gyroRates[3], const float translationRates[3], float dt,
+                    integrator_t integrator=INTEGRATOR_SEMI_IMPLICIT)
+            {
+                switch (integrator) {
+
+                    case INTEGRATOR_EXPLICIT_EULER:
+                        integrateExplicitEuler(dt);
+                        break;
+
+                    case INTEGRATOR_RK4:
+                        integrateRK4(gyroRates, translationRates, dt);
+                        break;
+
+                    default:
+                        integrateSemiImplicit(gyroRates, translationRates, dt);
+                }
+
+                memcpy(_gyroRates, gyroRates, sizeof(_gyroRates));
+                memcpy(_translationRates, translationRates, sizeof(_translationRates));
+            }
+
+    }; // class Pose
+
+} // namespace hf
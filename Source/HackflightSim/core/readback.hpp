@@ -0,0 +1,304 @@
+/*
+   readback.hpp: pipelined readback of rendered frames
+
+   A frame source copies rendered images into a ring of staging slots asynchronously.
+   The pipeline requests a new frame each time it is ticked and hands back whichever
+   frames have completed, so the caller never waits for the GPU: it sees each image a
+   few frames late instead.  Sources are pluggable, so the pipeline runs without a GPU
+   using SyntheticFrameSource.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "framepool.hpp"
+
+namespace hf {
+
+    // Supplies BGRA frames into numbered staging slots
+    class FrameSource {
+
+        public:
+
+            // Called once, before any capture, with the number of slots the pipeline will use
+            virtual void allocate(uint32_t depth) = 0;
+
+            // Called when the image changes size, to make room for frames of the new size once;
+            // anything in the slots is discarded, after waiting for copies still under way
+            virtual void resize(int rows, int cols) = 0;
+
+            // Starts copying the current image into a slot; must not block
+            virtual void capture(uint32_t slot) = 0;
+
+            // True once the copy started by capture() has completed
+            virtual bool ready(uint32_t slot) = 0;
+
+            // The completed image in a slot, rows*cols BGRA pixels in row-major order
+            virtual const uint8_t * pixels(uint32_t slot) = 0;
+
+            virtual int rows(void) = 0;
+            virtual int cols(void) = 0;
+
+            virtual ~FrameSource(void) { }
+    };
+
+    typedef struct {
+
+        uint64_t        frameNumber;
+        double          simSeconds;
+        float           position[3];    // camera pose when the frame was requested
+        float           orientation[4];
+        int             rows;
+        int             cols;
+        const uint8_t * bgra;
+
+    } readback_frame_t;
+
+    class ReadbackPipeline {
+
+        public:
+
+            static const uint32_t MAX_DEPTH = 8;
+
+        private:
+
+            FrameSource * _source;
+
+            uint32_t _depth;
+
+            // Slots are used in ring order: [_oldest, _oldest + _pending) are in flight
+            uint32_t _oldest;
+            uint32_t _pending;
+
+            // Slot handed to the caller by the last poll(), freed on the next request() or poll()
+            bool _holding;
+
+            uint64_t _frameNumbers[MAX_DEPTH];
+            double   _simSeconds[MAX_DEPTH];
+            float    _poses[MAX_DEPTH][7];
+
+            uint64_t _skipped;
+            uint64_t _superseded;
+            uint64_t _delivered;
+
+            void releaseHeld(void)
+            {
+                if (_holding) {
+                    _oldest = (_oldest + 1) % _depth;
+                    --_pending;
+                    _holding = false;
+                }
+            }
+
+        public:
+
+            ReadbackPipeline(FrameSource * source, uint32_t depth=3)
+                : _source(source), _depth(depth < 2 ? 2 : depth > MAX_DEPTH ? MAX_DEPTH : depth),
+                _oldest(0), _pending(0), _holding(false), _skipped(0), _superseded(0), _delivered(0)
+            {
+                _source->allocate(_depth);
+            }
+
+            // Starts reading back the current frame; when every slot is in flight the frame is
+            // skipped rather than waited for.  Returns false if skipped.  The optional pose is
+            // handed back with the frame.
+            bool request(uint64_t frameNumber, double simSeconds,
+                    const float position[3]=nullptr, const float orientation[4]=nullptr)
+            {
+                releaseHeld();
+
+                if (_pending == _depth) {
+                    ++_skipped;
+                    return false;
+                }
+
+                uint32_t slot = (_oldest + _pending) % _depth;
+
+                _frameNumbers[slot] = frameNumber;
+                _simSeconds[slot] = simSeconds;
+                for (uint8_t k=0; k<3; ++k) {
+                    _poses[slot][k] = position ? position[k] : 0;
+                }
+                for (uint8_t k=0; k<4; ++k) {
+                    _poses[slot][3+k] = orientation ? orientation[k] : (k == 3 ? 1 : 0);
+                }
+                _source->capture(slot);
+                ++_pending;
+
+                return true;
+            }
+
+            // Returns the oldest completed frame, if any.  Its pixels stay valid until the next
+            // call to request() or poll().
+            bool poll(readback_frame_t & frame)
+            {
+                releaseHeld();
+
+                if (_pending == 0 || !_source->ready(_oldest)) {
+                    return false;
+                }
+
+                frame.frameNumber = _frameNumbers[_oldest];
+                frame.simSeconds = _simSeconds[_oldest];
+                memcpy(frame.position, &_poses[_oldest][0], sizeof(frame.position));
+                memcpy(frame.orientation, &_poses[_oldest][3], sizeof(frame.orientation));
+                frame.rows = _source->rows();
+                frame.cols = _source->cols();
+                frame.bgra = _source->pixels(_oldest);
+
+                _holding = true;
+                ++_delivered;
+
+                return true;
+            }
+
+            // Like poll(), but discards completed frames that already have a completed successor,
+            // for callers that only care about the newest image
+            bool pollLatest(readback_frame_t & frame)
+            {
+                releaseHeld();
+
+                while (_pending > 1 && _source->ready(_oldest) && _source->ready((_oldest + 1) % _depth)) {
+                    _oldest = (_oldest + 1) % _depth;
+                    --_pending;
+                    ++_superseded;
+                }
+
+                return poll(frame);
+            }
+
+            // Switches to frames of a new size, dropping any in flight.  Does nothing if the
+            // size is unchanged, so it can be called every frame.
+            void resize(int rows, int cols)
+            {
+                if (rows == _source->rows() && cols == _source->cols()) {
+                    return;
+                }
+
+                _skipped += _pending - (_holding ? 1 : 0);
+
+                _oldest = 0;
+                _pending = 0;
+                _holding = false;
+
+                _source->resize(rows, cols);
+            }
+
+            uint32_t depth(void) const
+            {
+                return _depth;
+            }
+
+            uint32_t inFlight(void) const
+            {
+                return _pending - (_holding ? 1 : 0);
+            }
+
+            uint64_t skipped(void) const
+            {
+                return _skipped;
+            }
+
+            uint64_t superseded(void) const
+            {
+                return _superseded;
+            }
+
+            uint64_t delivered(void) const
+            {
+                return _delivered;
+            }
+
+    }; // class ReadbackPipeline
+
+    // CPU-only source for testing: fills each frame with a pattern derived from its capture
+    // count, and reports it ready only after a fixed number of ticks, mimicking GPU latency
+    class SyntheticFrameSource : public FrameSource {
+
+        private:
+
+            int _rows;
+            int _cols;
+            uint32_t _latency;
+
+            uint32_t _depth;
+            FramePool _slots;
+            uint64_t  _readyAt[ReadbackPipeline::MAX_DEPTH];
+            uint64_t  _clock;
+            uint64_t  _captures;
+
+        public:
+
+            SyntheticFrameSource(int rows, int cols, uint32_t latencyTicks=2)
+                : _rows(rows), _cols(cols), _latency(latencyTicks), _depth(0), _clock(0), _captures(0)
+            {
+            }
+
+            void allocate(uint32_t depth) override
+            {
+                _depth = depth;
+                _slots.reserve(_depth, (size_t)4 * _rows * _cols);
+            }
+
+            void resize(int rows, int cols) override
+            {
+                _rows = rows;
+                _cols = cols;
+                _slots.reserve(_depth, (size_t)4 * _rows * _cols);
+            }
+
+            void capture(uint32_t slot) override
+            {
+                // Every byte of frame n holds the low byte of n, so readers can check ordering
+                memset(_slots.buffer(slot), (uint8_t)_captures, (size_t)4 * _rows * _cols);
+                _readyAt[slot] = _clock + _latency;
+                ++_captures;
+            }
+
+            bool ready(uint32_t slot) override
+            {
+                return _clock >= _readyAt[slot];
+            }
+
+            const uint8_t * pixels(uint32_t slot) override
+            {
+                return _slots.buffer(slot);
+            }
+
+            int rows(void) override
+            {
+                return _rows;
+            }
+
+            int cols(void) override
+            {
+                return _cols;
+            }
+
+            // Advances the simulated GPU by one frame
+            void tick(void)
+            {
+                ++_clock;
+            }
+
+    }; // class SyntheticFrameSource
+
+} // namespace hf
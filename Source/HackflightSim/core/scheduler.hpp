@@ -0,0 +1,300 @@
+/*
+   scheduler.hpp: deterministic multi-rate task scheduler for HackflightSim
+
+   Tasks register a rate and a phase, and run on the steps of a fixed base clock (normally
+   the firmware rate), so when each one runs depends only on simulated time, never on frame
+   rate or wall-clock time.  A task at a rate that does not divide the base rate runs on the
+   nearest steps, keeping the exact average rate.
+
+   Heavy work can go to a worker thread: the task's prepare step copies its inputs on the
+   scheduler's thread, the work runs on the task's own thread, and its join step publishes
+   the results back on the scheduler's thread at a fixed number of steps after launch,
+   waiting for the worker if it is late.  Results therefore always arrive at the same
+   simulated time.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hf {
+
+    // Runs one task's work on its own thread, one launch at a time
+    class TaskWorker {
+
+        private:
+
+            std::function<void(void)> _work;
+
+            std::mutex _mutex;
+            std::condition_variable _signal;
+            bool _pending;
+            bool _quit;
+
+            // Last, so that everything it uses exists before it starts
+            std::thread _thread;
+
+            void loop(void)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+
+                while (true) {
+
+                    _signal.wait(lock, [&] { return _pending || _quit; });
+
+                    if (!_pending) {
+                        return;
+                    }
+
+                    lock.unlock();
+                    _work();
+                    lock.lock();
+
+                    _pending = false;
+                    _signal.notify_all();
+                }
+            }
+
+        public:
+
+            TaskWorker(std::function<void(void)> work)
+                : _work(work), _pending(false), _quit(false), _thread(&TaskWorker::loop, this)
+            {
+            }
+
+            ~TaskWorker(void)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _quit = true;
+                }
+
+                _signal.notify_all();
+                _thread.join();
+            }
+
+            void launch(void)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _pending = true;
+                _signal.notify_all();
+            }
+
+            // Waits for the work to finish; returns true if it had to
+            bool join(void)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                bool late = _pending;
+                _signal.wait(lock, [&] { return !_pending; });
+                return late;
+            }
+
+    }; // class TaskWorker
+
+    class Scheduler {
+
+        public:
+
+            // Called with the simulated seconds since the task last ran
+            typedef std::function<void(float)> Task;
+
+        private:
+
+            typedef struct {
+
+                const char * name;
+                double       stepsPerRun;
+                uint64_t     phase;         // base step of the first run
+                uint64_t     latency;       // steps from launching a worker to joining it
+                uint64_t     runs;
+                uint64_t     due;           // step of the next run
+                uint64_t     last;          // step of the last run
+                uint64_t     joinStep;
+                bool         inFlight;
+                uint64_t     stalls;        // joins that had to wait for the worker
+                Task         run;           // or, for a worker task, the prepare step
+                Task         join;
+                std::shared_ptr<TaskWorker> worker;
+
+            } task_t;
+
+            std::vector<task_t> _tasks;
+
+            double   _baseHz;
+            uint64_t _step;
+
+            int addTask(const char * name, float rateHz, float phaseSeconds, Task run)
+            {
+                task_t t = task_t();
+
+                t.name = name;
+                t.stepsPerRun = rateHz < _baseHz ? _baseHz / rateHz : 1;
+                t.phase = _step + (uint64_t)llround(phaseSeconds * _baseHz);
+                t.due = t.phase;
+                t.last = t.due;
+                t.run = run;
+
+                _tasks.push_back(t);
+
+                return (int)_tasks.size() - 1;
+            }
+
+            void finish(task_t & t)
+            {
+                if (t.worker->join()) {
+                    ++t.stalls;
+                }
+
+                t.inFlight = false;
+
+                if (t.join) {
+                    t.join((float)((t.joinStep - t.last) / _baseHz));
+                }
+            }
+
+        public:
+
+            Scheduler(float baseHz=1000) : _baseHz(baseHz), _step(0)
+            {
+            }
+
+            // The base clock; set it before adding tasks
+            void setBaseRate(float baseHz)
+            {
+                _baseHz = baseHz;
+            }
+
+            // Adds a task run on the scheduler's thread at rateHz (at most the base rate), first
+            // after phaseSeconds; returns its index.  Tasks due on the same step run in the
+            // order they were added.
+            int add(const char * name, float rateHz, float phaseSeconds, Task run)
+            {
+                return addTask(name, rateHz, phaseSeconds, run);
+            }
+
+            // Adds a task whose work runs on its own thread.  prepare runs on the scheduler's
+            // thread at each launch, to copy the inputs; join runs there latencySeconds later
+            // (at least one step, at most one period), to publish the results.  Either may be
+            // null.
+            int addWorker(const char * name, float rateHz, float phaseSeconds, float latencySeconds,
+                    Task prepare, std::function<void(void)> work, Task join)
+            {
+                int index = addTask(name, rateHz, phaseSeconds, prepare);
+
+                task_t & t = _tasks[index];
+
+                double latency = round(latencySeconds * _baseHz);
+                t.latency = (uint64_t)(latency < 1 ? 1 : latency > t.stepsPerRun ? floor(t.stepsPerRun) : latency);
+                t.join = join;
+                t.worker = std::make_shared<TaskWorker>(work);
+
+                return index;
+            }
+
+            // Runs one step of the base clock: first the joins due on it, then the tasks
+            void step(void)
+            {
+                for (task_t & t : _tasks) {
+                    if (t.inFlight && t.joinStep == _step) {
+                        finish(t);
+                    }
+                }
+
+                for (task_t & t : _tasks) {
+
+                    if (t.due != _step) {
+                        continue;
+                    }
+
+                    float dt = (float)((t.runs ? _step - t.last : t.stepsPerRun) / _baseHz);
+
+                    if (t.worker) {
+
+                        // Only possible if the latency was rounded to the whole period
+                        if (t.inFlight) {
+                            finish(t);
+                        }
+
+                        if (t.run) {
+                            t.run(dt);
+                        }
+
+                        t.worker->launch();
+                        t.inFlight = true;
+                        t.joinStep = _step + t.latency;
+                    }
+
+                    else {
+                        t.run(dt);
+                    }
+
+                    t.last = _step;
+                    ++t.runs;
+                    t.due = t.phase + (uint64_t)llround(t.runs * t.stepsPerRun);
+                }
+
+                ++_step;
+            }
+
+            // Waits for any work in flight and publishes it, e.g. before the inputs go away
+            void drain(void)
+            {
+                for (task_t & t : _tasks) {
+                    if (t.inFlight) {
+                        finish(t);
+                    }
+                }
+            }
+
+            uint64_t stepCount(void) const
+            {
+                return _step;
+            }
+
+            uint32_t taskCount(void) const
+            {
+                return (uint32_t)_tasks.size();
+            }
+
+            const char * name(int task) const
+            {
+                return _tasks[task].name;
+            }
+
+            uint64_t runs(int task) const
+            {
+                return _tasks[task].runs;
+            }
+
+            uint64_t stalls(int task) const
+            {
+                return _tasks[task].stalls;
+            }
+
+    }; // class Scheduler
+
+} // namespace hf
@@ -0,0 +1,82 @@
+/*
+   scriptedreceiver.hpp: Hackflight receiver whose sticks are set by code instead of a joystick
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "sticks.hpp"
+
+#ifdef _WIN32
+#include <receivers/sim/windows.hpp>
+#else
+#include <receivers/sim/linux.hpp>
+#endif
+
+namespace hf {
+
+    // Reuses the sim Controller's channel handling, but never opens the joystick
+    class ScriptedReceiver : public Controller {
+
+        private:
+
+            float _sticks[STICK_CHANNELS] = {-1, 0, 0, 0, 0};
+
+        protected:
+
+            void begin(void) override
+            {
+            }
+
+            bool gotNewFrame(void) override
+            {
+                return true;
+            }
+
+            void readRawvals(void) override
+            {
+                for (uint8_t k=0; k<STICK_CHANNELS; ++k) {
+                    rawvals[k] = _sticks[k];
+                }
+            }
+
+        public:
+
+            // Values are in [-1,+1], as from a real transmitter
+            void setSticks(const float sticks[STICK_CHANNELS])
+            {
+                for (uint8_t k=0; k<STICK_CHANNELS; ++k) {
+                    _sticks[k] = sticks[k];
+                }
+            }
+
+            void setStick(uint8_t channel, float value)
+            {
+                _sticks[channel] = value;
+            }
+
+            const float * getSticks(void) const
+            {
+                return _sticks;
+            }
+
+    }; // class ScriptedReceiver
+
+} // namespace hf
@@ -0,0 +1,164 @@
+/*
+   shmmailbox.hpp: a Mailbox placed in POSIX shared memory, so that one process can post
+   the latest value of something for another to pick up without locks
+
+   On Windows open() always fails, so callers can fall back without conditional code.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mailbox.hpp"
+
+namespace hf {
+
+    static const uint32_t SHM_MAILBOX_MAGIC = 0x424D4648; // "HFMB"
+
+    template <typename T>
+    class ShmMailbox {
+
+        private:
+
+            // A zero-filled segment is a valid, never-written Mailbox, so creation needs no constructor
+            typedef struct {
+
+                uint32_t   magic;
+                uint32_t   valueBytes;
+                Mailbox<T> mailbox;
+
+            } segment_t;
+
+            segment_t * _segment;
+            bool _owner;
+            char _name[64];
+
+        public:
+
+            ShmMailbox(void) : _segment(nullptr), _owner(false)
+            {
+                _name[0] = 0;
+            }
+
+            ~ShmMailbox(void)
+            {
+                close();
+            }
+
+            // Creates the named segment, or with create=false maps one that another process made
+            bool open(const char * name, bool create)
+            {
+                close();
+
+#ifdef _WIN32
+                (void)name;
+                (void)create;
+                return false;
+#else
+                // A segment left by an earlier run is unlinked rather than truncated, so that a sender
+                // still mapping it keeps its old pages instead of faulting on them, and must open
+                // the new one to reach us
+                if (create) {
+                    shm_unlink(name);
+                }
+
+                int fd = shm_open(name, create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR, 0644);
+                if (fd < 0) {
+                    return false;
+                }
+
+                struct stat st;
+                if (create ? ftruncate(fd, sizeof(segment_t)) != 0 :
+                        (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(segment_t))) {
+                    ::close(fd);
+                    return false;
+                }
+
+                void * base = mmap(nullptr, sizeof(segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                ::close(fd);
+
+                if (base == MAP_FAILED) {
+                    return false;
+                }
+
+                _segment = (segment_t *)base;
+                _owner = create;
+                strncpy(_name, name, sizeof(_name)-1);
+                _name[sizeof(_name)-1] = 0;
+
+                if (create) {
+                    _segment->valueBytes = sizeof(T);
+                    std::atomic_thread_fence(std::memory_order_release);
+                    _segment->magic = SHM_MAILBOX_MAGIC;
+                }
+
+                else if (_segment->magic != SHM_MAILBOX_MAGIC || _segment->valueBytes != sizeof(T)) {
+                    close();
+                    return false;
+                }
+
+                return true;
+#endif
+            }
+
+            // The creator also removes the name, so that readers stop finding a stale segment
+            void close(void)
+            {
+#ifndef _WIN32
+                if (_segment) {
+                    munmap(_segment, sizeof(segment_t));
+                    if (_owner) {
+                        shm_unlink(_name);
+                    }
+                    _segment = nullptr;
+                }
+#endif
+            }
+
+            bool isOpen(void) const
+            {
+                return _segment != nullptr;
+            }
+
+            void write(const T & value)
+            {
+                _segment->mailbox.write(value);
+            }
+
+            bool read(T & value) const
+            {
+                return _segment->mailbox.read(value);
+            }
+
+            uint32_t version(void) const
+            {
+                return _segment->mailbox.version();
+            }
+
+    }; // class ShmMailbox
+
+} // namespace hf
@@ -0,0 +1,338 @@
+/*
+   shmring.hpp: POSIX shared-memory ring of vision frames for external processes
+
+   Layout (all little-endian, offsets in bytes):
+
+     0    shm_ring_header_t     magic, version, geometry, sequence of newest frame
+     256  slot 0                shm_frame_header_t (128 bytes), then rows*cols*channels pixels
+     ...  slot 1 ... slot N-1   each slotBytes long, 64-byte aligned
+
+   The writer never waits for readers.  Each slot carries a sequence lock: odd while
+   being written, 2*(frame sequence + 1) once complete.  Readers map the segment
+   read-only and use pixels in place, then check that the slot's lock is unchanged to
+   know that the frame was not overwritten while they used it.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <atomic>
+
+namespace hf {
+
+    static const uint32_t SHM_RING_MAGIC   = 0x48465652; // "HFVR"
+    static const uint32_t SHM_RING_VERSION = 1;
+
+    static const uint32_t SHM_RING_HEADER_BYTES = 256;
+    static const uint32_t SHM_FRAME_HEADER_BYTES = 128;
+
+    typedef struct {
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slots;
+        uint32_t slotBytes;
+        uint32_t rows;
+        uint32_t cols;
+        uint32_t channels;
+        uint32_t reserved;
+
+        // Sequence number of the newest complete frame, plus one; zero before the first
+        std::atomic<uint64_t> published;
+
+    } shm_ring_header_t;
+
+    typedef struct {
+
+        std::atomic<uint64_t> lock;
+
+        uint64_t sequence;
+        uint64_t frameNumber;
+        double   simSeconds;
+        uint64_t monotonicNanos;    // CLOCK_MONOTONIC when the frame was published
+        float    position[3];       // meters
+        float    orientation[4];    // quaternion x, y, z, w
+        uint32_t rows;
+        uint32_t cols;
+
+    } shm_frame_header_t;
+
+    static_assert(sizeof(shm_ring_header_t) <= SHM_RING_HEADER_BYTES, "ring header too large");
+    static_assert(sizeof(shm_frame_header_t) <= SHM_FRAME_HEADER_BYTES, "frame header too large");
+
+    inline uint64_t monotonicNanos(void)
+    {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+    }
+
+    class ShmRingWriter {
+
+        private:
+
+            char       _name[64];
+            uint8_t *  _base;
+            size_t     _bytes;
+            uint64_t   _sequence;
+            shm_frame_header_t * _writing;
+
+            shm_ring_header_t * header(void)
+            {
+                return (shm_ring_header_t *)_base;
+            }
+
+            shm_frame_header_t * slot(uint64_t sequence)
+            {
+                return (shm_frame_header_t *)(_base + SHM_RING_HEADER_BYTES + (sequence % header()->slots) * header()->slotBytes);
+            }
+
+        public:
+
+            ShmRingWriter(void) : _base(nullptr), _bytes(0), _sequence(0), _writing(nullptr)
+            {
+                _name[0] = 0;
+            }
+
+            ~ShmRingWriter(void)
+            {
+                close();
+            }
+
+            // Creates (or replaces) the named segment, e.g. "/hackflight_vision"
+            bool open(const char * name, uint32_t slots, uint32_t rows, uint32_t cols, uint32_t channels=3)
+            {
+                close();
+
+                uint32_t slotBytes = (SHM_FRAME_HEADER_BYTES + rows * cols * channels + 63) / 64 * 64;
+
+                _bytes = SHM_RING_HEADER_BYTES + (size_t)slots * slotBytes;
+
+                // A segment left by an earlier run is unlinked rather than resized in place, so that a
+                // reader still mapping it keeps its old pages instead of faulting on them
+                shm_unlink(name);
+
+                int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+                if (fd < 0) {
+                    return false;
+                }
+
+                if (ftruncate(fd, _bytes) != 0) {
+                    ::close(fd);
+                    return false;
+                }
+
+                void * base = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                ::close(fd);
+
+                if (base == MAP_FAILED) {
+                    return false;
+                }
+
+                _base = (uint8_t *)base;
+                strncpy(_name, name, sizeof(_name)-1);
+                _name[sizeof(_name)-1] = 0;
+
+                memset(_base, 0, _bytes);
+
+                shm_ring_header_t * h = header();
+                h->version = SHM_RING_VERSION;
+                h->slots = slots;
+                h->slotBytes = slotBytes;
+                h->rows = rows;
+                h->cols = cols;
+                h->channels = channels;
+
+                // Magic last, so a reader never sees a half-initialized header as valid
+                std::atomic_thread_fence(std::memory_order_release);
+                h->magic = SHM_RING_MAGIC;
+
+                return true;
+            }
+
+            void close(void)
+            {
+                if (_base) {
+                    munmap(_base, _bytes);
+                    shm_unlink(_name);
+                    _base = nullptr;
+                }
+            }
+
+            bool isOpen(void) const
+            {
+                return _base != nullptr;
+            }
+
+            // Returns the pixel area of the next slot to fill; commit() publishes it
+            uint8_t * begin(void)
+            {
+                _writing = slot(_sequence);
+                _writing->lock.store(2 * _sequence + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                return (uint8_t *)_writing + SHM_FRAME_HEADER_BYTES;
+            }
+
+            void commit(uint64_t frameNumber, double simSeconds, const float position[3], const float orientation[4])
+            {
+                shm_frame_header_t * f = _writing;
+
+                f->sequence = _sequence;
+                f->frameNumber = frameNumber;
+                f->simSeconds = simSeconds;
+                f->monotonicNanos = monotonicNanos();
+                memcpy(f->position, position, sizeof(f->position));
+                memcpy(f->orientation, orientation, sizeof(f->orientation));
+                f->rows = header()->rows;
+                f->cols = header()->cols;
+
+                f->lock.store(2 * _sequence + 2, std::memory_order_release);
+                header()->published.store(_sequence + 1, std::memory_order_release);
+
+                ++_sequence;
+            }
+
+    }; // class ShmRingWriter
+
+    class ShmRingReader {
+
+        private:
+
+            const uint8_t * _base;
+            size_t _bytes;
+
+            const shm_ring_header_t * header(void) const
+            {
+                return (const shm_ring_header_t *)_base;
+            }
+
+        public:
+
+            ShmRingReader(void) : _base(nullptr), _bytes(0)
+            {
+            }
+
+            ~ShmRingReader(void)
+            {
+                close();
+            }
+
+            // Maps an existing segment read-only; fails until the writer has initialized it
+            bool open(const char * name)
+            {
+                close();
+
+                int fd = shm_open(name, O_RDONLY, 0);
+                if (fd < 0) {
+                    return false;
+                }
+
+                struct stat st;
+                if (fstat(fd, &st) != 0 || st.st_size < (off_t)SHM_RING_HEADER_BYTES) {
+                    ::close(fd);
+                    return false;
+                }
+
+                void * base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+
+                if (base == MAP_FAILED) {
+                    return false;
+                }
+
+                _base = (const uint8_t *)base;
+                _bytes = st.st_size;
+
+                const shm_ring_header_t * h = header();
+                if (h->magic != SHM_RING_MAGIC || h->version != SHM_RING_VERSION ||
+                        _bytes < SHM_RING_HEADER_BYTES + (size_t)h->slots * h->slotBytes) {
+                    close();
+                    return false;
+                }
+
+                return true;
+            }
+
+            void close(void)
+            {
+                if (_base) {
+                    munmap((void *)_base, _bytes);
+                    _base = nullptr;
+                }
+            }
+
+            const shm_ring_header_t * ring(void) const
+            {
+                return header();
+            }
+
+            // Number of frames published so far
+            uint64_t published(void) const
+            {
+                return header()->published.load(std::memory_order_acquire);
+            }
+
+            // Points at the newest frame, in place, and returns its lock value for valid();
+            // returns 0 if no frame has been published yet
+            uint64_t latest(const shm_frame_header_t ** frame, const uint8_t ** pixels) const
+            {
+                uint64_t count = published();
+
+                if (count == 0) {
+                    return 0;
+                }
+
+                return get(count - 1, frame, pixels);
+            }
+
+            // Points at a given frame; returns 0 if it is being written or has been overwritten
+            uint64_t get(uint64_t sequence, const shm_frame_header_t ** frame, const uint8_t ** pixels) const
+            {
+                const uint8_t * p = _base + SHM_RING_HEADER_BYTES + (sequence % header()->slots) * header()->slotBytes;
+
+                *frame = (const shm_frame_header_t *)p;
+                *pixels = p + SHM_FRAME_HEADER_BYTES;
+
+                uint64_t lock = (*frame)->lock.load(std::memory_order_acquire);
+
+                return lock == 2 * sequence + 2 ? lock : 0;
+            }
+
+            // True if a frame obtained with the given lock value was not overwritten since
+            bool valid(const shm_frame_header_t * frame, uint64_t lock) const
+            {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return lock != 0 && frame->lock.load(std::memory_order_relaxed) == lock;
+            }
+
+    }; // class ShmRingReader
+
+} // namespace hf
+
+#endif // _WIN32
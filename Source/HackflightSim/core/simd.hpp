@@ -0,0 +1,157 @@
+/*
+   simd.hpp: minimal float-lane wrappers so kernels can be written once and
+   compiled for scalar, SSE and AVX2 code paths
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HF_HAVE_SSE
+#include <emmintrin.h>
+#endif
+
+// SSSE3 code is compiled whatever the build's flags, which neither MSVC nor UE4's x64 defaults
+// raise to SSSE3, and is chosen at run time by hf::cpuHasSsse3().  Where the compiler may already
+// use AVX2, its vectorization of the scalar loops is faster, so there is no SSSE3 path.
+#if !defined(__AVX2__) && ((defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))) || \
+        (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))))
+#define HF_HAVE_SSSE3
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HF_TARGET_SSSE3
+#else
+#define HF_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
+#if defined(__AVX2__)
+#define HF_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace hf {
+
+#ifdef HF_HAVE_SSSE3
+    inline bool cpuHasSsse3(void)
+    {
+#ifdef _MSC_VER
+        static const bool has = [] {
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 9)) != 0;
+        }();
+#else
+        static const bool has = __builtin_cpu_supports("ssse3");
+#endif
+        return has;
+    }
+#endif
+
+    // Every SIMD array is aligned to, and padded out to a multiple of, this many bytes
+    static const size_t SIMD_ALIGNMENT = 32;
+
+    inline void * simdAlloc(size_t bytes)
+    {
+#ifdef _WIN32
+        return _aligned_malloc(bytes, SIMD_ALIGNMENT);
+#else
+        void * p = nullptr;
+        return posix_memalign(&p, SIMD_ALIGNMENT, bytes) == 0 ? p : nullptr;
+#endif
+    }
+
+    inline void simdFree(void * p)
+    {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+
+    struct ScalarLanes {
+
+        static const int WIDTH = 1;
+
+        float v;
+
+        static ScalarLanes load(const float * p)        { ScalarLanes r = {*p}; return r; }
+        static ScalarLanes set(float x)                 { ScalarLanes r = {x}; return r; }
+        void store(float * p) const                     { *p = v; }
+
+        ScalarLanes operator+(ScalarLanes b) const      { ScalarLanes r = {v + b.v}; return r; }
+        ScalarLanes operator-(ScalarLanes b) const      { ScalarLanes r = {v - b.v}; return r; }
+        ScalarLanes operator*(ScalarLanes b) const      { ScalarLanes r = {v * b.v}; return r; }
+        ScalarLanes operator/(ScalarLanes b) const      { ScalarLanes r = {v / b.v}; return r; }
+
+        static ScalarLanes sqrt(ScalarLanes a)          { ScalarLanes r = {sqrtf(a.v)}; return r; }
+        static ScalarLanes max(ScalarLanes a, ScalarLanes b) { ScalarLanes r = {a.v > b.v ? a.v : b.v}; return r; }
+    };
+
+#ifdef HF_HAVE_SSE
+    struct SseLanes {
+
+        static const int WIDTH = 4;
+
+        __m128 v;
+
+        static SseLanes load(const float * p)           { SseLanes r = {_mm_load_ps(p)}; return r; }
+        static SseLanes set(float x)                    { SseLanes r = {_mm_set1_ps(x)}; return r; }
+        void store(float * p) const                     { _mm_store_ps(p, v); }
+
+        SseLanes operator+(SseLanes b) const            { SseLanes r = {_mm_add_ps(v, b.v)}; return r; }
+        SseLanes operator-(SseLanes b) const            { SseLanes r = {_mm_sub_ps(v, b.v)}; return r; }
+        SseLanes operator*(SseLanes b) const            { SseLanes r = {_mm_mul_ps(v, b.v)}; return r; }
+        SseLanes operator/(SseLanes b) const            { SseLanes r = {_mm_div_ps(v, b.v)}; return r; }
+
+        static SseLanes sqrt(SseLanes a)                { SseLanes r = {_mm_sqrt_ps(a.v)}; return r; }
+        static SseLanes max(SseLanes a, SseLanes b)     { SseLanes r = {_mm_max_ps(a.v, b.v)}; return r; }
+    };
+#endif
+
+#ifdef HF_HAVE_AVX2
+    struct Avx2Lanes {
+
+        static const int WIDTH = 8;
+
+        __m256 v;
+
+        static Avx2Lanes load(const float * p)          { Avx2Lanes r = {_mm256_load_ps(p)}; return r; }
+        static Avx2Lanes set(float x)                   { Avx2Lanes r = {_mm256_set1_ps(x)}; return r; }
+        void store(float * p) const                     { _mm256_store_ps(p, v); }
+
+        Avx2Lanes operator+(Avx2Lanes b) const          { Avx2Lanes r = {_mm256_add_ps(v, b.v)}; return r; }
+        Avx2Lanes operator-(Avx2Lanes b) const          { Avx2Lanes r = {_mm256_sub_ps(v, b.v)}; return r; }
+        Avx2Lanes operator*(Avx2Lanes b) const          { Avx2Lanes r = {_mm256_mul_ps(v, b.v)}; return r; }
+        Avx2Lanes operator/(Avx2Lanes b) const          { Avx2Lanes r = {_mm256_div_ps(v, b.v)}; return r; }
+
+        static Avx2Lanes sqrt(Avx2Lanes a)              { Avx2Lanes r = {_mm256_sqrt_ps(a.v)}; return r; }
+        static Avx2Lanes max(Avx2Lanes a, Avx2Lanes b)  { Avx2Lanes r = {_mm256_max_ps(a.v, b.v)}; return r; }
+    };
+#endif
+
+} // namespace hf
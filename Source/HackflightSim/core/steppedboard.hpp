@@ -0,0 +1,85 @@
+/*
+   steppedboard.hpp: Hackflight SimBoard driven by simulated rather than wall-clock time
+
+   The stock SimBoard reads the host clock, so the firmware's timed tasks and the board's
+   physics run at whatever rate the caller happens to poll them.  This subclass reports the
+   time accumulated by FixedStepper instead, making every firmware step exactly one
+   fixed step long regardless of rendering or CPU load.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <boards/sim/sim.hpp>
+
+#include "imu.hpp"
+
+namespace hf {
+
+    class SteppedSimBoard : public SimBoard {
+
+        private:
+
+            uint64_t _micros = 0;
+
+            // Passes ideal values through until given a rate
+            ImuModel _imu;
+
+        public:
+
+            void advance(float dt)
+            {
+                _micros += (uint64_t)(dt * 1e6f + 0.5f);
+            }
+
+            void resetClock(void)
+            {
+                _micros = 0;
+                _imu.reset();
+            }
+
+            void setImuModel(const ImuModel & imu)
+            {
+                _imu = imu;
+            }
+
+            // The firmware's IMU readings, through the sensor model
+            void getImu(float eulerAnglesRadians[3], float gyroRadiansPerSecond[3]) override
+            {
+                SimBoard::getImu(eulerAnglesRadians, gyroRadiansPerSecond);
+                _imu.read(_micros * 1000, eulerAnglesRadians, gyroRadiansPerSecond);
+            }
+
+            // Sets the motors directly, as the firmware would
+            void setMotors(const float values[4])
+            {
+                for (uint8_t k=0; k<4; ++k) {
+                    writeMotor(k, values[k]);
+                }
+            }
+
+            uint32_t getMicroseconds(void) override
+            {
+                return (uint32_t)_micros;
+            }
+
+    }; // class SteppedSimBoard
+
+} // namespace hf
@@ -0,0 +1,115 @@
+/*
+   stepper.hpp: fixed-step time accumulator for HackflightSim
+
+   Decouples the firmware / physics rate from the rendering frame rate:
+   each frame adds its wall-clock duration to an accumulator, and the
+   simulation is advanced by as many fixed sub-steps as fit into it.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace hf {
+
+    class FixedStepper {
+
+        private:
+
+            double _stepSeconds;
+            double _maxFrameSeconds;
+            double _accumulator;
+
+            // Simulated time, kept as an integer step count so it never drifts
+            uint64_t _stepCount;
+
+        public:
+
+            FixedStepper(float rateHz=1000, float maxFrameSeconds=0.1f)
+            {
+                setRate(rateHz);
+                _maxFrameSeconds = maxFrameSeconds;
+                reset();
+            }
+
+            void setRate(float rateHz)
+            {
+                _stepSeconds = 1.0 / rateHz;
+            }
+
+            void reset(void)
+            {
+                _accumulator = 0;
+                _stepCount = 0;
+            }
+
+            // Adds a frame's worth of time and returns the number of fixed steps to run.
+            // Frames longer than maxFrameSeconds (breakpoints, level loads) are clamped so
+            // that a hitch cannot snowball into an ever-growing backlog of steps.
+            uint32_t beginFrame(float frameSeconds)
+            {
+                double t = frameSeconds > _maxFrameSeconds ? _maxFrameSeconds : frameSeconds;
+
+                _accumulator += t;
+
+                uint32_t steps = (uint32_t)(_accumulator / _stepSeconds);
+
+                _accumulator -= steps * _stepSeconds;
+
+                return steps;
+            }
+
+            // Runs step(dt) for each fixed step owed to this frame; returns the number of steps
+            template <typename StepFunction>
+            uint32_t advance(float frameSeconds, StepFunction step)
+            {
+                uint32_t steps = beginFrame(frameSeconds);
+
+                for (uint32_t k=0; k<steps; ++k) {
+                    step((float)_stepSeconds);
+                    ++_stepCount;
+                }
+
+                return steps;
+            }
+
+            float stepSeconds(void) const
+            {
+                return (float)_stepSeconds;
+            }
+
+            uint64_t stepCount(void) const
+            {
+                return _stepCount;
+            }
+
+            double simSeconds(void) const
+            {
+                return _stepCount * _stepSeconds;
+            }
+
+            // Fraction of a step left over in the accumulator, for interpolating the rendered pose
+            float remainder(void) const
+            {
+                return (float)(_accumulator / _stepSeconds);
+            }
+
+    }; // class FixedStepper
+
+} // namespace hf
@@ -0,0 +1,148 @@
+/*
+   stepresponse.hpp: overshoot, settling time and integrated error of a sampled step response
+
+   Each response is measured against the value it was commanded to reach and scaled by the size
+   of the commanded step, so that a response that settles short of the setpoint is penalised for
+   the shortfall rather than judged against wherever it happened to come to rest.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace hf {
+
+    typedef struct {
+
+        float overshoot;        // furthest excursion past the setpoint, as a fraction of the commanded step
+        float settlingSeconds;  // from the start of the step until it stays within the band
+        float iae;              // integrated absolute error from the setpoint, over the commanded step (seconds)
+        float trackingError;    // distance of the final value from the setpoint, over the commanded step
+        float step;             // final value minus initial value
+        bool  settled;          // within the band at the end of the window
+
+    } step_metrics_t;
+
+    class StepResponse {
+
+        private:
+
+            std::vector<float> _samples;
+
+            float _dt;
+            float _band;
+            float _finalFraction;
+            float _initial;
+            float _from;
+            float _to;
+
+        public:
+
+            // band is the settling tolerance as a fraction of the commanded step; the final value
+            // is the mean of the last finalFraction of the window
+            StepResponse(float dt, uint32_t capacity, float band=0.05f, float finalFraction=0.2f)
+                : _dt(dt), _band(band), _finalFraction(finalFraction), _initial(0), _from(0), _to(0)
+            {
+                _samples.reserve(capacity);
+            }
+
+            // Starts a new step from the value at its onset, commanded from one setpoint to another
+            void begin(float initial, float from, float to)
+            {
+                _samples.clear();
+                _initial = initial;
+                _from = from;
+                _to = to;
+            }
+
+            void add(float value)
+            {
+                _samples.push_back(value);
+            }
+
+            uint32_t size(void) const
+            {
+                return (uint32_t)_samples.size();
+            }
+
+            // Returns false when the commanded step is smaller than minStep, which leaves nothing
+            // to scale the metrics by
+            bool analyze(step_metrics_t & metrics, float minStep) const
+            {
+                uint32_t n = (uint32_t)_samples.size();
+
+                if (n == 0) {
+                    return false;
+                }
+
+                uint32_t tail = (uint32_t)(n * _finalFraction);
+                if (tail == 0) {
+                    tail = 1;
+                }
+
+                double sum = 0;
+                for (uint32_t k=n-tail; k<n; ++k) {
+                    sum += _samples[k];
+                }
+                float final = (float)(sum / tail);
+
+                metrics.step = final - _initial;
+
+                float size = fabsf(_to - _from);
+                if (!(size >= minStep)) {
+                    return false;
+                }
+
+                float direction = _to > _from ? +1.f : -1.f;
+                float band = _band * size;
+
+                float peak = 0;
+                double error = 0;
+                uint32_t lastOutside = 0;
+
+                for (uint32_t k=0; k<n; ++k) {
+
+                    float e = _samples[k] - _to;
+
+                    if (e * direction > peak) {
+                        peak = e * direction;
+                    }
+
+                    error += fabsf(e);
+
+                    if (fabsf(e) > band) {
+                        lastOutside = k + 1;
+                    }
+                }
+
+                metrics.overshoot = peak / size;
+                metrics.settlingSeconds = lastOutside * _dt;
+                metrics.iae = (float)(error * _dt / size);
+                metrics.trackingError = fabsf(final - _to) / size;
+                metrics.settled = lastOutside < n;
+
+                return true;
+            }
+
+    }; // class StepResponse
+
+} // namespace hf
@@ -0,0 +1,172 @@
+/*
+   stickmailbox.hpp: stick commands posted by another local process through a shared-memory
+   mailbox, for autopilots, test scripts and recorded input streams
+
+   Each sample carries the sender's steady-clock time, so the reader can report how old the
+   input was when a firmware step first used it (stage "input age" in timing.hpp).  The two
+   processes must share a steady clock, as they do on one Linux or Mac machine.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "sticks.hpp"
+#include "shmmailbox.hpp"
+#include "timing.hpp"
+
+namespace hf {
+
+    typedef struct {
+
+        uint64_t sequence;              // counts up from 1 with each sample sent
+        uint64_t sentNanos;             // sender's steady clock
+        float    sticks[STICK_CHANNELS]; // [-1,+1], in the order of sticks.hpp
+
+    } stick_sample_t;
+
+    // Owned by the simulator, which creates the mailbox so that senders may come and go
+    class StickMailboxReader {
+
+        private:
+
+            ShmMailbox<stick_sample_t> _mailbox;
+
+            uint64_t _timeoutNanos;
+
+            uint64_t _lastSequence;
+            uint64_t _received;
+            uint64_t _lastAgeNanos;
+
+        public:
+
+            StickMailboxReader(void) : _timeoutNanos(0), _lastSequence(0), _received(0), _lastAgeNanos(0)
+            {
+            }
+
+            // Input older than timeoutSeconds is ignored, so a sender that dies hands control back
+            bool open(const char * name, float timeoutSeconds=0.5f)
+            {
+                _timeoutNanos = (uint64_t)(1e9 * timeoutSeconds);
+                _lastSequence = 0;
+                _received = 0;
+                return _mailbox.open(name, true);
+            }
+
+            void close(void)
+            {
+                _mailbox.close();
+            }
+
+            // Copies the newest sticks, without waiting; false if there are none or they have
+            // timed out.  Called once per firmware step.
+            bool read(float sticks[STICK_CHANNELS])
+            {
+                stick_sample_t sample;
+
+                if (!_mailbox.isOpen() || !_mailbox.read(sample)) {
+                    return false;
+                }
+
+                uint64_t now = steadyNanos();
+                uint64_t age = now > sample.sentNanos ? now - sample.sentNanos : 0;
+
+                if (age > _timeoutNanos) {
+                    return false;
+                }
+
+                // Each sample's latency is counted once, on the step that first sees it
+                if (sample.sequence != _lastSequence) {
+                    _lastSequence = sample.sequence;
+                    _lastAgeNanos = age;
+                    ++_received;
+                    if (HF_TIMING) {
+                        Timing::instance().record(STAGE_INPUT_AGE, age);
+                    }
+                }
+
+                for (uint8_t k=0; k<STICK_CHANNELS; ++k) {
+                    sticks[k] = sample.sticks[k];
+                }
+
+                return true;
+            }
+
+            // Distinct samples seen by read(); the sender's sequence shows how many it sent
+            uint64_t received(void) const
+            {
+                return _received;
+            }
+
+            uint64_t lastSequence(void) const
+            {
+                return _lastSequence;
+            }
+
+            // Age of the newest sample when it was first read
+            uint64_t lastAgeNanos(void) const
+            {
+                return _lastAgeNanos;
+            }
+
+    }; // class StickMailboxReader
+
+    class StickMailboxSender {
+
+        private:
+
+            ShmMailbox<stick_sample_t> _mailbox;
+
+            uint64_t _sequence;
+
+        public:
+
+            StickMailboxSender(void) : _sequence(0)
+            {
+            }
+
+            // Fails until the simulator has created the mailbox
+            bool open(const char * name)
+            {
+                return _mailbox.open(name, false);
+            }
+
+            void send(const float sticks[STICK_CHANNELS])
+            {
+                stick_sample_t sample;
+
+                sample.sequence = ++_sequence;
+                for (uint8_t k=0; k<STICK_CHANNELS; ++k) {
+                    sample.sticks[k] = sticks[k];
+                }
+
+                // Stamped last, so the age covers only the handoff
+                sample.sentNanos = steadyNanos();
+
+                _mailbox.write(sample);
+            }
+
+            uint64_t sent(void) const
+            {
+                return _sequence;
+            }
+
+    }; // class StickMailboxSender
+
+} // namespace hf
@@ -0,0 +1,35 @@
+/*
+   sticks.hpp: stick channel order shared by receivers, recorders and scripts
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+namespace hf {
+
+    // Raw-value channel order used by the Hackflight receivers
+    enum {
+        STICK_THROTTLE,
+        STICK_ROLL,
+        STICK_PITCH,
+        STICK_YAW,
+        STICK_AUX1,
+        STICK_CHANNELS
+    };
+
+} // namespace hf
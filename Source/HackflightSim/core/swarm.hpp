@@ -0,0 +1,283 @@
+/*
+   swarm.hpp: structure-of-arrays dynamics for large swarms of simple quadcopters
+
+   Each state variable is stored as its own aligned array over all vehicles, so one
+   kernel, written once against the lane wrappers in simd.hpp, integrates eight
+   (AVX2), four (SSE) or one (scalar) vehicle per instruction.  There is no firmware
+   here: callers write motor values directly, and read back poses.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "simd.hpp"
+
+namespace hf {
+
+    // Physical constants shared by every vehicle in a swarm; defaults approximate the 3DFly
+    typedef struct {
+
+        float mass;             // kg
+        float armLength;        // m, motor to center
+        float thrustPerMotor;   // N at motor value 1
+        float yawPerMotor;      // N*m of reaction torque at motor value 1
+        float inertia[3];       // kg*m^2, roll, pitch, yaw
+        float angularDamping;   // 1/s
+        float linearDrag;       // 1/s
+        float gravity;          // m/s^2
+
+    } swarm_params_t;
+
+    static const swarm_params_t SWARM_DEFAULT_PARAMS = {
+        0.05f, 0.04f, 0.245f, 0.005f, {3e-5f, 3e-5f, 6e-5f}, 2.0f, 0.5f, 9.81f
+    };
+
+    class Swarm {
+
+        public:
+
+            typedef enum {
+
+                KERNEL_SCALAR,
+                KERNEL_SSE,
+                KERNEL_AVX2
+
+            } kernel_t;
+
+            // One array per field, each padded to a whole number of SIMD registers
+            enum {
+                MOTOR0, MOTOR1, MOTOR2, MOTOR3,
+                GYRO_X, GYRO_Y, GYRO_Z,
+                VEL_X,  VEL_Y,  VEL_Z,
+                QUAT_X, QUAT_Y, QUAT_Z, QUAT_W,
+                POS_X,  POS_Y,  POS_Z,
+                FIELD_COUNT
+            };
+
+        private:
+
+            swarm_params_t _params;
+
+            uint32_t _count;
+            uint32_t _stride;
+            float *  _data;
+
+            template <typename V>
+            void kernel(float dt)
+            {
+                const swarm_params_t & p = _params;
+
+                // Motor layout follows the pawn: 0 rear right, 1 front right, 2 rear left, 3 front left;
+                // motors 0 and 3 spin clockwise
+                const V kRoll  = V::set(dt * p.armLength * p.thrustPerMotor / p.inertia[0]);
+                const V kPitch = V::set(dt * p.armLength * p.thrustPerMotor / p.inertia[1]);
+                const V kYaw   = V::set(dt * p.yawPerMotor / p.inertia[2]);
+                const V kLift  = V::set(dt * p.thrustPerMotor / p.mass);
+                const V angularKeep = V::set(1 - dt * p.angularDamping);
+                const V linearKeep  = V::set(1 - dt * p.linearDrag);
+                const V gravityStep = V::set(dt * p.gravity);
+                const V halfDt = V::set(dt / 2);
+                const V vdt = V::set(dt);
+                const V one = V::set(1);
+                const V two = V::set(2);
+
+                for (uint32_t i=0; i<_stride; i+=V::WIDTH) {
+
+                    V m0 = V::load(field(MOTOR0) + i);
+                    V m1 = V::load(field(MOTOR1) + i);
+                    V m2 = V::load(field(MOTOR2) + i);
+                    V m3 = V::load(field(MOTOR3) + i);
+
+                    // Body rates from differential thrust and reaction torque
+                    V gx = V::load(field(GYRO_X) + i) * angularKeep + kRoll  * ((m2 + m3) - (m0 + m1));
+                    V gy = V::load(field(GYRO_Y) + i) * angularKeep + kPitch * ((m0 + m2) - (m1 + m3));
+                    V gz = V::load(field(GYRO_Z) + i) * angularKeep + kYaw   * ((m0 + m3) - (m1 + m2));
+
+                    // Attitude: q += dt/2 * q (x) (0, omega), then renormalize
+                    V qx = V::load(field(QUAT_X) + i);
+                    V qy = V::load(field(QUAT_Y) + i);
+                    V qz = V::load(field(QUAT_Z) + i);
+                    V qw = V::load(field(QUAT_W) + i);
+
+                    V nx = qx + halfDt * (qw*gx + qy*gz - qz*gy);
+                    V ny = qy + halfDt * (qw*gy + qz*gx - qx*gz);
+                    V nz = qz + halfDt * (qw*gz + qx*gy - qy*gx);
+                    V nw = qw - halfDt * (qx*gx + qy*gy + qz*gz);
+
+                    V norm = one / V::sqrt(nx*nx + ny*ny + nz*nz + nw*nw);
+                    nx = nx * norm;
+                    ny = ny * norm;
+                    nz = nz * norm;
+                    nw = nw * norm;
+
+                    // Thrust acts along the body's Z axis, expressed in the world frame
+                    V lift = kLift * (m0 + m1 + m2 + m3);
+                    V zx = two * (nx*nz + nw*ny);
+                    V zy = two * (ny*nz - nw*nx);
+                    V zz = one - two * (nx*nx + ny*ny);
+
+                    V vx = V::load(field(VEL_X) + i) * linearKeep + lift * zx;
+                    V vy = V::load(field(VEL_Y) + i) * linearKeep + lift * zy;
+                    V vz = V::load(field(VEL_Z) + i) * linearKeep + lift * zz - gravityStep;
+
+                    // Semi-implicit: position uses the updated velocity
+                    (V::load(field(POS_X) + i) + vdt * vx).store(field(POS_X) + i);
+                    (V::load(field(POS_Y) + i) + vdt * vy).store(field(POS_Y) + i);
+                    (V::load(field(POS_Z) + i) + vdt * vz).store(field(POS_Z) + i);
+
+                    gx.store(field(GYRO_X) + i);
+                    gy.store(field(GYRO_Y) + i);
+                    gz.store(field(GYRO_Z) + i);
+                    vx.store(field(VEL_X) + i);
+                    vy.store(field(VEL_Y) + i);
+                    vz.store(field(VEL_Z) + i);
+                    nx.store(field(QUAT_X) + i);
+                    ny.store(field(QUAT_Y) + i);
+                    nz.store(field(QUAT_Z) + i);
+                    nw.store(field(QUAT_W) + i);
+                }
+            }
+
+        public:
+
+            Swarm(uint32_t count, const swarm_params_t & params=SWARM_DEFAULT_PARAMS)
+            {
+                const uint32_t lanes = SIMD_ALIGNMENT / sizeof(float);
+
+                _params = params;
+                _count = count;
+                _stride = (count + lanes - 1) / lanes * lanes;
+                _data = (float *)simdAlloc(FIELD_COUNT * _stride * sizeof(float));
+
+                reset();
+            }
+
+            ~Swarm(void)
+            {
+                simdFree(_data);
+            }
+
+            Swarm(const Swarm &) = delete;
+            Swarm & operator=(const Swarm &) = delete;
+
+            // Puts every vehicle at the origin, level and at rest, with motors off
+            void reset(void)
+            {
+                memset(_data, 0, FIELD_COUNT * _stride * sizeof(float));
+
+                for (uint32_t i=0; i<_stride; ++i) {
+                    field(QUAT_W)[i] = 1;
+                }
+            }
+
+            static kernel_t bestKernel(void)
+            {
+#if defined(HF_HAVE_AVX2)
+                return KERNEL_AVX2;
+#elif defined(HF_HAVE_SSE)
+                return KERNEL_SSE;
+#else
+                return KERNEL_SCALAR;
+#endif
+            }
+
+            static bool haveKernel(kernel_t k)
+            {
+                switch (k) {
+#ifdef HF_HAVE_AVX2
+                    case KERNEL_AVX2:
+                        return true;
+#endif
+#ifdef HF_HAVE_SSE
+                    case KERNEL_SSE:
+                        return true;
+#endif
+                    case KERNEL_SCALAR:
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+
+            // Advances every vehicle by dt seconds; falls back to scalar for kernels not compiled in
+            void step(float dt, kernel_t k=bestKernel())
+            {
+                switch (k) {
+#ifdef HF_HAVE_AVX2
+                    case KERNEL_AVX2:
+                        kernel<Avx2Lanes>(dt);
+                        break;
+#endif
+#ifdef HF_HAVE_SSE
+                    case KERNEL_SSE:
+                        kernel<SseLanes>(dt);
+                        break;
+#endif
+                    default:
+                        kernel<ScalarLanes>(dt);
+                }
+            }
+
+            uint32_t count(void) const
+            {
+                return _count;
+            }
+
+            // Raw column access, e.g. field(POS_Z)[i]
+            float * field(int f)
+            {
+                return _data + f * _stride;
+            }
+
+            const float * field(int f) const
+            {
+                return _data + f * _stride;
+            }
+
+            void setMotors(uint32_t i, const float motors[4])
+            {
+                for (uint8_t k=0; k<4; ++k) {
+                    field(MOTOR0 + k)[i] = motors[k];
+                }
+            }
+
+            void setPosition(uint32_t i, const float position[3])
+            {
+                for (uint8_t k=0; k<3; ++k) {
+                    field(POS_X + k)[i] = position[k];
+                }
+            }
+
+            // Position in meters and orientation as x, y, z, w, ready for instanced-mesh transforms
+            void getPose(uint32_t i, float position[3], float quaternion[4]) const
+            {
+                for (uint8_t k=0; k<3; ++k) {
+                    position[k] = field(POS_X + k)[i];
+                }
+
+                for (uint8_t k=0; k<4; ++k) {
+                    quaternion[k] = field(QUAT_X + k)[i];
+                }
+            }
+
+    }; // class Swarm
+
+} // namespace hf
@@ -0,0 +1,92 @@
+/*
+   tappedreceiver.hpp: wraps any receiver to expose the stick values the firmware read,
+   or to feed the firmware recorded values in their place
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "sticks.hpp"
+
+namespace hf {
+
+    // R is a receiver class, e.g. Controller; the wrapper adds no virtual calls of its own
+    template <class R>
+    class TappedReceiver : public R {
+
+        private:
+
+            float _sticks[STICK_CHANNELS] = {-1, 0, 0, 0, 0};
+
+            bool _playing = false;
+
+        protected:
+
+            bool gotNewFrame(void) override
+            {
+                return _playing || R::gotNewFrame();
+            }
+
+            void readRawvals(void) override
+            {
+                if (_playing) {
+                    for (uint8_t k=0; k<STICK_CHANNELS; ++k) {
+                        this->rawvals[k] = _sticks[k];
+                    }
+                    return;
+                }
+
+                R::readRawvals();
+
+                for (uint8_t k=0; k<STICK_CHANNELS; ++k) {
+                    _sticks[k] = this->rawvals[k];
+                }
+            }
+
+        public:
+
+            // Values read on the most recent firmware update
+            const float * getSticks(void) const
+            {
+                return _sticks;
+            }
+
+            // Replaces the wrapped receiver's input with these values until stopPlaying()
+            void play(const float sticks[STICK_CHANNELS])
+            {
+                for (uint8_t k=0; k<STICK_CHANNELS; ++k) {
+                    _sticks[k] = sticks[k];
+                }
+                _playing = true;
+            }
+
+            void stopPlaying(void)
+            {
+                _playing = false;
+            }
+
+            bool isPlaying(void) const
+            {
+                return _playing;
+            }
+
+    }; // class TappedReceiver
+
+} // namespace hf
@@ -0,0 +1,154 @@
+/*
+   threadpool.hpp: small fork-join thread pool
+
+   run() hands out task indices to the pool's threads and to the calling thread, and
+   returns once every task has finished, so results are safe to read afterwards.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hf {
+
+    class ThreadPool {
+
+        private:
+
+            std::vector<std::thread> _threads;
+
+            std::mutex _mutex;
+            std::condition_variable _wake;
+            std::condition_variable _done;
+
+            // Current batch; _generation changes each time run() starts one
+            std::function<void(uint32_t)> _task;
+            uint32_t _count;
+            uint64_t _generation;
+            std::atomic<uint32_t> _next;
+            uint32_t _finished;
+
+            // Pool threads currently inside work(); a new batch may not start until this is zero
+            uint32_t _busy;
+
+            bool _quit;
+
+            // Claims and runs tasks until none are left; returns how many this thread ran
+            uint32_t work(void)
+            {
+                uint32_t ran = 0;
+
+                for (uint32_t k = _next++; k < _count; k = _next++) {
+                    _task(k);
+                    ++ran;
+                }
+
+                return ran;
+            }
+
+            void loop(void)
+            {
+                uint64_t seen = 0;
+
+                std::unique_lock<std::mutex> lock(_mutex);
+
+                while (true) {
+
+                    _wake.wait(lock, [&] { return _quit || _generation != seen; });
+
+                    if (_quit) {
+                        return;
+                    }
+
+                    seen = _generation;
+                    ++_busy;
+
+                    lock.unlock();
+                    uint32_t ran = work();
+                    lock.lock();
+
+                    _finished += ran;
+                    --_busy;
+
+                    _done.notify_all();
+                }
+            }
+
+        public:
+
+            // A pool of zero threads runs everything on the caller
+            ThreadPool(uint32_t threads) : _count(0), _generation(0), _next(0), _finished(0), _busy(0), _quit(false)
+            {
+                for (uint32_t k=0; k<threads; ++k) {
+                    _threads.push_back(std::thread(&ThreadPool::loop, this));
+                }
+            }
+
+            ~ThreadPool(void)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _quit = true;
+                }
+
+                _wake.notify_all();
+
+                for (auto & t : _threads) {
+                    t.join();
+                }
+            }
+
+            // Runs task(0) ... task(count-1) across the pool and the calling thread
+            void run(uint32_t count, std::function<void(uint32_t)> task)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+
+                // Threads that woke too late for the last batch may still be leaving work()
+                _done.wait(lock, [&] { return _busy == 0; });
+
+                _task = task;
+                _count = count;
+                _finished = 0;
+                _next = 0;
+                ++_generation;
+
+                lock.unlock();
+                _wake.notify_all();
+
+                uint32_t ran = work();
+
+                lock.lock();
+                _finished += ran;
+                _done.wait(lock, [&] { return _finished == _count && _busy == 0; });
+            }
+
+            uint32_t size(void) const
+            {
+                return (uint32_t)_threads.size();
+            }
+
+    }; // class ThreadPool
+
+} // namespace hf
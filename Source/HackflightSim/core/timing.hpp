@@ -0,0 +1,372 @@
+/*
+   timing.hpp: scoped stage timers feeding lock-free, per-thread latency histograms
+
+   Each thread records into its own histograms, so timing never contends across threads;
+   readers sum all threads' histograms to get counts, percentiles and maxima.  Timers
+   compile to nothing unless HF_TIMING is defined nonzero.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+
+#ifndef HF_TIMING
+#define HF_TIMING 0
+#endif
+
+namespace hf {
+
+    // Stages of the simulation we time
+    enum {
+        STAGE_TICK,             // whole vehicle tick
+        STAGE_FIRMWARE,         // Hackflight update
+        STAGE_VEHICLE_STATE,    // board vehicle state
+        STAGE_INTEGRATE,        // pose integration
+        STAGE_MOTORS,           // propeller rotation
+        STAGE_AUDIO,            // propeller sound parameters
+        STAGE_SWEEP,            // moving the actor, with collision sweep
+        STAGE_READBACK,         // vision frame readback from the GPU
+        STAGE_CONVERT,          // vision pixel conversion
+        STAGE_VISION,           // vision algorithms, on worker threads
+        STAGE_INPUT_AGE,        // external stick sample, from sending to first use by a step
+        STAGE_COUNT
+    };
+
+    static const char * const STAGE_NAMES[STAGE_COUNT] = {
+        "tick",
+        "firmware",
+        "vehicle state",
+        "integrate",
+        "motors",
+        "audio",
+        "sweep",
+        "readback",
+        "convert",
+        "vision",
+        "input age"
+    };
+
+    // Steady clock shared between processes on one machine, for stamping what they exchange
+    inline uint64_t steadyNanos(void)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    typedef struct {
+
+        uint64_t count;
+        double   meanMicros;
+        double   p50Micros;
+        double   p99Micros;
+        double   maxMicros;
+
+    } stage_stats_t;
+
+    class Timing {
+
+        public:
+
+            // Nanosecond buckets: exact below 8, then eight per power of two (12.5% resolution)
+            static const uint32_t BUCKETS = 320;
+
+            // Threads that can record at once; a thread takes a slot on its first sample and gives
+            // it back when it exits, and samples from threads beyond these are counted as dropped
+            static const uint32_t MAX_THREADS = 32;
+
+        private:
+
+            // Written only by its own thread, so plain load-and-store updates are enough
+            typedef struct {
+
+                std::atomic<uint32_t> counts[STAGE_COUNT][BUCKETS];
+                std::atomic<uint64_t> totals[STAGE_COUNT];
+                std::atomic<uint64_t> maxima[STAGE_COUNT];
+
+            } thread_histograms_t;
+
+            thread_histograms_t _threads[MAX_THREADS];
+            std::atomic<bool>   _claimed[MAX_THREADS];
+
+            // Slots ever claimed, so that stats() need not visit the rest
+            std::atomic<uint32_t> _used;
+
+            std::atomic<uint64_t> _dropped;
+
+            // Gives a thread's slot back when the thread exits; a later thread carries on its
+            // histograms, which belong to the session rather than to the thread
+            class Claim {
+
+                public:
+
+                    Timing * owner;
+                    uint32_t index;
+
+                    Claim(void) : owner(nullptr), index(0)
+                    {
+                    }
+
+                    ~Claim(void)
+                    {
+                        if (owner) {
+                            owner->_claimed[index].store(false, std::memory_order_release);
+                        }
+                    }
+
+            }; // class Claim
+
+            Timing(void) : _used(0), _dropped(0)
+            {
+                for (uint32_t t=0; t<MAX_THREADS; ++t) {
+                    _claimed[t] = false;
+                }
+            }
+
+            static uint32_t bucket(uint64_t nanos)
+            {
+                if (nanos < 8) {
+                    return (uint32_t)nanos;
+                }
+
+                uint32_t msb = 3;
+                while (msb < 63 && (nanos >> (msb + 1)) != 0) {
+                    ++msb;
+                }
+                uint32_t index = (msb - 2) * 8 + ((nanos >> (msb - 3)) & 7);
+
+                return index < BUCKETS ? index : BUCKETS - 1;
+            }
+
+            // Middle of a bucket's range
+            static double bucketNanos(uint32_t index)
+            {
+                if (index < 8) {
+                    return index;
+                }
+
+                uint32_t msb = index / 8 + 2;
+                // In 64 bits: buckets past about 4 s would overflow 32
+                double low = (double)((uint64_t)(8 + index % 8) << (msb - 3));
+
+                return low + (double)(1ull << (msb - 3)) / 2;
+            }
+
+            // Null while every slot is taken; tried again on the thread's next sample
+            thread_histograms_t * mine(void)
+            {
+                static thread_local Claim claim;
+
+                if (claim.owner) {
+                    return &_threads[claim.index];
+                }
+
+                for (uint32_t t=0; t<MAX_THREADS; ++t) {
+
+                    bool expected = false;
+
+                    if (_claimed[t].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+
+                        uint32_t used = _used.load();
+                        while (used < t + 1 && !_used.compare_exchange_weak(used, t + 1)) {
+                        }
+
+                        claim.owner = this;
+                        claim.index = t;
+                        return &_threads[t];
+                    }
+                }
+
+                return nullptr;
+            }
+
+            static void increment(std::atomic<uint32_t> & counter)
+            {
+                counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+
+        public:
+
+            static Timing & instance(void)
+            {
+                static Timing timing;
+                return timing;
+            }
+
+            void record(uint32_t stage, uint64_t nanos)
+            {
+                thread_histograms_t * h = mine();
+
+                if (!h) {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+
+                increment(h->counts[stage][bucket(nanos)]);
+
+                h->totals[stage].store(h->totals[stage].load(std::memory_order_relaxed) + nanos, std::memory_order_relaxed);
+
+                if (nanos > h->maxima[stage].load(std::memory_order_relaxed)) {
+                    h->maxima[stage].store(nanos, std::memory_order_relaxed);
+                }
+            }
+
+            // Combines every thread's samples of a stage; safe to call while timing continues
+            stage_stats_t stats(uint32_t stage) const
+            {
+                uint32_t threads = _used.load();
+
+                uint64_t counts[BUCKETS] = {0};
+                uint64_t total = 0;
+                uint64_t maximum = 0;
+                uint64_t count = 0;
+
+                for (uint32_t t=0; t<threads; ++t) {
+                    const thread_histograms_t & h = _threads[t];
+                    for (uint32_t b=0; b<BUCKETS; ++b) {
+                        uint32_t c = h.counts[stage][b].load(std::memory_order_relaxed);
+                        counts[b] += c;
+                        count += c;
+                    }
+                    total += h.totals[stage].load(std::memory_order_relaxed);
+                    uint64_t m = h.maxima[stage].load(std::memory_order_relaxed);
+                    maximum = m > maximum ? m : maximum;
+                }
+
+                stage_stats_t s = stage_stats_t();
+
+                s.count = count;
+
+                if (count == 0) {
+                    return s;
+                }
+
+                s.meanMicros = total / 1e3 / count;
+                s.maxMicros = maximum / 1e3;
+
+                uint64_t p50 = (count - 1) / 2;
+                uint64_t p99 = (count - 1) * 99 / 100;
+                uint64_t seen = 0;
+
+                for (uint32_t b=0; b<BUCKETS; ++b) {
+                    if (counts[b] == 0) {
+                        continue;
+                    }
+                    if (seen <= p50 && p50 < seen + counts[b]) {
+                        s.p50Micros = bucketNanos(b) / 1e3;
+                    }
+                    if (seen <= p99 && p99 < seen + counts[b]) {
+                        s.p99Micros = bucketNanos(b) / 1e3;
+                    }
+                    seen += counts[b];
+                }
+
+                // A bucket's middle can overshoot the largest sample
+                if (s.p50Micros > s.maxMicros) {
+                    s.p50Micros = s.maxMicros;
+                }
+                if (s.p99Micros > s.maxMicros) {
+                    s.p99Micros = s.maxMicros;
+                }
+
+                return s;
+            }
+
+            // Samples lost because every slot was taken when they were recorded
+            uint64_t dropped(void) const
+            {
+                return _dropped.load(std::memory_order_relaxed);
+            }
+
+            // Empties every histogram, for a new session; samples recorded meanwhile may be lost
+            void reset(void)
+            {
+                uint32_t threads = _used.load();
+
+                for (uint32_t t=0; t<threads; ++t) {
+                    thread_histograms_t & h = _threads[t];
+                    for (uint32_t stage=0; stage<STAGE_COUNT; ++stage) {
+                        for (uint32_t b=0; b<BUCKETS; ++b) {
+                            h.counts[stage][b].store(0, std::memory_order_relaxed);
+                        }
+                        h.totals[stage].store(0, std::memory_order_relaxed);
+                        h.maxima[stage].store(0, std::memory_order_relaxed);
+                    }
+                }
+
+                _dropped.store(0, std::memory_order_relaxed);
+            }
+
+            // Writes a table of every stage that has samples
+            void dump(FILE * out) const
+            {
+                fprintf(out, "%-14s %12s %10s %10s %10s %10s\n", "stage", "count", "mean us", "p50 us", "p99 us", "max us");
+
+                for (uint32_t stage=0; stage<STAGE_COUNT; ++stage) {
+
+                    stage_stats_t s = stats(stage);
+
+                    if (s.count > 0) {
+                        fprintf(out, "%-14s %12llu %10.2f %10.2f %10.2f %10.2f\n", STAGE_NAMES[stage],
+                                (unsigned long long)s.count, s.meanMicros, s.p50Micros, s.p99Micros, s.maxMicros);
+                    }
+                }
+
+                if (dropped() > 0) {
+                    fprintf(out, "%llu samples dropped: more than %u threads recording at once\n",
+                            (unsigned long long)dropped(), MAX_THREADS);
+                }
+            }
+
+    }; // class Timing
+
+    // Times the enclosing scope as one sample of a stage
+    class ScopedTimer {
+
+        private:
+
+            uint32_t _stage;
+            std::chrono::steady_clock::time_point _start;
+
+        public:
+
+            ScopedTimer(uint32_t stage) : _stage(stage), _start(std::chrono::steady_clock::now())
+            {
+            }
+
+            ~ScopedTimer(void)
+            {
+                uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+                Timing::instance().record(_stage, nanos);
+            }
+
+    }; // class ScopedTimer
+
+} // namespace hf
+
+#if HF_TIMING
+#define HF_TIMING_NAME2(line) hfStageTimer##line
+#define HF_TIMING_NAME(line) HF_TIMING_NAME2(line)
+#define HF_TIME_STAGE(stage) hf::ScopedTimer HF_TIMING_NAME(__LINE__)(stage)
+#else
+#define HF_TIME_STAGE(stage)
+#endif
@@ -0,0 +1,205 @@
+/*
+   vehicle.hpp: one simulated vehicle's firmware, board and pose
+
+   Each SimVehicle owns its own Hackflight instance, stabilizer and board, so any
+   number of vehicles can fly side by side without sharing firmware state.  The
+   receiver is supplied by the caller, since it differs between the editor
+   (joystick) and headless runs (scripted).
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string.h>
+
+#include <hackflight.hpp>
+
+#include "steppedboard.hpp"
+#include "pose.hpp"
+#include "timing.hpp"
+
+namespace hf {
+
+    class VehicleSnapshot;
+
+    class SimVehicle {
+
+        friend class VehicleSnapshot;
+
+        private:
+
+            Hackflight      _hackflight;
+            SteppedSimBoard _board;
+            Stabilizer      _stabilizer;
+            Stabilizer      _initialStabilizer;
+            Receiver *      _receiver;
+            integrator_t    _integrator;
+
+        public:
+
+            // Everything we should need to display the vehicle
+            float gyroRates[3];
+            float translationRates[3];
+            float motorValues[4];
+            Pose  pose;
+
+            SimVehicle(const Stabilizer & stabilizer)
+                : _stabilizer(stabilizer), _initialStabilizer(stabilizer), _receiver(nullptr),
+                _integrator(INTEGRATOR_SEMI_IMPLICIT)
+            {
+                for (uint8_t k=0; k<3; ++k) {
+                    gyroRates[k] = 0;
+                    translationRates[k] = 0;
+                }
+
+                for (uint8_t k=0; k<4; ++k) {
+                    motorValues[k] = 0;
+                }
+            }
+
+            // (Re)starts the firmware with fresh stabilizer state and board clock
+            void init(Receiver * receiver)
+            {
+                _receiver = receiver;
+                _stabilizer = _initialStabilizer;
+                _board.resetClock();
+                _hackflight.init(&_board, _receiver, &_stabilizer);
+            }
+
+            // Chooses how the pose is advanced through each step
+            void setIntegrator(integrator_t integrator)
+            {
+                _integrator = integrator;
+            }
+
+            // Puts a sensor model between the vehicle and the firmware's IMU readings
+            void setImuModel(const ImuModel & imu)
+            {
+                _board.setImuModel(imu);
+            }
+
+            // Copies this vehicle's entire state into a snapshot, and back
+            void capture(VehicleSnapshot & snapshot) const;
+            bool restore(const VehicleSnapshot & snapshot);
+
+            // Runs the firmware for one fixed step and integrates the resulting motion
+            void step(float dt)
+            {
+                _board.advance(dt);
+
+                {
+                    HF_TIME_STAGE(STAGE_FIRMWARE);
+                    _hackflight.update();
+                }
+
+                {
+                    HF_TIME_STAGE(STAGE_VEHICLE_STATE);
+                    _board.simGetVehicleState(gyroRates, translationRates, motorValues);
+                }
+
+                HF_TIME_STAGE(STAGE_INTEGRATE);
+                pose.integrate(gyroRates, translationRates, dt, _integrator);
+            }
+
+            // Runs one fixed step with the given motor values in place of the firmware's, for
+            // callers that close the loop themselves
+            void stepMotors(const float values[4], float dt)
+            {
+                _board.advance(dt);
+                _board.setMotors(values);
+
+                {
+                    HF_TIME_STAGE(STAGE_VEHICLE_STATE);
+                    _board.simGetVehicleState(gyroRates, translationRates, motorValues);
+                }
+
+                HF_TIME_STAGE(STAGE_INTEGRATE);
+                pose.integrate(gyroRates, translationRates, dt, _integrator);
+            }
+
+            // Integrates the current motion for one step without running the firmware
+            void coast(float dt)
+            {
+                HF_TIME_STAGE(STAGE_INTEGRATE);
+                pose.integrate(gyroRates, translationRates, dt, _integrator);
+            }
+
+    }; // class SimVehicle
+
+    // Everything needed to put a vehicle back exactly as it was: firmware, board (clock and
+    // dynamics), stabilizer integrators, rates and pose.  Fixed-size and copied by value, so
+    // capturing and restoring never allocate; create one per vehicle up front.
+    class VehicleSnapshot {
+
+        friend class SimVehicle;
+
+        private:
+
+            const SimVehicle * _owner;
+            Hackflight      _hackflight;
+            SteppedSimBoard _board;
+            Stabilizer      _stabilizer;
+            Receiver *      _receiver;
+            float           _gyroRates[3];
+            float           _translationRates[3];
+            float           _motorValues[4];
+            Pose            _pose;
+
+        public:
+
+            VehicleSnapshot(const SimVehicle & vehicle) : _stabilizer(vehicle._stabilizer)
+            {
+                vehicle.capture(*this);
+            }
+
+    }; // class VehicleSnapshot
+
+    inline void SimVehicle::capture(VehicleSnapshot & snapshot) const
+    {
+        snapshot._owner = this;
+        snapshot._hackflight = _hackflight;
+        snapshot._board = _board;
+        snapshot._stabilizer = _stabilizer;
+        snapshot._receiver = _receiver;
+        memcpy(snapshot._gyroRates, gyroRates, sizeof(gyroRates));
+        memcpy(snapshot._translationRates, translationRates, sizeof(translationRates));
+        memcpy(snapshot._motorValues, motorValues, sizeof(motorValues));
+        snapshot._pose = pose;
+    }
+
+    // The firmware refers to its own vehicle's board and stabilizer, so a snapshot can only be
+    // restored into the vehicle it was captured from; returns false otherwise
+    inline bool SimVehicle::restore(const VehicleSnapshot & snapshot)
+    {
+        if (snapshot._owner != this) {
+            return false;
+        }
+
+        _hackflight = snapshot._hackflight;
+        _board = snapshot._board;
+        _stabilizer = snapshot._stabilizer;
+        _receiver = snapshot._receiver;
+        memcpy(gyroRates, snapshot._gyroRates, sizeof(gyroRates));
+        memcpy(translationRates, snapshot._translationRates, sizeof(translationRates));
+        memcpy(motorValues, snapshot._motorValues, sizeof(motorValues));
+        pose = snapshot._pose;
+
+        return true;
+    }
+
+} // namespace hf
@@ -0,0 +1,357 @@
+/*
+   vision.hpp: runs vision algorithms on camera frames off the game thread
+
+   The game thread fills a pooled RGB buffer and publishes it; a dispatcher thread
+   takes frames from a bounded lock-free queue and runs every registered algorithm on
+   them in parallel on a thread pool.  If the algorithms fall behind, the oldest
+   waiting frame is dropped and counted.  Algorithms publish their results through
+   Mailboxes, which the vehicle reads without locking.
+
+   Copyright (C) Simon D. Levy 2017
+
+   This file is part of HackflightSim.
+
+   HackflightSim is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   HackflightSim is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with HackflightSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "framepool.hpp"
+#include "indexqueue.hpp"
+#include "mailbox.hpp"
+#include "threadpool.hpp"
+#include "timing.hpp"
+
+namespace hf {
+
+    typedef struct {
+
+        uint64_t        frameNumber;
+        double          simSeconds;
+        int             rows;
+        int             cols;
+        const uint8_t * rgb;
+
+    } vision_frame_t;
+
+    class VisionAlgorithm {
+
+        public:
+
+            // Called on a pool thread; must not keep the frame's pixels after returning
+            virtual void process(const vision_frame_t & frame) = 0;
+
+            virtual ~VisionAlgorithm(void) { }
+    };
+
+    class VisionPipeline {
+
+        public:
+
+            // Most frames that can wait for the algorithms; older ones are dropped beyond this
+            static const uint32_t MAX_QUEUED = 6;
+
+        private:
+
+            // Queued frames, a spare for the game thread and one for the dispatcher
+            static const uint32_t BUFFERS = MAX_QUEUED + 2;
+
+            int _rows;
+            int _cols;
+
+            uint32_t _queueDepth;
+
+            FramePool _pixels;
+            uint64_t _frameNumbers[BUFFERS];
+            double   _simSeconds[BUFFERS];
+
+            // Dispatcher returns finished buffers to the game thread through _free
+            IndexQueue<16> _ready;
+            IndexQueue<16> _free;
+
+            // Game thread only: buffer being filled, and a dropped buffer kept for reuse
+            int32_t _filling;
+            int32_t _spare;
+
+            std::vector<VisionAlgorithm *> _algorithms;
+
+            ThreadPool _pool;
+            std::thread _dispatcher;
+            std::atomic<bool> _running;
+
+            // Lets the dispatcher sleep when idle; the game thread only notifies, never waits
+            std::mutex _mutex;
+            std::condition_variable _wake;
+
+            std::atomic<uint64_t> _published;
+            std::atomic<uint64_t> _dropped;
+            std::atomic<uint64_t> _processed;
+
+            uint8_t * buffer(uint32_t index)
+            {
+                return _pixels.buffer(index);
+            }
+
+            void dispatch(void)
+            {
+                while (_running) {
+
+                    uint32_t index;
+
+                    if (!_ready.pop(index)) {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _wake.wait_for(lock, std::chrono::milliseconds(5));
+                        continue;
+                    }
+
+                    vision_frame_t frame = { _frameNumbers[index], _simSeconds[index], _rows, _cols, buffer(index) };
+
+                    _pool.run((uint32_t)_algorithms.size(), [&](uint32_t k) {
+                        HF_TIME_STAGE(STAGE_VISION);
+                        _algorithms[k]->process(frame);
+                    });
+
+                    ++_processed;
+
+                    _free.push(index);
+                }
+            }
+
+        public:
+
+            VisionPipeline(int rows, int cols, uint32_t queueDepth=2, uint32_t workers=2)
+                : _rows(rows), _cols(cols), _queueDepth(queueDepth < 1 ? 1 : queueDepth > MAX_QUEUED ? MAX_QUEUED : queueDepth),
+                _filling(-1), _spare(-1),
+                _pool(workers > 0 ? workers-1 : 0), _running(false), _published(0), _dropped(0), _processed(0)
+            {
+                _pixels.reserve(BUFFERS, (size_t)3 * rows * cols);
+
+                for (uint32_t k=0; k<BUFFERS; ++k) {
+                    _free.push(k);
+                }
+            }
+
+            ~VisionPipeline(void)
+            {
+                stop();
+            }
+
+            // Register algorithms before start()
+            void addAlgorithm(VisionAlgorithm * algorithm)
+            {
+                _algorithms.push_back(algorithm);
+            }
+
+            void start(void)
+            {
+                _running = true;
+                _dispatcher = std::thread(&VisionPipeline::dispatch, this);
+            }
+
+            void stop(void)
+            {
+                if (_running) {
+                    _running = false;
+                    _wake.notify_one();
+                    _dispatcher.join();
+                }
+            }
+
+            // Game thread: switches to frames of a new size, reallocating the buffers once.  Frames
+            // waiting for the algorithms are dropped; the workers are paused meanwhile.  Does
+            // nothing if the size is unchanged.
+            void resize(int rows, int cols)
+            {
+                if (rows == _rows && cols == _cols) {
+                    return;
+                }
+
+                bool running = _running;
+                stop();
+
+                uint32_t index;
+                while (_ready.pop(index)) {
+                    ++_dropped;
+                }
+                while (_free.pop(index)) {
+                }
+
+                _rows = rows;
+                _cols = cols;
+                _pixels.reserve(BUFFERS, (size_t)3 * rows * cols);
+
+                _filling = -1;
+                _spare = -1;
+                for (uint32_t k=0; k<BUFFERS; ++k) {
+                    _free.push(k);
+                }
+
+                if (running) {
+                    start();
+                }
+            }
+
+            // Game thread: returns an RGB buffer of rows*cols*3 bytes to fill, or nullptr if
+            // every buffer is busy.  Never blocks.
+            uint8_t * acquire(void)
+            {
+                uint32_t index;
+
+                if (_filling >= 0) {
+                    return buffer(_filling);
+                }
+
+                if (_spare >= 0) {
+                    _filling = _spare;
+                    _spare = -1;
+                }
+
+                else if (_free.pop(index)) {
+                    _filling = index;
+                }
+
+                // No free buffer: take back the oldest queued frame instead
+                else if (_ready.pop(index)) {
+                    _filling = index;
+                    ++_dropped;
+                }
+
+                else {
+                    return nullptr;
+                }
+
+                return buffer(_filling);
+            }
+
+            // Game thread: queues the acquired buffer for the algorithms, dropping the oldest
+            // waiting frame if the queue is already full
+            void publish(uint64_t frameNumber, double simSeconds)
+            {
+                if (_filling < 0) {
+                    return;
+                }
+
+                uint32_t index;
+
+                if (_ready.size() >= _queueDepth && _ready.pop(index)) {
+                    _spare = index;
+                    ++_dropped;
+                }
+
+                _frameNumbers[_filling] = frameNumber;
+                _simSeconds[_filling] = simSeconds;
+                _ready.push(_filling);
+                _filling = -1;
+
+                ++_published;
+
+                _wake.notify_one();
+            }
+
+            uint64_t published(void) const
+            {
+                return _published;
+            }
+
+            uint64_t dropped(void) const
+            {
+                return _dropped;
+            }
+
+            uint64_t processed(void) const
+            {
+                return _processed;
+            }
+
+            uint32_t queued(void) const
+            {
+                return _ready.size();
+            }
+
+            int rows(void) const
+            {
+                return _rows;
+            }
+
+            int cols(void) const
+            {
+                return _cols;
+            }
+
+            // Times the frame buffers have been allocated; one, plus one per resize
+            uint64_t reallocations(void) const
+            {
+                return _pixels.reallocations();
+            }
+
+    }; // class VisionPipeline
+
+    // Example algorithm: centroid of the pixels brighter than a threshold, in pixels
+    typedef struct {
+
+        uint64_t frameNumber;
+        double   simSeconds;
+        float    x;
+        float    y;
+        uint32_t count;
+
+    } vision_centroid_t;
+
+    class BrightCentroid : public VisionAlgorithm {
+
+        private:
+
+            uint32_t _threshold;
+
+        public:
+
+            Mailbox<vision_centroid_t> result;
+
+            BrightCentroid(uint8_t threshold=200) : _threshold(3u * threshold)
+            {
+            }
+
+            void process(const vision_frame_t & frame) override
+            {
+                uint64_t sx = 0;
+                uint64_t sy = 0;
+                uint32_t count = 0;
+
+                const uint8_t * p = frame.rgb;
+
+                for (int y=0; y<frame.rows; ++y) {
+                    for (int x=0; x<frame.cols; ++x, p+=3) {
+                        if ((uint32_t)p[0] + p[1] + p[2] >= _threshold) {
+                            sx += x;
+                            sy += y;
+                            ++count;
+                        }
+                    }
+                }
+
+                vision_centroid_t c = { frame.frameNumber, frame.simSeconds,
+                    count ? sx / (float)count : -1, count ? sy / (float)count : -1, count };
+
+                result.write(c);
+            }
+
+    }; // class BrightCentroid
+
+} // namespace hf